@@ -0,0 +1,72 @@
+// Request/response written as a coroutine instead of a chain of callbacks.
+// Needs C++20, see zcm/zcm-cpp-coro.hpp
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <zcm/zcm-cpp-coro.hpp>
+#include "types/example_t.hpp"
+using namespace std;
+
+static const int NUM_REQUESTS = 5;
+
+// An ordinary callback based server: answers every request with its timestamp + 1
+class Responder
+{
+    public:
+        Responder(zcm::ZCM& zcm) : zcm(zcm) {}
+
+        void handleRequest(const zcm::ReceiveBuffer* rbuf,
+                           const string& chan,
+                           const example_t *msg)
+        {
+            example_t reply = *msg;
+            reply.timestamp++;
+            zcm.publish("REPLY", &reply);
+        }
+
+    private:
+        zcm::ZCM& zcm;
+};
+
+static zcm::Task requester(zcm::CoroZCM& zcm, atomic_bool& done)
+{
+    example_t request {};
+    for (int i = 0; i < NUM_REQUESTS; ++i) {
+        request.timestamp = i * 10;
+
+        // Listen for the reply before asking, so that it can not slip through
+        auto reply = zcm.next<example_t>("REPLY");
+        int ret = co_await zcm.publishAsync("REQUEST", request);
+        if (ret != ZCM_EOK) {
+            printf("Failed to publish request: %s\n", zcm.strerrno(ret));
+            break;
+        }
+        example_t msg = co_await reply;
+        printf("Request %lld answered with %lld\n",
+               (long long) request.timestamp, (long long) msg.timestamp);
+    }
+    done = true;
+}
+
+int main(int argc, char *argv[])
+{
+    zcm::CoroZCM zcm {"inproc"};
+    if (!zcm.good())
+        return 1;
+
+    // Continue the coroutine on a thread of its own rather than the handler thread
+    zcm::PoolExecutor pool {1};
+    zcm.setExecutor(pool);
+
+    Responder responder {zcm};
+    zcm.subscribe("REQUEST", &Responder::handleRequest, &responder);
+    zcm.start();
+
+    atomic_bool done {false};
+    requester(zcm, done);
+    while (!done) usleep(1000);
+
+    zcm.stop();
+    return 0;
+}
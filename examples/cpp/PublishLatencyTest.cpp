@@ -0,0 +1,111 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include <zcm/zcm-cpp.hpp>
+
+using namespace std;
+using namespace zcm;
+
+// Publishes timestamped messages to itself, first through the send thread and then
+// inline from the publishing thread, and reports the publish-to-receive latency and the
+// time spent inside publish() for both modes
+
+static const char* CHANNEL = "PUBLISH_LATENCY";
+
+static uint64_t nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static mutex latMutex;
+static vector<uint64_t> latencies;
+
+static void handler(const ReceiveBuffer* rbuf, const string& channel, void* usr)
+{
+    uint64_t sent;
+    if (rbuf->data_size < sizeof(sent)) return;
+    memcpy(&sent, rbuf->data, sizeof(sent));
+    uint64_t lat = nowNs() - sent;
+    unique_lock<mutex> lk(latMutex);
+    latencies.push_back(lat);
+}
+
+static void report(const char* name, vector<uint64_t> v)
+{
+    if (v.empty()) {
+        cout << name << ": nothing received" << endl;
+        return;
+    }
+    sort(v.begin(), v.end());
+    auto pct = [&](double p) { return v[min(v.size() - 1, (size_t)(p * v.size()))] / 1e3; };
+    cout << name << ": n=" << v.size()
+         << "  p50=" << pct(0.5) << "us"
+         << "  p99=" << pct(0.99) << "us"
+         << "  max=" << v.back() / 1e3 << "us" << endl;
+}
+
+static void run(ZCM& zcm, zcm_publish_mode mode, const char* name,
+                size_t numMsgs, size_t msgSize, useconds_t period)
+{
+    zcm.setPublishMode(mode);
+    {
+        unique_lock<mutex> lk(latMutex);
+        latencies.clear();
+    }
+
+    vector<uint8_t> buf(max(msgSize, sizeof(uint64_t)));
+    vector<uint64_t> publishTimes;
+    for (size_t i = 0; i < numMsgs; ++i) {
+        uint64_t start = nowNs();
+        memcpy(buf.data(), &start, sizeof(start));
+        zcm.publish(CHANNEL, buf.data(), buf.size());
+        publishTimes.push_back(nowNs() - start);
+        usleep(period);
+    }
+    usleep(200000);
+
+    vector<uint64_t> lat;
+    {
+        unique_lock<mutex> lk(latMutex);
+        lat = latencies;
+    }
+    cout << "=== " << name << endl;
+    report("  publish() call ", publishTimes);
+    report("  end-to-end     ", lat);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && (string(argv[1]) == "-h" || string(argv[1]) == "--help")) {
+        cerr << "usage: ./publish-latency-test [url] [num_msgs] [msg_size] [period_us]" << endl;
+        return 1;
+    }
+    string url = argc > 1 ? argv[1] : "";
+    size_t numMsgs   = argc > 2 ? atoi(argv[2]) : 10000;
+    size_t msgSize   = argc > 3 ? atoi(argv[3]) : 64;
+    useconds_t period = argc > 4 ? atoi(argv[4]) : 100;
+
+    ZCM zcm(url);
+    if (!zcm.good()) {
+        cerr << "Unable to open zcm" << endl;
+        return 2;
+    }
+
+    auto sub = zcm.subscribe(CHANNEL, handler, nullptr);
+    zcm.start();
+
+    run(zcm, ZCM_PUBLISH_QUEUED, "queued (send thread)", numMsgs, msgSize, period);
+    run(zcm, ZCM_PUBLISH_INLINE, "inline", numMsgs, msgSize, period);
+
+    zcm.stop();
+    zcm.unsubscribe(sub);
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include <zcm/zcm-cpp.hpp>
+
+using namespace std;
+using namespace zcm;
+
+// Publishes timestamped messages to itself with an idle gap between them, so that the
+// receiving threads go idle before every message, and reports the publish-to-handler
+// latency for each receive strategy. Messages are published inline so that the send
+// thread's wakeup does not show up in the numbers. The polling strategies only pay off
+// with a spare core for each of the polling threads
+
+static const char* CHANNEL = "RECV_WAKEUP";
+
+static uint64_t nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static mutex latMutex;
+static vector<uint64_t> latencies;
+
+static void handler(const ReceiveBuffer* rbuf, const string& channel, void* usr)
+{
+    uint64_t sent;
+    if (rbuf->data_size < sizeof(sent)) return;
+    memcpy(&sent, rbuf->data, sizeof(sent));
+    uint64_t lat = nowNs() - sent;
+    unique_lock<mutex> lk(latMutex);
+    latencies.push_back(lat);
+}
+
+static void report(const char* name, vector<uint64_t> v)
+{
+    if (v.empty()) {
+        cout << name << ": nothing received" << endl;
+        return;
+    }
+    sort(v.begin(), v.end());
+    auto pct = [&](double p) { return v[min(v.size() - 1, (size_t)(p * v.size()))] / 1e3; };
+    cout << name << ": n=" << v.size()
+         << "  p50=" << pct(0.5) << "us"
+         << "  p99=" << pct(0.99) << "us"
+         << "  max=" << v.back() / 1e3 << "us" << endl;
+}
+
+static bool run(const string& url, zcm_recv_strategy strategy, uint32_t spinMicros,
+                const char* name, size_t numMsgs, useconds_t period)
+{
+    ZCM zcm(url);
+    if (!zcm.good()) {
+        cerr << "Unable to open zcm" << endl;
+        return false;
+    }
+    zcm.setRecvStrategy(strategy, spinMicros);
+    zcm.setPublishMode(ZCM_PUBLISH_INLINE);
+    {
+        unique_lock<mutex> lk(latMutex);
+        latencies.clear();
+    }
+
+    auto sub = zcm.subscribe(CHANNEL, handler, nullptr);
+    zcm.start();
+
+    uint64_t buf;
+    for (size_t i = 0; i < numMsgs; ++i) {
+        usleep(period);
+        buf = nowNs();
+        zcm.publish(CHANNEL, (const uint8_t*) &buf, sizeof(buf));
+    }
+    usleep(200000);
+
+    zcm.stop();
+    zcm.unsubscribe(sub);
+
+    unique_lock<mutex> lk(latMutex);
+    report(name, latencies);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && (string(argv[1]) == "-h" || string(argv[1]) == "--help")) {
+        cerr << "usage: ./recv-wakeup-test [url] [num_msgs] [period_us] [spin_us]" << endl;
+        return 1;
+    }
+    string url = argc > 1 ? argv[1] : "";
+    size_t numMsgs    = argc > 2 ? atoi(argv[2]) : 2000;
+    useconds_t period = argc > 3 ? atoi(argv[3]) : 1000;
+    uint32_t spinUs   = argc > 4 ? atoi(argv[4]) : 2 * period;
+
+    if (!run(url, ZCM_RECV_BLOCK, 0, "block          ", numMsgs, period)) return 2;
+    if (!run(url, ZCM_RECV_SPIN_BLOCK, spinUs, "spin then block", numMsgs, period)) return 2;
+    if (!run(url, ZCM_RECV_BUSY_POLL, 0, "busy poll      ", numMsgs, period)) return 2;
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include <zcm/zcm-cpp.hpp>
+
+using namespace std;
+using namespace zcm;
+
+// Publishes a burst of messages to itself over udp, once with every datagram in a syscall
+// of its own (batch=1, how the transport used to work) and once with recvmmsg() and
+// sendmmsg() moving up to 32 datagrams per call, and reports datagrams per second for
+// both. Small messages are batched by the send thread. Large messages go out as a train
+// of fragments
+
+static const char* CHANNEL = "UDP_BATCH";
+
+static atomic<size_t> received {0};
+
+static void handler(const ReceiveBuffer* rbuf, const string& channel, void* usr)
+{
+    received++;
+}
+
+// Datagrams the transport needs for a message of msgSize bytes
+static size_t datagramsPerMsg(size_t msgSize)
+{
+    const size_t SHORT_MAX = 65499, FRAGMENT = 65487;
+    size_t payload = strlen(CHANNEL) + 1 + msgSize;
+    if (payload <= SHORT_MAX) return 1;
+    return (payload + FRAGMENT - 1) / FRAGMENT;
+}
+
+static bool run(const string& url, size_t batch, size_t numMsgs, size_t msgSize)
+{
+    string fullUrl = url + (url.find('?') == string::npos ? "?" : "&") +
+                     "batch=" + to_string(batch);
+    ZCM zcm(fullUrl);
+    if (!zcm.good()) {
+        cerr << "Unable to open zcm at " << fullUrl << endl;
+        return false;
+    }
+    // Never drop in zcm, so that everything that is lost was lost by the kernel
+    zcm.setBackpressure(ZCM_BACKPRESSURE_BLOCK, 1000000);
+    received = 0;
+
+    auto sub = zcm.subscribe(CHANNEL, handler, nullptr);
+    zcm.start();
+
+    vector<uint8_t> data(msgSize);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < numMsgs; ++i)
+        zcm.publish(CHANNEL, data.data(), data.size());
+    zcm.flush();
+    auto sent = chrono::steady_clock::now();
+
+    // Wait for the receive side to go quiet
+    size_t last = ~(size_t)0;
+    while (received != last && received < numMsgs) {
+        last = received;
+        usleep(100000);
+    }
+    auto done = chrono::steady_clock::now();
+
+    zcm.stop();
+    zcm.unsubscribe(sub);
+
+    double sendSecs = chrono::duration<double>(sent - start).count();
+    double recvSecs = chrono::duration<double>(done - start).count();
+    // The last wait is idle whenever messages were lost
+    if (received < numMsgs) recvSecs -= 0.1;
+    size_t dgrams = datagramsPerMsg(msgSize);
+    cout << "batch=" << batch << "\t" << msgSize << " byte msgs: "
+         << "sent " << (size_t)(numMsgs * dgrams / sendSecs) << " datagrams/s, "
+         << "received " << (size_t)(received * dgrams / recvSecs) << " datagrams/s ("
+         << received << "/" << numMsgs << " msgs)" << endl;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && (string(argv[1]) == "-h" || string(argv[1]) == "--help")) {
+        cerr << "usage: ./udp-batch-benchmark [url] [num_msgs]" << endl
+             << "       url defaults to udp://127.0.0.1:7670:7670" << endl;
+        return 1;
+    }
+    string url     = argc > 1 ? argv[1] : "udp://127.0.0.1:7670:7670";
+    size_t numMsgs = argc > 2 ? atoi(argv[2]) : 100000;
+
+    for (size_t batch : {1, 32})
+        if (!run(url, batch, numMsgs, 100)) return 2;
+    for (size_t batch : {1, 32})
+        if (!run(url, batch, numMsgs / 1000 + 1, 4 << 20)) return 2;
+    return 0;
+}
@@ -259,6 +259,16 @@ struct Emit : public Emitter
         emit(2, "inline int encode(void* buf, uint32_t offset, uint32_t maxlen) const;");
         emit(0, "");
         emit(2, "/**");
+        emit(2, " * Encode a message straight into a buffer loaned from ZCM.");
+        emit(2, " *");
+        emit(2, " * @param loan A zcm_loan_t (see zcm_publish_loan()) or anything else with");
+        emit(2, " *  a writable \"data\" buffer of \"len\" bytes.");
+        emit(2, " * @return The number of bytes encoded, or <0 on error.");
+        emit(2, " */");
+        emit(2, "template <class Loan>");
+        emit(2, "inline int encodeInto(Loan* loan) const;");
+        emit(0, "");
+        emit(2, "/**");
         emit(2, " * Check how many bytes are required to encode this message.");
         emit(2, " */");
         emit(2, "inline uint32_t getEncodedSize() const;");
@@ -322,6 +332,17 @@ struct Emit : public Emitter
         emit(0, "");
     }
 
+    void emitEncodeInto()
+    {
+        const char* sn = zs.structname.shortname.c_str();
+        emit(0, "template <class Loan>");
+        emit(0, "int %s::encodeInto(Loan* loan) const", sn);
+        emit(0, "{");
+        emit(1,     "return encode(loan->data, 0, loan->len);");
+        emit(0, "}");
+        emit(0, "");
+    }
+
     void emitEncodedSize()
     {
         const char* sn = zs.structname.shortname.c_str();
@@ -841,6 +862,7 @@ struct Emit : public Emitter
     {
         emitHeaderStart();
         emitEncode();
+        emitEncodeInto();
         emitDecode();
         emitEncodedSize();
         emitGetHash();
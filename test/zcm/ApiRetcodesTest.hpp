@@ -214,6 +214,24 @@ class ApiRetcodesTest : public CxxTest::TestSuite
 
         zcm_cleanup(&zcm);
     }
+
+    void testThreadSched(void)
+    {
+        zcm_t zcm;
+        zcm_init(&zcm, "test-generic");
+
+        TS_ASSERT_EQUALS(ZCM_EOK, zcm_set_thread_sched(&zcm, ZCM_THREAD_RECV, "0", ZCM_SCHED_INHERIT, 0));
+        TS_ASSERT_EQUALS(ZCM_EOK, zcm_set_thread_sched(&zcm, ZCM_THREAD_SEND, NULL, ZCM_SCHED_OTHER, 0));
+        TS_ASSERT_EQUALS(ZCM_EOK, zcm_set_thread_sched(&zcm, ZCM_THREAD_DISPATCH, "0-1", ZCM_SCHED_FIFO, 10));
+
+        TS_ASSERT_EQUALS(ZCM_EINVALID, zcm_set_thread_sched(&zcm, ZCM_THREAD_RECV, "a", ZCM_SCHED_INHERIT, 0));
+        TS_ASSERT_EQUALS(ZCM_EINVALID, zcm_set_thread_sched(&zcm, ZCM_THREAD_RECV, "3-1", ZCM_SCHED_INHERIT, 0));
+        TS_ASSERT_EQUALS(ZCM_EINVALID, zcm_set_thread_sched(&zcm, ZCM_THREAD_RECV, NULL, ZCM_SCHED_OTHER, 5));
+        TS_ASSERT_EQUALS(ZCM_EINVALID, zcm_set_thread_sched(&zcm, ZCM_THREAD_RECV, NULL, ZCM_SCHED_RR, 1000));
+        TS_ASSERT_EQUALS(ZCM_EINVALID, zcm_set_thread_sched(&zcm, (zcm_thread_kind) 9, NULL, ZCM_SCHED_OTHER, 0));
+
+        zcm_cleanup(&zcm);
+    }
 };
 
 
@@ -0,0 +1,185 @@
+#ifndef BACKPRESSURETEST_HPP
+#define BACKPRESSURETEST_HPP
+
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+struct BackpressureRecv
+{
+    std::mutex mut;
+    std::vector<std::string> got;
+
+    size_t size()
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        return got.size();
+    }
+};
+
+static void backpressure_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    BackpressureRecv* r = (BackpressureRecv*) usr;
+    std::unique_lock<std::mutex> lk(r->mut);
+    r->got.push_back(std::string(channel) + (char) rbuf->data[0]);
+}
+
+static zcm_channel_stats_t backpressureStats(zcm_t *zcm, const char *channel)
+{
+    zcm_stats_t stats;
+    zcm_channel_stats_t channels[8];
+    zcm_get_stats(zcm, &stats, channels, 8);
+    for (uint32_t i = 0; i < stats.num_channels && i < 8; ++i)
+        if (strcmp(channels[i].channel, channel) == 0) return channels[i];
+    zcm_channel_stats_t none;
+    memset(&none, 0, sizeof(none));
+    return none;
+}
+
+class BackpressureTest : public CxxTest::TestSuite
+{
+    zcm_t *zcm;
+    BackpressureRecv recv;
+    zcm_sub_t *sub;
+
+    // Publishes '0', '1', ... on channel
+    void publishSeq(const char *channel, int n, int expectedRet = ZCM_EOK)
+    {
+        for (int i = 0; i < n; ++i) {
+            uint8_t data = '0' + i;
+            TS_ASSERT_EQUALS(zcm_publish(zcm, channel, &data, 1), expectedRet);
+        }
+    }
+
+    void waitFor(size_t n)
+    {
+        for (int i = 0; i < 100 && recv.size() < n; ++i) usleep(10000);
+        // Give anything unexpected a chance to show up too
+        usleep(20000);
+    }
+
+  public:
+    void setUp() override
+    {
+        recv.got.clear();
+        zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        sub = zcm_subscribe(zcm, ".*", backpressure_handler, &recv);
+        // A send queue of 4 holds 3 messages
+        zcm_set_queue_size(zcm, 4);
+        zcm_start(zcm);
+        // Nothing gets sent while paused, as if the transport had stalled
+        zcm_pause(zcm);
+    }
+
+    void tearDown() override
+    {
+        zcm_stop(zcm);
+        zcm_unsubscribe(zcm, sub);
+        zcm_destroy(zcm);
+    }
+
+    void testBlockTimesOut()
+    {
+        TS_ASSERT_EQUALS(zcm_set_backpressure(zcm, "BLOCK", ZCM_BACKPRESSURE_BLOCK, 20000),
+                         ZCM_EOK);
+        publishSeq("BLOCK", 3);
+
+        auto start = std::chrono::steady_clock::now();
+        uint8_t data = 'x';
+        TS_ASSERT_EQUALS(zcm_publish(zcm, "BLOCK", &data, 1), ZCM_EAGAIN);
+        TS_ASSERT(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+        zcm_channel_stats_t c = backpressureStats(zcm, "BLOCK");
+        TS_ASSERT_EQUALS(c.published, 3);
+        TS_ASSERT_EQUALS(c.dropped, 1);
+        TS_ASSERT_EQUALS(c.blocked, 1);
+    }
+
+    void testBlockWaitsForRoom()
+    {
+        zcm_set_backpressure(zcm, NULL, ZCM_BACKPRESSURE_BLOCK, 10000000);
+        publishSeq("BLOCK", 3);
+
+        std::thread resumer([&](){ usleep(20000); zcm_resume(zcm); });
+        uint8_t data = '3';
+        TS_ASSERT_EQUALS(zcm_publish(zcm, "BLOCK", &data, 1), ZCM_EOK);
+        resumer.join();
+
+        waitFor(4);
+        std::vector<std::string> expected = {"BLOCK0", "BLOCK1", "BLOCK2", "BLOCK3"};
+        TS_ASSERT_EQUALS(recv.got, expected);
+    }
+
+    void testDropNewest()
+    {
+        publishSeq("NEWEST", 3);
+        publishSeq("NEWEST", 2, ZCM_EAGAIN);
+        zcm_resume(zcm);
+
+        waitFor(3);
+        std::vector<std::string> expected = {"NEWEST0", "NEWEST1", "NEWEST2"};
+        TS_ASSERT_EQUALS(recv.got, expected);
+    }
+
+    void testDropOldest()
+    {
+        zcm_set_backpressure(zcm, "OLDEST", ZCM_BACKPRESSURE_DROP_OLDEST, 3);
+        publishSeq("OLDEST", 10);
+
+        zcm_channel_stats_t c = backpressureStats(zcm, "OLDEST");
+        TS_ASSERT_EQUALS(c.published, 10);
+        TS_ASSERT_EQUALS(c.dropped, 7);
+
+        zcm_resume(zcm);
+        waitFor(3);
+        std::vector<std::string> expected = {"OLDEST7", "OLDEST8", "OLDEST9"};
+        TS_ASSERT_EQUALS(recv.got, expected);
+    }
+
+    void testCoalesce()
+    {
+        zcm_set_backpressure(zcm, "LATEST", ZCM_BACKPRESSURE_COALESCE, 0);
+        publishSeq("OTHER", 1);
+        publishSeq("LATEST", 10);
+        publishSeq("OTHER", 1);
+        TS_ASSERT_EQUALS(backpressureStats(zcm, "LATEST").dropped, 9);
+
+        zcm_resume(zcm);
+        waitFor(3);
+        // The latest message takes the place of the first one
+        std::vector<std::string> expected = {"OTHER0", "LATEST9", "OTHER0"};
+        TS_ASSERT_EQUALS(recv.got, expected);
+    }
+
+    void testCoalesceIntoFullQueue()
+    {
+        zcm_set_backpressure(zcm, "LATEST", ZCM_BACKPRESSURE_COALESCE, 0);
+        publishSeq("OTHER", 3);
+        // The send queue is full, but a coalescing channel still takes the message
+        publishSeq("LATEST", 2);
+
+        zcm_resume(zcm);
+        waitFor(4);
+        std::vector<std::string> expected = {"OTHER0", "OTHER1", "OTHER2", "LATEST1"};
+        TS_ASSERT_EQUALS(recv.got, expected);
+    }
+
+    void testInvalid()
+    {
+        TS_ASSERT_EQUALS(zcm_set_backpressure(zcm, NULL, (zcm_backpressure) 7, 0),
+                         ZCM_EINVALID);
+        TS_ASSERT_EQUALS(zcm_set_backpressure(zcm, "A_CHANNEL_NAME_THAT_IS_FAR_TOO_LONG",
+                                              ZCM_BACKPRESSURE_BLOCK, 0), ZCM_EINVALID);
+    }
+};
+
+#endif // BACKPRESSURETEST_HPP
@@ -0,0 +1,111 @@
+#ifndef CONFLATETEST_HPP
+#define CONFLATETEST_HPP
+
+#include <unistd.h>
+#include <atomic>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+#define NUM_MSGS 10
+
+// The first message blocks the dispatch thread for a while so that the rest pile up
+struct ConflateCounter
+{
+    std::atomic<int> calls {0};
+    std::atomic<int> last {-1};
+    useconds_t firstDelay = 0;
+};
+
+static void conflate_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    ConflateCounter* c = (ConflateCounter*) usr;
+    if (c->calls++ == 0 && c->firstDelay) usleep(c->firstDelay);
+    c->last = rbuf->data[0];
+}
+
+static void publishAll(zcm_t *zcm, const char *channel)
+{
+    for (uint8_t i = 0; i < NUM_MSGS; ++i) {
+        zcm_publish(zcm, channel, &i, 1);
+        usleep(1000);
+    }
+}
+
+class ConflateTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testLatestOnly()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        ConflateCounter c;
+        c.firstDelay = 200000;
+        zcm_sub_t *sub = zcm_subscribe_flags(zcm, "LATEST", conflate_handler, &c,
+                                             ZCM_SUB_CONFLATE);
+        TS_ASSERT(sub);
+        zcm_start(zcm);
+
+        publishAll(zcm, "LATEST");
+        for (int i = 0; i < 100 && c.last != NUM_MSGS - 1; ++i) usleep(10000);
+        zcm_stop(zcm);
+
+        // The first message and then only the newest of the ones that piled up behind it
+        TS_ASSERT_EQUALS(c.last, NUM_MSGS - 1);
+        TS_ASSERT(c.calls < NUM_MSGS);
+
+        zcm_stats_t stats;
+        zcm_channel_stats_t channel;
+        TS_ASSERT_EQUALS(zcm_get_stats(zcm, &stats, &channel, 1), ZCM_EOK);
+        TS_ASSERT_EQUALS(channel.received, NUM_MSGS);
+        TS_ASSERT_EQUALS(channel.dispatched, (uint64_t) c.calls);
+        TS_ASSERT_EQUALS(channel.dropped, NUM_MSGS - c.calls);
+
+        zcm_unsubscribe(zcm, sub);
+        zcm_destroy(zcm);
+    }
+
+    void testMixedDoesNotConflate()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        // Another subscription still wants every message, so nothing may be dropped
+        ConflateCounter conflating, all;
+        all.firstDelay = 200000;
+        zcm_sub_t *sub1 = zcm_subscribe_flags(zcm, "MIXED", conflate_handler, &conflating,
+                                              ZCM_SUB_CONFLATE);
+        zcm_sub_t *sub2 = zcm_subscribe(zcm, "MIX.*", conflate_handler, &all);
+        TS_ASSERT(sub1 && sub2);
+        zcm_start(zcm);
+
+        publishAll(zcm, "MIXED");
+        for (int i = 0; i < 100 && all.calls < NUM_MSGS; ++i) usleep(10000);
+        zcm_stop(zcm);
+
+        TS_ASSERT_EQUALS(conflating.calls, NUM_MSGS);
+        TS_ASSERT_EQUALS(all.calls, NUM_MSGS);
+
+        zcm_unsubscribe(zcm, sub1);
+        zcm_unsubscribe(zcm, sub2);
+        zcm_destroy(zcm);
+    }
+
+    void testInvalidFlags()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        ConflateCounter c;
+        TS_ASSERT(zcm_subscribe_flags(zcm, "CH", conflate_handler, &c, 0x80) == NULL);
+        zcm_destroy(zcm);
+    }
+};
+
+#undef NUM_MSGS
+
+#endif // CONFLATETEST_HPP
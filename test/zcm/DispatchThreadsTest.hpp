@@ -0,0 +1,250 @@
+#ifndef DISPATCHTHREADSTEST_HPP
+#define DISPATCHTHREADSTEST_HPP
+
+#include <unistd.h>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zcm/zcm.h"
+#include "cxxtest/TestSuite.h"
+
+#define NUM_CHANNELS 4
+#define NUM_MSGS 200
+
+static std::atomic<int> nextExpected[NUM_CHANNELS];
+static std::atomic<bool> outOfOrder {false};
+
+static void ordered_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    size_t ch = (size_t) usr;
+    int seq;
+    memcpy(&seq, rbuf->data, sizeof(seq));
+    if (seq != nextExpected[ch]) outOfOrder = true;
+    nextExpected[ch] = seq + 1;
+}
+
+static std::atomic<int> numFast {0};
+static std::atomic<bool> slowDone {false};
+
+static void fast_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    numFast++;
+}
+
+static void slow_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    usleep(500000);
+    slowDone = true;
+}
+
+static std::atomic<int> numSlow {0};
+
+static void counting_slow_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    usleep(100000);
+    numSlow++;
+}
+
+static std::mutex groupMutex;
+static std::vector<int> groupSeqs;
+
+static void group_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    int seq;
+    memcpy(&seq, rbuf->data, sizeof(seq));
+    // Give other workers a chance to overtake us if ordering was broken
+    usleep(1000);
+    std::unique_lock<std::mutex> lk(groupMutex);
+    groupSeqs.push_back(seq);
+}
+
+static std::atomic<int> inRegex {0};
+static std::atomic<int> numRegex {0};
+static std::atomic<bool> regexOverlap {false};
+
+static void regex_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    if (inRegex++ != 0) regexOverlap = true;
+    usleep(200);
+    numRegex++;
+    inRegex--;
+}
+
+static void publish_retry(zcm_t *zcm, const char *channel, int seq)
+{
+    while (zcm_publish(zcm, channel, (uint8_t*) &seq, sizeof(seq)) != ZCM_EOK)
+        usleep(100);
+}
+
+class DispatchThreadsTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testPerChannelOrder() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_threads(zcm, 4), ZCM_EOK);
+
+        std::string channels[NUM_CHANNELS];
+        for (size_t i = 0; i < NUM_CHANNELS; ++i) {
+            nextExpected[i] = 0;
+            channels[i] = "CHANNEL" + std::to_string(i);
+            zcm_subscribe(zcm, channels[i].c_str(), ordered_handler, (void*) i);
+        }
+
+        zcm_start(zcm);
+        TSM_ASSERT_EQUALS("Can't change the dispatch pool while running",
+                          zcm_set_dispatch_threads(zcm, 2), ZCM_EINVALID);
+
+        for (int seq = 0; seq < NUM_MSGS; ++seq)
+            for (size_t i = 0; i < NUM_CHANNELS; ++i)
+                publish_retry(zcm, channels[i].c_str(), seq);
+
+        usleep(500000);
+        zcm_stop(zcm);
+
+        TSM_ASSERT("Messages on a channel were dispatched out of order", !outOfOrder);
+        for (size_t i = 0; i < NUM_CHANNELS; ++i)
+            TSM_ASSERT_EQUALS("Missed messages", nextExpected[i], NUM_MSGS);
+
+        zcm_destroy(zcm);
+    }
+
+    void testSlowChannelDoesNotBlockOthers() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_threads(zcm, 2), ZCM_EOK);
+
+        zcm_subscribe(zcm, "SLOW", slow_handler, NULL);
+        zcm_subscribe(zcm, "FAST", fast_handler, NULL);
+        zcm_start(zcm);
+
+        publish_retry(zcm, "SLOW", 0);
+        for (int i = 0; i < 10; ++i) publish_retry(zcm, "FAST", i);
+
+        usleep(200000);
+        TSM_ASSERT("Slow handler finished too early to tell", !slowDone);
+        TSM_ASSERT_EQUALS("Fast channel was held up by the slow one", numFast, 10);
+
+        zcm_stop(zcm);
+        TSM_ASSERT("zcm_stop() returned while a callback was still running", slowDone);
+        zcm_destroy(zcm);
+    }
+
+    void testGroupOrder() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_threads(zcm, 4), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_group(zcm, "GROUPED_A", "GROUP"), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_group(zcm, "GROUPED_B", "GROUP"), ZCM_EOK);
+
+        zcm_subscribe(zcm, "GROUPED_A", group_handler, NULL);
+        zcm_subscribe(zcm, "GROUPED_B", group_handler, NULL);
+        zcm_start(zcm);
+
+        for (int seq = 0; seq < 50; ++seq)
+            publish_retry(zcm, seq % 2 ? "GROUPED_A" : "GROUPED_B", seq);
+
+        usleep(500000);
+        zcm_stop(zcm);
+
+        TSM_ASSERT_EQUALS("Missed messages", groupSeqs.size(), 50);
+        for (size_t i = 0; i < groupSeqs.size(); ++i)
+            TSM_ASSERT_EQUALS("Messages in a group were dispatched out of order",
+                              groupSeqs[i], (int) i);
+
+        zcm_destroy(zcm);
+    }
+
+    void testRegexSubscriptionIsSerialized() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_threads(zcm, 4), ZCM_EOK);
+
+        // Every channel has a strand of its own, but they share the one callback
+        zcm_subscribe(zcm, "CAM_.*", regex_handler, NULL);
+        zcm_start(zcm);
+
+        std::string channels[NUM_CHANNELS];
+        for (size_t i = 0; i < NUM_CHANNELS; ++i) channels[i] = "CAM_" + std::to_string(i);
+        for (int seq = 0; seq < NUM_MSGS; ++seq)
+            for (size_t i = 0; i < NUM_CHANNELS; ++i)
+                publish_retry(zcm, channels[i].c_str(), seq);
+
+        usleep(500000);
+        zcm_stop(zcm);
+
+        TSM_ASSERT("A regex callback ran on two threads at once", !regexOverlap);
+        TSM_ASSERT_EQUALS("Missed messages", numRegex, NUM_CHANNELS * NUM_MSGS);
+        zcm_destroy(zcm);
+    }
+
+    void testPauseAndFlush() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_threads(zcm, 3), ZCM_EOK);
+
+        numFast = 0;
+        zcm_subscribe(zcm, "FAST", fast_handler, NULL);
+        zcm_start(zcm);
+        zcm_pause(zcm);
+
+        for (int i = 0; i < 10; ++i) publish_retry(zcm, "FAST", i);
+        usleep(100000);
+        TSM_ASSERT_EQUALS("Dispatched while paused", numFast, 0);
+
+        // Send everything and give the recv thread time to queue it up. Whatever
+        // was already received is dispatched by the flush, nothing after that
+        zcm_flush(zcm);
+        usleep(200000);
+        int n = numFast;
+        usleep(100000);
+        TSM_ASSERT_EQUALS("Dispatched while paused", numFast, n);
+
+        zcm_flush(zcm);
+        TSM_ASSERT_EQUALS("zcm_flush() did not dispatch everything", numFast, 10);
+
+        zcm_resume(zcm);
+        zcm_stop(zcm);
+        zcm_destroy(zcm);
+    }
+
+    void testFlushWhilePoolFullAndPaused() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        zcm_set_queue_size(zcm, 3);
+        TS_ASSERT_EQUALS(zcm_set_dispatch_threads(zcm, 1), ZCM_EOK);
+
+        numSlow = 0;
+        numFast = 0;
+        zcm_subscribe(zcm, "A", counting_slow_handler, NULL);
+        const char *others[] = {"B", "C", "D", "E", "F", "G", "H"};
+        for (const char *ch : others) zcm_subscribe(zcm, ch, fast_handler, NULL);
+        zcm_start(zcm);
+
+        for (int i = 0; i < 9; ++i) publish_retry(zcm, "A", i);
+        usleep(50000);
+
+        // The pool fills up with jobs of other strands that no worker runs while paused,
+        // so the flush has to run them itself
+        zcm_pause(zcm);
+        // Sending is paused too, so some of these may not fit into the send queue
+        int seq = 0;
+        for (const char *ch : others) zcm_publish(zcm, ch, (uint8_t*) &seq, sizeof(seq));
+        usleep(100000);
+        // Used to never return
+        zcm_flush(zcm);
+        TSM_ASSERT("zcm_flush() did not dispatch anything", numSlow + numFast > 0);
+
+        zcm_resume(zcm);
+        zcm_stop(zcm);
+        zcm_destroy(zcm);
+    }
+};
+
+#endif // DISPATCHTHREADSTEST_HPP
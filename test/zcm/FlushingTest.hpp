@@ -2,6 +2,7 @@
 #define FLUSHINGTEST_HPP
 
 #include <unistd.h>
+#include <atomic>
 #include <thread>
 
 #include <zcm/zcm.h>
@@ -18,6 +19,14 @@ static void handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
     numrecv++;
 }
 
+static std::atomic<size_t> numslow {0};
+
+static void slow_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    usleep(1000);
+    numslow++;
+}
+
 void subscriber_thread_function()
 {
     zcm_t *zcm = zcm_create("udpm://239.255.76.67:7667?ttl=0");
@@ -65,6 +74,29 @@ class FlushingTest : public CxxTest::TestSuite
 
         TS_ASSERT_EQUALS(numrecv, N);
     }
+
+    void testFlushKeepsReceivedMessages() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        zcm_set_queue_size(zcm, 4);
+        zcm_subscribe(zcm, CHANNEL, slow_handler, NULL);
+        zcm_start(zcm);
+
+        // The receive thread keeps getting stuck on a full queue with most of its batch
+        // still in hand, which every flush interrupts
+        uint8_t data = 'A';
+        for (size_t i = 0; i < N; i++) {
+            while (zcm_publish(zcm, CHANNEL, &data, 1) != ZCM_EOK) usleep(100);
+        }
+        for (int i = 0; i < 500 && numslow < N; ++i) {
+            zcm_flush(zcm);
+            usleep(1000);
+        }
+
+        zcm_stop(zcm);
+        zcm_destroy(zcm);
+        TS_ASSERT_EQUALS(numslow, N);
+    }
 };
 
 #endif // FLUSHINGTEST_HPP
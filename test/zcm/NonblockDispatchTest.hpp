@@ -0,0 +1,230 @@
+#ifndef NONBLOCKDISPATCHTEST_HPP
+#define NONBLOCKDISPATCHTEST_HPP
+
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+// Every callback appends its tag, so tests can check who was called and in which order
+struct NonblockRecorder
+{
+    std::vector<std::string> calls;
+};
+
+struct NonblockSub
+{
+    NonblockRecorder* rec;
+    std::string tag;
+    zcm_t* zcm;
+    zcm_sub_t* sub;        // Unsubscribed from within the callback, if set
+    zcm_sub_t* other;      // Also unsubscribed from within the callback, if set
+};
+
+static void nonblock_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    NonblockSub* s = (NonblockSub*) usr;
+    s->rec->calls.push_back(s->tag + ":" + channel);
+    if (s->sub)   { zcm_unsubscribe(s->zcm, s->sub);   s->sub = nullptr; }
+    if (s->other) { zcm_unsubscribe(s->zcm, s->other); s->other = nullptr; }
+}
+
+static void nonblock_slow_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    (*(int*) usr)++;
+    usleep(2000);
+}
+
+static void nonblockPublish(zcm_t* zcm, const char* channel)
+{
+    uint8_t data = 0;
+    TS_ASSERT_EQUALS(zcm_publish(zcm, channel, &data, 1), ZCM_EOK);
+    zcm_flush(zcm);
+}
+
+class NonblockDispatchTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testExactAndPrefix()
+    {
+        zcm_t *zcm = zcm_create("nonblock-inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        NonblockRecorder rec;
+        NonblockSub a    { &rec, "a",    zcm, nullptr, nullptr };
+        NonblockSub b    { &rec, "b",    zcm, nullptr, nullptr };
+        NonblockSub pre  { &rec, "pre",  zcm, nullptr, nullptr };
+        NonblockSub all  { &rec, "all",  zcm, nullptr, nullptr };
+        TS_ASSERT(zcm_subscribe(zcm, "CHAN_A", nonblock_handler, &a));
+        TS_ASSERT(zcm_subscribe(zcm, "CHAN_B", nonblock_handler, &b));
+        TS_ASSERT(zcm_subscribe(zcm, "CHAN.*", nonblock_handler, &pre));
+        TS_ASSERT(zcm_subscribe(zcm, ".*", nonblock_handler, &all));
+        // Only "prefix.*" patterns are supported
+        TS_ASSERT(!zcm_subscribe(zcm, "CHAN_(A|B)", nonblock_handler, &a));
+
+        nonblockPublish(zcm, "CHAN_A");
+        nonblockPublish(zcm, "OTHER");
+        std::vector<std::string> expected {
+            "a:CHAN_A", "pre:CHAN_A", "all:CHAN_A", "all:OTHER",
+        };
+        TS_ASSERT_EQUALS(rec.calls, expected);
+
+        zcm_destroy(zcm);
+    }
+
+    void testSubscriptionOrder()
+    {
+        zcm_t *zcm = zcm_create("nonblock-inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        NonblockRecorder rec;
+        NonblockSub pre   { &rec, "pre",   zcm, nullptr, nullptr };
+        NonblockSub a     { &rec, "a",     zcm, nullptr, nullptr };
+        NonblockSub all   { &rec, "all",   zcm, nullptr, nullptr };
+        NonblockSub again { &rec, "again", zcm, nullptr, nullptr };
+        zcm_sub_t* first = zcm_subscribe(zcm, "ORDER.*", nonblock_handler, &pre);
+        TS_ASSERT(first);
+        TS_ASSERT(zcm_subscribe(zcm, "ORDER_A", nonblock_handler, &a));
+        TS_ASSERT(zcm_subscribe(zcm, ".*", nonblock_handler, &all));
+
+        nonblockPublish(zcm, "ORDER_A");
+
+        // The first slot is free again and goes to the next subscription
+        TS_ASSERT_EQUALS(zcm_unsubscribe(zcm, first), ZCM_EOK);
+        TS_ASSERT(zcm_subscribe(zcm, "ORDER_A", nonblock_handler, &again));
+        nonblockPublish(zcm, "ORDER_A");
+
+        std::vector<std::string> expected {
+            "pre:ORDER_A", "a:ORDER_A", "all:ORDER_A",
+            "again:ORDER_A", "a:ORDER_A", "all:ORDER_A",
+        };
+        TS_ASSERT_EQUALS(rec.calls, expected);
+
+        zcm_destroy(zcm);
+    }
+
+    void testUnsubscribe()
+    {
+        zcm_t *zcm = zcm_create("nonblock-inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        NonblockRecorder rec;
+        NonblockSub a1 { &rec, "a1", zcm, nullptr, nullptr };
+        NonblockSub a2 { &rec, "a2", zcm, nullptr, nullptr };
+        NonblockSub p  { &rec, "p",  zcm, nullptr, nullptr };
+        zcm_sub_t* sub1 = zcm_subscribe(zcm, "CHAN", nonblock_handler, &a1);
+        zcm_sub_t* sub2 = zcm_subscribe(zcm, "CHAN", nonblock_handler, &a2);
+        zcm_sub_t* subP = zcm_subscribe(zcm, "CH.*", nonblock_handler, &p);
+        TS_ASSERT(sub1 && sub2 && subP);
+
+        TS_ASSERT_EQUALS(zcm_unsubscribe(zcm, sub1), ZCM_EOK);
+        nonblockPublish(zcm, "CHAN");
+        TS_ASSERT_EQUALS(zcm_unsubscribe(zcm, sub2), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_unsubscribe(zcm, subP), ZCM_EOK);
+        // Not subscribed anymore
+        TS_ASSERT_EQUALS(zcm_unsubscribe(zcm, subP), ZCM_EINVALID);
+        nonblockPublish(zcm, "CHAN");
+
+        std::vector<std::string> expected { "a2:CHAN", "p:CHAN" };
+        TS_ASSERT_EQUALS(rec.calls, expected);
+
+        zcm_destroy(zcm);
+    }
+
+    void testUnsubscribeInCallback()
+    {
+        zcm_t *zcm = zcm_create("nonblock-inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        // "first" takes itself and the subscription after it out of the channel
+        NonblockRecorder rec;
+        NonblockSub first  { &rec, "first",  zcm, nullptr, nullptr };
+        NonblockSub second { &rec, "second", zcm, nullptr, nullptr };
+        NonblockSub third  { &rec, "third",  zcm, nullptr, nullptr };
+        first.sub = zcm_subscribe(zcm, "CHAN", nonblock_handler, &first);
+        first.other = zcm_subscribe(zcm, "CHAN", nonblock_handler, &second);
+        TS_ASSERT(zcm_subscribe(zcm, "CHAN", nonblock_handler, &third));
+
+        nonblockPublish(zcm, "CHAN");
+        // Freed slots get reused once the dispatch is over, so this takes the first one
+        TS_ASSERT(zcm_subscribe(zcm, "CHAN", nonblock_handler, &second));
+        nonblockPublish(zcm, "CHAN");
+
+        std::vector<std::string> expected {
+            "first:CHAN", "third:CHAN", "second:CHAN", "third:CHAN",
+        };
+        TS_ASSERT_EQUALS(rec.calls, expected);
+
+        zcm_destroy(zcm);
+    }
+
+    void testManyChannels()
+    {
+        zcm_t *zcm = zcm_create("nonblock-inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        // Fill every subscription slot, mostly with distinct channels
+        const int MAX_SUBS = 512;
+        NonblockRecorder rec;
+        std::vector<NonblockSub> subs(MAX_SUBS);
+        std::vector<zcm_sub_t*> zsubs(MAX_SUBS);
+        for (int i = 0; i < MAX_SUBS; ++i) {
+            subs[i] = { &rec, std::to_string(i), zcm, nullptr, nullptr };
+            std::string ch = "CHAN_" + std::to_string(i % 500);
+            zsubs[i] = zcm_subscribe(zcm, ch.c_str(), nonblock_handler, &subs[i]);
+            TS_ASSERT(zsubs[i]);
+        }
+        NonblockSub extra { &rec, "extra", zcm, nullptr, nullptr };
+        TS_ASSERT(!zcm_subscribe(zcm, "CHAN_EXTRA", nonblock_handler, &extra));
+
+        // Remove every other one, which shuffles the hash table around
+        for (int i = 0; i < MAX_SUBS; i += 2)
+            TS_ASSERT_EQUALS(zcm_unsubscribe(zcm, zsubs[i]), ZCM_EOK);
+
+        for (int i = 0; i < 500; ++i) {
+            rec.calls.clear();
+            std::string ch = "CHAN_" + std::to_string(i);
+            nonblockPublish(zcm, ch.c_str());
+            std::vector<std::string> expected;
+            for (int j = i; j < MAX_SUBS; j += 500)
+                if (j % 2) expected.push_back(std::to_string(j) + ":" + ch);
+            TS_ASSERT_EQUALS(rec.calls, expected);
+        }
+
+        TS_ASSERT(zcm_subscribe(zcm, "CHAN_EXTRA", nonblock_handler, &extra));
+
+        zcm_destroy(zcm);
+    }
+
+    void testBudget()
+    {
+        zcm_t *zcm = zcm_create("nonblock-inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        int calls = 0;
+        TS_ASSERT(zcm_subscribe(zcm, "SLOW", nonblock_slow_handler, &calls));
+
+        uint8_t data = 0;
+        for (int i = 0; i < 10; ++i)
+            TS_ASSERT_EQUALS(zcm_publish(zcm, "SLOW", &data, 1), ZCM_EOK);
+
+        TS_ASSERT_EQUALS(zcm_handle_nonblock_budget(zcm, 0, 0), ZCM_EINVALID);
+        TS_ASSERT_EQUALS(zcm_handle_nonblock_budget(zcm, 3, 0), 3);
+        // Every message takes longer than the whole time budget
+        TS_ASSERT_EQUALS(zcm_handle_nonblock_budget(zcm, 100, 1000), 1);
+        TS_ASSERT_EQUALS(zcm_handle_nonblock_budget(zcm, 100, 0), 6);
+        TS_ASSERT_EQUALS(zcm_handle_nonblock_budget(zcm, 100, 0), 0);
+        TS_ASSERT_EQUALS(zcm_handle_nonblock(zcm), ZCM_EAGAIN);
+        TS_ASSERT_EQUALS(calls, 10);
+
+        zcm_destroy(zcm);
+    }
+};
+
+#endif // NONBLOCKDISPATCHTEST_HPP
@@ -0,0 +1,135 @@
+#ifndef POLLFDTEST_HPP
+#define POLLFDTEST_HPP
+
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+static void pollfd_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    (*(std::atomic<int>*) usr)++;
+}
+
+static bool fdReadable(int fd, int timeoutMs)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeoutMs) == 1 && (pfd.revents & POLLIN);
+}
+
+class PollFdTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testReadableWhileQueued()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        std::atomic<int> calls {0};
+        zcm_sub_t *sub = zcm_subscribe(zcm, "FD", pollfd_handler, &calls);
+        int fd = zcm_get_fd(zcm);
+        TS_ASSERT(fd >= 0);
+        TS_ASSERT_EQUALS(zcm_get_fd(zcm), fd);
+        TS_ASSERT(!fdReadable(fd, 0));
+
+        uint8_t data = 0;
+        for (int i = 0; i < 3; ++i) zcm_publish(zcm, "FD", &data, 1);
+        TS_ASSERT(fdReadable(fd, 1000));
+
+        // Stays readable until the last message was dispatched
+        for (int i = 0; i < 100 && calls < 3; ++i) {
+            while (zcm_handle_nonblock(zcm) == ZCM_EOK) {}
+            if (calls < 3) TS_ASSERT(fdReadable(fd, 100));
+        }
+        TS_ASSERT_EQUALS(calls, 3);
+        TS_ASSERT(!fdReadable(fd, 0));
+
+        zcm_stop(zcm);
+        zcm_unsubscribe(zcm, sub);
+        zcm_destroy(zcm);
+    }
+
+    void testReactorLoop()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        const int N = 1000;
+        std::atomic<int> calls {0};
+        zcm_sub_t *sub = zcm_subscribe(zcm, "FD", pollfd_handler, &calls);
+        TS_ASSERT_EQUALS(zcm_set_nonblock_batch(zcm, 64), ZCM_EOK);
+        zcm_set_backpressure(zcm, NULL, ZCM_BACKPRESSURE_BLOCK, 1000000);
+        int fd = zcm_get_fd(zcm);
+        TS_ASSERT(fd >= 0);
+
+        std::thread publisher([&](){
+            for (int i = 0; i < N; ++i) {
+                uint8_t data = i;
+                zcm_publish(zcm, "FD", &data, 1);
+            }
+        });
+        // A single threaded loop that only ever wakes up through the fd
+        while (calls < N && fdReadable(fd, 1000))
+            while (zcm_handle_nonblock(zcm) == ZCM_EOK) {}
+        publisher.join();
+        TS_ASSERT_EQUALS(calls, N);
+
+        zcm_stop(zcm);
+        zcm_unsubscribe(zcm, sub);
+        zcm_destroy(zcm);
+    }
+
+    void testBudget()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        std::atomic<int> calls {0};
+        zcm_sub_t *sub = zcm_subscribe(zcm, "FD", pollfd_handler, &calls);
+        int fd = zcm_get_fd(zcm);
+        TS_ASSERT(fd >= 0);
+
+        uint8_t data = 0;
+        for (int i = 0; i < 10; ++i) zcm_publish(zcm, "FD", &data, 1);
+
+        // Only ever dispatches what was already received, at most maxMsgs at a time
+        int handled = 0;
+        for (int i = 0; i < 100 && handled < 10; ++i) {
+            TS_ASSERT(fdReadable(fd, 100));
+            int n = zcm_handle_nonblock_budget(zcm, 4, 0);
+            TS_ASSERT(n >= 0 && n <= 4);
+            if (n > 0) handled += n;
+        }
+        TS_ASSERT_EQUALS(handled, 10);
+        TS_ASSERT_EQUALS(calls, 10);
+        TS_ASSERT_EQUALS(zcm_handle_nonblock_budget(zcm, 4, 1000), 0);
+        TS_ASSERT_EQUALS(zcm_handle_nonblock_budget(zcm, 0, 0), ZCM_EINVALID);
+
+        zcm_stop(zcm);
+        zcm_unsubscribe(zcm, sub);
+        zcm_destroy(zcm);
+    }
+
+    void testInvalid()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_nonblock_batch(zcm, 0), ZCM_EINVALID);
+        zcm_start(zcm);
+        TS_ASSERT_EQUALS(zcm_get_fd(zcm), ZCM_EINVALID);
+        zcm_stop(zcm);
+        zcm_destroy(zcm);
+    }
+};
+
+#endif // POLLFDTEST_HPP
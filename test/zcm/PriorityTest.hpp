@@ -0,0 +1,117 @@
+#ifndef PRIORITYTEST_HPP
+#define PRIORITYTEST_HPP
+
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+// Records the order of dispatch. The first message blocks the dispatch thread for a while
+// so that the rest pile up in their queues
+struct PriorityOrder
+{
+    std::mutex mut;
+    std::vector<std::string> order;
+    std::atomic<int> calls {0};
+};
+
+static void priority_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    PriorityOrder* o = (PriorityOrder*) usr;
+    if (o->calls == 0) usleep(200000);
+    {
+        std::unique_lock<std::mutex> lk(o->mut);
+        o->order.push_back(std::string(channel) + (char) rbuf->data[0]);
+    }
+    o->calls++;
+}
+
+class PriorityTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testHighPriorityOvertakes()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        PriorityOrder o;
+        zcm_sub_t *bulk = zcm_subscribe(zcm, "BULK", priority_handler, &o);
+        zcm_sub_t *urgent = zcm_subscribe_flags(zcm, "URGENT", priority_handler, &o,
+                                                ZCM_SUB_PRIORITY_HIGH);
+        TS_ASSERT(bulk && urgent);
+        zcm_start(zcm);
+
+        for (uint8_t i = '0'; i < '5'; ++i) {
+            zcm_publish(zcm, "BULK", &i, 1);
+            usleep(1000);
+        }
+        uint8_t u = '0';
+        zcm_publish(zcm, "URGENT", &u, 1);
+        for (int i = 0; i < 100 && o.calls < 6; ++i) usleep(10000);
+        zcm_stop(zcm);
+
+        std::vector<std::string> expected =
+            {"BULK0", "URGENT0", "BULK1", "BULK2", "BULK3", "BULK4"};
+        TS_ASSERT_EQUALS(o.order, expected);
+
+        zcm_stats_t stats;
+        TS_ASSERT_EQUALS(zcm_get_stats(zcm, &stats, NULL, 0), ZCM_EOK);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_HIGH].high_water, 1);
+        TS_ASSERT(stats.priorities[ZCM_PRIORITY_NORMAL].high_water >= 4);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_LOW].high_water, 0);
+
+        zcm_unsubscribe(zcm, bulk);
+        zcm_unsubscribe(zcm, urgent);
+        zcm_destroy(zcm);
+    }
+
+    void testConfiguration()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        TS_ASSERT_EQUALS(zcm_set_priority_class(zcm, ZCM_PRIORITY_HIGH, 8, 5), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_set_priority_mode(zcm, ZCM_PRIORITY_WEIGHTED), ZCM_EOK);
+        // Classes without a capacity of their own follow the queue size
+        zcm_set_queue_size(zcm, 32);
+
+        zcm_stats_t stats;
+        TS_ASSERT_EQUALS(zcm_get_stats(zcm, &stats, NULL, 0), ZCM_EOK);
+        TS_ASSERT_EQUALS(stats.priority_mode, ZCM_PRIORITY_WEIGHTED);
+        TS_ASSERT_EQUALS(stats.recv_queue_capacity, 32);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_HIGH].capacity, 8);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_HIGH].weight, 5);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_NORMAL].capacity, 32);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_NORMAL].weight, 2);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_LOW].capacity, 32);
+        TS_ASSERT_EQUALS(stats.priorities[ZCM_PRIORITY_LOW].weight, 1);
+
+        zcm_destroy(zcm);
+    }
+
+    void testInvalid()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        PriorityOrder o;
+        TS_ASSERT(zcm_subscribe_flags(zcm, "CH", priority_handler, &o,
+                                      ZCM_SUB_PRIORITY_HIGH | ZCM_SUB_PRIORITY_LOW) == NULL);
+        TS_ASSERT_EQUALS(zcm_set_priority_class(zcm, ZCM_PRIORITY_LOW, 1, 1), ZCM_EINVALID);
+        TS_ASSERT_EQUALS(zcm_set_priority_class(zcm, ZCM_PRIORITY_LOW, 8, 0), ZCM_EINVALID);
+        TS_ASSERT_EQUALS(zcm_set_priority_class(zcm, (zcm_priority) 7, 8, 1), ZCM_EINVALID);
+        TS_ASSERT_EQUALS(zcm_set_priority_mode(zcm, (zcm_priority_mode) 7), ZCM_EINVALID);
+
+        zcm_destroy(zcm);
+    }
+};
+
+#endif // PRIORITYTEST_HPP
@@ -0,0 +1,121 @@
+#ifndef PUBLISHLOANTEST_HPP
+#define PUBLISHLOANTEST_HPP
+
+#include <unistd.h>
+#include <cstring>
+#include <atomic>
+#include <string>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm-cpp.hpp"
+#include "types/example_t.hpp"
+
+static std::atomic<int> loanedReceived {0};
+static std::atomic<uint32_t> loanedSize {0};
+static std::atomic<bool> loanedCorrupt {false};
+
+static void loaned_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    for (uint32_t i = 0; i < rbuf->data_size; ++i)
+        if (rbuf->data[i] != (uint8_t) i) loanedCorrupt = true;
+    loanedSize = rbuf->data_size;
+    loanedReceived++;
+}
+
+class LoanHandler
+{
+  public:
+    std::atomic<int> numReceived {0};
+    std::string name;
+
+    void handle(const zcm::ReceiveBuffer* rbuf, const std::string& channel,
+                const example_t* msg)
+    {
+        name = msg->name;
+        numReceived++;
+    }
+};
+
+class PublishLoanTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testLoanAndCommit() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+
+        loanedReceived = 0;
+        zcm_subscribe(zcm, "LOANED", loaned_handler, NULL);
+        zcm_start(zcm);
+
+        zcm_loan_t loan;
+        TS_ASSERT_EQUALS(zcm_publish_loan(zcm, "LOANED", 1000, &loan), ZCM_EOK);
+        TS_ASSERT(loan.data != NULL);
+        TS_ASSERT_EQUALS(loan.len, 1000);
+        for (uint32_t i = 0; i < 100; ++i) loan.data[i] = (uint8_t) i;
+
+        TSM_ASSERT_EQUALS("Committed more than was loaned",
+                          zcm_publish_commit(zcm, &loan, 1001), ZCM_EINVALID);
+        TS_ASSERT_EQUALS(zcm_publish_commit(zcm, &loan, 100), ZCM_EOK);
+        TSM_ASSERT("Loan still usable after commit", loan.data == NULL);
+        TSM_ASSERT_EQUALS("Committed the same loan twice",
+                          zcm_publish_commit(zcm, &loan, 100), ZCM_EINVALID);
+
+        usleep(200000);
+        TS_ASSERT_EQUALS(loanedReceived, 1);
+        TS_ASSERT_EQUALS(loanedSize, 100);
+        TS_ASSERT(!loanedCorrupt);
+
+        zcm_stop(zcm);
+        zcm_destroy(zcm);
+    }
+
+    void testCommitWhenFull() {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        zcm_set_queue_size(zcm, 4);
+        zcm_pause(zcm);
+
+        // A queue of 4 holds 3 messages
+        zcm_loan_t loan;
+        for (int i = 0; i < 3; ++i) {
+            TS_ASSERT_EQUALS(zcm_publish_loan(zcm, "LOANED", 10, &loan), ZCM_EOK);
+            TS_ASSERT_EQUALS(zcm_publish_commit(zcm, &loan, 10), ZCM_EOK);
+        }
+
+        TS_ASSERT_EQUALS(zcm_publish_loan(zcm, "LOANED", 10, &loan), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_publish_commit(zcm, &loan, 10), ZCM_EAGAIN);
+        TSM_ASSERT("A failed commit must keep the loan", loan.data != NULL);
+        zcm_publish_cancel(zcm, &loan);
+        TS_ASSERT(loan.data == NULL);
+
+        TS_ASSERT_EQUALS(zcm_publish_loan(zcm, "LOANED", 1 << 30, &loan), ZCM_EINVALID);
+
+        zcm_resume(zcm);
+        zcm_destroy(zcm);
+    }
+
+    void testEncodeInto() {
+        zcm::ZCM zcm("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm.good());
+
+        LoanHandler handler;
+        zcm.subscribe("EXAMPLE", &LoanHandler::handle, &handler);
+        zcm.start();
+
+        example_t msg {};
+        msg.num_ranges = 0;
+        msg.name = "loaned";
+        TS_ASSERT_EQUALS(zcm.publishLoaned("EXAMPLE", &msg), ZCM_EOK);
+
+        usleep(200000);
+        zcm.stop();
+        TS_ASSERT_EQUALS(handler.numReceived, 1);
+        TS_ASSERT_EQUALS(handler.name, "loaned");
+    }
+};
+
+#endif // PUBLISHLOANTEST_HPP
@@ -0,0 +1,118 @@
+#ifndef PUBLISHMODETEST_HPP
+#define PUBLISHMODETEST_HPP
+
+#include <unistd.h>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "zcm/zcm.h"
+#include "zcm/transport.h"
+#include "cxxtest/TestSuite.h"
+
+// A transport that remembers which thread sent what
+static std::mutex sentMutex;
+static std::vector<std::string> sentChannels;
+static std::vector<std::thread::id> sentThreads;
+
+static size_t record_get_mtu(zcm_trans_t *zt) { return 1024; }
+static int record_sendmsg(zcm_trans_t *zt, zcm_msg_t msg)
+{
+    std::unique_lock<std::mutex> lk(sentMutex);
+    sentChannels.emplace_back(msg.channel);
+    sentThreads.push_back(std::this_thread::get_id());
+    return ZCM_EOK;
+}
+static int record_recvmsg_enable(zcm_trans_t *zt, const char *channel, bool enable)
+{ return ZCM_EOK; }
+static int record_recvmsg(zcm_trans_t *zt, zcm_msg_t *msg, int timeout)
+{ usleep(timeout * 1000); return ZCM_EAGAIN; }
+static void record_destroy(zcm_trans_t *zt) {}
+
+static zcm_trans_methods_t record_methods = {
+    record_get_mtu,
+    record_sendmsg,
+    record_recvmsg_enable,
+    record_recvmsg,
+    NULL,
+    record_destroy,
+};
+
+static size_t numSent()
+{
+    std::unique_lock<std::mutex> lk(sentMutex);
+    return sentChannels.size();
+}
+
+class PublishModeTest : public CxxTest::TestSuite
+{
+    zcm_trans_t trans;
+
+  public:
+    void setUp() override
+    {
+        trans.trans_type = ZCM_BLOCKING;
+        trans.vtbl = &record_methods;
+        sentChannels.clear();
+        sentThreads.clear();
+    }
+    void tearDown() override {}
+
+    void testInlineSendsFromPublisher()
+    {
+        zcm_t *zcm = zcm_create_from_trans(&trans);
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_publish_mode(zcm, NULL, ZCM_PUBLISH_INLINE), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_set_publish_mode(zcm, "QUEUED", ZCM_PUBLISH_QUEUED), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_set_publish_mode(zcm, NULL, (zcm_publish_mode) 5), ZCM_EINVALID);
+
+        uint8_t data = 'a';
+        TS_ASSERT_EQUALS(zcm_publish(zcm, "INLINE", &data, 1), ZCM_EOK);
+        TSM_ASSERT_EQUALS("Inline publish returned before sending", numSent(), 1);
+        TS_ASSERT(sentThreads[0] == std::this_thread::get_id());
+
+        // Without a flush, only the send thread sends queued messages
+        TS_ASSERT_EQUALS(zcm_publish(zcm, "QUEUED", &data, 1), ZCM_EOK);
+        for (int i = 0; i < 100 && numSent() < 2; ++i) usleep(10000);
+        TS_ASSERT_EQUALS(numSent(), 2);
+        TSM_ASSERT("Queued channel was sent inline",
+                   sentThreads[1] != std::this_thread::get_id());
+
+        zcm_destroy(zcm);
+    }
+
+    void testInlineKeepsOrderWhilePaused()
+    {
+        zcm_t *zcm = zcm_create_from_trans(&trans);
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_publish_mode(zcm, "CHAN", ZCM_PUBLISH_INLINE), ZCM_EOK);
+
+        uint8_t data = 'a';
+        zcm_pause(zcm);
+        TS_ASSERT_EQUALS(zcm_publish(zcm, "CHAN", &data, 1), ZCM_EOK);
+        TS_ASSERT_EQUALS(zcm_publish(zcm, "OTHER", &data, 1), ZCM_EOK);
+        usleep(50000);
+        TSM_ASSERT_EQUALS("Sent while paused", numSent(), 0);
+
+        zcm_resume(zcm);
+        // Whatever is still queued must go out before the next inline message
+        TS_ASSERT_EQUALS(zcm_publish(zcm, "CHAN", &data, 1), ZCM_EOK);
+        zcm_flush(zcm);
+
+        std::unique_lock<std::mutex> lk(sentMutex);
+        TS_ASSERT_EQUALS(sentChannels.size(), 3);
+        if (sentChannels.size() == 3) {
+            TS_ASSERT_EQUALS(sentChannels[0], "CHAN");
+            TS_ASSERT_EQUALS(sentChannels[1], "OTHER");
+            TS_ASSERT_EQUALS(sentChannels[2], "CHAN");
+        }
+        lk.unlock();
+
+        zcm_destroy(zcm);
+    }
+};
+
+#endif // PUBLISHMODETEST_HPP
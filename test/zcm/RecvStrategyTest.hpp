@@ -0,0 +1,88 @@
+#ifndef RECVSTRATEGYTEST_HPP
+#define RECVSTRATEGYTEST_HPP
+
+#include <unistd.h>
+#include <atomic>
+
+#include "zcm/zcm.h"
+#include "cxxtest/TestSuite.h"
+
+static std::atomic<int> strategyReceived {0};
+
+static void strategy_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    strategyReceived++;
+}
+
+class RecvStrategyTest : public CxxTest::TestSuite
+{
+    void receiveWith(zcm_t *zcm)
+    {
+        const int N = 10;
+        strategyReceived = 0;
+        zcm_sub_t *sub = zcm_subscribe(zcm, "STRATEGY", strategy_handler, NULL);
+        zcm_start(zcm);
+
+        uint8_t data = 'a';
+        for (int i = 0; i < N; ++i) {
+            zcm_publish(zcm, "STRATEGY", &data, 1);
+            // Leave time for the receiving side to go idle in between
+            usleep(2000);
+        }
+        for (int i = 0; i < 100 && strategyReceived < N; ++i) usleep(10000);
+        TS_ASSERT_EQUALS(strategyReceived, N);
+
+        zcm_stop(zcm);
+        zcm_unsubscribe(zcm, sub);
+    }
+
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testStrategies()
+    {
+        zcm_recv_strategy strategies[] = {
+            ZCM_RECV_BLOCK, ZCM_RECV_SPIN_BLOCK, ZCM_RECV_BUSY_POLL
+        };
+        for (zcm_recv_strategy s : strategies) {
+            zcm_t *zcm = zcm_create("inproc");
+            TSM_ASSERT("Failed to create zcm", zcm);
+            TS_ASSERT_EQUALS(zcm_set_recv_strategy(zcm, s, 1000), ZCM_EOK);
+            receiveWith(zcm);
+            zcm_destroy(zcm);
+        }
+    }
+
+    void testInvalid()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        TS_ASSERT_EQUALS(zcm_set_recv_strategy(zcm, (zcm_recv_strategy) 5, 0), ZCM_EINVALID);
+
+        zcm_start(zcm);
+        TSM_ASSERT_EQUALS("Changed the strategy while running",
+                          zcm_set_recv_strategy(zcm, ZCM_RECV_BUSY_POLL, 0), ZCM_EINVALID);
+        zcm_stop(zcm);
+        TS_ASSERT_EQUALS(zcm_set_recv_strategy(zcm, ZCM_RECV_BUSY_POLL, 0), ZCM_EOK);
+        zcm_destroy(zcm);
+    }
+
+    void testUrlOption()
+    {
+        zcm_t *zcm = NULL;
+        TS_ASSERT_EQUALS(zcm_try_create(&zcm, "inproc://?recv_strategy=spin&recv_spin_us=500"),
+                         ZCM_EOK);
+        TSM_ASSERT("Failed to create zcm", zcm);
+        if (zcm) {
+            receiveWith(zcm);
+            zcm_destroy(zcm);
+        }
+
+        zcm = NULL;
+        TS_ASSERT_EQUALS(zcm_try_create(&zcm, "inproc://?recv_strategy=bogus"), ZCM_EINVALID);
+        TS_ASSERT(zcm == NULL);
+    }
+};
+
+#endif // RECVSTRATEGYTEST_HPP
@@ -0,0 +1,107 @@
+#ifndef STATSTEST_HPP
+#define STATSTEST_HPP
+
+#include <unistd.h>
+#include <cstring>
+#include <atomic>
+#include <string>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm-cpp.hpp"
+
+static std::atomic<int> statsReceived {0};
+
+static void stats_handler(const zcm::ReceiveBuffer *rbuf, const std::string& channel, void *usr)
+{
+    statsReceived++;
+}
+
+static const zcm_channel_stats_t* findStats(const zcm::Stats& stats, const char* channel)
+{
+    for (auto& c : stats.channels)
+        if (strcmp(c.channel, channel) == 0) return &c;
+    return nullptr;
+}
+
+class StatsTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testCounters()
+    {
+        zcm::ZCM zcm("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm.good());
+
+        statsReceived = 0;
+        auto sub = zcm.subscribe("WANTED", stats_handler, nullptr);
+        zcm.start();
+
+        uint8_t data = 'a';
+        for (int i = 0; i < 5; ++i) zcm.publish("WANTED", &data, 1);
+        for (int i = 0; i < 3; ++i) zcm.publish("UNWANTED", &data, 1);
+        for (int i = 0; i < 100 && statsReceived < 5; ++i) usleep(10000);
+        zcm.flush();
+        zcm.stop();
+        zcm.unsubscribe(sub);
+
+        zcm::Stats stats;
+        TS_ASSERT_EQUALS(zcm.getStats(stats), ZCM_EOK);
+        TS_ASSERT_EQUALS(stats.summary.num_channels, stats.channels.size());
+        TS_ASSERT(stats.summary.send_queue_high_water >= 1);
+        TS_ASSERT(stats.summary.recv_queue_high_water >= 1);
+
+        const zcm_channel_stats_t* wanted = findStats(stats, "WANTED");
+        TSM_ASSERT("No stats for WANTED", wanted);
+        if (wanted) {
+            TS_ASSERT_EQUALS(wanted->published, 5);
+            TS_ASSERT_EQUALS(wanted->received, 5);
+            TS_ASSERT_EQUALS(wanted->dispatched, 5);
+            TS_ASSERT_EQUALS(wanted->dropped, 0);
+            uint64_t handled = 0;
+            for (uint64_t n : wanted->handler_hist) handled += n;
+            TS_ASSERT_EQUALS(handled, 5);
+        }
+
+        // Nobody subscribed, so nothing was queued for dispatch
+        const zcm_channel_stats_t* unwanted = findStats(stats, "UNWANTED");
+        TSM_ASSERT("No stats for UNWANTED", unwanted);
+        if (unwanted) {
+            TS_ASSERT_EQUALS(unwanted->published, 3);
+            TS_ASSERT_EQUALS(unwanted->received, 0);
+        }
+    }
+
+    void testDropped()
+    {
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm);
+        zcm_set_queue_size(zcm, 4);
+        zcm_pause(zcm);
+
+        // A queue of 4 holds 3 messages
+        uint8_t data = 'a';
+        for (int i = 0; i < 5; ++i) zcm_publish(zcm, "FULL", &data, 1);
+
+        zcm_stats_t stats;
+        zcm_channel_stats_t channel;
+        TS_ASSERT_EQUALS(zcm_get_stats(zcm, &stats, &channel, 1), ZCM_EOK);
+        TS_ASSERT_EQUALS(stats.num_channels, 1);
+        TS_ASSERT_EQUALS(stats.send_queue_capacity, 4);
+        TS_ASSERT_EQUALS(stats.send_queue_high_water, 3);
+        TS_ASSERT_EQUALS(std::string(channel.channel), "FULL");
+        TS_ASSERT_EQUALS(channel.published, 3);
+        TS_ASSERT_EQUALS(channel.dropped, 2);
+
+        // Just the summary
+        TS_ASSERT_EQUALS(zcm_get_stats(zcm, &stats, NULL, 0), ZCM_EOK);
+        TS_ASSERT_EQUALS(stats.num_channels, 1);
+
+        zcm_resume(zcm);
+        zcm_destroy(zcm);
+    }
+};
+
+#endif // STATSTEST_HPP
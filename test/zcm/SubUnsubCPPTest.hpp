@@ -6,6 +6,7 @@
 #include "zcm/zcm-cpp.hpp"
 #include "types/example_t.hpp"
 
+#include <atomic>
 #include <cinttypes>
 #include <unistd.h>
 
@@ -221,6 +222,78 @@ class SubUnsubCPPTest : public CxxTest::TestSuite
         }
     }
 
+    void testUnsubSiblingInCallback()
+    {
+        // The first handler unsubscribes the second one, which must not be called with
+        // the message that is already being dispatched, nor with any later one
+        struct SiblingHandler
+        {
+            zcm::ZCM* zcm = nullptr;
+            zcm::Subscription* sibling = nullptr;
+            int first = 0, second = 0;
+
+            void handleFirst(const zcm::ReceiveBuffer* rbuf, const string& channel)
+            {
+                first++;
+                if (sibling) {
+                    zcm->unsubscribe(sibling);
+                    sibling = nullptr;
+                }
+            }
+            void handleSecond(const zcm::ReceiveBuffer* rbuf, const string& channel)
+            { second++; }
+        };
+
+        zcm::ZCM zcm("inproc");
+        TSM_ASSERT("Failed to create ZCM", zcm.good());
+
+        SiblingHandler handler;
+        handler.zcm = &zcm;
+        TS_ASSERT(zcm.subscribe("TEST", &SiblingHandler::handleFirst, &handler));
+        handler.sibling = zcm.subscribe("TEST", &SiblingHandler::handleSecond, &handler);
+        TS_ASSERT(handler.sibling);
+
+        zcm.start();
+        for (size_t j = 0; j < NUM_DATA; ++j) zcm.publish("TEST", data + j, sizeof(char));
+        usleep(sleep_time);
+        zcm.stop();
+
+        TS_ASSERT_EQUALS(handler.first, NUM_DATA);
+        TS_ASSERT_EQUALS(handler.second, 0);
+    }
+
+    void testUnsubWaitsForCallback()
+    {
+        struct SlowHandler
+        {
+            std::atomic<bool> running {false};
+            std::atomic<bool> done {false};
+
+            void handle(const zcm::ReceiveBuffer* rbuf, const string& channel)
+            {
+                running = true;
+                usleep(200000);
+                done = true;
+            }
+        };
+
+        zcm::ZCM zcm("inproc");
+        TSM_ASSERT("Failed to create ZCM", zcm.good());
+
+        SlowHandler handler;
+        zcm::Subscription* sub = zcm.subscribe("TEST", &SlowHandler::handle, &handler);
+        TS_ASSERT(sub);
+
+        zcm.start();
+        zcm.publish("TEST", data, sizeof(char));
+        while (!handler.running) usleep(1000);
+
+        // Once unsubscribe returns, the handler may go away
+        TS_ASSERT_EQUALS(zcm.unsubscribe(sub), ZCM_EOK);
+        TS_ASSERT(handler.done);
+        zcm.stop();
+    }
+
 };
 
 #endif // SUBUNSUBCPPTEST_H
@@ -49,6 +49,25 @@ static void example_t_handler(const zcm_recv_buf_t *rbuf, const char *channel,
     fflush(stdout);
 }
 
+static int  num_first_received = 0;
+static int  num_second_received = 0;
+static zcm_sub_t *first_sub = NULL;
+static void second_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    num_second_received++;
+}
+
+// Replaces its own subscription with one on another channel
+static void first_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    num_first_received++;
+    zcm_t *zcm = (zcm_t*) usr;
+    TSM_ASSERT("Subscribing from a callback failed",
+               zcm_subscribe(zcm, "SECOND", second_handler, NULL));
+    TSM_ASSERT_EQUALS("Unsubscribing from a callback failed",
+                      zcm_unsubscribe(zcm, first_sub), ZCM_EOK);
+}
+
 class SubUnsubCTest : public CxxTest::TestSuite
 {
   public:
@@ -155,5 +174,28 @@ class SubUnsubCTest : public CxxTest::TestSuite
         }
     }
 
+    void testSubUnsubFromCallback() {
+        size_t sleep_time = 200000;
+
+        zcm_t *zcm = zcm_create("inproc");
+        TSM_ASSERT("Failed to create zcm", zcm)
+
+        first_sub = zcm_subscribe(zcm, "FIRST", first_handler, zcm);
+        TSM_ASSERT("Subscription failed", first_sub);
+        zcm_start(zcm);
+
+        TSM_ASSERT_EQUALS("Publishing failed!", zcm_publish(zcm, "FIRST", data, 1), ZCM_EOK);
+        usleep(sleep_time);
+        TSM_ASSERT_EQUALS("Publishing failed!", zcm_publish(zcm, "FIRST", data, 1), ZCM_EOK);
+        TSM_ASSERT_EQUALS("Publishing failed!", zcm_publish(zcm, "SECOND", data, 1), ZCM_EOK);
+        usleep(sleep_time);
+
+        zcm_stop(zcm);
+        TSM_ASSERT_EQUALS("First handler should have run exactly once", num_first_received, 1);
+        TSM_ASSERT_EQUALS("Second handler should have run exactly once", num_second_received, 1);
+
+        zcm_destroy(zcm);
+    }
+
 };
 #endif // SUBUNSUBCTEST_HPP
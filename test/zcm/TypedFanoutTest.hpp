@@ -0,0 +1,232 @@
+#ifndef TYPEDFANOUTTEST_HPP
+#define TYPEDFANOUTTEST_HPP
+
+#include <unistd.h>
+#include <atomic>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm-cpp.hpp"
+#include "types/example_t.hpp"
+
+// Records what one typed handler was handed
+struct FanoutRecord
+{
+    std::atomic<int> calls {0};
+    std::atomic<int64_t> utime {-1};
+    std::atomic<const example_t*> msg {nullptr};
+
+    void record(const example_t* m)
+    {
+        msg = m;
+        utime = m->utime;
+        calls++;
+    }
+};
+
+static void fanout_handler(const zcm::ReceiveBuffer*, const std::string&,
+                           const example_t* msg, void* usr)
+{
+    ((FanoutRecord*) usr)->record(msg);
+}
+
+class FanoutHandler
+{
+  public:
+    FanoutRecord rec;
+
+    void handle(const zcm::ReceiveBuffer*, const std::string&, const example_t* msg)
+    {
+        rec.record(msg);
+    }
+};
+
+// Unsubscribes sub (itself or another subscription) from within its first callback
+struct FanoutOnce
+{
+    zcm::ZCM* zcm;
+    zcm::Subscription* sub;
+    FanoutRecord rec;
+};
+
+static void fanout_once_handler(const zcm::ReceiveBuffer*, const std::string&,
+                                const example_t* msg, void* usr)
+{
+    FanoutOnce* o = (FanoutOnce*) usr;
+    o->rec.record(msg);
+    if (o->sub) {
+        o->zcm->unsubscribe(o->sub);
+        o->sub = nullptr;
+    }
+}
+
+static void fanoutPublish(zcm::ZCM& zcm, const std::string& channel, int64_t utime)
+{
+    example_t msg {};
+    msg.utime = utime;
+    zcm.publish(channel, &msg);
+}
+
+static void fanoutWait(const FanoutRecord& rec, int calls)
+{
+    for (int i = 0; i < 200 && rec.calls < calls; ++i) usleep(5000);
+}
+
+class TypedFanoutTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testSameMessageForAll()
+    {
+        zcm::ZCM zcm("inproc");
+        TS_ASSERT(zcm.good());
+
+        FanoutRecord fn, lambda;
+        FanoutHandler member;
+        TS_ASSERT(zcm.subscribe("FANOUT", fanout_handler, &fn));
+        TS_ASSERT(zcm.subscribe("FANOUT", &FanoutHandler::handle, &member));
+        TS_ASSERT(zcm.subscribe<example_t>("FANOUT",
+            [&](const zcm::ReceiveBuffer*, const std::string&, const example_t* msg) {
+                lambda.record(msg);
+            }));
+        zcm.start();
+
+        fanoutPublish(zcm, "FANOUT", 42);
+        fanoutWait(fn, 1);
+        fanoutWait(member.rec, 1);
+        fanoutWait(lambda, 1);
+        zcm.stop();
+
+        TS_ASSERT_EQUALS(fn.calls, 1);
+        TS_ASSERT_EQUALS(member.rec.calls, 1);
+        TS_ASSERT_EQUALS(lambda.calls, 1);
+        TS_ASSERT_EQUALS(fn.utime, 42);
+        TS_ASSERT_EQUALS(member.rec.utime, 42);
+        TS_ASSERT_EQUALS(lambda.utime, 42);
+        // Decoded once and handed to everyone
+        TS_ASSERT_EQUALS(fn.msg.load(), member.rec.msg.load());
+        TS_ASSERT_EQUALS(fn.msg.load(), lambda.msg.load());
+    }
+
+    void testUnsubscribe()
+    {
+        zcm::ZCM zcm("inproc");
+        TS_ASSERT(zcm.good());
+
+        FanoutRecord a, b;
+        zcm::Subscription* subA = zcm.subscribe("FANOUT", fanout_handler, &a);
+        zcm::Subscription* subB = zcm.subscribe("FANOUT", fanout_handler, &b);
+        TS_ASSERT(subA && subB);
+        zcm.start();
+
+        fanoutPublish(zcm, "FANOUT", 1);
+        fanoutWait(a, 1);
+        fanoutWait(b, 1);
+
+        // The rest of the group keeps receiving
+        TS_ASSERT_EQUALS(zcm.unsubscribe(subA), ZCM_EOK);
+        fanoutPublish(zcm, "FANOUT", 2);
+        fanoutWait(b, 2);
+        TS_ASSERT_EQUALS(a.calls, 1);
+        TS_ASSERT_EQUALS(b.calls, 2);
+        TS_ASSERT_EQUALS(b.utime, 2);
+
+        // And so does a new group once the old one is gone
+        TS_ASSERT_EQUALS(zcm.unsubscribe(subB), ZCM_EOK);
+        subA = zcm.subscribe("FANOUT", fanout_handler, &a);
+        TS_ASSERT(subA);
+        fanoutPublish(zcm, "FANOUT", 3);
+        fanoutWait(a, 2);
+        zcm.stop();
+
+        TS_ASSERT_EQUALS(a.calls, 2);
+        TS_ASSERT_EQUALS(a.utime, 3);
+        TS_ASSERT_EQUALS(b.calls, 2);
+    }
+
+    void testUnsubscribeInCallback()
+    {
+        zcm::ZCM zcm("inproc");
+        TS_ASSERT(zcm.good());
+
+        FanoutOnce once;
+        once.zcm = &zcm;
+        FanoutRecord rest;
+        once.sub = zcm.subscribe("FANOUT", fanout_once_handler, &once);
+        TS_ASSERT(once.sub);
+        TS_ASSERT(zcm.subscribe("FANOUT", fanout_handler, &rest));
+        zcm.start();
+
+        fanoutPublish(zcm, "FANOUT", 1);
+        fanoutWait(rest, 1);
+        fanoutPublish(zcm, "FANOUT", 2);
+        fanoutWait(rest, 2);
+        zcm.stop();
+
+        TS_ASSERT_EQUALS(once.rec.calls, 1);
+        TS_ASSERT_EQUALS(rest.calls, 2);
+        TS_ASSERT_EQUALS(rest.utime, 2);
+    }
+
+    void testUnsubscribeSiblingInCallback()
+    {
+        zcm::ZCM zcm("inproc");
+        TS_ASSERT(zcm.good());
+
+        // The sibling comes after the unsubscriber in the same group, so it is still in the
+        // snapshot of the message that removes it
+        FanoutOnce once;
+        once.zcm = &zcm;
+        FanoutHandler sibling;
+        FanoutRecord rest;
+        TS_ASSERT(zcm.subscribe("FANOUT", fanout_once_handler, &once));
+        once.sub = zcm.subscribe("FANOUT", &FanoutHandler::handle, &sibling);
+        TS_ASSERT(once.sub);
+        TS_ASSERT(zcm.subscribe("FANOUT", fanout_handler, &rest));
+        zcm.start();
+
+        fanoutPublish(zcm, "FANOUT", 1);
+        fanoutWait(rest, 1);
+        fanoutPublish(zcm, "FANOUT", 2);
+        fanoutWait(rest, 2);
+        zcm.stop();
+
+        TS_ASSERT_EQUALS(once.rec.calls, 2);
+        TS_ASSERT_EQUALS(sibling.rec.calls, 0);
+        TS_ASSERT_EQUALS(rest.calls, 2);
+        TS_ASSERT_EQUALS(rest.utime, 2);
+    }
+
+    void testSeparateGroups()
+    {
+        zcm::ZCM zcm("inproc");
+        TS_ASSERT(zcm.good());
+
+        // Other channels and other subscribe flags get messages of their own
+        FanoutRecord a, b, conflated;
+        TS_ASSERT(zcm.subscribe("FANOUT_A", fanout_handler, &a));
+        TS_ASSERT(zcm.subscribe("FANOUT_B", fanout_handler, &b));
+        TS_ASSERT(zcm.subscribe("FANOUT_A", fanout_handler, &conflated, ZCM_SUB_CONFLATE));
+        zcm.start();
+
+        fanoutPublish(zcm, "FANOUT_A", 1);
+        fanoutPublish(zcm, "FANOUT_B", 2);
+        fanoutWait(a, 1);
+        fanoutWait(b, 1);
+        fanoutWait(conflated, 1);
+        zcm.stop();
+
+        TS_ASSERT_EQUALS(a.calls, 1);
+        TS_ASSERT_EQUALS(b.calls, 1);
+        TS_ASSERT_EQUALS(conflated.calls, 1);
+        TS_ASSERT_EQUALS(a.utime, 1);
+        TS_ASSERT_EQUALS(b.utime, 2);
+        TS_ASSERT_EQUALS(conflated.utime, 1);
+        TS_ASSERT_DIFFERS(a.msg.load(), b.msg.load());
+        TS_ASSERT_DIFFERS(a.msg.load(), conflated.msg.load());
+    }
+};
+
+#endif // TYPEDFANOUTTEST_HPP
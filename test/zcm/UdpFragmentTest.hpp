@@ -0,0 +1,122 @@
+#ifndef UDPFRAGMENTTEST_HPP
+#define UDPFRAGMENTTEST_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+// Hand-made fragments of the udp transport's long message format, so that the test
+// controls their order
+static const uint32_t FRAG_MAGIC_LONG = 0x4c433033;
+static const char* FRAG_CHANNEL = "FRAG";
+static const uint16_t FRAG_SUB_PORT = 7683;
+
+struct FragReceived
+{
+    std::mutex mut;
+    std::vector<std::string> msgs;
+};
+
+static void frag_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    FragReceived* r = (FragReceived*) usr;
+    std::unique_lock<std::mutex> lk(r->mut);
+    r->msgs.push_back(std::string((const char*) rbuf->data, rbuf->data_size));
+}
+
+// Sends fragment fragNo of data (split into nfrags pieces of fragLen bytes)
+static void sendFragment(int fd, uint32_t seqno, const std::string& data,
+                         uint16_t fragNo, uint16_t nfrags, size_t fragLen)
+{
+    size_t off = fragNo * fragLen;
+    size_t len = std::min(fragLen, data.size() - off);
+
+    std::vector<char> pkt(20);
+    uint32_t u32s[4] = { htonl(FRAG_MAGIC_LONG), htonl(seqno),
+                         htonl((uint32_t) data.size()), htonl((uint32_t) off) };
+    uint16_t u16s[2] = { htons(fragNo), htons(nfrags) };
+    memcpy(&pkt[0], u32s, sizeof(u32s));
+    memcpy(&pkt[16], u16s, sizeof(u16s));
+    if (fragNo == 0) pkt.insert(pkt.end(), FRAG_CHANNEL, FRAG_CHANNEL + strlen(FRAG_CHANNEL) + 1);
+    pkt.insert(pkt.end(), data.begin() + off, data.begin() + off + len);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(FRAG_SUB_PORT);
+    inet_aton("127.0.0.1", &addr.sin_addr);
+    TS_ASSERT_EQUALS(sendto(fd, pkt.data(), pkt.size(), 0,
+                            (struct sockaddr*) &addr, sizeof(addr)), (ssize_t) pkt.size());
+}
+
+static void fragWait(FragReceived& r, size_t n)
+{
+    for (int i = 0; i < 200; ++i) {
+        {
+            std::unique_lock<std::mutex> lk(r.mut);
+            if (r.msgs.size() >= n) return;
+        }
+        usleep(5000);
+    }
+}
+
+class UdpFragmentTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testInterleavedAndReordered()
+    {
+        std::string url = "udp://127.0.0.1:" + std::to_string(FRAG_SUB_PORT) + ":" +
+                          std::to_string(FRAG_SUB_PORT + 1);
+        zcm_t *zcm = zcm_create(url.c_str());
+        TSM_ASSERT("Failed to create zcm", zcm);
+        if (!zcm) return;
+
+        FragReceived r;
+        zcm_subscribe(zcm, FRAG_CHANNEL, frag_handler, &r);
+        zcm_start(zcm);
+
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        TS_ASSERT(fd >= 0);
+
+        // Two messages from the same sender in flight at once, fragment 0 of the first
+        // one last, and a duplicate fragment that must not count twice
+        std::string a = "aaaaaaaaaabbbbbbbbbbcccccccccc";
+        std::string b = "0123456789ABCDEFGHIJ";
+        sendFragment(fd, 7, a, 2, 3, 10);
+        sendFragment(fd, 8, b, 0, 2, 10);
+        sendFragment(fd, 7, a, 1, 3, 10);
+        sendFragment(fd, 7, a, 1, 3, 10);
+        sendFragment(fd, 8, b, 1, 2, 10);
+        sendFragment(fd, 7, a, 0, 3, 10);
+        fragWait(r, 2);
+
+        // A message whose fragments were lost doesn't keep the next one from completing
+        std::string c = "xxxxxxxxxxyyyyyyyyyy";
+        sendFragment(fd, 9, c, 0, 2, 10);
+        sendFragment(fd, 10, c, 1, 2, 10);
+        sendFragment(fd, 10, c, 0, 2, 10);
+        fragWait(r, 3);
+
+        zcm_stop(zcm);
+        close(fd);
+
+        std::vector<std::string> expected { b, a, c };
+        TS_ASSERT_EQUALS(r.msgs, expected);
+
+        zcm_destroy(zcm);
+    }
+};
+
+#endif // UDPFRAGMENTTEST_HPP
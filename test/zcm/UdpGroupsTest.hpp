@@ -0,0 +1,188 @@
+#ifndef UDPGROUPSTEST_HPP
+#define UDPGROUPSTEST_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+static const char* GROUPS_ADDR = "239.255.76.100";
+static const uint16_t GROUPS_PORT = 7686;
+static const uint32_t GROUPS_N = 8;
+static const uint32_t GROUPS_MAGIC_SHORT = 0x4c433032;
+
+// The transport's channel to group mapping, which is part of the wire protocol
+static uint32_t groupOf(const std::string& channel)
+{
+    uint32_t h = 2166136261u;
+    for (char c : channel) {
+        h ^= (uint8_t) c;
+        h *= 16777619u;
+    }
+    return h % GROUPS_N;
+}
+
+static std::string groupsUrl()
+{
+    return "udpm://" + std::string(GROUPS_ADDR) + ":" + std::to_string(GROUPS_PORT) +
+           "?ttl=0&groups=" + std::to_string(GROUPS_N);
+}
+
+// Two channels that hash onto different groups
+static void differentGroups(std::string& a, std::string& b)
+{
+    a = "GROUPS_A";
+    for (int i = 0; ; ++i) {
+        b = "GROUPS_B" + std::to_string(i);
+        if (groupOf(b) != groupOf(a)) return;
+    }
+}
+
+struct GroupsReceived
+{
+    std::mutex mut;
+    std::vector<std::string> msgs;
+    size_t size() { std::unique_lock<std::mutex> lk(mut); return msgs.size(); }
+};
+
+static void groups_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    GroupsReceived* r = (GroupsReceived*) usr;
+    std::unique_lock<std::mutex> lk(r->mut);
+    r->msgs.push_back(std::string(channel) + ":" +
+                      std::string((const char*) rbuf->data, rbuf->data_size));
+}
+
+static void groupsWait(GroupsReceived& r, size_t n)
+{
+    for (int i = 0; i < 200 && r.size() < n; ++i) usleep(5000);
+}
+
+// Sends a short message on channel to group g, bypassing the transport's own choice
+static void sendToGroup(int fd, uint32_t g, const std::string& channel, const std::string& data)
+{
+    std::vector<char> pkt(8);
+    uint32_t hdr[2] = { htonl(GROUPS_MAGIC_SHORT), 0 };
+    memcpy(&pkt[0], hdr, sizeof(hdr));
+    pkt.insert(pkt.end(), channel.c_str(), channel.c_str() + channel.size() + 1);
+    pkt.insert(pkt.end(), data.begin(), data.end());
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(GROUPS_PORT);
+    inet_aton(GROUPS_ADDR, &addr.sin_addr);
+    addr.sin_addr.s_addr = htonl(ntohl(addr.sin_addr.s_addr) + g);
+    TS_ASSERT_EQUALS(sendto(fd, pkt.data(), pkt.size(), 0,
+                            (struct sockaddr*) &addr, sizeof(addr)), (ssize_t) pkt.size());
+}
+
+class UdpGroupsTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testDelivery()
+    {
+        zcm_t *pub = zcm_create(groupsUrl().c_str());
+        zcm_t *sub = zcm_create(groupsUrl().c_str());
+        TSM_ASSERT("Failed to create zcm", pub && sub);
+        if (!pub || !sub) return;
+
+        std::string a, b;
+        differentGroups(a, b);
+
+        GroupsReceived r;
+        TS_ASSERT(zcm_subscribe(sub, a.c_str(), groups_handler, &r));
+        TS_ASSERT(zcm_subscribe(sub, b.c_str(), groups_handler, &r));
+        TS_ASSERT(zcm_subscribe(sub, "GROUPS_R.*", groups_handler, &r));
+        zcm_start(sub);
+
+        uint8_t data = 'x';
+        for (std::string ch : { a, b, std::string("GROUPS_R1") }) {
+            TS_ASSERT_EQUALS(zcm_publish(pub, ch.c_str(), &data, 1), ZCM_EOK);
+            zcm_flush(pub);
+            groupsWait(r, r.size() + 1);
+        }
+
+        zcm_stop(sub);
+        std::vector<std::string> expected { a + ":x", b + ":x", "GROUPS_R1:x" };
+        TS_ASSERT_EQUALS(r.msgs, expected);
+
+        zcm_destroy(sub);
+        zcm_destroy(pub);
+    }
+
+    void testOnlySubscribedGroupsArrive()
+    {
+        zcm_t *zcm = zcm_create(groupsUrl().c_str());
+        TSM_ASSERT("Failed to create zcm", zcm);
+        if (!zcm) return;
+
+        std::string a, b;
+        differentGroups(a, b);
+
+        GroupsReceived r;
+        TS_ASSERT(zcm_subscribe(zcm, a.c_str(), groups_handler, &r));
+        zcm_start(zcm);
+
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        TS_ASSERT(fd >= 0);
+        uint8_t ttl = 0;
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+        // Channel a sent to the group of b is never seen, so the message after it is
+        // the first one
+        sendToGroup(fd, groupOf(b), a, "wrong group");
+        usleep(50000);
+        sendToGroup(fd, groupOf(a), a, "right group");
+        groupsWait(r, 1);
+
+        // A regex subscription joins every group
+        zcm_sub_t *all = zcm_subscribe(zcm, "GROUPS_.*", groups_handler, &r);
+        TS_ASSERT(all);
+        sendToGroup(fd, groupOf(b), b, "regex");
+        groupsWait(r, 2);
+
+        // And leaves them again
+        TS_ASSERT_EQUALS(zcm_unsubscribe(zcm, all), ZCM_EOK);
+        sendToGroup(fd, groupOf(b), a, "wrong group");
+        usleep(50000);
+
+        zcm_stop(zcm);
+        close(fd);
+
+        std::vector<std::string> expected { a + ":right group", b + ":regex" };
+        TS_ASSERT_EQUALS(r.msgs, expected);
+
+        zcm_destroy(zcm);
+    }
+
+    void testInvalidOptions()
+    {
+        // 0 is the default, which doesn't spread channels at all
+        zcm_t *off = nullptr;
+        std::string offUrl = "udpm://239.255.76.100:7686?ttl=0&groups=0";
+        TS_ASSERT_EQUALS(zcm_try_create(&off, offUrl.c_str()), ZCM_EOK);
+        if (off) zcm_destroy(off);
+
+        for (std::string url : { "udpm://239.255.76.100:7686?ttl=0&groups=257",
+                                 "udpm://239.255.255.250:7686?ttl=0&groups=8",
+                                 "udp://127.0.0.1:7687:7688?ttl=0&groups=2" }) {
+            zcm_t *zcm = nullptr;
+            TSM_ASSERT_DIFFERS(url.c_str(), zcm_try_create(&zcm, url.c_str()), ZCM_EOK);
+            TSM_ASSERT(url.c_str(), !zcm);
+        }
+    }
+};
+
+#endif // UDPGROUPSTEST_HPP
@@ -0,0 +1,40 @@
+#ifndef UDPOPTIONSTEST_HPP
+#define UDPOPTIONSTEST_HPP
+
+#include <string>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+
+class UdpOptionsTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testValidOptions()
+    {
+        // Clamped buffers and refused busy polling only warn
+        for (std::string opts : {"rcvbuf=4194304&sndbuf=1048576", "busy_poll=0",
+                                 "rcvbuf=0&prefer_busy_poll=0", "batch=1"}) {
+            std::string url = "udpm://239.255.76.67:7667?ttl=0&" + opts;
+            zcm_t *zcm = nullptr;
+            TSM_ASSERT_EQUALS(url.c_str(), zcm_try_create(&zcm, url.c_str()), ZCM_EOK);
+            if (zcm) zcm_destroy(zcm);
+        }
+    }
+
+    void testInvalidOptions()
+    {
+        for (std::string opts : {"rcvbuf=lots", "rcvbuf=-1", "sndbuf=4294967296",
+                                 "busy_poll=10us", "prefer_busy_poll=2", "batch=0"}) {
+            std::string url = "udpm://239.255.76.67:7667?ttl=0&" + opts;
+            zcm_t *zcm = nullptr;
+            TSM_ASSERT_DIFFERS(url.c_str(), zcm_try_create(&zcm, url.c_str()), ZCM_EOK);
+            TSM_ASSERT(url.c_str(), !zcm);
+        }
+    }
+};
+
+#endif // UDPOPTIONSTEST_HPP
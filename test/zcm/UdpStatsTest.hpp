@@ -0,0 +1,245 @@
+#ifndef UDPSTATSTEST_HPP
+#define UDPSTATSTEST_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+#include "zcm/util/channel_intern.hpp"
+
+static const uint16_t STATS_SUB_PORT = 7689;
+
+// Hand-made packets of the udp transport, so that the test controls their sequence numbers
+static void statsSend(int fd, const std::vector<char>& pkt)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(STATS_SUB_PORT);
+    inet_aton("127.0.0.1", &addr.sin_addr);
+    TS_ASSERT_EQUALS(sendto(fd, pkt.data(), pkt.size(), 0,
+                            (struct sockaddr*) &addr, sizeof(addr)), (ssize_t) pkt.size());
+}
+
+static void statsSendShort(int fd, uint32_t seqno, const char* channel = "STATS")
+{
+    std::vector<char> pkt(8);
+    uint32_t hdr[2] = { htonl(0x4c433032), htonl(seqno) };
+    memcpy(&pkt[0], hdr, sizeof(hdr));
+    pkt.insert(pkt.end(), channel, channel + strlen(channel) + 1);
+    pkt.push_back('x');
+    statsSend(fd, pkt);
+}
+
+// Fragment fragNo of a message with nfrags fragments of one byte each
+static void statsSendFragment(int fd, uint32_t seqno, uint16_t fragNo, uint16_t nfrags)
+{
+    std::vector<char> pkt(20);
+    uint32_t u32s[4] = { htonl(0x4c433033), htonl(seqno), htonl(nfrags), htonl(fragNo) };
+    uint16_t u16s[2] = { htons(fragNo), htons(nfrags) };
+    memcpy(&pkt[0], u32s, sizeof(u32s));
+    memcpy(&pkt[16], u16s, sizeof(u16s));
+    const char* channel = "STATS";
+    if (fragNo == 0) pkt.insert(pkt.end(), channel, channel + strlen(channel) + 1);
+    pkt.push_back('x');
+    statsSend(fd, pkt);
+}
+
+static zcm_transport_stats_t statsWait(zcm_t* zcm, uint64_t received, uint64_t discarded)
+{
+    zcm_transport_stats_t st;
+    memset(&st, 0, sizeof(st));
+    for (int i = 0; i < 200; ++i) {
+        TS_ASSERT_EQUALS(zcm_get_transport_stats(zcm, &st), ZCM_EOK);
+        if (st.received >= received && st.discarded >= discarded) break;
+        usleep(5000);
+    }
+    return st;
+}
+
+// Group of channel on a bus with n channel groups, see channelGroup() in udp.cpp
+static uint32_t statsGroupOf(const std::string& channel, uint32_t n)
+{
+    uint32_t h = 2166136261u;
+    for (char c : channel) {
+        h ^= (uint8_t) c;
+        h *= 16777619u;
+    }
+    return h % n;
+}
+
+struct StatsReceived
+{
+    std::mutex mut;
+    std::vector<std::string> msgs;
+};
+
+static void stats_handler(const zcm_recv_buf_t *rbuf, const char *channel, void *usr)
+{
+    StatsReceived* r = (StatsReceived*) usr;
+    std::unique_lock<std::mutex> lk(r->mut);
+    r->msgs.push_back(std::string((const char*) rbuf->data, rbuf->data_size));
+}
+
+class UdpStatsTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testSequenceCounters()
+    {
+        std::string url = "udp://127.0.0.1:" + std::to_string(STATS_SUB_PORT) + ":" +
+                          std::to_string(STATS_SUB_PORT + 1);
+        zcm_t *zcm = zcm_create(url.c_str());
+        TSM_ASSERT("Failed to create zcm", zcm);
+        if (!zcm) return;
+        zcm_start(zcm);
+
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        TS_ASSERT(fd >= 0);
+
+        // 4 goes missing, 2 comes late and then again
+        for (uint32_t seqno : { 0, 1, 3, 2, 2, 5 }) statsSendShort(fd, seqno);
+        statsSend(fd, std::vector<char>(12, 'z'));
+        zcm_transport_stats_t st = statsWait(zcm, 6, 1);
+        TS_ASSERT_EQUALS(st.received, 6);
+        TS_ASSERT_EQUALS(st.lost, 1);
+        TS_ASSERT_EQUALS(st.reordered, 1);
+        TS_ASSERT_EQUALS(st.duplicates, 1);
+        TS_ASSERT_EQUALS(st.lost_fragments, 0);
+        TS_ASSERT_EQUALS(st.discarded, 1);
+        TS_ASSERT_EQUALS(st.num_senders, 1);
+
+        // Message 6 never completes and expires once message 7 arrives
+        statsSendFragment(fd, 6, 0, 2);
+        usleep(1200000);
+        statsSendFragment(fd, 7, 1, 2);
+        statsSendFragment(fd, 7, 0, 2);
+        st = statsWait(zcm, 7, 1);
+        TS_ASSERT_EQUALS(st.received, 7);
+        TS_ASSERT_EQUALS(st.lost, 2);
+        TS_ASSERT_EQUALS(st.lost_fragments, 1);
+
+        zcm_stop(zcm);
+        close(fd);
+        zcm_destroy(zcm);
+    }
+
+    void testSequenceCountersWithGroups()
+    {
+        const uint32_t groups = 8;
+        std::string url = "udpm://239.255.76.110:" + std::to_string(STATS_SUB_PORT + 2) +
+                          "?ttl=0&groups=" + std::to_string(groups);
+        zcm_t *pub = zcm_create(url.c_str());
+        zcm_t *sub = zcm_create(url.c_str());
+        TSM_ASSERT("Failed to create zcm", pub && sub);
+        if (!pub || !sub) return;
+
+        // Only the group of the subscribed channel is joined, the messages of the other
+        // one never arrive but were not lost either
+        std::string joined = "STATS_A", other;
+        for (int i = 0; ; ++i) {
+            other = "STATS_B" + std::to_string(i);
+            if (statsGroupOf(other, groups) != statsGroupOf(joined, groups)) break;
+        }
+        StatsReceived r;
+        TS_ASSERT(zcm_subscribe(sub, joined.c_str(), stats_handler, &r));
+        zcm_start(sub);
+
+        const int n = 10;
+        uint8_t data = 'x';
+        for (int i = 0; i < n; ++i) {
+            TS_ASSERT_EQUALS(zcm_publish(pub, joined.c_str(), &data, 1), ZCM_EOK);
+            TS_ASSERT_EQUALS(zcm_publish(pub, other.c_str(), &data, 1), ZCM_EOK);
+            zcm_flush(pub);
+        }
+        zcm_transport_stats_t st = statsWait(sub, n, 0);
+        TS_ASSERT_EQUALS(st.received, n);
+        TS_ASSERT_EQUALS(st.lost, 0);
+        TS_ASSERT_EQUALS(st.reordered, 0);
+        TS_ASSERT_EQUALS(st.num_senders, 1);
+
+        zcm_stop(sub);
+        zcm_destroy(sub);
+        zcm_destroy(pub);
+    }
+
+    void testOnlySubscribedChannelsAreInterned()
+    {
+        std::string url = "udp://127.0.0.1:" + std::to_string(STATS_SUB_PORT) + ":" +
+                          std::to_string(STATS_SUB_PORT + 1);
+        zcm_t *zcm = zcm_create(url.c_str());
+        TSM_ASSERT("Failed to create zcm", zcm);
+        if (!zcm) return;
+
+        StatsReceived r;
+        TS_ASSERT(zcm_subscribe(zcm, "STATS_WANTED.*", stats_handler, &r));
+        zcm_start(zcm);
+
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        TS_ASSERT(fd >= 0);
+        statsSendShort(fd, 0, "STATS_UNWANTED");
+        statsSendShort(fd, 1, "STATS_WANTED_1");
+        for (int i = 0; i < 200; ++i) {
+            {
+                std::unique_lock<std::mutex> lk(r.mut);
+                if (!r.msgs.empty()) break;
+            }
+            usleep(5000);
+        }
+        zcm_stop(zcm);
+        close(fd);
+
+        TS_ASSERT_EQUALS(r.msgs.size(), 1);
+        TS_ASSERT_DIFFERS(zcm::ChannelIntern::find("STATS_WANTED_1"), zcm::ChannelIntern::NONE);
+        TS_ASSERT_EQUALS(zcm::ChannelIntern::find("STATS_UNWANTED"), zcm::ChannelIntern::NONE);
+
+        zcm_destroy(zcm);
+    }
+
+    void testPublishedStats()
+    {
+        std::string url = "udp://127.0.0.1:" + std::to_string(STATS_SUB_PORT + 2) + ":" +
+                          std::to_string(STATS_SUB_PORT + 2) +
+                          "?stats_period=20&stats_channel=MY_STATS";
+        zcm_t *zcm = zcm_create(url.c_str());
+        TSM_ASSERT("Failed to create zcm", zcm);
+        if (!zcm) return;
+
+        StatsReceived r;
+        TS_ASSERT(zcm_subscribe(zcm, "MY_STATS", stats_handler, &r));
+        zcm_start(zcm);
+        for (int i = 0; i < 200; ++i) {
+            {
+                std::unique_lock<std::mutex> lk(r.mut);
+                if (r.msgs.size() >= 2) break;
+            }
+            usleep(5000);
+        }
+        zcm_stop(zcm);
+
+        TS_ASSERT_LESS_THAN_EQUALS((size_t) 2, r.msgs.size());
+        if (r.msgs.size() >= 2) {
+            TS_ASSERT_EQUALS(r.msgs[0].find("host="), 0);
+            // The first report went out before it came back
+            TS_ASSERT_DIFFERS(r.msgs[1].find(" received=1 lost=0 "), std::string::npos);
+        }
+
+        zcm_destroy(zcm);
+
+        zcm_t *bad = nullptr;
+        std::string badUrl = "udp://127.0.0.1:7691:7691?stats_period=1s";
+        TS_ASSERT_DIFFERS(zcm_try_create(&bad, badUrl.c_str()), ZCM_EOK);
+    }
+};
+
+#endif // UDPSTATSTEST_HPP
@@ -90,6 +90,9 @@ struct Args
     vector<int> Adec;
     vector<int> Bdec;
 
+    vector<bool> Alatest;
+    vector<bool> Blatest;
+
     string Aurl = "";
     string Burl = "";
 
@@ -106,7 +109,7 @@ struct Args
     bool parse(int argc, char *argv[])
     {
         // set some defaults
-        const char *optstring = "hA:B:a:b:D:p:d";
+        const char *optstring = "hA:B:a:b:D:lp:d";
         struct option long_opts[] = {
             { "help",              no_argument, 0,  'h' },
             { "A-prefix",    required_argument, 0,   0  },
@@ -118,6 +121,7 @@ struct Args
             { "A-watchdog",  required_argument, 0,   0  },
             { "B-watchdog",  required_argument, 0,   0  },
             { "decimation",  required_argument, 0,  'D' },
+            { "latest",            no_argument, 0,  'l' },
             { "plugin-path", required_argument, 0,  'p' },
             { "debug",             no_argument, 0,  'd' },
             { 0, 0, 0, 0 }
@@ -125,20 +129,25 @@ struct Args
 
         int c;
         vector<int> *currDec = nullptr;
+        vector<bool> *currLatest = nullptr;
         int option_index;
         while ((c = getopt_long(argc, argv, optstring, long_opts, &option_index)) >= 0) {
             switch (c) {
-                case 'A': currDec = nullptr; Aurl = optarg; break;
-                case 'B': currDec = nullptr; Burl = optarg; break;
+                case 'A': currDec = nullptr; currLatest = nullptr; Aurl = optarg; break;
+                case 'B': currDec = nullptr; currLatest = nullptr; Burl = optarg; break;
                 case 'a':
                     Achannels.push_back(optarg);
                     Adec.push_back(0);
+                    Alatest.push_back(false);
                     currDec = &Adec;
+                    currLatest = &Alatest;
                     break;
                 case 'b':
                     Bchannels.push_back(optarg);
                     Bdec.push_back(0);
+                    Blatest.push_back(false);
                     currDec = &Bdec;
+                    currLatest = &Blatest;
                     break;
                 case 'D':
                     ZCM_ASSERT(currDec != nullptr &&
@@ -146,6 +155,12 @@ struct Args
                     currDec->back() = atoi(optarg);
                     currDec = nullptr;
                     break;
+                case 'l':
+                    ZCM_ASSERT(currLatest != nullptr &&
+                               "Latest must follow a channel");
+                    currLatest->back() = true;
+                    currLatest = nullptr;
+                    break;
                 case 'p':
                     plugin_path = string(optarg);
                     break;
@@ -155,9 +170,11 @@ struct Args
                 case 0:
                     if (string(long_opts[option_index].name) == "A-prefix") {
                         currDec = nullptr;
+                        currLatest = nullptr;
                         Aprefix = optarg;
                     } else if (string(long_opts[option_index].name) == "B-prefix") {
                         currDec = nullptr;
+                        currLatest = nullptr;
                         Bprefix = optarg;
                     } else if (string(long_opts[option_index].name) == "A-watchdog") {
                         Awatchdog = atol(optarg);
@@ -219,6 +236,10 @@ struct Args
              << "                             Ex: zcm-bridge -A ipc -B udpm://239.255.76.67:7667?ttl=0 -b EXAMPLE -d 2" << endl
              << "                             This example would result in the message on EXAMPLE being rebroadcast on" << endl
              << "                             the A url every third message." << endl
+             << "  -l, --latest               Only bridge the latest message of the preceeding A-channel or" << endl
+             << "                             B-channel. Messages that arrive while the previous one is still" << endl
+             << "                             being republished replace each other instead of queueing up." << endl
+             << "                             Ex: zcm-bridge -A ipc -B udpm://239.255.76.67:7667?ttl=0 -b EXAMPLE -l" << endl
              << "  -p, --plugin-path=path     Path to shared library containing transcoder plugins" << endl
              << "" << endl << endl;
     }
@@ -371,7 +392,8 @@ struct Bridge
             for (size_t i = 0; i < args.Achannels.size(); i++) {
                 infoA.emplace_back(zcmB, args.Bprefix, args.Adec.at(i),
                                    wd.get(), &Watchdog::feedA);
-                zcmA->subscribe(args.Achannels.at(i), &handler, &infoA.back());
+                zcmA->subscribe(args.Achannels.at(i), &handler, &infoA.back(),
+                                args.Alatest.at(i) ? ZCM_SUB_CONFLATE : 0);
             }
         }
 
@@ -381,7 +403,8 @@ struct Bridge
             for (size_t i = 0; i < args.Bchannels.size(); i++) {
                 infoB.emplace_back(zcmA, args.Aprefix, args.Bdec.at(i),
                                    wd.get(), &Watchdog::feedB);
-                zcmB->subscribe(args.Bchannels.at(i), &handler, &infoB.back());
+                zcmB->subscribe(args.Bchannels.at(i), &handler, &infoB.back(),
+                                args.Blatest.at(i) ? ZCM_SUB_CONFLATE : 0);
             }
         }
 
@@ -3,12 +3,22 @@
 #include "zcm/blocking.h"
 #include "zcm/transport.h"
 #include "zcm/zcm_coretypes.h"
-#include "zcm/util/threadsafe_queue.hpp"
+#include "zcm/util/channel_intern.hpp"
+#include "zcm/util/channel_matcher.hpp"
+#include "zcm/util/channel_stats.hpp"
+#include "zcm/util/event_fd.hpp"
+#include "zcm/util/msg_pool.hpp"
+#include "zcm/util/priority_lanes.hpp"
+#include "zcm/util/rcu.hpp"
+#include "zcm/util/spsc_queue.hpp"
+#include "zcm/util/strand_pool.hpp"
+#include "zcm/util/thread_sched.hpp"
 #include "zcm/util/topology.hpp"
 
 #include "util/TimeUtil.hpp"
 #include "util/debug.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <utility>
@@ -18,12 +28,20 @@
 #include <string>
 #include <iostream>
 #include <thread>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
-#include <regex>
+#include <memory>
+#include <cerrno>
+#include <sys/mman.h>
 using namespace std;
+using zcm::ChannelIntern;
 
 #define RECV_TIMEOUT 100
+// Most messages moved between a queue and the transport in a single call
+#define SEND_BATCH 16
+#define RECV_BATCH 16
 
 // Define a macro to set thread names. The function call is
 // different for some operating systems
@@ -39,29 +57,245 @@ using namespace std;
     #define SET_THREAD_NAME(name)
 #endif
 
+#define NUM_THREAD_KINDS (ZCM_THREAD_DISPATCH + 1)
+// Indexed by zcm_thread_kind, used for the ZCM_<THREAD>_CPUS and ZCM_<THREAD>_SCHED
+// environment variables
+static const char* const THREAD_ENV_NAMES[NUM_THREAD_KINDS] = {
+    "SENDER", "RECEIVER", "HANDLER", "DISPATCH"
+};
+
+// The latest undelivered message of a channel whose subscriptions conflate. While a message
+// is pending, recvQueue (or the dispatch pool) holds a single marker Msg pointing here and
+// newer messages overwrite the pending one instead of being queued. The payload buffers
+// are reused, so this only allocates when a message is bigger than any before it
+struct ConflateSlot
+{
+    uint32_t channelId;
+    const char* channel; // Interned
+
+    mutex mut;
+    bool pending = false;
+    uint64_t utime = 0;
+    vector<uint8_t> buf;
+
+    // Only used by whoever takes the pending message, which is one thread at a time
+    vector<uint8_t> takenBuf;
+
+    ConflateSlot(uint32_t channelId)
+        : channelId(channelId), channel(ChannelIntern::name(channelId)) {}
+
+    // Returns true if no message was pending, in which case a marker must be queued
+    bool put(const zcm_msg_t* msg)
+    {
+        unique_lock<mutex> lk(mut);
+        bool wasPending = pending;
+        pending = true;
+        utime = msg->utime;
+        buf.assign(msg->buf, msg->buf + msg->len);
+        return !wasPending;
+    }
+
+    // Moves the pending message into out, which stays valid until the next take()
+    bool take(zcm_msg_t* out)
+    {
+        unique_lock<mutex> lk(mut);
+        if (!pending) return false;
+        pending = false;
+        takenBuf.swap(buf);
+        out->utime = utime;
+        out->channel = channel;
+        out->channel_id = channelId;
+        out->len = takenBuf.size();
+        out->buf = takenBuf.data();
+        return true;
+    }
+
+    // For a marker that is thrown away without being taken
+    void drop()
+    {
+        unique_lock<mutex> lk(mut);
+        pending = false;
+    }
+};
+
+// The unsent messages of a channel published with ZCM_BACKPRESSURE_DROP_OLDEST or
+// ZCM_BACKPRESSURE_COALESCE. They wait here instead of in sendQueue, which only holds a
+// single marker Msg for the whole backlog, so that a full backlog can always make room by
+// dropping its oldest message. The send thread takes the whole backlog when it reaches the
+// marker. Like ConflateSlot, the payload buffers are reused
+struct SendBacklog
+{
+    struct Pending
+    {
+        uint64_t utime;
+        vector<uint8_t> buf;
+    };
+
+    uint32_t channelId;
+    const char* channel; // Interned
+
+    mutex mut;
+    vector<Pending> ring;
+    size_t head = 0;
+    size_t count = 0;
+    // Set while the marker is in sendQueue (or waiting for room, see strandedBacklogs)
+    bool queued = false;
+
+    // Only used by whoever takes the backlog, which is one thread at a time. The messages
+    // of the last take() point into it, so only take() may resize it
+    vector<Pending> taken;
+
+    SendBacklog(uint32_t channelId, size_t depth)
+        : channelId(channelId), channel(ChannelIntern::name(channelId)),
+          ring(depth), taken(depth) {}
+
+    // Keeps the newest messages if the backlog shrinks. Returns the number dropped. The
+    // next take() catches up with the new depth
+    size_t setDepth(size_t depth)
+    {
+        unique_lock<mutex> lk(mut);
+        size_t dropped = 0;
+        vector<Pending> next(depth);
+        while (count > depth) {
+            head = head + 1 == ring.size() ? 0 : head + 1;
+            --count;
+            ++dropped;
+        }
+        for (size_t i = 0; i < count; ++i)
+            next[i] = std::move(ring[(head + i) % ring.size()]);
+        ring.swap(next);
+        head = 0;
+        return dropped;
+    }
+
+    size_t depth()
+    {
+        return ring.size();
+    }
+
+    // Returns the number of messages dropped to make room. needsMarker is set if no
+    // marker is queued for the backlog, in which case the caller must queue one
+    size_t put(uint64_t utime, const uint8_t* data, size_t len, bool& needsMarker)
+    {
+        unique_lock<mutex> lk(mut);
+        size_t dropped = 0;
+        if (count == ring.size()) {
+            head = head + 1 == ring.size() ? 0 : head + 1;
+            --count;
+            dropped = 1;
+        }
+        Pending& p = ring[(head + count) % ring.size()];
+        p.utime = utime;
+        p.buf.assign(data, data + len);
+        ++count;
+        needsMarker = !queued;
+        queued = true;
+        return dropped;
+    }
+
+    // Moves the whole backlog to the end of out. The messages stay valid until the next
+    // take(). Returns the number of messages taken
+    size_t take(vector<zcm_msg_t>& out)
+    {
+        unique_lock<mutex> lk(mut);
+        queued = false;
+        if (taken.size() != ring.size()) taken.resize(ring.size());
+        for (size_t i = 0; i < count; ++i) {
+            Pending& p = taken[i];
+            std::swap(p, ring[(head + i) % ring.size()]);
+            zcm_msg_t msg;
+            msg.utime = p.utime;
+            msg.channel = channel;
+            msg.channel_id = channelId;
+            msg.len = p.buf.size();
+            msg.buf = p.buf.data();
+            out.push_back(msg);
+        }
+        size_t n = count;
+        head = 0;
+        count = 0;
+        return n;
+    }
+
+    // For a marker that is thrown away without being taken
+    void drop()
+    {
+        unique_lock<mutex> lk(mut);
+        queued = false;
+        head = 0;
+        count = 0;
+    }
+};
+
 // A C++ class that manages a zcm_msg_t*
+// The payload comes from a MsgPool and the channel is an interned id (msg.channel points at
+// its interned name), so constructing and destructing a Msg in steady state never touches
+// the heap or copies the channel
 struct Msg
 {
     zcm_msg_t msg;
+    MsgPool& pool;
+    size_t bufLen; // What msg.buf was allocated with, can be more than msg.len
+    // Set for markers, which have no payload of their own
+    ConflateSlot* slot = nullptr;
+    SendBacklog* backlog = nullptr;
 
     // NOTE: copy the provided data into this object
-    Msg(uint64_t utime, const char* channel, size_t len, const uint8_t* buf)
+    Msg(MsgPool& pool, uint64_t utime, uint32_t channelId, size_t len, const uint8_t* buf)
+        : pool(pool)
     {
         msg.utime = utime;
-        msg.channel = strdup(channel);
+        msg.channel = ChannelIntern::name(channelId);
+        msg.channel_id = channelId;
         msg.len = len;
-        msg.buf = (uint8_t*)malloc(len);
+        msg.buf = pool.alloc(len);
+        bufLen = len;
         memcpy(msg.buf, buf, len);
     }
 
-    Msg(zcm_msg_t* msg) : Msg(msg->utime, msg->channel, msg->len, msg->buf) {}
+    // NOTE: msg must already be interned
+    Msg(MsgPool& pool, zcm_msg_t* msg)
+        : Msg(pool, msg->utime, msg->channel_id, msg->len, msg->buf) {}
+
+    // NOTE: takes over the loaned buffer (which must come from pool) instead of copying
+    Msg(MsgPool& pool, uint64_t utime, uint32_t channelId, const zcm_loan_t* loan, size_t len)
+        : pool(pool)
+    {
+        msg.utime = utime;
+        msg.channel = ChannelIntern::name(channelId);
+        msg.channel_id = channelId;
+        msg.len = len;
+        msg.buf = loan->data;
+        bufLen = loan->len;
+    }
+
+    // A marker for the message pending in slot
+    Msg(MsgPool& pool, ConflateSlot* slot)
+        : pool(pool), bufLen(0), slot(slot)
+    {
+        msg.utime = 0;
+        msg.channel = slot->channel;
+        msg.channel_id = slot->channelId;
+        msg.len = 0;
+        msg.buf = nullptr;
+    }
+
+    // A marker for the messages in backlog
+    Msg(MsgPool& pool, SendBacklog* backlog)
+        : pool(pool), bufLen(0), backlog(backlog)
+    {
+        msg.utime = 0;
+        msg.channel = backlog->channel;
+        msg.channel_id = backlog->channelId;
+        msg.len = 0;
+        msg.buf = nullptr;
+    }
 
     ~Msg()
     {
-        if (msg.channel)
-            free((void*)msg.channel);
-        if (msg.buf)
-            free((void*)msg.buf);
+        if (slot) slot->drop();
+        if (backlog) backlog->drop();
+        pool.free(msg.buf, bufLen);
         memset(&msg, 0, sizeof(msg));
     }
 
@@ -78,6 +312,44 @@ struct Msg
     Msg& operator=(Msg&& other) = delete;
 };
 
+// A message handed from recvQueue to the dispatch pool. It takes
+// over the payload buffer of the Msg it was created from
+struct DispatchJob
+{
+    uint64_t utime;
+    size_t len;
+    uint8_t* buf;
+    uint32_t channelId;
+    ConflateSlot* slot; // Set for conflation markers, see ConflateSlot
+};
+
+// The blocking core's subscriptions. Dispatch strands are per channel, so a regex
+// subscription that matches channels on several strands would otherwise see its callback
+// run on more than one dispatch thread at once
+struct Subscription : public zcm_sub_t
+{
+    mutex dispatchMutex;
+    // Set by unsubscribe(). Dispatches from an older snapshot of the table skip the
+    // subscription from then on
+    atomic<bool> removed {false};
+};
+
+// The interned id of msg's channel. The id the transport handed back is taken as is if it is
+// one (see "Channel ids" in transport.h), otherwise the channel is looked up by name. Either
+// way, msg ends up pointing at the interned name. Unless intern is set, channels that were
+// never interned are not added to the table. Returns ChannelIntern::NONE if the channel has
+// no id
+static uint32_t internChannel(zcm_msg_t* msg, bool intern)
+{
+    uint32_t id = msg->channel_id;
+    if (id != ChannelIntern::NONE && ChannelIntern::name(id) == msg->channel) return id;
+    id = intern ? ChannelIntern::id(msg->channel) : ChannelIntern::find(msg->channel);
+    if (id == ChannelIntern::NONE) return id;
+    msg->channel = ChannelIntern::name(id);
+    msg->channel_id = id;
+    return id;
+}
+
 static bool isRegexChannel(const string& channel)
 {
     // These chars are considered regex
@@ -96,10 +368,35 @@ static bool isRegexChannel(const string& channel)
 struct zcm_blocking
 {
   private:
-    // XXX If we change this to a linked list implementation, we can probably
-    //     support subscribing/unsubscribing from within subscription callback handlers
     using SubList = vector<zcm_sub_t*>;
 
+    // An immutable snapshot of all subscriptions. subscribe() and unsubscribe() build a
+    // new table and swap it in while the recv thread and dispatch read it without locks,
+    // so callbacks may subscribe and unsubscribe freely
+    struct SubTable
+    {
+        // Indexed by interned channel id
+        vector<SubList> subs;
+        unordered_map<string, SubList> subsRegex;
+        // Compiled form of subsRegex
+        ChannelMatcher<SubList> regexMatcher;
+        // Subscriptions with ZCM_SUB_* flags. Messages are only checked against the flags
+        // of their subscriptions while there are any
+        size_t numFlagged = 0;
+
+        SubTable() {}
+
+        SubTable(const SubTable& other) :
+            subs(other.subs), subsRegex(other.subsRegex), regexMatcher(other.regexMatcher),
+            numFlagged(other.numFlagged)
+        {
+            // Point the matcher at our own copies of the lists
+            regexMatcher.remap([&](const string& pattern, SubList*) {
+                return &subsRegex.at(pattern);
+            });
+        }
+    };
+
   public:
     zcm_blocking(zcm_t* z, zcm_trans_t* zt_);
     ~zcm_blocking();
@@ -109,58 +406,203 @@ struct zcm_blocking
     int stop(bool block);
     int handle();
     int handle_nonblock();
+    int handleNonblockBudget(uint32_t maxMsgs, uint32_t maxMicros);
+    int getFd();
+    int setNonblockBatch(uint32_t maxMsgs);
 
 
     void pause();
     void resume();
 
     int publish(const string& channel, const uint8_t* data, uint32_t len);
-    zcm_sub_t* subscribe(const string& channel, zcm_msg_handler_t cb, void* usr, bool block);
+    int publishLoan(const string& channel, uint32_t len, zcm_loan_t* loan);
+    int publishCommit(zcm_loan_t* loan, uint32_t len);
+    void publishCancel(zcm_loan_t* loan);
+    zcm_sub_t* subscribe(const string& channel, zcm_msg_handler_t cb, void* usr,
+                         uint32_t flags, bool block);
     int unsubscribe(zcm_sub_t* sub, bool block);
     int flush(bool block);
 
     int setQueueSize(uint32_t numMsgs, bool block);
+    int setPriorityClass(zcm_priority prio, uint32_t capacity, uint32_t weight);
+    int setPriorityMode(zcm_priority_mode mode);
+    int setDispatchThreads(uint32_t numThreads);
+    int setDispatchGroup(const string& channel, const string& group);
+    int setPublishMode(const char* channel, zcm_publish_mode mode);
+    int setBackpressure(const char* channel, zcm_backpressure policy, uint32_t param);
+    int setRecvStrategy(zcm_recv_strategy strategy, uint32_t spinMicros);
+    int setThreadSched(zcm_thread_kind thread, const char* cpus,
+                       zcm_sched_policy policy, int priority);
+    int lockMemory();
+    int getStats(zcm_stats_t* stats, zcm_channel_stats_t* channels, uint32_t maxChannels);
+    int getTransportStats(zcm_transport_stats_t* stats);
 
     int writeTopology(string name);
 
   private:
     void sendThreadFunc();
     void recvThreadFunc();
+    size_t recvWanted(zcm_msg_t* msgs, bool* conflate, size_t* lane,
+                      chrono::steady_clock::time_point& lastRecv);
     void hndlThreadFunc();
 
-    bool startRecvThread();
+    void loadThreadSchedEnv();
+    void applyThreadSched(zcm_thread_kind thread, const char* name);
 
-    void dispatchMsg(zcm_msg_t* msg);
+    bool startRecvThread();
+    void startSendThread();
+    bool publishesInline(uint32_t channelId);
+    struct Backpressure;
+    Backpressure backpressureOf(uint32_t channelId);
+    int publishToBacklog(uint32_t channelId, const uint8_t* data, uint32_t len,
+                         size_t depth);
+    size_t requeueStranded();
+    bool sendInline(uint32_t channelId, const uint8_t* data, uint32_t len, int& ret);
+    void trackSent(const char* channel, const uint8_t* data, uint32_t len);
+    void countQueuedPublish(uint32_t channelId, bool success, bool isDrop);
+
+    struct DispatchCtx;
+    void dispatchMsg(zcm_msg_t* msg, DispatchCtx& ctx);
+    bool dispatchToPool(Msg* m, bool ignorePaused);
+    static void combineFlags(const SubList* exact, const vector<SubList*>& regexMatches,
+                             uint32_t& all, uint32_t& any);
+    template<class F> int withRecvQuiesced(bool block, F f);
+    ConflateSlot* conflateSlot(uint32_t channelId);
+    void runDispatchJob(DispatchJob& job, size_t worker);
+    void setPoolHeld();
     bool dispatchOneMessage(bool returnIfPaused);
-    bool sendOneMessage(bool returnIfPaused);
+    bool isDispatchThread() const;
+    size_t sendMessages(bool returnIfPaused, size_t maxMsgs, size_t* requeued = nullptr);
 
-    // Mutexes protecting the ...OneMessage() functions
+    // Mutexes protecting the ...OneMessage() and sendMessages() functions
     mutex dispOneMutex;
     mutex sendOneMutex;
 
-    bool deleteSubEntry(zcm_sub_t* sub, size_t nentriesleft);
-    bool deleteFromSubList(SubList& slist, zcm_sub_t* sub);
+    static bool removeFromSubList(SubList& slist, zcm_sub_t* sub);
 
     zcm_t* z;
     zcm_trans_t* zt;
-    unordered_map<string, SubList> subs;
-    unordered_map<string, SubList> subsRegex;
     size_t mtu;
 
+    // Message counters (see zcm_get_stats()). Every writer is only used under the mutex
+    // or from the thread noted next to it, the dispatching threads have their own writers
+    typedef ChannelStats<ZCM_STATS_HIST_BUCKETS> MsgStats;
+    MsgStats msgStats;
+    MsgStats::Writer queuedPubStats {msgStats}; // sendPushMutex
+    MsgStats::Writer inlinePubStats {msgStats}; // transSendMutex
+    MsgStats::Writer recvStats {msgStats};      // recv thread
+    atomic<uint32_t> sendQueueHighWater {0};    // sendPushMutex
+    atomic<uint32_t> recvLaneHighWater[ZCM_NUM_PRIORITIES] {}; // recvPushMutex
+
+    RcuPtr<SubTable> subTable {new SubTable()};
+    // Serializes subscribe() and unsubscribe(), readers never take it
+    mutex subWriteMutex;
+
+    // Everything one dispatching thread needs to read the subscriptions
+    struct DispatchCtx
+    {
+        RcuPtr<SubTable>::Reader subReader;
+        ChannelMatcher<SubList>::Cache matchCache;
+        MsgStats::Writer stats;
+        // The thread inside dispatchMsg() with this context, if any
+        atomic<thread::id> dispatchingThread {thread::id()};
+        DispatchCtx(RcuPtr<SubTable>& subTable, MsgStats& msgStats) :
+            subReader(subTable), stats(msgStats) {}
+    };
+
+    // The recv thread and every dispatching thread read the subscriptions through their
+    // own reader and match cache. dispCtx is protected by dispOneMutex
+    RcuPtr<SubTable>::Reader recvSubReader {subTable};
+    ChannelMatcher<SubList>::Cache recvMatchCache;
+    DispatchCtx dispCtx {subTable, msgStats};
+
     mutex receivedTopologyMutex;
     zcm::TopologyMap receivedTopologyMap;
     mutex sentTopologyMutex;
     zcm::TopologyMap sentTopologyMap;
 
-    // These 2 mutexes used to implement a read-write style infrastructure on the subscription
-    // lists. Both the recvThread and the message dispatch may read the subscriptions
-    // concurrently, but subscribe() and unsubscribe() need both locks in order to write to it.
-    mutex subDispMutex;
-    mutex subRecvMutex;
-
+    // The queues are single-producer/single-consumer. The consumer sides are serialized by
+    // the ...OneMutex mutexes above, the producer sides are serialized by these mutexes
+    // (publish() may be called from any number of threads)
+    mutex sendPushMutex;
+    mutex recvPushMutex;
+
+    // Serializes every call into the transport's send methods, which only have to support
+    // one caller at a time. Messages are only popped off sendQueue while holding this, so
+    // an empty sendQueue means that everything published so far has been sent
+    mutex transSendMutex;
+
+    // Publish mode of every channel without one of its own, and the channels that have
+    // their own by id (protected by publishModeMutex, but only looked at while non-empty)
+    atomic<bool> publishInlineDefault {false};
+    unordered_map<uint32_t, bool> publishInlineChannels;
+    atomic<bool> hasPublishModeChannels {false};
+    mutex publishModeMutex;
+
+    // Backpressure policy of every channel without one of its own, and the channels that
+    // have their own by id (protected by backpressureMutex, but only looked at while any policy
+    // other than the default drop-newest was set)
+    struct Backpressure
+    {
+        zcm_backpressure policy;
+        uint32_t param;
+    };
+    Backpressure backpressureDefault {ZCM_BACKPRESSURE_DROP_NEWEST, 0};
+    unordered_map<uint32_t, Backpressure> backpressureChannels;
+    atomic<bool> hasBackpressure {false};
+    mutex backpressureMutex;
+
+    // How the recv thread waits on the transport (see setRecvStrategy()). Only changed
+    // while recvMode == RECV_MODE_NONE
+    zcm_recv_strategy recvStrategy {ZCM_RECV_BLOCK};
+    chrono::microseconds recvSpinTime {0};
+
+    // Placement and scheduling of each kind of thread. Threads apply their settings when
+    // they start, so changes only affect threads started afterwards
+    ThreadSched threadScheds[NUM_THREAD_KINDS];
+    mutex threadSchedMutex;
+
+    // One slot per channel that ever conflated, indexed by id. Only touched by the recv
+    // thread, but the slots must outlive the queues and the dispatch pool that hold markers
+    // pointing at them
+    vector<unique_ptr<ConflateSlot>> conflateSlots;
+
+    // One backlog per channel that ever dropped oldest or coalesced, and the backlogs whose
+    // marker did not fit into sendQueue (use sendPushMutex). Backlogs must outlive sendQueue
+    unordered_map<uint32_t, unique_ptr<SendBacklog>> sendBacklogs;
+    vector<SendBacklog*> strandedBacklogs;
+    atomic<bool> hasStranded {false};
+    // What the send thread hands to the transport (use sendOneMutex)
+    vector<zcm_msg_t> sendBatch;
+
+    // The payload pools must outlive the queues that hold Msgs pointing into them
     static constexpr size_t QUEUE_SIZE = 16;
-    ThreadsafeQueue<Msg> sendQueue {QUEUE_SIZE};
-    ThreadsafeQueue<Msg> recvQueue {QUEUE_SIZE};
+    MsgPool sendPool {QUEUE_SIZE};
+    MsgPool recvPool {QUEUE_SIZE};
+    SpscQueue<Msg> sendQueue {QUEUE_SIZE};
+    // Received messages wait for dispatch in one lane per zcm_priority
+    PriorityLanes<Msg> recvQueue {ZCM_NUM_PRIORITIES, QUEUE_SIZE};
+    // Whether the capacity of a lane was set by setPriorityClass(), otherwise it follows
+    // setQueueSize() (use dispOneMutex)
+    bool laneSized[ZCM_NUM_PRIORITIES] = {};
+    // Readable while recvQueue has messages, once getFd() opened it. Raised by the recv
+    // thread after pushing, lowered by whichever thread pops the last message
+    EventFd recvReady;
+    // Most messages a single handle_nonblock() dispatches
+    atomic<uint32_t> nonblockBatch {1};
+
+    // Only set when dispatching from a pool of threads (see setDispatchThreads()).
+    // Every message popped off recvQueue is then handed to the pool and its payload
+    // is freed by whichever thread ran the job, so all frees into recvPool have to
+    // hold recvFreeMutex
+    unique_ptr<StrandPool<DispatchJob>> dispPool;
+    vector<unique_ptr<DispatchCtx>> dispPoolCtxs;
+    mutex recvFreeMutex;
+
+    // channel -> group, applied to every dispatch pool. dispPool may only be replaced
+    // while holding this mutex
+    unordered_map<string, string> dispGroups;
+    mutex dispGroupMutex;
 
     typedef enum {
         RECV_MODE_NONE = 0,
@@ -198,15 +640,30 @@ struct zcm_blocking
     // Flag and condition variables used to pause the sendThread (use sendStateMutex)
     // and hndlThread (use hndlStateMutex)
     bool               paused {false};
+    // Whether dispatch is stopped, which holds the dispatch pool just like pausing (use
+    // hndlStateMutex)
+    bool               dispStopped {true};
     condition_variable sendPauseCond;
     condition_variable hndlPauseCond;
 };
 
-zcm_blocking_t::zcm_blocking(zcm_t* z, zcm_trans_t* zt_)
+zcm_blocking_t::zcm_blocking(zcm_t* z_, zcm_trans_t* zt_)
 {
-    ZCM_ASSERT(z->type == ZCM_BLOCKING);
+    ZCM_ASSERT(z_->type == ZCM_BLOCKING);
+    z = z_;
     zt = zt_;
     mtu = zcm_trans_get_mtu(zt);
+
+    sendBatch.reserve(SEND_BATCH);
+
+    recvQueue.setWeight(ZCM_PRIORITY_HIGH, 4);
+    recvQueue.setWeight(ZCM_PRIORITY_NORMAL, 2);
+    recvQueue.setWeight(ZCM_PRIORITY_LOW, 1);
+
+    loadThreadSchedEnv();
+    // Memory locking is process wide, only do it for the first zcm
+    static once_flag envLockMemory;
+    call_once(envLockMemory, [this]{ if (getenv("ZCM_MLOCKALL")) lockMemory(); });
 }
 
 zcm_blocking_t::~zcm_blocking()
@@ -214,19 +671,29 @@ zcm_blocking_t::~zcm_blocking()
     // Shutdown all threads
     stop(true);
 
+    // Drop anything that was never dispatched
+    if (dispPool) {
+        dispPool->discard([&](DispatchJob& job){
+            if (job.slot) job.slot->drop();
+            recvPool.free(job.buf, job.len);
+        });
+        dispPool.reset();
+    }
+
     // Destroy the transport
     zcm_trans_destroy(zt);
 
-    // Need to delete all subs
-    for (auto& it : subs) {
-        for (auto& sub : it.second) {
-            delete sub;
+    // Need to delete all subs (the ones that were unsubscribed
+    // are deleted by subTable once it reclaims their tables)
+    const SubTable* table = subTable.get();
+    for (auto& slist : table->subs) {
+        for (auto& sub : slist) {
+            delete static_cast<Subscription*>(sub);
         }
     }
-    for (auto& it : subsRegex) {
+    for (auto& it : table->subsRegex) {
         for (auto& sub : it.second) {
-            delete (regex*) sub->regexobj;
-            delete sub;
+            delete static_cast<Subscription*>(sub);
         }
     }
 }
@@ -245,6 +712,8 @@ void zcm_blocking_t::run()
         unique_lock<mutex> lk2(hndlStateMutex);
         lk1.unlock();
         hndlThreadState = THREAD_STATE_RUNNING;
+        dispStopped = false;
+        setPoolHeld();
         recvQueue.enable();
     }
     hndlThreadFunc();
@@ -268,6 +737,8 @@ void zcm_blocking_t::start()
     lk1.unlock();
     // Start the hndl thread
     hndlThreadState = THREAD_STATE_RUNNING;
+    dispStopped = false;
+    setPoolHeld();
     recvQueue.enable();
     hndlThread = thread{&zcm_blocking::hndlThreadFunc, this};
 }
@@ -306,6 +777,14 @@ int zcm_blocking_t::stop(bool block)
         }
     }
 
+    // Hold the dispatch pool and wait for the callbacks it is still running
+    {
+        unique_lock<mutex> lk2(hndlStateMutex);
+        dispStopped = true;
+        setPoolHeld();
+    }
+    if (block && dispPool) dispPool->waitRunning();
+
     // Shutdown send thread
     {
         unique_lock<mutex> lk2(sendStateMutex);
@@ -379,6 +858,11 @@ bool zcm_blocking_t::startRecvThread()
         recvThreadState = THREAD_STATE_RUNNING;
         recvQueue.enable();
         recvThread = thread{&zcm_blocking::recvThreadFunc, this};
+        lk2.unlock();
+
+        unique_lock<mutex> lk3(hndlStateMutex);
+        dispStopped = false;
+        setPoolHeld();
     }
 
     return true;
@@ -394,11 +878,50 @@ int zcm_blocking_t::handle()
 
 int zcm_blocking_t::handle_nonblock()
 {
+    int n = handleNonblockBudget(nonblockBatch, 0);
+    if (n < 0) return n;
+    return n > 0 ? ZCM_EOK : ZCM_EAGAIN;
+}
+
+int zcm_blocking_t::handleNonblockBudget(uint32_t maxMsgs, uint32_t maxMicros)
+{
+    if (maxMsgs == 0) return ZCM_EINVALID;
+    if (maxMsgs > INT32_MAX) maxMsgs = INT32_MAX;
     if (!startRecvThread()) return ZCM_EINVALID;
 
     unique_lock<mutex> lk(dispOneMutex);
-    if (!recvQueue.hasMessage()) return ZCM_EAGAIN;
-    return dispatchOneMessage(true) ? ZCM_EOK : ZCM_EAGAIN;
+    // Only drain what is already queued, never wait for more
+    auto deadline = chrono::steady_clock::now() + chrono::microseconds(maxMicros);
+    uint32_t n = 0;
+    while (n < maxMsgs && recvQueue.hasMessage() && dispatchOneMessage(true)) {
+        ++n;
+        if (maxMicros != 0 && chrono::steady_clock::now() >= deadline) break;
+    }
+    return (int) n;
+}
+
+int zcm_blocking_t::getFd()
+{
+    // Nothing would ever make the fd readable without the recv thread
+    if (!startRecvThread()) return ZCM_EINVALID;
+
+    unique_lock<mutex> lk(dispOneMutex);
+    if (!recvReady.isOpen()) {
+        if (!recvReady.open()) {
+            ZCM_DEBUG("Err: failed to create the event fd: %s", strerror(errno));
+            return ZCM_EUNKNOWN;
+        }
+        // Anything queued before the fd was open was never signaled
+        if (recvQueue.hasMessage()) recvReady.raise();
+    }
+    return recvReady.fd();
+}
+
+int zcm_blocking_t::setNonblockBatch(uint32_t maxMsgs)
+{
+    if (maxMsgs == 0) return ZCM_EINVALID;
+    nonblockBatch = maxMsgs;
+    return ZCM_EOK;
 }
 
 void zcm_blocking_t::pause()
@@ -406,6 +929,7 @@ void zcm_blocking_t::pause()
     unique_lock<mutex> lk1(sendStateMutex);
     unique_lock<mutex> lk2(hndlStateMutex);
     paused = true;
+    setPoolHeld();
 }
 
 void zcm_blocking_t::resume()
@@ -413,6 +937,7 @@ void zcm_blocking_t::resume()
     unique_lock<mutex> lk1(sendStateMutex);
     unique_lock<mutex> lk2(hndlStateMutex);
     paused = false;
+    setPoolHeld();
     // Intentionally unlocking in this order
     lk2.unlock();
     lk1.unlock();
@@ -425,22 +950,238 @@ int zcm_blocking_t::publish(const string& channel, const uint8_t* data, uint32_t
     // Check the validity of the request
     if (len > mtu) return ZCM_EINVALID;
     if (channel.size() > ZCM_CHANNEL_MAXLEN) return ZCM_EINVALID;
+    uint32_t id = ChannelIntern::id(channel.c_str());
+    if (id == ChannelIntern::NONE) return ZCM_EMEMORY;
 
-    // If needed: spawn the send thread
-    {
-        unique_lock<mutex> lk(sendStateMutex);
-        if (sendThreadState == THREAD_STATE_STOPPED) {
-            sendThreadState = THREAD_STATE_RUNNING;
-            sendThread = thread{&zcm_blocking::sendThreadFunc, this};
+    startSendThread();
+
+    int ret;
+    if (publishesInline(id) && sendInline(id, data, len, ret)) {
+        trackSent(channel.c_str(), data, len);
+        return ret;
+    }
+
+    Backpressure bp = backpressureDefault;
+    if (hasBackpressure) {
+        bp = backpressureOf(id);
+        if (bp.policy == ZCM_BACKPRESSURE_DROP_OLDEST || bp.policy == ZCM_BACKPRESSURE_COALESCE) {
+            size_t depth = bp.policy == ZCM_BACKPRESSURE_COALESCE ? 1 : bp.param;
+            ret = publishToBacklog(id, data, len, depth);
+            trackSent(channel.c_str(), data, len);
+            return ret;
         }
     }
 
-    bool success = sendQueue.pushIfRoom(TimeUtil::utime(), channel.c_str(), len, data);
+    bool success;
+    bool blocked = false;
+    auto deadline = chrono::steady_clock::now() + chrono::microseconds(bp.param);
+    while (true) {
+        {
+            unique_lock<mutex> lk(sendPushMutex);
+            success = sendQueue.pushIfRoom(sendPool, TimeUtil::utime(), id, len, data);
+            if (success || bp.policy != ZCM_BACKPRESSURE_BLOCK ||
+                chrono::steady_clock::now() >= deadline) {
+                countQueuedPublish(id, success, true);
+                break;
+            }
+            // Counted once per publish, however often it has to wait
+            if (!blocked) MsgStats::Counters::inc(queuedPubStats.get(id, channel.c_str()).blocked);
+            blocked = true;
+        }
+        sendQueue.waitForRoom(deadline - chrono::steady_clock::now());
+    }
     if (!success) {
         ZCM_DEBUG("sendQueue has no free space");
         return ZCM_EAGAIN;
     }
 
+    trackSent(channel.c_str(), data, len);
+
+    return ZCM_EOK;
+}
+
+zcm_blocking_t::Backpressure zcm_blocking_t::backpressureOf(uint32_t channelId)
+{
+    unique_lock<mutex> lk(backpressureMutex);
+    auto it = backpressureChannels.find(channelId);
+    if (it != backpressureChannels.end()) return it->second;
+    return backpressureDefault;
+}
+
+// Adds the message to the channel's backlog, which never fails
+int zcm_blocking_t::publishToBacklog(uint32_t channelId, const uint8_t* data,
+                                     uint32_t len, size_t depth)
+{
+    unique_lock<mutex> lk(sendPushMutex);
+    if (depth == 0) depth = sendQueue.getCapacity() - 1;
+
+    auto it = sendBacklogs.find(channelId);
+    if (it == sendBacklogs.end())
+        it = sendBacklogs.emplace(channelId, unique_ptr<SendBacklog>(
+                new SendBacklog(channelId, depth))).first;
+    SendBacklog* backlog = it->second.get();
+
+    auto& c = queuedPubStats.get(channelId, backlog->channel);
+    size_t dropped = 0;
+    if (backlog->depth() != depth) dropped += backlog->setDepth(depth);
+
+    bool needsMarker;
+    dropped += backlog->put(TimeUtil::utime(), data, len, needsMarker);
+    MsgStats::Counters::inc(c.published);
+    for (size_t i = 0; i < dropped; ++i) MsgStats::Counters::inc(c.dropped);
+
+    if (needsMarker) {
+        if (sendQueue.pushIfRoom(sendPool, backlog)) {
+            raiseHighWater(sendQueueHighWater, sendQueue.numMessages());
+        } else {
+            // The send thread queues the marker as soon as there is room
+            strandedBacklogs.push_back(backlog);
+            hasStranded = true;
+        }
+    }
+    return ZCM_EOK;
+}
+
+// Requires sendPushMutex. Returns the number of markers that were queued
+size_t zcm_blocking_t::requeueStranded()
+{
+    size_t n = 0;
+    while (n < strandedBacklogs.size() && sendQueue.pushIfRoom(sendPool, strandedBacklogs[n]))
+        ++n;
+    strandedBacklogs.erase(strandedBacklogs.begin(), strandedBacklogs.begin() + n);
+    hasStranded = !strandedBacklogs.empty();
+    return n;
+}
+
+bool zcm_blocking_t::publishesInline(uint32_t channelId)
+{
+    if (hasPublishModeChannels) {
+        unique_lock<mutex> lk(publishModeMutex);
+        auto it = publishInlineChannels.find(channelId);
+        if (it != publishInlineChannels.end()) return it->second;
+    }
+    return publishInlineDefault;
+}
+
+// Sends the message from the calling thread. Messages that are still queued (or any
+// message while publishing is paused) must not be overtaken, in which case this returns
+// false and the message has to be queued instead. Otherwise ret is set to the result
+bool zcm_blocking_t::sendInline(uint32_t channelId, const uint8_t* data, uint32_t len,
+                                int& ret)
+{
+    unique_lock<mutex> lk(transSendMutex);
+    if (sendQueue.hasMessage()) return false;
+    {
+        unique_lock<mutex> lk2(sendStateMutex);
+        if (paused) return false;
+    }
+
+    zcm_msg_t msg;
+    msg.utime = TimeUtil::utime();
+    msg.channel = ChannelIntern::name(channelId);
+    msg.channel_id = channelId;
+    msg.len = len;
+    msg.buf = (uint8_t*) data;
+    ret = zcm_trans_sendmsg(zt, msg);
+    if (ret != ZCM_EOK) ZCM_DEBUG("zcm_trans_sendmsg() returned error for inline publish");
+
+    auto& c = inlinePubStats.get(channelId, msg.channel);
+    MsgStats::Counters::inc(ret == ZCM_EOK ? c.published : c.dropped);
+    return true;
+}
+
+// Loaned buffers come straight out of sendPool, so that publishCommit() can hand them to
+// the send queue without copying the payload
+int zcm_blocking_t::publishLoan(const string& channel, uint32_t len, zcm_loan_t* loan)
+{
+    // Check the validity of the request
+    if (len > mtu) return ZCM_EINVALID;
+    if (channel.size() > ZCM_CHANNEL_MAXLEN) return ZCM_EINVALID;
+    // Interned now, so that publishCommit() only has to find it
+    if (ChannelIntern::id(channel.c_str()) == ChannelIntern::NONE) return ZCM_EMEMORY;
+
+    {
+        // Allocating from the pool is serialized with the producer side of sendQueue
+        unique_lock<mutex> lk(sendPushMutex);
+        loan->data = sendPool.alloc(len);
+    }
+    if (!loan->data) return ZCM_EMEMORY;
+    loan->len = len;
+    strncpy(loan->_channel, channel.c_str(), ZCM_CHANNEL_MAXLEN);
+    loan->_channel[ZCM_CHANNEL_MAXLEN] = '\0';
+    return ZCM_EOK;
+}
+
+int zcm_blocking_t::publishCommit(zcm_loan_t* loan, uint32_t len)
+{
+    if (!loan->data || len > loan->len) return ZCM_EINVALID;
+
+    startSendThread();
+
+    // Once the message is in the queue, the send thread may free it at any time
+    trackSent(loan->_channel, loan->data, len);
+
+    uint32_t id = ChannelIntern::find(loan->_channel);
+    if (id == ChannelIntern::NONE) return ZCM_EINVALID;
+
+    bool success;
+    {
+        unique_lock<mutex> lk(sendPushMutex);
+        success = sendQueue.pushIfRoom(sendPool, TimeUtil::utime(), id, loan, len);
+        // The caller keeps the loan and may retry, so this is not a drop
+        countQueuedPublish(id, success, false);
+    }
+    if (!success) {
+        ZCM_DEBUG("sendQueue has no free space");
+        return ZCM_EAGAIN;
+    }
+
+    loan->data = nullptr;
+    loan->len = 0;
+    return ZCM_EOK;
+}
+
+void zcm_blocking_t::publishCancel(zcm_loan_t* loan)
+{
+    if (!loan->data) return;
+
+    // Buffers go back into sendPool from the consumer side of sendQueue, so
+    // wake up the send thread and take its place (just like flush() does)
+    {
+        sendQueue.disable();
+        unique_lock<mutex> lk(sendOneMutex);
+        sendQueue.enable();
+        sendPool.free(loan->data, loan->len);
+    }
+    sendPauseCond.notify_all();
+
+    loan->data = nullptr;
+    loan->len = 0;
+}
+
+void zcm_blocking_t::startSendThread()
+{
+    unique_lock<mutex> lk(sendStateMutex);
+    if (sendThreadState == THREAD_STATE_STOPPED) {
+        sendThreadState = THREAD_STATE_RUNNING;
+        sendThread = thread{&zcm_blocking::sendThreadFunc, this};
+    }
+}
+
+// Requires sendPushMutex
+void zcm_blocking_t::countQueuedPublish(uint32_t channelId, bool success, bool isDrop)
+{
+    const char* channel = ChannelIntern::name(channelId);
+    if (success) {
+        MsgStats::Counters::inc(queuedPubStats.get(channelId, channel).published);
+        raiseHighWater(sendQueueHighWater, sendQueue.numMessages());
+    } else if (isDrop) {
+        MsgStats::Counters::inc(queuedPubStats.get(channelId, channel).dropped);
+    }
+}
+
+void zcm_blocking_t::trackSent(const char* channel, const uint8_t* data, uint32_t len)
+{
 #ifdef TRACK_TRAFFIC_TOPOLOGY
     int64_t hashBE = 0, hashLE = 0;
     if (__int64_t_decode_array(data, 0, len, &hashBE, 1) == 8 &&
@@ -451,26 +1192,38 @@ int zcm_blocking_t::publish(const string& channel, const uint8_t* data, uint32_t
         }
     }
 #endif
-
-    return ZCM_EOK;
 }
 
 // Note: We use a lock on subscribe() to make sure it can be
-// called concurrently. Without the lock, there is a race
-// on modifying and reading the 'subs' and 'subsRegex' containers
+// called concurrently. Readers of the subscription table never
+// take it, so this is safe to call from within a callback
 zcm_sub_t* zcm_blocking_t::subscribe(const string& channel,
                                      zcm_msg_handler_t cb, void* usr,
-                                     bool block)
-{
-    unique_lock<mutex> lk1(subDispMutex, std::defer_lock);
-    unique_lock<mutex> lk2(subRecvMutex, std::defer_lock);
-    if (block) {
-        // Intentionally locking in this order
-        lk1.lock();
-        lk2.lock();
-    } else if (!lk1.try_lock() || !lk2.try_lock()) {
+                                     uint32_t flags, bool block)
+{
+    const uint32_t priorities = ZCM_SUB_PRIORITY_HIGH | ZCM_SUB_PRIORITY_LOW;
+    if (flags & ~(ZCM_SUB_CONFLATE | priorities)) {
+        ZCM_DEBUG("unknown subscription flags: %u", flags);
+        return nullptr;
+    }
+    if ((flags & priorities) == priorities) {
+        ZCM_DEBUG("subscription can not have more than one priority: %u", flags);
         return nullptr;
     }
+
+    bool regex = isRegexChannel(channel);
+    uint32_t id = ChannelIntern::NONE;
+    if (!regex) {
+        id = ChannelIntern::id(channel.c_str());
+        if (id == ChannelIntern::NONE) {
+            ZCM_DEBUG("failed to intern channel %s", channel.c_str());
+            return nullptr;
+        }
+    }
+
+    unique_lock<mutex> lk(subWriteMutex, std::defer_lock);
+    if (block) lk.lock();
+    else if (!lk.try_lock()) return nullptr;
     int rc;
 
     rc = zcm_trans_recvmsg_enable(zt, channel.c_str(), true);
@@ -480,55 +1233,82 @@ zcm_sub_t* zcm_blocking_t::subscribe(const string& channel,
         return nullptr;
     }
 
-    zcm_sub_t* sub = new zcm_sub_t();
+    zcm_sub_t* sub = new Subscription();
     ZCM_ASSERT(sub);
     strncpy(sub->channel, channel.c_str(), ZCM_CHANNEL_MAXLEN);
     sub->channel[ZCM_CHANNEL_MAXLEN] = '\0';
     sub->callback = cb;
     sub->usr = usr;
-    sub->regex = isRegexChannel(channel);
+    sub->flags = flags;
+    sub->regex = regex;
+    sub->channel_id = id;
+    // Regex subscriptions are matched by regexMatcher, which compiles each pattern once
+    sub->regexobj = nullptr;
+    SubTable* next = new SubTable(*subTable.get());
     if (sub->regex) {
-        sub->regexobj = (void*) new std::regex(sub->channel);
-        ZCM_ASSERT(sub->regexobj);
-        subsRegex[channel].push_back(sub);
+        SubList& slist = next->subsRegex[channel];
+        slist.push_back(sub);
+        if (slist.size() == 1) next->regexMatcher.add(channel, &slist);
     } else {
-        sub->regexobj = nullptr;
-        subs[channel].push_back(sub);
+        if (next->subs.size() <= id) next->subs.resize(id + 1);
+        next->subs[id].push_back(sub);
     }
+    if (flags) next->numFlagged++;
+    subTable.update(next);
 
     return sub;
 }
 
 // Note: We use a lock on unsubscribe() to make sure it can be
-// called concurrently. Without the lock, there is a race
-// on modifying and reading the 'subs' and 'subsRegex' containers
+// called concurrently. Readers of the subscription table never
+// take it, so this is safe to call from within a callback
 int zcm_blocking_t::unsubscribe(zcm_sub_t* sub, bool block)
 {
-    unique_lock<mutex> lk1(subDispMutex, std::defer_lock);
-    unique_lock<mutex> lk2(subRecvMutex, std::defer_lock);
-    if (block) {
-        // Intentionally locking in this order
-        lk1.lock();
-        lk2.lock();
-    } else if (!lk1.try_lock() || !lk2.try_lock()) {
-        return ZCM_EAGAIN;
-    }
+    unique_lock<mutex> lk(subWriteMutex, std::defer_lock);
+    if (block) lk.lock();
+    else if (!lk.try_lock()) return ZCM_EAGAIN;
 
-    auto& subsSelected = sub->regex ? subsRegex : subs;
-
-    auto it = subsSelected.find(sub->channel);
-    if (it == subsSelected.end()) {
+    unique_ptr<SubTable> next(new SubTable(*subTable.get()));
+    SubList* slist = nullptr;
+    if (sub->regex) {
+        auto it = next->subsRegex.find(sub->channel);
+        if (it != next->subsRegex.end()) slist = &it->second;
+    } else if (sub->channel_id < next->subs.size()) {
+        slist = &next->subs[sub->channel_id];
+    }
+    if (!slist) {
         ZCM_DEBUG("failed to find the subscription channel in unsubscribe()");
         return ZCM_EINVALID;
     }
 
-    bool success = deleteFromSubList(it->second, sub);
-    if (!success) {
+    if (!removeFromSubList(*slist, sub)) {
         ZCM_DEBUG("failed to find the subscription entry in unsubscribe()");
         return ZCM_EINVALID;
     }
 
-    return ZCM_EOK;
+    if (sub->flags) next->numFlagged--;
+
+    int rc = ZCM_EOK;
+    if (slist->empty()) {
+        rc = zcm_trans_recvmsg_enable(zt, sub->channel, false);
+        if (sub->regex) {
+            next->regexMatcher.remove(sub->channel);
+            next->subsRegex.erase(sub->channel);
+        }
+    }
+
+    // The recv thread or a callback may still be using sub, so it
+    // can only be deleted once the current table is reclaimed
+    static_cast<Subscription*>(sub)->removed = true;
+    subTable.update(next.release(), [sub](){ delete static_cast<Subscription*>(sub); });
+    lk.unlock();
+
+    // Callbacks of sub that are already running on other threads finish before this returns,
+    // so that the caller may free usr. A callback that unsubscribes can't wait for the
+    // dispatch it is part of, but the rest of that dispatch skips sub
+    if (block && !isDispatchThread()) subTable.synchronize();
+
+    return rc == ZCM_EOK ? ZCM_EOK : ZCM_EINVALID;
 }
 
 int zcm_blocking_t::flush(bool block)
@@ -549,7 +1329,14 @@ int zcm_blocking_t::flush(bool block)
 
         sendQueue.enable();
         n = sendQueue.numMessages();
-        for (size_t i = 0; i < n; ++i) sendOneMessage(false);
+        for (size_t i = 0; i < n; ) {
+            // Backlogs that were waiting for room hold messages published before this
+            size_t requeued = 0;
+            size_t sent = sendMessages(false, n - i, &requeued);
+            if (sent == 0) break;
+            i += sent;
+            n += requeued;
+        }
     }
     sendPauseCond.notify_all();
 
@@ -568,6 +1355,7 @@ int zcm_blocking_t::flush(bool block)
         recvQueue.enable();
         n = recvQueue.numMessages();
         for (size_t i = 0; i < n; ++i) dispatchOneMessage(false);
+        if (dispPool) dispPool->drain();
     }
     hndlPauseCond.notify_all();
 
@@ -588,33 +1376,314 @@ int zcm_blocking_t::setQueueSize(uint32_t numMsgs, bool block)
             return ZCM_EAGAIN;
         }
 
+        unique_lock<mutex> lk2(sendPushMutex);
         sendQueue.setCapacity(numMsgs);
+        sendPool.setCapacity(numMsgs);
         sendQueue.enable();
     }
 
-    if (recvQueue.getCapacity() != numMsgs) {
+    if (recvQueue.getCapacity(ZCM_PRIORITY_NORMAL) != numMsgs) {
+        return withRecvQuiesced(block, [&]{
+            for (size_t l = 0; l < ZCM_NUM_PRIORITIES; ++l)
+                if (l == ZCM_PRIORITY_NORMAL || !laneSized[l])
+                    recvQueue.setCapacity(l, numMsgs);
+        });
+    }
 
-        recvQueue.disable();
+    return ZCM_EOK;
+}
 
-        unique_lock<mutex> lk(dispOneMutex, defer_lock);
+int zcm_blocking_t::setPriorityClass(zcm_priority prio, uint32_t capacity, uint32_t weight)
+{
+    if (prio < ZCM_PRIORITY_HIGH || prio > ZCM_PRIORITY_LOW) return ZCM_EINVALID;
+    // A queue of capacity 1 could never hold a message
+    if (capacity < 2 || weight < 1) return ZCM_EINVALID;
+
+    return withRecvQuiesced(true, [&]{
+        if (recvQueue.getCapacity(prio) != capacity) recvQueue.setCapacity(prio, capacity);
+        recvQueue.setWeight(prio, weight);
+        laneSized[prio] = true;
+    });
+}
 
-        if (block) lk.lock();
-        else if (!lk.try_lock()) {
-            recvQueue.enable();
-            return ZCM_EAGAIN;
-        }
+int zcm_blocking_t::setPriorityMode(zcm_priority_mode mode)
+{
+    if (mode != ZCM_PRIORITY_STRICT && mode != ZCM_PRIORITY_WEIGHTED) return ZCM_EINVALID;
+
+    return withRecvQuiesced(true, [&]{
+        recvQueue.setWeighted(mode == ZCM_PRIORITY_WEIGHTED);
+    });
+}
+
+// Runs f with both sides of recvQueue quiesced, which wakes up and holds off the
+// dispatching thread. Returns ZCM_EAGAIN if !block and it is busy dispatching
+template<class F>
+int zcm_blocking_t::withRecvQuiesced(bool block, F f)
+{
+    recvQueue.disable();
+
+    unique_lock<mutex> lk(dispOneMutex, defer_lock);
 
-        recvQueue.setCapacity(numMsgs);
+    if (block) lk.lock();
+    else if (!lk.try_lock()) {
         recvQueue.enable();
+        hndlPauseCond.notify_all();
+        return ZCM_EAGAIN;
+    }
+
+    {
+        unique_lock<mutex> lk2(recvPushMutex);
+        unique_lock<mutex> lk3(recvFreeMutex);
+        f();
+        // With a dispatch pool, payloads can be in recvQueue and in the pool at once
+        size_t capacity = recvQueue.totalCapacity();
+        recvPool.setCapacity(dispPool ? 2 * capacity : capacity);
+        if (dispPool) dispPool->setMaxPending(capacity);
+        recvQueue.enable();
+    }
+    lk.unlock();
+    // The dispatching thread may have gone to sleep while the queue was disabled
+    hndlPauseCond.notify_all();
+
+    return ZCM_EOK;
+}
+
+int zcm_blocking_t::setDispatchThreads(uint32_t numThreads)
+{
+    unique_lock<mutex> lk1(recvModeMutex);
+    if (recvMode != RECV_MODE_NONE) {
+        ZCM_DEBUG("Err: call to setDispatchThreads() when 'recvMode != RECV_MODE_NONE'");
+        return ZCM_EINVALID;
+    }
+
+    unique_lock<mutex> lk2(dispOneMutex);
+    unique_lock<mutex> lk3(dispGroupMutex);
+
+    if (dispPool) {
+        // Dispatch whatever the old pool still holds
+        dispPool->drain();
+        dispPool.reset();
+        dispPoolCtxs.clear();
+    }
+
+    size_t capacity = recvQueue.totalCapacity();
+    if (numThreads > 0) {
+        for (size_t i = 0; i < numThreads; ++i)
+            dispPoolCtxs.emplace_back(new DispatchCtx(subTable, msgStats));
+
+        auto run = [this](DispatchJob& job, size_t worker) { runDispatchJob(job, worker); };
+        auto init = [this](size_t worker) {
+            char name[16];
+            snprintf(name, sizeof(name), "ZeroCM_disp%zu", worker);
+            SET_THREAD_NAME(name);
+            applyThreadSched(ZCM_THREAD_DISPATCH, name);
+        };
+        dispPool.reset(new StrandPool<DispatchJob>(numThreads, capacity, run, init));
+        for (auto& g : dispGroups) dispPool->setGroup(g.first, g.second);
+
+        unique_lock<mutex> lk4(hndlStateMutex);
+        setPoolHeld();
+    }
+
+    unique_lock<mutex> lk4(recvPushMutex);
+    unique_lock<mutex> lk5(recvFreeMutex);
+    recvPool.setCapacity(dispPool ? 2 * capacity : capacity);
+
+    return ZCM_EOK;
+}
+
+int zcm_blocking_t::setPublishMode(const char* channel, zcm_publish_mode mode)
+{
+    if (mode != ZCM_PUBLISH_QUEUED && mode != ZCM_PUBLISH_INLINE) return ZCM_EINVALID;
+    bool isInline = mode == ZCM_PUBLISH_INLINE;
+
+    if (!channel) {
+        publishInlineDefault = isInline;
+        return ZCM_EOK;
     }
+    if (strlen(channel) > ZCM_CHANNEL_MAXLEN) return ZCM_EINVALID;
+    uint32_t id = ChannelIntern::id(channel);
+    if (id == ChannelIntern::NONE) return ZCM_EMEMORY;
 
+    unique_lock<mutex> lk(publishModeMutex);
+    publishInlineChannels[id] = isInline;
+    hasPublishModeChannels = true;
     return ZCM_EOK;
 }
 
+int zcm_blocking_t::setBackpressure(const char* channel, zcm_backpressure policy,
+                                    uint32_t param)
+{
+    switch (policy) {
+        case ZCM_BACKPRESSURE_DROP_NEWEST: case ZCM_BACKPRESSURE_BLOCK:
+        case ZCM_BACKPRESSURE_DROP_OLDEST: case ZCM_BACKPRESSURE_COALESCE: break;
+        default: return ZCM_EINVALID;
+    }
+    if (channel && strlen(channel) > ZCM_CHANNEL_MAXLEN) return ZCM_EINVALID;
+    uint32_t id = channel ? ChannelIntern::id(channel) : ChannelIntern::NONE;
+    if (channel && id == ChannelIntern::NONE) return ZCM_EMEMORY;
+
+    unique_lock<mutex> lk(backpressureMutex);
+    Backpressure bp {policy, param};
+    if (channel) backpressureChannels[id] = bp;
+    else backpressureDefault = bp;
+    hasBackpressure = true;
+    return ZCM_EOK;
+}
+
+int zcm_blocking_t::setRecvStrategy(zcm_recv_strategy strategy, uint32_t spinMicros)
+{
+    SpscQueue<Msg>::WaitStrategy wait;
+    switch (strategy) {
+        case ZCM_RECV_BLOCK:      wait = SpscQueue<Msg>::WAIT_ADAPTIVE; break;
+        case ZCM_RECV_SPIN_BLOCK: wait = SpscQueue<Msg>::WAIT_SPIN; break;
+        case ZCM_RECV_BUSY_POLL:  wait = SpscQueue<Msg>::WAIT_POLL; break;
+        default: return ZCM_EINVALID;
+    }
+
+    unique_lock<mutex> lk1(recvModeMutex);
+    if (recvMode != RECV_MODE_NONE) {
+        ZCM_DEBUG("Err: call to setRecvStrategy() when 'recvMode != RECV_MODE_NONE'");
+        return ZCM_EINVALID;
+    }
+
+    unique_lock<mutex> lk2(dispOneMutex);
+    recvStrategy = strategy;
+    recvSpinTime = chrono::microseconds(spinMicros);
+    recvQueue.setConsumerWait(wait, recvSpinTime);
+    return ZCM_EOK;
+}
+
+int zcm_blocking_t::setThreadSched(zcm_thread_kind thread, const char* cpus,
+                                   zcm_sched_policy policy, int priority)
+{
+    if ((unsigned) thread >= NUM_THREAD_KINDS) return ZCM_EINVALID;
+
+    ThreadSched sched;
+    if (cpus && cpus[0] != '\0' && !ThreadSched::parseCpus(cpus, sched.cpus))
+        return ZCM_EINVALID;
+
+    sched.hasPolicy = true;
+    switch (policy) {
+        case ZCM_SCHED_INHERIT: sched.hasPolicy = false; break;
+        case ZCM_SCHED_OTHER:   sched.policy = SCHED_OTHER; break;
+        case ZCM_SCHED_FIFO:    sched.policy = SCHED_FIFO; break;
+        case ZCM_SCHED_RR:      sched.policy = SCHED_RR; break;
+        default: return ZCM_EINVALID;
+    }
+    if (!ThreadSched::validPriority(sched.policy, priority)) return ZCM_EINVALID;
+    sched.priority = priority;
+
+    unique_lock<mutex> lk(threadSchedMutex);
+    threadScheds[thread] = sched;
+    return ZCM_EOK;
+}
+
+int zcm_blocking_t::lockMemory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "ZCM: failed to lock memory: %s\n", strerror(errno));
+        return ZCM_EUNKNOWN;
+    }
+    fprintf(stderr, "ZCM: locked all current and future memory\n");
+    return ZCM_EOK;
+}
+
+// Bad values are ignored (loudly) rather than failing to create zcm
+void zcm_blocking_t::loadThreadSchedEnv()
+{
+    for (size_t i = 0; i < NUM_THREAD_KINDS; ++i) {
+        ThreadSched& sched = threadScheds[i];
+        string var = string("ZCM_") + THREAD_ENV_NAMES[i] + "_CPUS";
+        const char* val = getenv(var.c_str());
+        if (val && !ThreadSched::parseCpus(val, sched.cpus))
+            fprintf(stderr, "ZCM: ignoring invalid %s='%s'\n", var.c_str(), val);
+
+        var = string("ZCM_") + THREAD_ENV_NAMES[i] + "_SCHED";
+        val = getenv(var.c_str());
+        if (val) {
+            sched.hasPolicy = ThreadSched::parsePolicy(val, sched.policy, sched.priority);
+            if (!sched.hasPolicy)
+                fprintf(stderr, "ZCM: ignoring invalid %s='%s'\n", var.c_str(), val);
+        }
+    }
+}
+
+// Called by every thread as it starts. Threads without settings stay quiet
+void zcm_blocking_t::applyThreadSched(zcm_thread_kind thread, const char* name)
+{
+    ThreadSched sched;
+    {
+        unique_lock<mutex> lk(threadSchedMutex);
+        sched = threadScheds[thread];
+    }
+    if (!sched.isSet()) return;
+
+    string report = sched.apply();
+    fprintf(stderr, "ZCM: %s running with %s\n", name, report.c_str());
+}
+
+int zcm_blocking_t::getStats(zcm_stats_t* stats, zcm_channel_stats_t* channels,
+                             uint32_t maxChannels)
+{
+    stats->send_queue_capacity = sendQueue.getCapacity();
+    stats->send_queue_high_water = sendQueueHighWater;
+    stats->recv_queue_capacity = recvQueue.getCapacity(ZCM_PRIORITY_NORMAL);
+    stats->recv_queue_high_water = recvLaneHighWater[ZCM_PRIORITY_NORMAL];
+    stats->priority_mode = recvQueue.isWeighted() ? ZCM_PRIORITY_WEIGHTED : ZCM_PRIORITY_STRICT;
+    for (size_t l = 0; l < ZCM_NUM_PRIORITIES; ++l) {
+        zcm_priority_stats_t& p = stats->priorities[l];
+        p.capacity = recvQueue.getCapacity(l);
+        p.weight = recvQueue.getWeight(l);
+        p.queued = recvQueue.numMessages(l);
+        p.high_water = recvLaneHighWater[l];
+    }
+
+    auto totals = msgStats.snapshot();
+    stats->num_channels = (uint32_t) totals.size();
+
+    size_t i = 0;
+    for (auto it = totals.begin(); it != totals.end() && i < maxChannels; ++it, ++i) {
+        zcm_channel_stats_t& c = channels[i];
+        strncpy(c.channel, it->first.c_str(), ZCM_CHANNEL_MAXLEN);
+        c.channel[ZCM_CHANNEL_MAXLEN] = '\0';
+        c.published = it->second.published;
+        c.received = it->second.received;
+        c.dispatched = it->second.dispatched;
+        c.dropped = it->second.dropped;
+        c.blocked = it->second.blocked;
+        memcpy(c.handler_hist, it->second.handlerHist, sizeof(c.handler_hist));
+    }
+    return ZCM_EOK;
+}
+
+int zcm_blocking_t::getTransportStats(zcm_transport_stats_t* stats)
+{
+    // Transports that keep counters have to be able to read them from any thread
+    return zcm_trans_get_stats(zt, stats);
+}
+
+int zcm_blocking_t::setDispatchGroup(const string& channel, const string& group)
+{
+    if (channel.size() > ZCM_CHANNEL_MAXLEN) return ZCM_EINVALID;
+
+    unique_lock<mutex> lk(dispGroupMutex);
+    dispGroups[channel] = group;
+    if (dispPool) dispPool->setGroup(channel, group);
+    return ZCM_EOK;
+}
+
+// Requires hndlStateMutex
+void zcm_blocking_t::setPoolHeld()
+{
+    if (dispPool) dispPool->setHeld(paused || dispStopped);
+}
+
 void zcm_blocking_t::sendThreadFunc()
 {
     // Name the send thread
     SET_THREAD_NAME("ZeroCM_sender");
+    applyThreadSched(ZCM_THREAD_SEND, "ZeroCM_sender");
 
     while (true) {
         {
@@ -626,54 +1695,152 @@ void zcm_blocking_t::sendThreadFunc()
             if (sendThreadState == THREAD_STATE_HALTING) break;
         }
         unique_lock<mutex> lk(sendOneMutex);
-        sendOneMessage(true);
+        sendMessages(true, SEND_BATCH);
     }
 
     unique_lock<mutex> lk(sendStateMutex);
     sendThreadState = THREAD_STATE_HALTED;
 }
 
+// Recv thread only. Receives the next batch of messages from the transport into msgs and
+// keeps the ones that some subscription wants at the front, along with whether to conflate
+// them and the lane to queue them in. Returns how many were kept
+size_t zcm_blocking_t::recvWanted(zcm_msg_t* msgs, bool* conflate, size_t* lane,
+                                  chrono::steady_clock::time_point& lastRecv)
+{
+    // Polling the transport is simply a zero timeout
+    int timeout = RECV_TIMEOUT;
+    if (recvStrategy == ZCM_RECV_BUSY_POLL) {
+        timeout = 0;
+    } else if (recvStrategy == ZCM_RECV_SPIN_BLOCK) {
+        if (chrono::steady_clock::now() - lastRecv < recvSpinTime) timeout = 0;
+    }
+
+    for (size_t i = 0; i < RECV_BATCH; ++i) msgs[i].channel_id = ChannelIntern::NONE;
+    size_t n = 0;
+    int rc = zcm_trans_recvmsg_batch(zt, msgs, RECV_BATCH, &n, timeout);
+    if (rc != ZCM_EOK) return 0;
+    if (recvStrategy == ZCM_RECV_SPIN_BLOCK) lastRecv = chrono::steady_clock::now();
+
+    // Keep only the messages that some subscription actually wants
+    size_t numWanted = 0;
+    {
+        RcuPtr<SubTable>::ReadLock table(recvSubReader);
+        for (size_t i = 0; i < n; ++i) {
+            // Exact subscriptions intern their channel, so a channel that was never
+            // interned can only be wanted by a regex subscription. Interning it only
+            // then keeps traffic that nobody subscribed to out of the table
+            uint32_t id = internChannel(&msgs[i], false);
+            if (id == ChannelIntern::NONE) {
+                if (recvMatchCache.lookup(table->regexMatcher, msgs[i].channel).empty())
+                    continue;
+                id = internChannel(&msgs[i], true);
+                if (id == ChannelIntern::NONE) continue;
+            }
+            // From here on, the message is only known by its id
+            // Check if message matches a non regex channel
+            const SubList* exact = nullptr;
+            if (id < table->subs.size() && !table->subs[id].empty()) exact = &table->subs[id];
+            uint32_t all = 0, any = 0;
+            if (!exact || table->numFlagged > 0) {
+                // Check if message matches a regex channel
+                auto& matches = recvMatchCache.lookup(table->regexMatcher, id,
+                                                      msgs[i].channel);
+                if (!exact && matches.empty()) continue;
+                if (table->numFlagged > 0) combineFlags(exact, matches, all, any);
+            }
+            // Conflate only if every subscription does, queue by the highest priority
+            conflate[numWanted] = all & ZCM_SUB_CONFLATE;
+            if (any & ZCM_SUB_PRIORITY_HIGH)     lane[numWanted] = ZCM_PRIORITY_HIGH;
+            else if (all & ZCM_SUB_PRIORITY_LOW) lane[numWanted] = ZCM_PRIORITY_LOW;
+            else                                 lane[numWanted] = ZCM_PRIORITY_NORMAL;
+            msgs[numWanted++] = msgs[i];
+        }
+    }
+    return numWanted;
+}
+
 void zcm_blocking_t::recvThreadFunc()
 {
     // Name the recv thread
     SET_THREAD_NAME("ZeroCM_receiver");
-
+    applyThreadSched(ZCM_THREAD_RECV, "ZeroCM_receiver");
+
+    auto lastRecv = chrono::steady_clock::now();
+    // The wanted messages of the current batch. Messages that could not be pushed because the
+    // queue got disabled (flush, resizing, ...) stay here and are pushed before anything else
+    // is received. The transport owns them until the next receive, so they stay valid
+    zcm_msg_t msgs[RECV_BATCH];
+    bool conflate[RECV_BATCH];
+    size_t lane[RECV_BATCH];
+    size_t numWanted = 0;
     while (true) {
         {
             unique_lock<mutex> lk(recvStateMutex);
             if (recvThreadState == THREAD_STATE_HALTING) break;
         }
-        zcm_msg_t msg;
-        int rc = zcm_trans_recvmsg(zt, &msg, RECV_TIMEOUT);
-        if (rc == ZCM_EOK) {
-            {
-                unique_lock<mutex> lk(subRecvMutex);
-
-                // Check if message matches a non regex channel
-                auto it = subs.find(msg.channel);
-                if (it == subs.end()) {
-                    // Check if message matches a regex channel
-                    bool foundRegex = false;
-                    for (auto& it : subsRegex) {
-                        for (auto& sub : it.second) {
-                            regex* r = (regex*)sub->regexobj;
-                            if (regex_match(msg.channel, *r)) {
-                                foundRegex = true;
-                                break;
-                            }
-                        }
-                        if (foundRegex) break;
+
+        if (numWanted > 0) {
+            // The rest of the last batch waits for the queue to be enabled again
+            if (!recvQueue.isEnabled()) {
+                this_thread::sleep_for(chrono::microseconds(100));
+                continue;
+            }
+        } else {
+            numWanted = recvWanted(msgs, conflate, lane, lastRecv);
+            if (numWanted == 0) continue;
+        }
+
+        // Note: A push only fails if the queue was disabled. The messages from there on
+        //       are kept for the next iteration, which re-checks the running condition
+        unique_lock<mutex> lk(recvPushMutex);
+        uint32_t lanesUsed = 0;
+        for (size_t i = 0; i < numWanted; ++i) lanesUsed |= 1u << lane[i];
+        // Push the higher priority messages of the batch first, so that they never wait
+        // for room in a lower lane
+        size_t failedLane = ZCM_NUM_PRIORITIES, failedAt = 0;
+        for (size_t l = 0; l < ZCM_NUM_PRIORITIES && failedLane == ZCM_NUM_PRIORITIES; ++l) {
+            if (!(lanesUsed & (1u << l))) continue;
+            for (size_t i = 0; i < numWanted; ++i) {
+                if (lane[i] != l) continue;
+                auto& counters = recvStats.get(msgs[i].channel_id, msgs[i].channel);
+                if (conflate[i]) {
+                    ConflateSlot* slot = conflateSlot(msgs[i].channel_id);
+                    if (!slot->put(&msgs[i])) {
+                        // Replaced the pending message, whose marker is still queued
+                        MsgStats::Counters::inc(counters.received);
+                        MsgStats::Counters::inc(counters.dropped);
+                        continue;
+                    }
+                    if (!recvQueue.push(l, recvPool, slot)) {
+                        slot->drop();
+                        failedLane = l;
+                        failedAt = i;
+                        break;
                     }
-                    // No subscription actually wants the message
-                    if (!foundRegex) continue;
+                } else if (!recvQueue.push(l, recvPool, &msgs[i])) {
+                    failedLane = l;
+                    failedAt = i;
+                    break;
                 }
+                MsgStats::Counters::inc(counters.received);
+                // Per message, the next push may wait for the dispatcher to make room
+                if (recvReady.isOpen()) recvReady.raise();
             }
+            raiseHighWater(recvLaneHighWater[l], recvQueue.numMessages(l));
+        }
 
-            // Note: After this returns, you have either successfully pushed a message
-            //       into the queue, or the queue was disabled and you will quit out of
-            //       this loop when you re-check the running condition
-            recvQueue.push(&msg);
+        // Everything in a higher lane than the failed push, and what came before it in the
+        // same lane, is in the queue now
+        size_t kept = 0;
+        for (size_t i = 0; i < numWanted && failedLane < ZCM_NUM_PRIORITIES; ++i) {
+            if (lane[i] < failedLane || (lane[i] == failedLane && i < failedAt)) continue;
+            msgs[kept] = msgs[i];
+            conflate[kept] = conflate[i];
+            lane[kept] = lane[i];
+            ++kept;
         }
+        numWanted = kept;
     }
     unique_lock<mutex> lk(recvStateMutex);
     recvThreadState = THREAD_STATE_HALTED;
@@ -683,6 +1850,7 @@ void zcm_blocking_t::hndlThreadFunc()
 {
     // Name the handle thread
     SET_THREAD_NAME("ZeroCM_handler");
+    applyThreadSched(ZCM_THREAD_HANDLE, "ZeroCM_handler");
 
     {
         // Spawn the recv thread
@@ -718,7 +1886,7 @@ void zcm_blocking_t::hndlThreadFunc()
     hndlThreadState = THREAD_STATE_HALTED;
 }
 
-void zcm_blocking_t::dispatchMsg(zcm_msg_t* msg)
+void zcm_blocking_t::dispatchMsg(zcm_msg_t* msg, DispatchCtx& ctx)
 {
     zcm_recv_buf_t rbuf;
     rbuf.recv_utime = msg->utime;
@@ -726,34 +1894,43 @@ void zcm_blocking_t::dispatchMsg(zcm_msg_t* msg)
     rbuf.data = msg->buf;
     rbuf.data_size = msg->len;
 
-    // Note: We use a lock on dispatch to ensure there is not
-    // a race on modifying and reading the 'subs' container.
-    // This means users cannot call zcm_subscribe or
-    // zcm_unsubscribe from a callback without deadlocking.
+    // Note: We dispatch from a snapshot of the subscriptions. Callbacks may call
+    // zcm_subscribe or zcm_unsubscribe. A new subscription only gets future messages,
+    // while a removed one is skipped for the rest of this message.
     bool wasDispatched = false;
+    auto start = chrono::steady_clock::now();
+    ctx.dispatchingThread = this_thread::get_id();
     {
-        unique_lock<mutex> lk(subDispMutex);
+        RcuPtr<SubTable>::ReadLock table(ctx.subReader);
 
         // dispatch to a non regex channel
-        auto it = subs.find(msg->channel);
-        if (it != subs.end()) {
-            for (zcm_sub_t* sub : it->second) {
+        uint32_t id = msg->channel_id;
+        if (id < table->subs.size()) {
+            for (zcm_sub_t* sub : table->subs[id]) {
+                if (static_cast<Subscription*>(sub)->removed) continue;
                 sub->callback(&rbuf, msg->channel, sub->usr);
                 wasDispatched = true;
             }
         }
 
         // dispatch to any regex channels
-        for (auto& it : subsRegex) {
-            for (auto& sub : it.second) {
-                regex* r = (regex*)sub->regexobj;
-                if (regex_match(msg->channel, *r)) {
-                    sub->callback(&rbuf, msg->channel, sub->usr);
-                    wasDispatched = true;
-                }
+        for (SubList* slist : ctx.matchCache.lookup(table->regexMatcher, id, msg->channel)) {
+            for (zcm_sub_t* sub : *slist) {
+                unique_lock<mutex> lk(static_cast<Subscription*>(sub)->dispatchMutex);
+                if (static_cast<Subscription*>(sub)->removed) continue;
+                sub->callback(&rbuf, msg->channel, sub->usr);
+                wasDispatched = true;
             }
         }
     }
+    ctx.dispatchingThread = thread::id();
+
+    if (wasDispatched) {
+        auto& c = ctx.stats.get(msg->channel_id, msg->channel);
+        MsgStats::Counters::inc(c.dispatched);
+        c.addHandlerTime(chrono::duration_cast<chrono::nanoseconds>(
+                            chrono::steady_clock::now() - start).count());
+    }
 
 #ifdef TRACK_TRAFFIC_TOPOLOGY
     if (wasDispatched) {
@@ -771,6 +1948,16 @@ void zcm_blocking_t::dispatchMsg(zcm_msg_t* msg)
 #endif
 }
 
+// Whether the calling thread is in the middle of dispatching a message, i.e. in a callback
+bool zcm_blocking_t::isDispatchThread() const
+{
+    thread::id self = this_thread::get_id();
+    if (dispCtx.dispatchingThread == self) return true;
+    for (auto& ctx : dispPoolCtxs)
+        if (ctx->dispatchingThread == self) return true;
+    return false;
+}
+
 bool zcm_blocking_t::dispatchOneMessage(bool returnIfPaused)
 {
     Msg* m = recvQueue.top();
@@ -783,44 +1970,134 @@ bool zcm_blocking_t::dispatchOneMessage(bool returnIfPaused)
         if (paused || hndlThreadState == THREAD_STATE_HALTING) return false;
     }
 
-    dispatchMsg(m->get());
+    if (dispPool) {
+        if (!dispatchToPool(m, !returnIfPaused)) return false;
+    } else if (m->slot) {
+        zcm_msg_t msg;
+        if (m->slot->take(&msg)) dispatchMsg(&msg, dispCtx);
+        m->slot = nullptr;
+    } else {
+        dispatchMsg(m->get(), dispCtx);
+    }
     recvQueue.pop();
+    if (recvReady.isOpen() && !recvQueue.hasMessage())
+        recvReady.lower([&](){ return recvQueue.hasMessage(); });
     return true;
 }
 
-bool zcm_blocking_t::sendOneMessage(bool returnIfPaused)
+// The flags that all and that any of the subscriptions a message would be dispatched to have
+void zcm_blocking_t::combineFlags(const SubList* exact, const vector<SubList*>& regexMatches,
+                                  uint32_t& all, uint32_t& any)
+{
+    all = ~0u;
+    any = 0;
+    auto combine = [&](const SubList& slist) {
+        for (zcm_sub_t* sub : slist) {
+            all &= sub->flags;
+            any |= sub->flags;
+        }
+    };
+    if (exact) combine(*exact);
+    for (SubList* slist : regexMatches) combine(*slist);
+}
+
+// Recv thread only
+ConflateSlot* zcm_blocking_t::conflateSlot(uint32_t channelId)
+{
+    if (channelId >= conflateSlots.size()) conflateSlots.resize(channelId + 1);
+    auto& slot = conflateSlots[channelId];
+    if (!slot) slot.reset(new ConflateSlot(channelId));
+    return slot.get();
+}
+
+// Hands msg over to the dispatch pool. If the pool is full, the calling thread helps out
+// with the jobs queued ahead of msg on its own strand until there is room. With
+// ignorePaused (flush) it also runs the jobs of other strands that the paused workers
+// leave alone. Otherwise, returns false if the pool got paused or stopped in the meantime
+bool zcm_blocking_t::dispatchToPool(Msg* m, bool ignorePaused)
+{
+    zcm_msg_t* msg = m->get();
+    DispatchJob job;
+    job.slot = m->slot;
+    job.utime = msg->utime;
+    job.len = msg->len;
+    job.buf = msg->buf;
+    job.channelId = msg->channel_id;
+
+    while (!dispPool->push(msg->channel, job)) {
+        if (dispPool->runOne(msg->channel, ignorePaused)) continue;
+        if (!dispPool->waitForRoom(ignorePaused)) return false;
+    }
+
+    // The job owns the payload (or the marker) now
+    msg->buf = nullptr;
+    m->slot = nullptr;
+    return true;
+}
+
+// Jobs run by the calling thread (from dispatchToPool() or flush()) get an index past
+// the pool's workers. Those callers hold dispOneMutex, so they can use dispCtx
+void zcm_blocking_t::runDispatchJob(DispatchJob& job, size_t worker)
+{
+    DispatchCtx& ctx = worker < dispPoolCtxs.size() ? *dispPoolCtxs[worker] : dispCtx;
+    if (job.slot) {
+        // Jobs of one channel never run concurrently, so neither do takes from its slot
+        zcm_msg_t msg;
+        if (job.slot->take(&msg)) dispatchMsg(&msg, ctx);
+        return;
+    }
+
+    zcm_msg_t msg;
+    msg.utime = job.utime;
+    msg.channel = ChannelIntern::name(job.channelId);
+    msg.channel_id = job.channelId;
+    msg.len = job.len;
+    msg.buf = job.buf;
+    dispatchMsg(&msg, ctx);
+
+    unique_lock<mutex> lk(recvFreeMutex);
+    recvPool.free(job.buf, job.len);
+}
+
+// Hands up to maxMsgs queued messages to the transport in one call. Returns the number
+// of messages that were taken off the queue (0 if it was woken up or paused)
+size_t zcm_blocking_t::sendMessages(bool returnIfPaused, size_t maxMsgs, size_t* requeued)
 {
     Msg* m = sendQueue.top();
     // If the Queue was forcibly woken-up, recheck the
     // running condition, and then retry.
-    if (m == nullptr) return false;
+    if (m == nullptr) return 0;
 
     if (returnIfPaused) {
         unique_lock<mutex> lk(sendStateMutex);
-        if (paused || sendThreadState == THREAD_STATE_HALTING) return false;
+        if (paused || sendThreadState == THREAD_STATE_HALTING) return 0;
     }
 
-    zcm_msg_t* msg = m->get();
-    int ret = zcm_trans_sendmsg(zt, *msg);
-    if (ret != ZCM_EOK) ZCM_DEBUG("zcm_trans_sendmsg() returned error, dropping the msg!");
-    sendQueue.pop();
-    return true;
-}
+    size_t n = std::min(sendQueue.numMessages(), std::min(maxMsgs, (size_t) SEND_BATCH));
+    sendBatch.clear();
+    for (size_t i = 0; i < n; ++i) {
+        Msg* m = sendQueue.at(i);
+        if (m->backlog) m->backlog->take(sendBatch);
+        else sendBatch.push_back(*m->get());
+    }
 
-bool zcm_blocking_t::deleteSubEntry(zcm_sub_t* sub, size_t nentriesleft)
-{
-    int rc = ZCM_EOK;
-    if (sub->regex) {
-        delete (std::regex*) sub->regexobj;
+    unique_lock<mutex> lk(transSendMutex);
+    int ret = zcm_trans_sendmsg_batch(zt, sendBatch.data(), sendBatch.size());
+    if (ret != ZCM_EOK) ZCM_DEBUG("zcm_trans_sendmsg_batch() returned error, dropping msgs!");
+    for (size_t i = 0; i < n; ++i) {
+        // The backlogs were taken already
+        sendQueue.at(0)->backlog = nullptr;
+        sendQueue.pop();
     }
-    if (nentriesleft == 0) {
-        rc = zcm_trans_recvmsg_enable(zt, sub->channel, false);
+    if (hasStranded) {
+        unique_lock<mutex> lk2(sendPushMutex);
+        size_t r = requeueStranded();
+        if (requeued) *requeued = r;
     }
-    delete sub;
-    return rc == ZCM_EOK;
+    return n;
 }
 
-bool zcm_blocking_t::deleteFromSubList(SubList& slist, zcm_sub_t* sub)
+bool zcm_blocking_t::removeFromSubList(SubList& slist, zcm_sub_t* sub)
 {
     for (size_t i = 0; i < slist.size(); i++) {
         if (slist[i] == sub) {
@@ -828,8 +2105,7 @@ bool zcm_blocking_t::deleteFromSubList(SubList& slist, zcm_sub_t* sub)
             size_t last = slist.size() - 1;
             slist[i] = slist[last];
             slist.resize(last);
-            // delete the element
-            return deleteSubEntry(sub, slist.size());
+            return true;
         }
     }
     return false;
@@ -873,10 +2149,32 @@ int zcm_blocking_publish(zcm_blocking_t* zcm, const char* channel, const uint8_t
     return zcm->publish(channel, data, len);
 }
 
+int zcm_blocking_publish_loan(zcm_blocking_t* zcm, const char* channel, uint32_t len,
+                              zcm_loan_t* loan)
+{
+    return zcm->publishLoan(channel, len, loan);
+}
+
+int zcm_blocking_publish_commit(zcm_blocking_t* zcm, zcm_loan_t* loan, uint32_t len)
+{
+    return zcm->publishCommit(loan, len);
+}
+
+void zcm_blocking_publish_cancel(zcm_blocking_t* zcm, zcm_loan_t* loan)
+{
+    zcm->publishCancel(loan);
+}
+
 zcm_sub_t* zcm_blocking_subscribe(zcm_blocking_t* zcm, const char* channel,
                                   zcm_msg_handler_t cb, void* usr)
 {
-    return zcm->subscribe(channel, cb, usr, true);
+    return zcm->subscribe(channel, cb, usr, 0, true);
+}
+
+zcm_sub_t* zcm_blocking_subscribe_flags(zcm_blocking_t* zcm, const char* channel,
+                                        zcm_msg_handler_t cb, void* usr, uint32_t flags)
+{
+    return zcm->subscribe(channel, cb, usr, flags, true);
 }
 
 int zcm_blocking_unsubscribe(zcm_blocking_t* zcm, zcm_sub_t* sub)
@@ -924,11 +2222,88 @@ int zcm_blocking_handle_nonblock(zcm_blocking_t* zcm)
     return zcm->handle_nonblock();
 }
 
+int zcm_blocking_handle_nonblock_budget(zcm_blocking_t* zcm, uint32_t maxMsgs,
+                                        uint32_t maxMicros)
+{
+    return zcm->handleNonblockBudget(maxMsgs, maxMicros);
+}
+
+int zcm_blocking_get_fd(zcm_blocking_t* zcm)
+{
+    return zcm->getFd();
+}
+
+int zcm_blocking_set_nonblock_batch(zcm_blocking_t* zcm, uint32_t maxMsgs)
+{
+    return zcm->setNonblockBatch(maxMsgs);
+}
+
 void zcm_blocking_set_queue_size(zcm_blocking_t* zcm, uint32_t sz)
 {
     zcm->setQueueSize(sz, true);
 }
 
+int zcm_blocking_set_priority_class(zcm_blocking_t* zcm, zcm_priority prio,
+                                    uint32_t capacity, uint32_t weight)
+{
+    return zcm->setPriorityClass(prio, capacity, weight);
+}
+
+int zcm_blocking_set_priority_mode(zcm_blocking_t* zcm, zcm_priority_mode mode)
+{
+    return zcm->setPriorityMode(mode);
+}
+
+int zcm_blocking_set_dispatch_threads(zcm_blocking_t* zcm, uint32_t numThreads)
+{
+    return zcm->setDispatchThreads(numThreads);
+}
+
+int zcm_blocking_set_dispatch_group(zcm_blocking_t* zcm, const char* channel, const char* group)
+{
+    return zcm->setDispatchGroup(channel, group);
+}
+
+int zcm_blocking_set_publish_mode(zcm_blocking_t* zcm, const char* channel,
+                                  zcm_publish_mode mode)
+{
+    return zcm->setPublishMode(channel, mode);
+}
+
+int zcm_blocking_set_backpressure(zcm_blocking_t* zcm, const char* channel,
+                                  zcm_backpressure policy, uint32_t param)
+{
+    return zcm->setBackpressure(channel, policy, param);
+}
+
+int zcm_blocking_set_recv_strategy(zcm_blocking_t* zcm, zcm_recv_strategy strategy,
+                                   uint32_t spinMicros)
+{
+    return zcm->setRecvStrategy(strategy, spinMicros);
+}
+
+int zcm_blocking_set_thread_sched(zcm_blocking_t* zcm, zcm_thread_kind thread,
+                                  const char* cpus, zcm_sched_policy policy, int priority)
+{
+    return zcm->setThreadSched(thread, cpus, policy, priority);
+}
+
+int zcm_blocking_lock_memory(zcm_blocking_t* zcm)
+{
+    return zcm->lockMemory();
+}
+
+int zcm_blocking_get_stats(zcm_blocking_t* zcm, zcm_stats_t* stats,
+                           zcm_channel_stats_t* channels, uint32_t maxChannels)
+{
+    return zcm->getStats(stats, channels, maxChannels);
+}
+
+int zcm_blocking_get_transport_stats(zcm_blocking_t* zcm, zcm_transport_stats_t* stats)
+{
+    return zcm->getTransportStats(stats);
+}
+
 int zcm_blocking_write_topology(zcm_blocking_t* zcm, const char* name)
 {
 #ifdef TRACK_TRAFFIC_TOPOLOGY
@@ -946,7 +2321,7 @@ int zcm_blocking_write_topology(zcm_blocking_t* zcm, const char* name)
 zcm_sub_t* zcm_blocking_try_subscribe(zcm_blocking_t* zcm, const char* channel,
                                       zcm_msg_handler_t cb, void* usr)
 {
-    return zcm->subscribe(channel, cb, usr, false);
+    return zcm->subscribe(channel, cb, usr, 0, false);
 }
 
 int zcm_blocking_try_unsubscribe(zcm_blocking_t* zcm, zcm_sub_t* sub)
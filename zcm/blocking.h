@@ -15,9 +15,15 @@ void zcm_blocking_destroy(zcm_blocking_t* zcm);
 
 int zcm_blocking_publish(zcm_blocking_t* zcm, const char* channel,
                          const uint8_t* data, uint32_t len);
+int zcm_blocking_publish_loan(zcm_blocking_t* zcm, const char* channel, uint32_t len,
+                              zcm_loan_t* loan);
+int zcm_blocking_publish_commit(zcm_blocking_t* zcm, zcm_loan_t* loan, uint32_t len);
+void zcm_blocking_publish_cancel(zcm_blocking_t* zcm, zcm_loan_t* loan);
 
 zcm_sub_t* zcm_blocking_subscribe(zcm_blocking_t* zcm, const char* channel,
                                   zcm_msg_handler_t cb, void* usr);
+zcm_sub_t* zcm_blocking_subscribe_flags(zcm_blocking_t* zcm, const char* channel,
+                                        zcm_msg_handler_t cb, void* usr, uint32_t flags);
 
 int zcm_blocking_unsubscribe(zcm_blocking_t* zcm, zcm_sub_t* sub);
 
@@ -30,7 +36,29 @@ void zcm_blocking_pause(zcm_blocking_t* zcm);
 void zcm_blocking_resume(zcm_blocking_t* zcm);
 int  zcm_blocking_handle(zcm_blocking_t* zcm);
 int  zcm_blocking_handle_nonblock(zcm_blocking_t* zcm);
+int  zcm_blocking_handle_nonblock_budget(zcm_blocking_t* zcm, uint32_t maxMsgs,
+                                         uint32_t maxMicros);
+int  zcm_blocking_get_fd(zcm_blocking_t* zcm);
+int  zcm_blocking_set_nonblock_batch(zcm_blocking_t* zcm, uint32_t maxMsgs);
 void zcm_blocking_set_queue_size(zcm_blocking_t* zcm, uint32_t numMsgs);
+int  zcm_blocking_set_priority_class(zcm_blocking_t* zcm, zcm_priority prio,
+                                     uint32_t capacity, uint32_t weight);
+int  zcm_blocking_set_priority_mode(zcm_blocking_t* zcm, zcm_priority_mode mode);
+int  zcm_blocking_set_dispatch_threads(zcm_blocking_t* zcm, uint32_t numThreads);
+int  zcm_blocking_set_dispatch_group(zcm_blocking_t* zcm, const char* channel,
+                                     const char* group);
+int  zcm_blocking_set_publish_mode(zcm_blocking_t* zcm, const char* channel,
+                                   zcm_publish_mode mode);
+int  zcm_blocking_set_backpressure(zcm_blocking_t* zcm, const char* channel,
+                                   zcm_backpressure policy, uint32_t param);
+int  zcm_blocking_set_recv_strategy(zcm_blocking_t* zcm, zcm_recv_strategy strategy,
+                                    uint32_t spinMicros);
+int  zcm_blocking_set_thread_sched(zcm_blocking_t* zcm, zcm_thread_kind thread,
+                                   const char* cpus, zcm_sched_policy policy, int priority);
+int  zcm_blocking_lock_memory(zcm_blocking_t* zcm);
+int  zcm_blocking_get_stats(zcm_blocking_t* zcm, zcm_stats_t* stats,
+                            zcm_channel_stats_t* channels, uint32_t maxChannels);
+int  zcm_blocking_get_transport_stats(zcm_blocking_t* zcm, zcm_transport_stats_t* stats);
 
 int zcm_blocking_write_topology(zcm_blocking_t* zcm, const char* name);
 
@@ -20,6 +20,9 @@ export Zcm,
        stop,
        handle,
        handle_nonblock,
+       handle_nonblock_budget,
+       get_fd,
+       set_nonblock_batch,
        set_queue_size,
        write_topology,
        read_bits,
@@ -295,6 +298,22 @@ function handle_nonblock(zcm::Zcm)
     ccall(("zcm_handle_nonblock", "libzcm"), Cint, (Ptr{Native.Zcm},), zcm)
 end
 
+# Returns the number of messages dispatched (maxMicros == 0 means no time limit)
+function handle_nonblock_budget(zcm::Zcm, maxMsgs::Integer, maxMicros::Integer = 0)
+    ccall(("zcm_handle_nonblock_budget", "libzcm"), Cint,
+          (Ptr{Native.Zcm}, UInt32, UInt32), zcm, UInt32(maxMsgs), UInt32(maxMicros))
+end
+
+# Readable while messages wait for handle_nonblock, e.g. for FileWatching.poll_fd
+function get_fd(zcm::Zcm)
+    ccall(("zcm_get_fd", "libzcm"), Cint, (Ptr{Native.Zcm},), zcm)
+end
+
+function set_nonblock_batch(zcm::Zcm, num::Integer)
+    ccall(("zcm_set_nonblock_batch", "libzcm"), Cint,
+          (Ptr{Native.Zcm}, UInt32), zcm, UInt32(num))
+end
+
 function set_queue_size(zcm::Zcm, num::Integer)
     sz = UInt32(num)
     while (true)
@@ -4,21 +4,68 @@
 
 #include <string.h>
 
-/* TODO remove malloc for preallocated mem and linked-lists */
+/* Clock for the time budget of zcm_nonblocking_handle_nonblock_budget(), in microseconds.
+   Embedded builds have nothing to fall back on and may define ZCM_NONBLOCK_UTIME() to a
+   clock of their own; without one, time budgets are rejected */
+#if !defined(ZCM_NONBLOCK_UTIME) && !defined(ZCM_EMBEDDED)
+#include <time.h>
+static uint64_t monotonicUtime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#define ZCM_NONBLOCK_UTIME() monotonicUtime()
+#endif
+
 #ifndef ZCM_NONBLOCK_SUBS_MAX
 #define ZCM_NONBLOCK_SUBS_MAX 512
 #endif
 
+/* Buckets of the channel hash table. Must be a power of two larger than
+   ZCM_NONBLOCK_SUBS_MAX, so that the table can never fill up */
+#ifndef ZCM_NONBLOCK_HASH_SIZE
+#define ZCM_NONBLOCK_HASH_SIZE 1024
+#endif
+
+typedef char zcm_nonblock_hash_size_check[
+    (ZCM_NONBLOCK_HASH_SIZE > ZCM_NONBLOCK_SUBS_MAX &&
+     (ZCM_NONBLOCK_HASH_SIZE & (ZCM_NONBLOCK_HASH_SIZE - 1)) == 0) ? 1 : -1];
+
+#define NO_SUB (-1)
+
+enum
+{
+    SUB_FREE = 0,
+    SUB_EXACT,   /* on the list of its channel's bucket */
+    SUB_PREFIX,  /* on the prefix list */
+    SUB_DEAD     /* unsubscribed during dispatch, freed once dispatch is done */
+};
+
 struct zcm_nonblocking
 {
     zcm_t* z;
     zcm_trans_t* zt;
 
-    /* TODO speed this up */
+    /* Every subscription is on exactly one list, linked through subNext in slot order:
+       the list of its channel, the prefix list or the free list. New subscriptions take
+       the lowest free slot and messages go to their subscriptions in slot order, exact
+       and prefix ones alike. Unsubscribing takes a subscription off its list but leaves
+       its subNext alone and only frees it once no dispatch is walking the lists anymore */
     zcm_sub_t subs[ZCM_NONBLOCK_SUBS_MAX];
-    bool      subInUse[ZCM_NONBLOCK_SUBS_MAX];
-    bool      subIsRegex[ZCM_NONBLOCK_SUBS_MAX];
-    size_t    subInUseEnd;
+    int       subNext[ZCM_NONBLOCK_SUBS_MAX];
+    uint8_t   subState[ZCM_NONBLOCK_SUBS_MAX];
+    uint8_t   subPrefixLen[ZCM_NONBLOCK_SUBS_MAX]; /* "prefix.*" compares this many chars */
+    int       freeHead;
+    int       prefixHead;
+
+    /* Open addressing with linear probing on the channel name. A used bucket holds the
+       first subscription to its channel, whose name is the key */
+    int       bucketHead[ZCM_NONBLOCK_HASH_SIZE];
+    uint32_t  bucketHash[ZCM_NONBLOCK_HASH_SIZE];
+
+    int       dispatchDepth;
+    int       numDead;
 };
 
 static bool isRegexChannel(const char* c, size_t clen)
@@ -34,6 +81,8 @@ static bool isRegexChannel(const char* c, size_t clen)
 
 static bool isSupportedRegex(const char* c, size_t clen)
 {
+    size_t i;
+
     /* Currently only support strings formed as such: */
     /* "[any non-regex character any number of times].*" */
     if (!isRegexChannel(c, clen)) return true;
@@ -42,7 +91,6 @@ static bool isSupportedRegex(const char* c, size_t clen)
     if (c[clen - 1] != '*') return false;
     if (c[clen - 2] != '.') return false;
 
-    size_t i;
     for (i = 0; i < clen - 2; ++i)
         if (!((c[i] >= 'a' && c[i] <= 'z') ||
               (c[i] >= 'A' && c[i] <= 'Z') ||
@@ -52,9 +100,89 @@ static bool isSupportedRegex(const char* c, size_t clen)
     return true;
 }
 
+/* FNV-1a over the part of the channel that subscriptions keep */
+static uint32_t hashChannel(const char* channel)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+    for (i = 0; i < ZCM_CHANNEL_MAXLEN && channel[i]; ++i) {
+        h ^= (uint8_t) channel[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Returns the bucket of channel, or the empty bucket it would go into */
+static size_t findBucket(const zcm_nonblocking_t* zcm, const char* channel, uint32_t hash)
+{
+    size_t b = hash & (ZCM_NONBLOCK_HASH_SIZE - 1);
+    while (zcm->bucketHead[b] != NO_SUB) {
+        if (zcm->bucketHash[b] == hash &&
+            strncmp(zcm->subs[zcm->bucketHead[b]].channel, channel, ZCM_CHANNEL_MAXLEN) == 0)
+            break;
+        b = (b + 1) & (ZCM_NONBLOCK_HASH_SIZE - 1);
+    }
+    return b;
+}
+
+/* Empties bucket b and moves later buckets of the same probe run back into the gap, so
+   that lookups never need tombstones */
+static void clearBucket(zcm_nonblocking_t* zcm, size_t b)
+{
+    size_t next = b, home;
+    zcm->bucketHead[b] = NO_SUB;
+    while (true) {
+        next = (next + 1) & (ZCM_NONBLOCK_HASH_SIZE - 1);
+        if (zcm->bucketHead[next] == NO_SUB) return;
+        home = zcm->bucketHash[next] & (ZCM_NONBLOCK_HASH_SIZE - 1);
+        /* Only move entries whose home is not within (b, next] */
+        if (b <= next ? (b < home && home <= next) : (b < home || home <= next)) continue;
+        zcm->bucketHead[b] = zcm->bucketHead[next];
+        zcm->bucketHash[b] = zcm->bucketHash[next];
+        zcm->bucketHead[next] = NO_SUB;
+        b = next;
+    }
+}
+
+/* Puts sub on list *head, which stays in slot order */
+static void linkSub(zcm_nonblocking_t* zcm, int* head, int sub)
+{
+    int* prev = head;
+    while (*prev != NO_SUB && *prev < sub) prev = &zcm->subNext[*prev];
+    zcm->subNext[sub] = *prev;
+    *prev = sub;
+}
+
+/* Takes sub off list *head. Returns true if it was on it */
+static bool unlinkSub(zcm_nonblocking_t* zcm, int* head, int sub)
+{
+    int* prev = head;
+    while (*prev != NO_SUB && *prev != sub) prev = &zcm->subNext[*prev];
+    if (*prev == NO_SUB) return false;
+    *prev = zcm->subNext[sub];
+    return true;
+}
+
+static void freeSub(zcm_nonblocking_t* zcm, int sub)
+{
+    zcm->subState[sub] = SUB_FREE;
+    linkSub(zcm, &zcm->freeHead, sub);
+}
+
+static void freeDeadSubs(zcm_nonblocking_t* zcm)
+{
+    int i;
+    for (i = 0; i < ZCM_NONBLOCK_SUBS_MAX && zcm->numDead > 0; ++i) {
+        if (zcm->subState[i] != SUB_DEAD) continue;
+        freeSub(zcm, i);
+        --zcm->numDead;
+    }
+}
 
 int zcm_nonblocking_try_create(zcm_nonblocking_t** zcm, zcm_t* z, zcm_trans_t* zt)
 {
+    int i;
+
     if (z->type != ZCM_NONBLOCKING) return ZCM_EINVALID;
 
     *zcm = malloc(sizeof(zcm_nonblocking_t));
@@ -62,11 +190,16 @@ int zcm_nonblocking_try_create(zcm_nonblocking_t** zcm, zcm_t* z, zcm_trans_t* z
     (*zcm)->z = z;
     (*zcm)->zt = zt;
 
-    size_t i;
-    for (i = 0; i < ZCM_NONBLOCK_SUBS_MAX; ++i)
-        (*zcm)->subInUse[i] = false;
+    /* Lowest slots first */
+    (*zcm)->freeHead = NO_SUB;
+    for (i = ZCM_NONBLOCK_SUBS_MAX - 1; i >= 0; --i)
+        freeSub(*zcm, i);
+    (*zcm)->prefixHead = NO_SUB;
+    for (i = 0; i < ZCM_NONBLOCK_HASH_SIZE; ++i)
+        (*zcm)->bucketHead[i] = NO_SUB;
+    (*zcm)->dispatchDepth = 0;
+    (*zcm)->numDead = 0;
 
-    (*zcm)->subInUseEnd = 0;
     return ZCM_EOK;
 }
 
@@ -88,125 +221,181 @@ int zcm_nonblocking_publish(zcm_nonblocking_t* z, const char* channel,
     msg.len = len;
     /* Casting away constness okay because msg isn't used past end of function */
     msg.buf = (uint8_t*) data;
+    msg.channel_id = 0;
     return zcm_trans_sendmsg(z->zt, msg);
 }
 
 zcm_sub_t* zcm_nonblocking_subscribe(zcm_nonblocking_t* zcm, const char* channel,
                                      zcm_msg_handler_t cb, void* usr)
 {
-    int rc;
-    size_t i;
-
-    rc = zcm_trans_recvmsg_enable(zcm->zt, channel, true);
+    int rc, i;
+    int* head;
+    size_t clen, b;
+    uint32_t hash;
+    bool regex;
 
-    if (rc != ZCM_EOK) return NULL;
-
-    for (i = 0; i <= zcm->subInUseEnd && i < ZCM_NONBLOCK_SUBS_MAX; ++i) {
-        if (zcm->subInUse[i]) continue;
+    if (zcm->freeHead == NO_SUB) return NULL;
 
-        strncpy(zcm->subs[i].channel, channel, ZCM_CHANNEL_MAXLEN);
-        zcm->subs[i].channel[ZCM_CHANNEL_MAXLEN] = '\0';
-        zcm->subs[i].callback = cb;
-        zcm->subs[i].usr = usr;
+    clen = strlen(channel);
+    if (clen > ZCM_CHANNEL_MAXLEN) clen = ZCM_CHANNEL_MAXLEN;
+    regex = isRegexChannel(channel, clen);
+    if (regex && !isSupportedRegex(channel, clen)) return NULL;
 
-        size_t clen = strlen(zcm->subs[i].channel);
-        zcm->subIsRegex[i] = isRegexChannel(zcm->subs[i].channel, clen);
-        if (zcm->subIsRegex[i] &&
-            !isSupportedRegex(zcm->subs[i].channel, clen)) {
-            return NULL;
-        }
-
-        zcm->subInUse[i] = true;
+    rc = zcm_trans_recvmsg_enable(zcm->zt, channel, true);
 
-        if (i == zcm->subInUseEnd) ++zcm->subInUseEnd;
+    if (rc != ZCM_EOK) return NULL;
 
-        return &zcm->subs[i];
+    i = zcm->freeHead;
+    zcm->freeHead = zcm->subNext[i];
+
+    strncpy(zcm->subs[i].channel, channel, ZCM_CHANNEL_MAXLEN);
+    zcm->subs[i].channel[ZCM_CHANNEL_MAXLEN] = '\0';
+    zcm->subs[i].callback = cb;
+    zcm->subs[i].usr = usr;
+    zcm->subs[i].flags = 0;
+
+    if (regex) {
+        zcm->subState[i] = SUB_PREFIX;
+        zcm->subPrefixLen[i] = (uint8_t) (clen - 2);
+        head = &zcm->prefixHead;
+    } else {
+        zcm->subState[i] = SUB_EXACT;
+        hash = hashChannel(channel);
+        b = findBucket(zcm, channel, hash);
+        if (zcm->bucketHead[b] == NO_SUB) zcm->bucketHash[b] = hash;
+        head = &zcm->bucketHead[b];
     }
-    return NULL;
+    linkSub(zcm, head, i);
+
+    return &zcm->subs[i];
 }
 
 int zcm_nonblocking_unsubscribe(zcm_nonblocking_t* zcm, zcm_sub_t* sub)
 {
-    size_t i;
     int match_idx = sub - zcm->subs;
     bool lastChanSub = true;
     int rc = ZCM_EOK;
-
-    if (match_idx < 0 || match_idx >= zcm->subInUseEnd) return ZCM_EINVALID;
-    if (!zcm->subInUse[match_idx]) return ZCM_EINVALID;
-
-    for (i = 0; i < zcm->subInUseEnd; ++i) {
-        if (!zcm->subInUse[i]) continue;
-        /* Note: it would be nice if we didn't have to do a string comp to unsubscribe, but
-                 we need to count the number of channel matches so we know when we can disable
-                 the transport's recvmsg_enable */
-        if (match_idx != i &&
-            strncmp(sub->channel, zcm->subs[i].channel, ZCM_CHANNEL_MAXLEN) == 0) {
-            lastChanSub = false;
-            break;
+    int i;
+    size_t b;
+
+    if (match_idx < 0 || match_idx >= ZCM_NONBLOCK_SUBS_MAX) return ZCM_EINVALID;
+
+    if (zcm->subState[match_idx] == SUB_EXACT) {
+        b = findBucket(zcm, sub->channel, hashChannel(sub->channel));
+        if (!unlinkSub(zcm, &zcm->bucketHead[b], match_idx)) return ZCM_EINVALID;
+        if (zcm->bucketHead[b] == NO_SUB) clearBucket(zcm, b);
+        else lastChanSub = false;
+    } else if (zcm->subState[match_idx] == SUB_PREFIX) {
+        if (!unlinkSub(zcm, &zcm->prefixHead, match_idx)) return ZCM_EINVALID;
+        for (i = zcm->prefixHead; i != NO_SUB; i = zcm->subNext[i]) {
+            if (strncmp(sub->channel, zcm->subs[i].channel, ZCM_CHANNEL_MAXLEN) == 0) {
+                lastChanSub = false;
+                break;
+            }
         }
+    } else {
+        return ZCM_EINVALID;
     }
 
     if (lastChanSub) rc = zcm_trans_recvmsg_enable(zcm->zt, sub->channel, false);
 
-    zcm->subInUse[match_idx] = false;
-    while (zcm->subInUseEnd > 0 && !zcm->subInUse[zcm->subInUseEnd - 1]) {
-        --zcm->subInUseEnd;
+    /* A dispatch in progress may still have to walk past it */
+    if (zcm->dispatchDepth > 0) {
+        zcm->subState[match_idx] = SUB_DEAD;
+        ++zcm->numDead;
+    } else {
+        freeSub(zcm, match_idx);
     }
 
     return rc;
 }
 
-static void dispatch_message(zcm_nonblocking_t* zcm, zcm_msg_t* msg)
+static void dispatch_sub(zcm_nonblocking_t* zcm, int i, zcm_msg_t* msg)
 {
     zcm_recv_buf_t rbuf;
-    zcm_sub_t* sub;
+    zcm_sub_t* sub = &zcm->subs[i];
 
-    size_t i;
-    for (i = 0; i < zcm->subInUseEnd; ++i) {
-        if (!zcm->subInUse[i]) continue;
+    rbuf.zcm = zcm->z;
+    rbuf.data = msg->buf;
+    rbuf.data_size = msg->len;
+    rbuf.recv_utime = msg->utime;
 
-        bool shouldDispatch = false;
+    sub->callback(&rbuf, msg->channel, sub->usr);
+}
 
-        if (zcm->subIsRegex[i]) {
-            /* This only works because isSupportedRegex() is called on subscribe */
-            if (strlen(msg->channel) > 2 &&
-                strncmp(zcm->subs[i].channel, msg->channel,
-                        strlen(zcm->subs[i].channel) - 2) == 0) {
-                shouldDispatch = true;
-            }
+static void dispatch_message(zcm_nonblocking_t* zcm, zcm_msg_t* msg)
+{
+    int i, exact, prefix;
+    size_t b;
+
+    ++zcm->dispatchDepth;
+
+    /* Subscriptions to exactly this channel */
+    b = findBucket(zcm, msg->channel, hashChannel(msg->channel));
+    exact = zcm->bucketHead[b];
+    /* This only works because isSupportedRegex() is called on subscribe */
+    prefix = strlen(msg->channel) > 2 ? zcm->prefixHead : NO_SUB;
+
+    /* Both lists are in slot order, so merging them dispatches in slot order */
+    while (exact != NO_SUB || prefix != NO_SUB) {
+        if (prefix == NO_SUB || (exact != NO_SUB && exact < prefix)) {
+            i = exact;
+            if (zcm->subState[i] == SUB_EXACT) dispatch_sub(zcm, i, msg);
+            exact = zcm->subNext[i];
         } else {
-            if (strncmp(zcm->subs[i].channel, msg->channel, ZCM_CHANNEL_MAXLEN) == 0) {
-                shouldDispatch = true;
-            }
-        }
-
-        if (shouldDispatch) {
-            rbuf.zcm = zcm->z;
-            rbuf.data = msg->buf;
-            rbuf.data_size = msg->len;
-            rbuf.recv_utime = msg->utime;
-
-            sub = &zcm->subs[i];
-            sub->callback(&rbuf, msg->channel, sub->usr);
+            i = prefix;
+            if (zcm->subState[i] == SUB_PREFIX &&
+                strncmp(zcm->subs[i].channel, msg->channel, zcm->subPrefixLen[i]) == 0)
+                dispatch_sub(zcm, i, msg);
+            prefix = zcm->subNext[i];
         }
     }
+
+    if (--zcm->dispatchDepth == 0 && zcm->numDead > 0) freeDeadSubs(zcm);
 }
 
 int zcm_nonblocking_handle_nonblock(zcm_nonblocking_t* zcm)
 {
-    int ret;
+    int ret = zcm_nonblocking_handle_nonblock_budget(zcm, 1, 0);
+    if (ret < 0) return ret;
+    return ret > 0 ? ZCM_EOK : ZCM_EAGAIN;
+}
+
+int zcm_nonblocking_handle_nonblock_budget(zcm_nonblocking_t* zcm,
+                                           uint32_t maxMsgs, uint32_t maxMicros)
+{
+    int ret, n = 0;
     zcm_msg_t msg;
+#ifdef ZCM_NONBLOCK_UTIME
+    uint64_t start = 0;
+#endif
 
-    /* Perform any required traansport-level updates */
-    zcm_trans_update(zcm->zt);
+    if (maxMsgs == 0) return ZCM_EINVALID;
+    if (maxMsgs > INT32_MAX) maxMsgs = INT32_MAX;
+#ifdef ZCM_NONBLOCK_UTIME
+    if (maxMicros != 0) start = ZCM_NONBLOCK_UTIME();
+#else
+    if (maxMicros != 0) return ZCM_EINVALID;
+#endif
 
-    /* Try to receive a messages from the transport and dispatch them */
-    if ((ret = zcm_trans_recvmsg(zcm->zt, &msg, 0)) != ZCM_EOK) return ret;
+    /* Perform any required transport-level updates, once for the whole batch */
+    zcm_trans_update(zcm->zt);
 
-    dispatch_message(zcm, &msg);
+    /* Receive and dispatch whatever the transport already has, within budget */
+    while ((uint32_t) n < maxMsgs) {
+        if ((ret = zcm_trans_recvmsg(zcm->zt, &msg, 0)) != ZCM_EOK) {
+            /* Other errors are reported once the messages that made it are accounted for */
+            if (n == 0 && ret != ZCM_EAGAIN) return ret;
+            break;
+        }
+        dispatch_message(zcm, &msg);
+        ++n;
+#ifdef ZCM_NONBLOCK_UTIME
+        if (maxMicros != 0 && ZCM_NONBLOCK_UTIME() - start >= maxMicros) break;
+#endif
+    }
 
-    return ZCM_EOK;
+    return n;
 }
 
 void zcm_nonblocking_flush(zcm_nonblocking_t* zcm)
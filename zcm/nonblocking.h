@@ -25,6 +25,10 @@ int zcm_nonblocking_unsubscribe(zcm_nonblocking_t* zcm, zcm_sub_t* sub);
 /* Returns 1 if a message was dispatched, and 0 otherwise */
 int zcm_nonblocking_handle_nonblock(zcm_nonblocking_t* zcm);
 
+/* Returns the number of messages dispatched, or an error code if none were */
+int zcm_nonblocking_handle_nonblock_budget(zcm_nonblocking_t* zcm,
+                                           uint32_t maxMsgs, uint32_t maxMicros);
+
 void zcm_nonblocking_flush(zcm_nonblocking_t* zcm);
 
 #ifndef ZCM_EMBEDDED
@@ -98,6 +98,47 @@
  *      --------------------------------------------------------------------
  *         Close the transport and cleanup any resources used.
  *
+ *      int sendmsg_batch(zcm_trans_t* zt, const zcm_msg_t* msgs, size_t nmsgs)
+ *      --------------------------------------------------------------------
+ *         Optional, may be NULL. Sends 'nmsgs' messages in order, exactly as
+ *         if sendmsg() had been called on each of them. A failure to send one
+ *         message does not stop the others from being sent. Returns ZCM_EOK if
+ *         every message was sent, otherwise the error of the last failure.
+ *         Transports that can hand several messages to the OS at once (or
+ *         need a lock per send) should implement this.
+ *
+ *      int recvmsg_batch(zcm_trans_t* zt, zcm_msg_t* msgs, size_t maxmsgs,
+ *                        size_t* nmsgs, int timeout)
+ *      --------------------------------------------------------------------
+ *         Optional, may be NULL. Like recvmsg(), but receives up to 'maxmsgs'
+ *         messages into 'msgs' and stores how many it received in 'nmsgs'.
+ *         This method blocks (subject to 'timeout') until at least one
+ *         message is available and then returns every message that is
+ *         immediately available (up to 'maxmsgs') without blocking again.
+ *         Returns ZCM_EOK if at least one message was received, otherwise
+ *         it should return EAGAIN. The memory of all received messages must
+ *         stay valid until the next call to recvmsg() or recvmsg_batch().
+ *
+ *      When the batch methods are NULL, the zcm_trans_*_batch() helpers below
+ *      fall back to the single message methods.
+ *
+ *      int get_stats(zcm_trans_t* zt, zcm_transport_stats_t* stats)
+ *      --------------------------------------------------------------------
+ *         Optional, may be NULL. Fills 'stats' with the counters of the
+ *         transport (see zcm_get_transport_stats()) and returns ZCM_EOK.
+ *         NOTE: This method is called from user threads and should work
+ *         concurrently with every other method.
+ *
+ *      Channel ids: on every message zcm hands to sendmsg()/sendmsg_batch(),
+ *      'channel_id' is the id of the channel in the process-wide channel table
+ *      (see zcm/util/channel_intern.hpp) and 'channel' is the table's copy of
+ *      its name. zcm clears 'channel_id' before every recvmsg() and
+ *      recvmsg_batch(). Transports that keep messages within the process (or
+ *      otherwise know the id of a received channel) may hand both back
+ *      unchanged, which spares zcm from looking the channel up by name. An id
+ *      is only trusted if 'channel' points at the table's copy of its name.
+ *      Other transports can ignore the field.
+ *
  *******************************************************************************
  * Non-Blocking Transport API:
  *
@@ -167,6 +208,10 @@
  *      --------------------------------------------------------------------
  *         Close the transport and cleanup any resources used.
  *
+ *      sendmsg_batch / recvmsg_batch / get_stats
+ *      --------------------------------------------------------------------
+ *         These are unused (in this mode) and should be set to NULL.
+ *
  ******************************************************************************/
 
 #ifdef __cplusplus
@@ -198,6 +243,7 @@ struct zcm_msg_t
     const char* channel;
     size_t len;
     uint8_t* buf;
+    uint32_t channel_id; /* 0 means unknown, see "Channel ids" above */
 };
 
 struct zcm_trans_t
@@ -214,6 +260,10 @@ struct zcm_trans_methods_t
     int     (*recvmsg)(zcm_trans_t* zt, zcm_msg_t* msg, int timeout);
     int     (*update)(zcm_trans_t* zt);
     void    (*destroy)(zcm_trans_t* zt);
+    int     (*sendmsg_batch)(zcm_trans_t* zt, const zcm_msg_t* msgs, size_t nmsgs);
+    int     (*recvmsg_batch)(zcm_trans_t* zt, zcm_msg_t* msgs, size_t maxmsgs,
+                             size_t* nmsgs, int timeout);
+    int     (*get_stats)(zcm_trans_t* zt, zcm_transport_stats_t* stats);
 };
 
 /* Helper functions to make the VTbl dispatch cleaner */
@@ -235,6 +285,39 @@ static INLINE int zcm_trans_update(zcm_trans_t* zt)
 static INLINE void zcm_trans_destroy(zcm_trans_t* zt)
 { return zt->vtbl->destroy(zt); }
 
+static INLINE int zcm_trans_sendmsg_batch(zcm_trans_t* zt, const zcm_msg_t* msgs, size_t nmsgs)
+{
+    size_t i;
+    int rc, ret = ZCM_EOK;
+    if (zt->vtbl->sendmsg_batch) return zt->vtbl->sendmsg_batch(zt, msgs, nmsgs);
+    for (i = 0; i < nmsgs; ++i) {
+        rc = zt->vtbl->sendmsg(zt, msgs[i]);
+        if (rc != ZCM_EOK) ret = rc;
+    }
+    return ret;
+}
+
+/* Without batch support only one message can be received per call, since the next
+   recvmsg() is allowed to invalidate the memory of the previous message */
+static INLINE int zcm_trans_recvmsg_batch(zcm_trans_t* zt, zcm_msg_t* msgs, size_t maxmsgs,
+                                          size_t* nmsgs, int timeout)
+{
+    int rc;
+    if (zt->vtbl->recvmsg_batch)
+        return zt->vtbl->recvmsg_batch(zt, msgs, maxmsgs, nmsgs, timeout);
+    *nmsgs = 0;
+    if (maxmsgs == 0) return ZCM_EAGAIN;
+    rc = zt->vtbl->recvmsg(zt, &msgs[0], timeout);
+    if (rc == ZCM_EOK) *nmsgs = 1;
+    return rc;
+}
+
+static INLINE int zcm_trans_get_stats(zcm_trans_t* zt, zcm_transport_stats_t* stats)
+{
+    if (!zt->vtbl->get_stats) return ZCM_EINVALID;
+    return zt->vtbl->get_stats(zt, stats);
+}
+
 #ifdef __cplusplus
 }
 #endif
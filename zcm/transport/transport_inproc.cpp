@@ -2,12 +2,14 @@
 #include "zcm/transport_registrar.h"
 #include "zcm/transport_register.hpp"
 
+#include "zcm/util/channel_intern.hpp"
 #include "zcm/util/debug.h"
 #include "util/TimeUtil.hpp"
 
 #include <algorithm>
 #include <cstring>
 #include <deque>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 
@@ -18,12 +20,13 @@ using namespace std;
 
 struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
 {
-    // Messages are queued into a deque and then dispatched one at a time through recvmsg
-    // using the "inFlight" pointers to store their memory until the next message is dispatched
-    // Note: Have to use free() to clean up chan memory in these because we create them via strdup
+    // Messages are queued into a deque and then dispatched through recvmsg (or several at
+    // a time through recvmsgBatch) using "inFlight" to store their memory until the next
+    // recv call
+    // Note: Channels are interned, so a message keeps its channel id (and the interned name)
+    //       from sendmsg() all the way to recvmsg() and the name is never copied
     deque<zcm_msg_t*> msgs;
-    const char*    inFlightChanMem = nullptr;
-          uint8_t* inFlightDataMem = nullptr;
+    vector<zcm_msg_t> inFlight;
 
     condition_variable msgCond;
     mutex msgLock;
@@ -37,22 +40,24 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
     ~ZCM_TRANS_CLASSNAME()
     {
         for (auto msg: msgs) {
-            free((void*) msg->channel);
             delete [] msg->buf;
             delete msg;
         }
         msgs.clear();
 
-        free((void*) inFlightChanMem);
-        delete [] inFlightDataMem;
+        freeInFlight();
     }
 
-    bool good() { return true; }
-
-    /********************** METHODS **********************/
-    size_t get_mtu() { return MTU; }
+    void freeInFlight()
+    {
+        for (auto& msg : inFlight) {
+            delete [] msg.buf;
+        }
+        inFlight.clear();
+    }
 
-    int sendmsg(zcm_msg_t msg)
+    // Returns a copy of msg that the queue can own or nullptr if msg is invalid
+    static zcm_msg_t* copyMsg(const zcm_msg_t& msg)
     {
         size_t chanLen = 0;
         for (; chanLen < ZCM_CHANNEL_MAXLEN + 1; ++chanLen) {
@@ -60,35 +65,82 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
         }
         if (chanLen > ZCM_CHANNEL_MAXLEN) {
             ZCM_DEBUG("nonblock_inproc_send failed: invalid channel length");
-            return ZCM_EINVALID;
+            return nullptr;
         }
         if (msg.len > MTU) {
             ZCM_DEBUG("nonblock_inproc_send failed: msg larger than MTU");
-            return ZCM_EINVALID;
+            return nullptr;
+        }
+
+        uint32_t id = msg.channel_id;
+        if (id == zcm::ChannelIntern::NONE || zcm::ChannelIntern::name(id) != msg.channel) {
+            id = zcm::ChannelIntern::id(msg.channel);
+            if (id == zcm::ChannelIntern::NONE) {
+                ZCM_DEBUG("nonblock_inproc_send failed: unable to intern channel");
+                return nullptr;
+            }
         }
 
         zcm_msg_t *newMsg = new zcm_msg_t();
         newMsg->utime = msg.utime;
         newMsg->len = msg.len;
-        newMsg->channel = strdup(msg.channel);
+        newMsg->channel = zcm::ChannelIntern::name(id);
+        newMsg->channel_id = id;
         newMsg->buf = new uint8_t[msg.len];
         std::copy_n(msg.buf, msg.len, newMsg->buf);
+        return newMsg;
+    }
 
+    bool good() { return true; }
+
+    /********************** METHODS **********************/
+    size_t get_mtu() { return MTU; }
+
+    int sendmsg(zcm_msg_t msg)
+    {
+        zcm_msg_t *newMsg = copyMsg(msg);
+        if (!newMsg) return ZCM_EINVALID;
+        enqueue(&newMsg, 1);
+        return ZCM_EOK;
+    }
+
+    // Copies every message first so that they are all queued under one lock
+    int sendmsgBatch(const zcm_msg_t *batch, size_t nmsgs)
+    {
+        int ret = ZCM_EOK;
+        vector<zcm_msg_t*> copies;
+        copies.reserve(nmsgs);
+        for (size_t i = 0; i < nmsgs; ++i) {
+            zcm_msg_t *newMsg = copyMsg(batch[i]);
+            if (newMsg) copies.push_back(newMsg);
+            else        ret = ZCM_EINVALID;
+        }
+        if (!copies.empty()) enqueue(copies.data(), copies.size());
+        return ret;
+    }
+
+    void enqueue(zcm_msg_t **newMsgs, size_t n)
+    {
         std::unique_lock<mutex> lk(msgLock, defer_lock);
         if (trans_type == ZCM_BLOCKING) lk.lock();
-        msgs.push_back(newMsg);
+        msgs.insert(msgs.end(), newMsgs, newMsgs + n);
         if (trans_type == ZCM_BLOCKING) {
             lk.unlock();
             msgCond.notify_all();
         }
-
-        return ZCM_EOK;
     }
 
     int recvmsg_enable(const char *channel, bool enable) { return ZCM_EOK; }
 
     int recvmsg(zcm_msg_t *msg, int timeout)
     {
+        size_t n;
+        return recvmsgBatch(msg, 1, &n, timeout);
+    }
+
+    int recvmsgBatch(zcm_msg_t *batch, size_t maxmsgs, size_t *nmsgs, int timeout)
+    {
+        *nmsgs = 0;
         std::unique_lock<mutex> lk(msgLock, defer_lock);
 
         if (trans_type == ZCM_BLOCKING) {
@@ -100,19 +152,21 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
             if (msgs.empty()) return ZCM_EAGAIN;
         }
 
-        // Clean up memory from last message
-        free((void*) inFlightChanMem);
-        delete [] inFlightDataMem;
+        // Clean up memory from the last recv
+        freeInFlight();
 
         // Steal the dynamic memory from the front of the queue, but hang onto the
-        // ptrs via the "inFlight" ptrs so we can clean it up later
-        *msg = *(msgs.front());
-        msg->utime = TimeUtil::utime();
-        inFlightChanMem = msg->channel;
-        inFlightDataMem = msg->buf;
-
-        delete msgs.front();
-        msgs.pop_front();
+        // ptrs via "inFlight" so we can clean it up later
+        uint64_t utime = TimeUtil::utime();
+        while (*nmsgs < maxmsgs && !msgs.empty()) {
+            zcm_msg_t *msg = &batch[(*nmsgs)++];
+            *msg = *(msgs.front());
+            msg->utime = utime;
+            inFlight.push_back(*msg);
+
+            delete msgs.front();
+            msgs.pop_front();
+        }
 
         return ZCM_EOK;
     }
@@ -142,6 +196,13 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
     static int _update(zcm_trans_t *zt)
     { return cast(zt)->update(); }
 
+    static int _sendmsgBatch(zcm_trans_t *zt, const zcm_msg_t *msgs, size_t nmsgs)
+    { return cast(zt)->sendmsgBatch(msgs, nmsgs); }
+
+    static int _recvmsgBatch(zcm_trans_t *zt, zcm_msg_t *msgs, size_t maxmsgs,
+                             size_t *nmsgs, int timeout)
+    { return cast(zt)->recvmsgBatch(msgs, maxmsgs, nmsgs, timeout); }
+
     static void _destroy(zcm_trans_t *zt)
     { delete cast(zt); }
 
@@ -156,6 +217,8 @@ zcm_trans_methods_t ZCM_TRANS_CLASSNAME::methods = {
     &ZCM_TRANS_CLASSNAME::_recvmsg,
     &ZCM_TRANS_CLASSNAME::_update,
     &ZCM_TRANS_CLASSNAME::_destroy,
+    &ZCM_TRANS_CLASSNAME::_sendmsgBatch,
+    &ZCM_TRANS_CLASSNAME::_recvmsgBatch,
 };
 
 static zcm_trans_t *create_blocking(zcm_url_t *url)
@@ -3,6 +3,7 @@
 #include "zcm/transport.h"
 #include "zcm/transport_registrar.h"
 #include "zcm/transport_register.hpp"
+#include "zcm/util/channel_intern.hpp"
 #include "zcm/util/debug.h"
 #include "zcm/util/lockfile.h"
 #include <zmq.h>
@@ -27,6 +28,7 @@
 #include <regex>
 
 using namespace std;
+using zcm::ChannelIntern;
 
 // Define this the class name you want
 #define ZCM_TRANS_CLASSNAME TransportZmqLocal
@@ -61,16 +63,22 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
     int pubhwm = 1000, subhwm = 1000;
 
     unordered_map<string, pair<void*,lockfile_t*>> pubsocks;
+    // The same sockets by interned channel id, for messages that come with one
+    vector<void*> pubsocksById;
     // socket pair contains the socket + whether it was subscribed to explicitly or not
     unordered_map<string, pair<void*, bool>> subsocks;
     typedef unordered_map<string, pair<void*, bool>>::iterator SubsocksItr;
     unordered_map<string, std::regex> regexChannels;
 
-    string recvmsgChannel;
     size_t recvmsgBufferSize = START_BUF_SIZE; // Start at 1MB but allow it to grow to MTU
     uint8_t* recvmsgBuffer;
     size_t startRecvSockIdx = 0;
 
+    // Messages handed out by the last recvmsgBatch() and the ids of the channels they came
+    // from. Held until the next recv so that they can be returned without copying
+    vector<zmq_msg_t> batchMsgs;
+    vector<uint32_t> batchChannels;
+
     // Mutex used to protect 'subsocks' while allowing
     // recvmsgEnable() and recvmsg() to be called
     // concurrently
@@ -117,6 +125,8 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
         int rc;
         string address;
 
+        releaseBatch();
+
         // Clean up all publish sockets
         for (auto it = pubsocks.begin(); it != pubsocks.end(); ++it) {
             address = getAddress(it->first);
@@ -321,15 +331,28 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
         return MTU;
     }
 
+    // Only looks the channel up by name the first time a channel id is seen
+    void *pubsockFor(const zcm_msg_t& msg)
+    {
+        uint32_t id = msg.channel_id;
+        if (id == ChannelIntern::NONE || ChannelIntern::name(id) != msg.channel)
+            return pubsockFindOrCreate(msg.channel);
+        if (id < pubsocksById.size() && pubsocksById[id]) return pubsocksById[id];
+        void *sock = pubsockFindOrCreate(msg.channel);
+        if (sock == nullptr) return nullptr;
+        if (id >= pubsocksById.size()) pubsocksById.resize(id + 1, nullptr);
+        pubsocksById[id] = sock;
+        return sock;
+    }
+
     int sendmsg(zcm_msg_t msg)
     {
-        string channel = msg.channel;
-        if (channel.size() > ZCM_CHANNEL_MAXLEN)
+        if (strlen(msg.channel) > ZCM_CHANNEL_MAXLEN)
             return ZCM_EINVALID;
         if (msg.len > MTU)
             return ZCM_EINVALID;
 
-        void *sock = pubsockFindOrCreate(channel);
+        void *sock = pubsockFor(msg);
         if (sock == nullptr)
             return ZCM_ECONNECT;
         int rc = zmq_send(sock, msg.buf, msg.len, 0);
@@ -390,40 +413,53 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
         }
     }
 
-    int recvmsg(zcm_msg_t *msg, int timeout)
+    // Build up a list of poll items and the interned ids of their channels, so that
+    // received messages point at the interned names and carry their ids
+    void buildPollItems(vector<zmq_pollitem_t>& pitems, vector<uint32_t>& pchannels)
     {
-        // Build up a list of poll items
-        vector<zmq_pollitem_t> pitems;
-        vector<string> pchannels;
-        {
-            // Mutex used to protect 'subsocks' while allowing
-            // recvmsgEnable() and recvmsg() to be called
-            // concurrently
-            unique_lock<mutex> lk(mut);
-
-            // XXX Only call this if enough time has ellapse since the last
-            //     time you called it
-            if (!regexChannels.empty()) {
-                switch (type) {
-                    case IPC: ipcScanForNewChannels();
-                    case INPROC: inprocScanForNewChannels();
-                }
-            }
+        // Mutex used to protect 'subsocks' while allowing
+        // recvmsgEnable() and recvmsg() to be called
+        // concurrently
+        unique_lock<mutex> lk(mut);
 
-            pitems.resize(subsocks.size());
-            int i = 0;
-            for (auto& elt : subsocks) {
-                auto& channel = elt.first;
-                auto& sock = elt.second.first;
-                auto *p = &pitems[i];
-                memset(p, 0, sizeof(*p));
-                p->socket = sock;
-                p->events = ZMQ_POLLIN;
-                pchannels.emplace_back(channel);
-                ++i;
+        // XXX Only call this if enough time has ellapse since the last
+        //     time you called it
+        if (!regexChannels.empty()) {
+            switch (type) {
+                case IPC: ipcScanForNewChannels();
+                case INPROC: inprocScanForNewChannels();
             }
         }
 
+        pitems.clear();
+        pchannels.clear();
+        for (auto& elt : subsocks) {
+            uint32_t id = ChannelIntern::id(elt.first.c_str());
+            // Can't be handed to zcm without an id
+            if (id == ChannelIntern::NONE) continue;
+            zmq_pollitem_t p;
+            memset(&p, 0, sizeof(p));
+            p.socket = elt.second.first;
+            p.events = ZMQ_POLLIN;
+            pitems.push_back(p);
+            pchannels.push_back(id);
+        }
+    }
+
+    void releaseBatch()
+    {
+        for (auto& m : batchMsgs) zmq_msg_close(&m);
+        batchMsgs.clear();
+    }
+
+    int recvmsg(zcm_msg_t *msg, int timeout)
+    {
+        releaseBatch();
+
+        vector<zmq_pollitem_t> pitems;
+        vector<uint32_t> pchannels;
+        buildPollItems(pitems, pchannels);
+
         timeout = (timeout >= 0) ? timeout : -1;
         int rc = zmq_poll(pitems.data(), pitems.size(), timeout);
         // TODO: implement better error handling, but can't assert because this triggers during
@@ -460,8 +496,8 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
                     recvmsgBuffer = new uint8_t[recvmsgBufferSize];
                     return ZCM_EAGAIN;
                 }
-                recvmsgChannel = pchannels[i];
-                msg->channel = recvmsgChannel.c_str();
+                msg->channel = ChannelIntern::name(pchannels[i]);
+                msg->channel_id = pchannels[i];
                 msg->len = rc;
                 msg->buf = recvmsgBuffer;
 
@@ -498,6 +534,65 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
         return ZCM_EAGAIN;
     }
 
+    // Polls once and then takes every message that is already queued on the ready
+    // sockets, one socket at a time in round-robin order. The messages are received
+    // straight into zmq messages so nothing is copied and they are never truncated
+    int recvmsgBatch(zcm_msg_t *msgs, size_t maxmsgs, size_t *nmsgs, int timeout)
+    {
+        *nmsgs = 0;
+        releaseBatch();
+
+        vector<zmq_pollitem_t> pitems;
+        buildPollItems(pitems, batchChannels);
+
+        timeout = (timeout >= 0) ? timeout : -1;
+        int rc = zmq_poll(pitems.data(), pitems.size(), timeout);
+        if (rc == -1) {
+            ZCM_DEBUG("zmq_poll failed with: %s", zmq_strerror(errno));
+            return ZCM_EAGAIN;
+        }
+        if (rc == 0) return ZCM_EAGAIN;
+
+        if (startRecvSockIdx >= pitems.size()) startRecvSockIdx = 0;
+        batchMsgs.reserve(maxmsgs);
+        uint64_t utime = TimeUtil::utime();
+
+        // Keep making passes over the ready sockets until they are all drained
+        bool progress = true;
+        while (progress && *nmsgs < maxmsgs) {
+            progress = false;
+            for (size_t n = 0; n < pitems.size() && *nmsgs < maxmsgs; ++n) {
+                size_t i = (startRecvSockIdx + n) % pitems.size();
+                auto& p = pitems[i];
+                if (p.revents == 0) continue;
+
+                batchMsgs.emplace_back();
+                zmq_msg_t *zmsg = &batchMsgs.back();
+                zmq_msg_init(zmsg);
+                int sz = zmq_msg_recv(zmsg, p.socket, ZMQ_DONTWAIT);
+                if (sz == -1) {
+                    if (errno != EAGAIN)
+                        ZCM_DEBUG("zmq_msg_recv failed with: %s", zmq_strerror(errno));
+                    zmq_msg_close(zmsg);
+                    batchMsgs.pop_back();
+                    p.revents = 0;
+                    continue;
+                }
+
+                zcm_msg_t *msg = &msgs[(*nmsgs)++];
+                msg->utime = utime;
+                msg->channel = ChannelIntern::name(batchChannels[i]);
+                msg->channel_id = batchChannels[i];
+                msg->len = sz;
+                msg->buf = (uint8_t*) zmq_msg_data(zmsg);
+                progress = true;
+            }
+        }
+        ++startRecvSockIdx;
+
+        return *nmsgs > 0 ? ZCM_EOK : ZCM_EAGAIN;
+    }
+
     /********************** STATICS **********************/
     static zcm_trans_methods_t methods;
     static ZCM_TRANS_CLASSNAME *cast(zcm_trans_t *zt)
@@ -518,6 +613,10 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
     static int _recvmsg(zcm_trans_t *zt, zcm_msg_t *msg, int timeout)
     { return cast(zt)->recvmsg(msg, timeout); }
 
+    static int _recvmsgBatch(zcm_trans_t *zt, zcm_msg_t *msgs, size_t maxmsgs,
+                             size_t *nmsgs, int timeout)
+    { return cast(zt)->recvmsgBatch(msgs, maxmsgs, nmsgs, timeout); }
+
     static void _destroy(zcm_trans_t *zt)
     { delete cast(zt); }
 
@@ -532,6 +631,8 @@ zcm_trans_methods_t ZCM_TRANS_CLASSNAME::methods = {
     &ZCM_TRANS_CLASSNAME::_recvmsg,
     NULL, // update
     &ZCM_TRANS_CLASSNAME::_destroy,
+    NULL, // sendmsg_batch
+    &ZCM_TRANS_CLASSNAME::_recvmsgBatch,
 };
 
 static zcm_trans_t *createIpc(zcm_url_t *url)
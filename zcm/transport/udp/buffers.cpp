@@ -1,15 +1,8 @@
 #include "buffers.hpp"
 
-static bool sockaddrEqual(struct sockaddr_in *a, struct sockaddr_in *b)
+static FragKey fragKey(const struct sockaddr_in *from, u32 msg_seqno)
 {
-    return a->sin_addr.s_addr == b->sin_addr.s_addr &&
-           a->sin_port        == b->sin_port &&
-           a->sin_family      == b->sin_family;
-}
-
-bool FragBuf::matchesSockaddr(struct sockaddr_in *addr)
-{
-    return sockaddrEqual(&from, addr);
+    return FragKey{from->sin_addr.s_addr, from->sin_port, msg_seqno};
 }
 
 MessagePool::MessagePool(size_t maxSize, size_t maxBuffers)
@@ -19,6 +12,7 @@ MessagePool::MessagePool(size_t maxSize, size_t maxBuffers)
 
 MessagePool::~MessagePool()
 {
+    while (!fragbufs.empty()) removeFragBuf(fragbufs.begin()->second);
 }
 
 Buffer MessagePool::allocBuffer(size_t sz)
@@ -82,69 +76,92 @@ void MessagePool::freeMessage(Message *b)
 }
 
 
-FragBuf *MessagePool::addFragBuf(u32 data_size)
+FragBuf *MessagePool::addFragBuf(struct sockaddr_in *from, u32 msg_seqno, u32 data_size,
+                                 u16 fragments_in_msg, i64 utime)
 {
-    FragBuf *fbuf = new (mempool.alloc<FragBuf>()) FragBuf{};
-    fbuf->buf = this->allocBuffer(data_size);
-
-    while (totalSize > maxSize || fragbufs.size() > maxBuffers) {
-        // find and remove the least recently updated fragment buffer
-        int idx = -1;
-        FragBuf *eldest = nullptr;
-        for (size_t i = 0; i < fragbufs.size(); i++) {
-            FragBuf *f = fragbufs[i];
-            if (idx == -1 || f->last_packet_utime < eldest->last_packet_utime) {
-                idx = (int)i;
-                eldest = f;
-            }
-        }
-        if (eldest) {
-            _removeFragBuf((size_t)idx);
-            // XXX Need to free the removed FragBuf*
-        }
-    }
+    FragKey key = fragKey(from, msg_seqno);
+    if (fragbufs.count(key)) return nullptr;
 
-    fragbufs.push_back(fbuf);
-    totalSize += data_size;
+    size_t sz = FRAG_BUF_DATA_OFFSET + data_size;
+    // A message bigger than maxSize can still be reassembled, just not next to any other
+    while (!fragbufs.empty() &&
+           (totalSize + sz > maxSize || fragbufs.size() >= maxBuffers))
+        _removeEldestFragBuf();
+
+    FragBuf *fbuf = new (mempool.alloc<FragBuf>()) FragBuf{};
+    fbuf->last_packet_utime = utime;
+    fbuf->msg_seqno = msg_seqno;
+    fbuf->data_size = data_size;
+    fbuf->fragments_remaining = fragments_in_msg;
+    fbuf->received.assign(fragments_in_msg, false);
+    fbuf->channellen = 0;
+    fbuf->from = *from;
+    fbuf->buf = this->allocBuffer(sz);
+
+    fragbufs[key] = fbuf;
+    totalSize += sz;
 
     return fbuf;
 }
 
-FragBuf *MessagePool::lookupFragBuf(struct sockaddr_in *key)
+FragBuf *MessagePool::lookupFragBuf(struct sockaddr_in *from, u32 msg_seqno)
+{
+    auto it = fragbufs.find(fragKey(from, msg_seqno));
+    return it == fragbufs.end() ? nullptr : it->second;
+}
+
+void MessagePool::_removeEldestFragBuf()
 {
+    // find and remove the least recently updated fragment buffer
+    FragBuf *eldest = nullptr;
     for (auto& elt : fragbufs)
-        if (elt->matchesSockaddr(key))
-            return elt;
-    return nullptr;
+        if (!eldest || elt.second->last_packet_utime < eldest->last_packet_utime)
+            eldest = elt.second;
+    if (eldest) {
+        ZCM_DEBUG("Evicting partial message (missing %d fragments)",
+                  eldest->fragments_remaining);
+        dropFragBuf(eldest);
+    }
 }
 
-void MessagePool::_removeFragBuf(size_t index)
+void MessagePool::removeFragBuf(FragBuf *fbuf)
 {
-    assert(index < fragbufs.size());
+    size_t erased = fragbufs.erase(fragKey(&fbuf->from, fbuf->msg_seqno));
+    assert(erased == 1 && "Tried to remove invalid fragbuf");
+    (void) erased;
 
-    // Update the total_size of the fragment buffers
-    FragBuf *fbuf = fragbufs[index];
+    // Update the total_size of the fragment buffers. The buffer itself may have been
+    // moved into a message already
     totalSize -= fbuf->buf.size;
 
-    // delete old element, move last element to this slot, and shrink by 1
-    size_t lastIdx = fragbufs.size()-1;
-    fragbufs[index] = fragbufs[lastIdx];
-    fragbufs.pop_back();
-
     this->freeBuffer(fbuf->buf);
+    fbuf->~FragBuf();
     mempool.free(fbuf);
 }
 
-void MessagePool::removeFragBuf(FragBuf *fbuf)
+void MessagePool::dropFragBuf(FragBuf *fbuf)
 {
-    // NOTE: this is kinda slow...
-    // Search for the fragbuf index
-    for (size_t idx = 0; idx < fragbufs.size(); idx++)
-        if (fragbufs[idx] == fbuf)
-            return this->_removeFragBuf(idx);
+    lostFragments.store(numLostFragments() + fbuf->fragments_remaining,
+                        std::memory_order_relaxed);
+    removeFragBuf(fbuf);
+}
 
-    // Did not find
-    assert(0 && "Tried to remove invalid fragbuf");
+void MessagePool::expireFragBufs(i64 now, i64 timeout)
+{
+    if (fragbufs.empty()) return;
+    // Stale buffers linger for at most another quarter of the timeout
+    if (now >= lastExpireUtime && now - lastExpireUtime < timeout / 4) return;
+    lastExpireUtime = now;
+
+    for (auto it = fragbufs.begin(); it != fragbufs.end();) {
+        FragBuf *fbuf = it->second;
+        ++it;
+        if (now - fbuf->last_packet_utime > timeout) {
+            ZCM_DEBUG("Dropping stale message (missing %d fragments)",
+                      fbuf->fragments_remaining);
+            dropFragBuf(fbuf);
+        }
+    }
 }
 
 void MessagePool::transferBufffer(Message *to, FragBuf *from)
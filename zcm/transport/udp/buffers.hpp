@@ -125,21 +125,46 @@ struct Packet
 };
 
 /******************** fragment buffer **********************/
+// Fragments of a message can come in any order. The channel is only known once fragment 0
+// arrives, so the data always starts at a fixed offset in the buffer
+#define FRAG_BUF_DATA_OFFSET (ZCM_CHANNEL_MAXLEN + 1)
+
 struct FragBuf
 {
     i64     last_packet_utime;
     u32     msg_seqno;
+    u32     data_size;
     u16     fragments_remaining;
+    vector<bool> received; // by fragment number, to ignore duplicates
 
-    // The channel starts at the beginning of the buffer. The data
-    // follows immediately after the channel and its NULL
+    // The channel (and its NULL) starts at the beginning of the buffer once fragment 0
+    // has arrived. The data starts at FRAG_BUF_DATA_OFFSET
     size_t  channellen;
     struct sockaddr_in from;
 
     // Fields set by the allocator object
     Buffer buf;
+};
+
+// Messages are reassembled per sender and sequence number, so several messages from the
+// same sender can be in flight at once
+struct FragKey
+{
+    u32 addr;
+    u16 port;
+    u32 msg_seqno;
 
-    bool matchesSockaddr(struct sockaddr_in *addr);
+    bool operator==(const FragKey& o) const
+    { return addr == o.addr && port == o.port && msg_seqno == o.msg_seqno; }
+};
+
+struct FragKeyHash
+{
+    size_t operator()(const FragKey& k) const
+    {
+        u64 h = ((u64) k.addr << 16 | k.port) * 0x9e3779b97f4a7c15ull;
+        return (size_t) (h ^ (h >> 29) ^ ((u64) k.msg_seqno * 0xbf58476d1ce4e5b9ull));
+    }
 };
 
 /************** A pool to handle every alloc/dealloc operation on Message objects ******/
@@ -162,21 +187,34 @@ struct MessagePool
     void freeMessage(Message *b);
 
     // FragBuf
-    FragBuf *addFragBuf(u32 data_size);
-    FragBuf *lookupFragBuf(struct sockaddr_in *key);
+    // Evicts the least recently updated fragment buffers as needed to stay within
+    // maxSize and maxBuffers. Returns NULL if there is one for this message already
+    FragBuf *addFragBuf(struct sockaddr_in *from, u32 msg_seqno, u32 data_size,
+                        u16 fragments_in_msg, i64 utime);
+    FragBuf *lookupFragBuf(struct sockaddr_in *from, u32 msg_seqno);
     void removeFragBuf(FragBuf *fbuf);
+    // Removes a partial message and counts its missing fragments as lost
+    void dropFragBuf(FragBuf *fbuf);
+    // Drops the fragment buffers that have not been updated for timeout micros. Only
+    // looks at them every once in a while, so it is cheap enough to call for every packet
+    void expireFragBufs(i64 now, i64 timeout);
+    size_t numFragBufs() const { return fragbufs.size(); }
+    // Fragments of the partial messages that were dropped. Can be read from any thread
+    u64 numLostFragments() const { return lostFragments.load(std::memory_order_relaxed); }
 
     void transferBufffer(Message *to, FragBuf *from);
     void moveBuffer(Buffer& to, Buffer& from);
 
   private:
     void _freeMessageBuffer(Message *b);
-    void _removeFragBuf(size_t index);
+    void _removeEldestFragBuf();
 
   private:
     MemPool mempool;
-    vector<FragBuf*> fragbufs;
+    unordered_map<FragKey, FragBuf*, FragKeyHash> fragbufs;
     size_t maxSize;
     size_t maxBuffers;
     size_t totalSize = 0;
+    i64 lastExpireUtime = 0;
+    std::atomic<u64> lostFragments {0};
 };
@@ -0,0 +1,76 @@
+#include "seqtrack.hpp"
+
+static const i32 SEQ_WINDOW = 64;
+
+void SeqTracker::setGroups(u32 groups)
+{
+    bits = groupBits(groups);
+    joins.reset(new std::atomic<u32>[1u << bits]);
+    for (u32 i = 0; i < (1u << bits); ++i) joins[i] = 0;
+}
+
+void SeqTracker::joined(u32 group)
+{
+    joins[group]++;
+}
+
+void SeqTracker::track(const struct sockaddr_in *from, u32 seqno, i64 utime)
+{
+    count(received);
+    expire(utime);
+
+    u64 key = (u64) from->sin_addr.s_addr << 16 | from->sin_port;
+    auto it = senders.find(key);
+    if (it == senders.end()) {
+        if (senders.size() >= MAX_TRACKED_SENDERS) return;
+        it = senders.emplace(key, Sender()).first;
+        numSenders.store(senders.size(), std::memory_order_relaxed);
+    }
+    Sender& sender = it->second;
+    sender.last_utime = utime;
+
+    u32 group = seqno & ((1u << bits) - 1);
+    u32 join = joins ? joins[group].load(std::memory_order_relaxed) : 0;
+    auto st = sender.streams.find(group);
+    if (st == sender.streams.end() || st->second.join != join) {
+        sender.streams[group] = Stream{seqno, seqno, 1, join};
+        return;
+    }
+
+    // Consecutive messages of a group are 1 << bits apart
+    Stream& s = st->second;
+    i32 ahead = (i32) (seqno - s.newest) / (i32) (1u << bits);
+    if (ahead > 0) {
+        // Everything between the newest one and this one is missing, for now
+        count(lost, ahead - 1);
+        s.seen = ahead < SEQ_WINDOW ? (s.seen << ahead) | 1 : 1;
+        s.newest = seqno;
+    } else if (-ahead < SEQ_WINDOW) {
+        u64 bit = 1ull << -ahead;
+        if (s.seen & bit) {
+            count(duplicates);
+        } else {
+            s.seen |= bit;
+            count(reordered);
+            if ((i32) (seqno - s.first) > 0) count(lost, -1);
+            else s.first = seqno;
+        }
+    } else {
+        ZCM_DEBUG("sequence number of %s:%d went back from %u to %u, assuming a restart",
+                  inet_ntoa(from->sin_addr), ntohs(from->sin_port), s.newest, seqno);
+        s = Stream{seqno, seqno, 1, join};
+    }
+}
+
+void SeqTracker::expire(i64 now)
+{
+    // Quiet senders linger for at most another quarter of the timeout
+    if (now >= lastExpireUtime && now - lastExpireUtime < SENDER_TIMEOUT_US / 4) return;
+    lastExpireUtime = now;
+
+    for (auto it = senders.begin(); it != senders.end();) {
+        if (now - it->second.last_utime > SENDER_TIMEOUT_US) it = senders.erase(it);
+        else ++it;
+    }
+    numSenders.store(senders.size(), std::memory_order_relaxed);
+}
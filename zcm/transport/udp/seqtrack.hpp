@@ -0,0 +1,67 @@
+#pragma once
+#include "udp.hpp"
+
+// Follows the message sequence numbers of every sender to count the messages that were
+// lost, came out of order or came more than once. Only the receive thread calls track(),
+// the counters can be read from anywhere
+//
+// With channel groups, a sender numbers the messages of every group separately and keeps
+// the group in the low bits of the sequence number (see groupSeqno()). Only the groups
+// that are joined arrive, so each one is followed on its own
+class SeqTracker
+{
+  public:
+    // Must be called before the first track()
+    void setGroups(u32 groups);
+
+    // The sequence number of the n-th message sent to group
+    static u32 groupSeqno(u32 n, u32 group, u32 groups)
+    { return n << groupBits(groups) | group; }
+
+    // Counts message seqno of sender from, received at utime
+    void track(const struct sockaddr_in *from, u32 seqno, i64 utime);
+
+    // Call when group is joined. Messages sent to it while it was not joined are not lost
+    void joined(u32 group);
+
+    std::atomic<u64> received   {0};
+    std::atomic<u64> lost       {0};
+    std::atomic<u64> reordered  {0};
+    std::atomic<u64> duplicates {0};
+    std::atomic<u32> numSenders {0};
+
+  private:
+    // The newest sequence number of a sender in one group and which of the SEQ_WINDOW
+    // before it (bit 0 being the newest itself) have arrived. Messages that are older than
+    // that are taken to be from a restarted sender
+    struct Stream
+    {
+        u32 newest;
+        u32 first;      // the first one that arrived, nothing before it counts as lost
+        u64 seen;
+        u32 join;       // joins[group] when the first one arrived
+    };
+
+    struct Sender
+    {
+        unordered_map<u32, Stream> streams; // by group
+        i64 last_utime;
+    };
+
+    static u32 groupBits(u32 groups)
+    {
+        u32 bits = 0;
+        while (bits < 32 && (1ull << bits) < groups) ++bits;
+        return bits;
+    }
+
+    void expire(i64 now);
+    void count(std::atomic<u64>& counter, i64 n = 1)
+    { counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    unordered_map<u64, Sender> senders; // by address << 16 | port
+    i64 lastExpireUtime = 0;
+
+    u32 bits = 0;
+    std::unique_ptr<std::atomic<u32>[]> joins; // how often each group was joined
+};
@@ -2,6 +2,7 @@
 #include "buffers.hpp"
 #include "udpsocket.hpp"
 #include "mempool.hpp"
+#include "seqtrack.hpp"
 
 #include "zcm/transport.h"
 #include "zcm/transport_registrar.h"
@@ -9,14 +10,9 @@
 
 #include "util/StringUtil.hpp"
 
-#define MTU (1<<28)
+#include <chrono>
 
-static i32 utimeInSeconds()
-{
-    struct timeval tv;
-    gettimeofday (&tv, NULL);
-    return (i32)tv.tv_sec;
-}
+#define MTU (1<<28)
 
 /**
  * udp_params_t:
@@ -27,8 +23,20 @@ static i32 utimeInSeconds()
  *                  if 1, then packets stay on the local network
  *                        and never traverse a router
  *                  don't use > 1.  that's just rude.
- * @recv_buf_size:  requested size of the kernel receive buffer, set with
- *                  SO_RCVBUF.  0 indicates to use the default settings.
+ * @rcvbuf:         requested size of the kernel receive buffer, set with
+ *                  SO_RCVBUFFORCE or SO_RCVBUF.  0 keeps the system default.
+ * @sndbuf:         same for the kernel send buffer (SO_SNDBUFFORCE / SO_SNDBUF)
+ * @busy_poll:      micros to busy poll the device queue for when waiting for
+ *                  packets (SO_BUSY_POLL).  0 keeps the system default.
+ * @prefer_busy_poll: also set SO_PREFER_BUSY_POLL
+ * @io_batch:       most datagrams moved per recvmmsg() / sendmmsg() call.
+ *                  1 makes every datagram a syscall of its own.
+ * @groups:         udpm only.  if > 0, every channel is sent to one of this
+ *                  many consecutive multicast groups starting at addr (picked
+ *                  by channelGroup()) and only the groups of the subscribed
+ *                  channels are joined.  0 puts every channel on addr.
+ * @stats_period:   if > 0, publish the transport's counters (see getStats())
+ *                  on stats_channel every this many millis.
  *
  */
 struct Params
@@ -37,25 +45,58 @@ struct Params
     struct in_addr addr;
     u16            sub_port;
     u16            pub_port;
-    size_t         recv_buf_size;
     u8             ttl;
     bool           multicast;
-
-    Params(const string& ip, u16 sub_port, u16 pub_port,
-           size_t recv_buf_size, u8 ttl, bool multicast) :
-        ip(ip), sub_port(sub_port), pub_port(pub_port),
-        recv_buf_size(recv_buf_size), ttl(ttl), multicast(multicast)
+    size_t         rcvbuf = 0;
+    size_t         sndbuf = 0;
+    u32            busy_poll = 0;
+    bool           prefer_busy_poll = false;
+    size_t         io_batch = ZCM_DEFAULT_IO_BATCH;
+    u32            groups = 0;
+    u32            stats_period = 0;
+    string         stats_channel = "ZCM_UDP_STATS";
+
+    Params(const string& ip, u16 sub_port, u16 pub_port, u8 ttl, bool multicast) :
+        ip(ip), sub_port(sub_port), pub_port(pub_port), ttl(ttl), multicast(multicast)
     {
         // TODO verify that the IP and PORT are vaild
         inet_aton(ip.c_str(), (struct in_addr*) &this->addr);
     }
 };
 
+// Group of a channel when channels are spread over n multicast groups. Every
+// publisher and subscriber on the bus must agree on it, so it is part of the
+// wire protocol: 32 bit FNV-1a of the channel name, modulo n
+static u32 channelGroup(const char *channel, u32 n)
+{
+    u32 h = 2166136261u;
+    for (const char *c = channel; *c; ++c) {
+        h ^= (u8)*c;
+        h *= 16777619u;
+    }
+    return h % n;
+}
+
+static bool isRegexChannel(const char *channel)
+{
+    // These chars are considered regex
+    return strpbrk(channel, "()|.*+") != NULL;
+}
+
 struct UDP
 {
     Params params;
     UDPAddress destAddr;
 
+    // With params.groups, the address of every group. Messages go to the group of
+    // their channel instead of destAddr
+    vector<UDPAddress> groupAddrs;
+    // Channels enabled with recvmsgEnable() and how many of them are in each group.
+    // Regex channels count towards every group. A group is joined while it is > 0
+    std::mutex enableLock;
+    unordered_set<string> enabledChannels;
+    vector<u32> groupRefs;
+
     UDPSocket recvfd;
     UDPSocket sendfd;
 
@@ -67,35 +108,62 @@ struct UDP
     MessagePool pool {MAX_FRAG_BUF_TOTAL_SIZE, MAX_NUM_FRAG_BUFS};
 
     /* other variables */
-    u32          udp_rx = 0;            // packets received and processed
-    u32          udp_discarded_bad = 0; // packets discarded because they were bad
-                                    // somehow
-    double       udp_low_watermark = 1.0; // least buffer available
-    i32          udp_last_report_secs = 0;
-
-    u32          msg_seqno = 0; // rolling counter of how many messages transmitted
+    SeqTracker   seqs;                  // messages received, by sender
+    std::atomic<u64> udp_discarded_bad {0}; // packets discarded because they were bad
+                                            // somehow
+
+    // Rolling counters of how many messages were transmitted, one per group (or just one
+    // without groups). See SeqTracker::groupSeqno()
+    vector<u32>  msg_seqnos;
+    // Sending happens on the send thread, and on the receive thread for the stats
+    std::mutex   sendLock;
+    std::chrono::steady_clock::time_point nextStatsTime;
+    string       statsSource;   // host and pid at the start of every stats message
 
     /***** Methods ******/
-    UDP(const string& ip, u16 sub_port, u16 pub_port,
-        size_t recv_buf_size, u8 ttl, bool multicast);
+    UDP(const Params& params);
     bool init();
     ~UDP();
 
     int handle();
 
     int sendmsg(zcm_msg_t msg);
+    int sendmsgBatch(const zcm_msg_t *msgs, size_t nmsgs);
     int recvmsg(zcm_msg_t *msg, int timeout);
+    int recvmsgBatch(zcm_msg_t *msgs, size_t maxmsgs, size_t *nmsgs, int timeout);
+    int recvmsgEnable(const char *channel, bool enable);
+    int getStats(zcm_transport_stats_t *stats);
 
   private:
     // These returns non-null when a full message has been received
     Message *recvShort(Packet *pkt, u32 sz);
     Message *recvFragment(Packet *pkt, u32 sz);
+    Message *recvPacket(Packet *pkt);
     Message *readMessage(int timeout);
 
-    Message *m = nullptr;
+    // Packets are received io_batch at a time into packets that are allocated once and
+    // then handed out in order. rxPackets[rxNext, rxEnd) are received but not processed
+    vector<Packet*> rxPackets;
+    size_t rxNext = 0, rxEnd = 0;
+    bool receivePackets();
+
+    // Datagrams of the messages being sent, and the index one past the last datagram of
+    // each message, so that a failed send only gives up on the rest of its own message
+    vector<OutPacket> txPackets;
+    vector<size_t> txMsgEnds;
+    int queuePackets(const zcm_msg_t& msg);
+    int sendPackets();
+
+    // Messages handed out by the last recv, freed on the next one
+    vector<Message*> inFlight;
+    void freeInFlight();
+
+    // Takes a reference on (or drops one from) every group in [first, last)
+    bool refGroups(u32 first, u32 last);
+    void unrefGroups(u32 first, u32 last);
 
     bool selftest();
-    void checkForMessageLoss();
+    void publishStats();
 };
 
 Message *UDP::recvShort(Packet *pkt, u32 sz)
@@ -109,7 +177,7 @@ Message *UDP::recvShort(Packet *pkt, u32 sz)
         return NULL;
     }
 
-    udp_rx++;
+    seqs.track((struct sockaddr_in*)&pkt->from, hdr->getMsgSeqno(), pkt->utime);
 
     Message *msg = pool.allocMessageEmpty();
     msg->utime = pkt->utime;
@@ -124,10 +192,12 @@ Message *UDP::recvShort(Packet *pkt, u32 sz)
 
 Message *UDP::recvFragment(Packet *pkt, u32 sz)
 {
+    if (sz < sizeof(MsgHeaderLong)) {
+        udp_discarded_bad++;
+        return NULL;
+    }
     MsgHeaderLong *hdr = pkt->asHeaderLong();
-
-    // any existing fragment buffer for this message source?
-    FragBuf *fbuf = pool.lookupFragBuf((struct sockaddr_in*)&pkt->from);
+    struct sockaddr_in *from = (struct sockaddr_in*)&pkt->from;
 
     u32 msg_seqno = hdr->getMsgSeqno();
     u32 data_size = hdr->getMsgSize();
@@ -137,65 +207,78 @@ Message *UDP::recvFragment(Packet *pkt, u32 sz)
     u32 frag_size = hdr->getFragmentSize(sz);
     char *data_start = hdr->getDataPtr();
 
-    // discard any stale fragments from previous messages
-    if (fbuf && ((fbuf->msg_seqno != msg_seqno) ||
-                 (fbuf->buf.size != data_size + fbuf->channellen+1))) {
-        pool.removeFragBuf(fbuf);
+    if (data_size > MTU) {
+        ZCM_DEBUG("rejecting huge message (%d bytes)", data_size);
+        return NULL;
+    }
+    if (fragment_no >= fragments_in_msg) {
+        udp_discarded_bad++;
+        return NULL;
+    }
+
+    pool.expireFragBufs(pkt->utime, FRAG_BUF_TIMEOUT_US);
+
+    // any existing fragment buffer for this message?
+    FragBuf *fbuf = pool.lookupFragBuf(from, msg_seqno);
+
+    // the sender reused the sequence number of a message that never completed
+    if (fbuf && (fbuf->data_size != data_size || fbuf->received.size() != fragments_in_msg)) {
         ZCM_DEBUG("Dropping message (missing %d fragments)", fbuf->fragments_remaining);
+        pool.dropFragBuf(fbuf);
         fbuf = NULL;
     }
 
-    if (data_size > MTU) {
-        ZCM_DEBUG("rejecting huge message (%d bytes)", data_size);
+    // create a new fragment buffer if necessary
+    if (!fbuf) {
+        fbuf = pool.addFragBuf(from, msg_seqno, data_size, fragments_in_msg, pkt->utime);
+        recvfd.checkAndWarnAboutSmallBuffer(data_size, kernel_rbuf_sz);
+    }
+
+    if (fbuf->received[fragment_no]) {
+        ZCM_DEBUG("dropping duplicate fragment %d", fragment_no);
         return NULL;
     }
 
-    // create a new fragment buffer if necessary
-    if (!fbuf && fragment_no == 0) {
-        char *channel = (char*) (hdr + 1);
-        int channel_sz = strlen(channel);
-        if (channel_sz > ZCM_CHANNEL_MAXLEN) {
+    // first fragment is special.  the channel comes before the data
+    if (fragment_no == 0) {
+        size_t channel_sz = strnlen(data_start, std::min((size_t)frag_size,
+                                                         (size_t)ZCM_CHANNEL_MAXLEN + 1));
+        if (channel_sz > ZCM_CHANNEL_MAXLEN || channel_sz == frag_size) {
             ZCM_DEBUG("bad channel name length");
             udp_discarded_bad++;
+            pool.removeFragBuf(fbuf);
             return NULL;
         }
-
-        fbuf = pool.addFragBuf(channel_sz + 1 + data_size);
-        fbuf->last_packet_utime = pkt->utime;
-        fbuf->msg_seqno = msg_seqno;
-        fbuf->fragments_remaining = fragments_in_msg;
+        memcpy(fbuf->buf.data, data_start, channel_sz + 1);
         fbuf->channellen = channel_sz;
-        fbuf->from = *(struct sockaddr_in*)&pkt->from;
-        memcpy(fbuf->buf.data, data_start, frag_size);
-
-        --fbuf->fragments_remaining;
-        return NULL;
+        data_start += channel_sz + 1;
+        frag_size -= channel_sz + 1;
     }
 
-    if (!fbuf) return NULL;
-    recvfd.checkAndWarnAboutSmallBuffer(data_size, kernel_rbuf_sz);
-
-    if (fbuf->channellen+1 + fragment_offset + frag_size > fbuf->buf.size) {
-        ZCM_DEBUG("dropping invalid fragment (off: %d, %d / %zu)",
-                fragment_offset, frag_size, fbuf->buf.size);
+    if ((u64)fragment_offset + frag_size > data_size) {
+        ZCM_DEBUG("dropping invalid fragment (off: %d, %d / %d)",
+                fragment_offset, frag_size, data_size);
         pool.removeFragBuf(fbuf);
         return NULL;
     }
 
     // copy data
-    memcpy(fbuf->buf.data + fbuf->channellen+1 + fragment_offset, data_start, frag_size);
+    memcpy(fbuf->buf.data + FRAG_BUF_DATA_OFFSET + fragment_offset, data_start, frag_size);
 
+    fbuf->received[fragment_no] = true;
     fbuf->last_packet_utime = pkt->utime;
     if (--fbuf->fragments_remaining > 0)
         return NULL;
 
+    seqs.track(from, msg_seqno, fbuf->last_packet_utime);
+
     // we've received all the fragments, return a new Message
     Message *msg = pool.allocMessageEmpty();
     msg->utime = fbuf->last_packet_utime;
     msg->channel = fbuf->buf.data;
     msg->channellen = fbuf->channellen;
-    msg->data = fbuf->buf.data + fbuf->channellen + 1;
-    msg->datalen = fbuf->buf.size - (fbuf->channellen + 1);
+    msg->data = fbuf->buf.data + FRAG_BUF_DATA_OFFSET;
+    msg->datalen = fbuf->data_size;
     pool.moveBuffer(msg->buf, fbuf->buf);
 
     // don't need the fragment buffer anymore
@@ -204,80 +287,106 @@ Message *UDP::recvFragment(Packet *pkt, u32 sz)
     return msg;
 }
 
-void UDP::checkForMessageLoss()
+int UDP::getStats(zcm_transport_stats_t *stats)
 {
-    // ISSUE-101 TODO: add this back
-    // TODO warn about message loss somewhere else.
-    // u32 ring_capacity = ringbuf->get_capacity();
-    // u32 ring_used = ringbuf->get_used();
-
-    // double buf_avail = ((double)(ring_capacity - ring_used)) / ring_capacity;
-    // if (buf_avail < udp_low_watermark)
-    //     udp_low_watermark = buf_avail;
-
-    // i32 tm = utimeInSeconds();
-    // int elapsedsecs = tm - udp_last_report_secs;
-    // if (elapsedsecs > 2) {
-    //    if (udp_discarded_bad > 0 || udp_low_watermark < 0.5) {
-    //        fprintf(stderr,
-    //                "%d ZCM loss %4.1f%% : %5d err, "
-    //                "buf avail %4.1f%%\n",
-    //                (int) tm,
-    //                udp_discarded_bad * 100.0 / (udp_rx + udp_discarded_bad),
-    //                udp_discarded_bad,
-    //                100.0 * udp_low_watermark);
-
-    //        udp_rx = 0;
-    //        udp_discarded_bad = 0;
-    //        udp_last_report_secs = tm;
-    //        udp_low_watermark = HUGE;
-    //    }
-    // }
+    stats->received = seqs.received.load(std::memory_order_relaxed);
+    stats->lost = seqs.lost.load(std::memory_order_relaxed);
+    stats->reordered = seqs.reordered.load(std::memory_order_relaxed);
+    stats->duplicates = seqs.duplicates.load(std::memory_order_relaxed);
+    stats->lost_fragments = pool.numLostFragments();
+    stats->discarded = udp_discarded_bad.load(std::memory_order_relaxed);
+    stats->num_senders = seqs.numSenders.load(std::memory_order_relaxed);
+    return ZCM_EOK;
 }
 
-// read continuously until a complete message arrives
-Message *UDP::readMessage(int timeout)
+// Sends the counters as text (e.g. "host=a pid=1 received=10 lost=0 ..."), so that any
+// subscriber can read them without knowing about a type
+void UDP::publishStats()
 {
-    Packet *pkt = pool.allocPacket(ZCM_MAX_UNFRAGMENTED_PACKET_SIZE);
-    UDP::checkForMessageLoss();
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextStatsTime) return;
+    nextStatsTime = now + std::chrono::milliseconds(params.stats_period);
+
+    zcm_transport_stats_t st;
+    getStats(&st);
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf),
+                       "%s received=%llu lost=%llu reordered=%llu duplicates=%llu "
+                       "lost_fragments=%llu discarded=%llu senders=%u",
+                       statsSource.c_str(),
+                       (unsigned long long)st.received, (unsigned long long)st.lost,
+                       (unsigned long long)st.reordered, (unsigned long long)st.duplicates,
+                       (unsigned long long)st.lost_fragments,
+                       (unsigned long long)st.discarded, st.num_senders);
+
+    zcm_msg_t msg;
+    msg.utime = 0;
+    msg.channel = params.stats_channel.c_str();
+    msg.len = std::min((size_t)len, sizeof(buf) - 1);
+    msg.buf = (uint8_t*)buf;
+    msg.channel_id = 0;
+    if (sendmsg(msg) != ZCM_EOK)
+        ZCM_DEBUG("failed to publish udp stats on %s", msg.channel);
+}
 
-    Message *msg = NULL;
-    while (!msg) {
-        // // wait for either incoming UDP data, or for an abort message
-        if (!recvfd.waitUntilData(timeout)) break;
+// Refills rxPackets from the socket once every packet in it has been processed
+bool UDP::receivePackets()
+{
+    // Short messages take over the buffer of their packet
+    for (Packet *pkt : rxPackets)
+        if (!pkt->buf.data) pkt->buf = pool.allocBuffer(ZCM_MAX_UNFRAGMENTED_PACKET_SIZE);
 
-        int sz = recvfd.recvPacket(pkt);
-        if (sz < 0) {
-            ZCM_DEBUG("udp_read_packet -- recvmsg");
-            udp_discarded_bad++;
-            continue;
-        }
+    int n = recvfd.recvPackets(rxPackets.data(), rxPackets.size());
+    if (n < 0) {
+        ZCM_DEBUG("udp_read_packet -- recvmmsg");
+        udp_discarded_bad++;
+        return false;
+    }
+    rxNext = 0;
+    rxEnd = n;
+    return n > 0;
+}
 
-        ZCM_DEBUG("Got packet of size %d", sz);
+Message *UDP::recvPacket(Packet *pkt)
+{
+    int sz = pkt->sz;
+    ZCM_DEBUG("Got packet of size %d", sz);
 
-        if (sz < (int)sizeof(MsgHeaderShort)) {
-            // packet too short to be ZCM
-            udp_discarded_bad++;
-            continue;
-        }
+    if (sz < (int)sizeof(MsgHeaderShort)) {
+        // packet too short to be ZCM
+        udp_discarded_bad++;
+        return NULL;
+    }
 
-        u32 magic = pkt->asHeaderShort()->getMagic();
-        if (magic == ZCM_MAGIC_SHORT)
-            msg = recvShort(pkt, sz);
-        else if (magic == ZCM_MAGIC_LONG)
-            msg = recvFragment(pkt, sz);
-        else {
-            ZCM_DEBUG("ZCM: bad magic");
-            udp_discarded_bad++;
-            continue;
+    u32 magic = pkt->asHeaderShort()->getMagic();
+    if (magic == ZCM_MAGIC_SHORT)
+        return recvShort(pkt, sz);
+    else if (magic == ZCM_MAGIC_LONG)
+        return recvFragment(pkt, sz);
+
+    ZCM_DEBUG("ZCM: bad magic");
+    udp_discarded_bad++;
+    return NULL;
+}
+
+// read continuously until a complete message arrives
+Message *UDP::readMessage(int timeout)
+{
+    Message *msg = NULL;
+    while (!msg) {
+        if (rxNext == rxEnd) {
+            // wait for incoming UDP data
+            if (!recvfd.waitUntilData(timeout)) break;
+            if (!receivePackets()) continue;
         }
+        msg = recvPacket(rxPackets[rxNext++]);
     }
 
-    pool.freePacket(pkt);
     return msg;
 }
 
-int UDP::sendmsg(zcm_msg_t msg)
+// Appends the datagrams of msg to txPackets
+int UDP::queuePackets(const zcm_msg_t& msg)
 {
     int channel_size = strlen(msg.channel);
     if (channel_size > ZCM_CHANNEL_MAXLEN) {
@@ -285,6 +394,14 @@ int UDP::sendmsg(zcm_msg_t msg)
         return ZCM_EINVALID;
     }
 
+    const UDPAddress *dest = &destAddr;
+    u32 group = 0;
+    if (!groupAddrs.empty()) {
+        group = channelGroup(msg.channel, groupAddrs.size());
+        dest = &groupAddrs[group];
+    }
+    u32 msg_seqno = SeqTracker::groupSeqno(msg_seqnos[group], group, params.groups);
+
     int payload_size = channel_size + 1 + msg.len;
     if (payload_size <= ZCM_SHORT_MESSAGE_MAX_SIZE) {
         // message is short.  send in a single packet
@@ -293,17 +410,19 @@ int UDP::sendmsg(zcm_msg_t msg)
         hdr.setMagic(ZCM_MAGIC_SHORT);
         hdr.setMsgSeqno(msg_seqno);
 
-        ssize_t status = sendfd.sendBuffers(destAddr,
-                              (char*)&hdr, sizeof(hdr),
-                              (char*)msg.channel, channel_size+1,
-                              (char*)msg.buf, msg.len);
-
-        int packet_size = sizeof(hdr) + payload_size;
-        ZCM_DEBUG("transmitting %zu byte [%s] payload (%d byte pkt)",
-                  msg.len, msg.channel, packet_size);
-        msg_seqno++;
-
-        return (status == packet_size) ? 0 : status;
+        OutPacket pkt;
+        pkt.dest = dest;
+        memcpy(pkt.hdr, &hdr, sizeof(hdr));
+        pkt.hdrlen = sizeof(hdr);
+        pkt.data[0].iov_base = (char*)msg.channel;
+        pkt.data[0].iov_len = channel_size+1;
+        pkt.data[1].iov_base = (char*)msg.buf;
+        pkt.data[1].iov_len = msg.len;
+        pkt.ndata = 2;
+        txPackets.push_back(pkt);
+
+        ZCM_DEBUG("transmitting %zu byte [%s] payload (%zu byte pkt)",
+                  msg.len, msg.channel, sizeof(hdr) + payload_size);
     }
 
 
@@ -315,12 +434,12 @@ int UDP::sendmsg(zcm_msg_t msg)
 
         if (nfragments > 65535) {
             fprintf(stderr, "ZCM error: too much data for a single message\n");
-            return -1;
+            return ZCM_EINVALID;
         }
 
-        // acquire transmit lock so that all fragments are transmitted
-        // together, and so that no other message uses the same sequence number
-        // (at least until the sequence # rolls over)
+        // all fragments are queued together, so that they go out back to back and no
+        // other message uses the same sequence number (at least until the sequence #
+        // rolls over)
 
         ZCM_DEBUG("transmitting %d byte [%s] payload in %d fragments",
                   payload_size, msg.channel, nfragments);
@@ -339,66 +458,207 @@ int UDP::sendmsg(zcm_msg_t msg)
         size_t firstfrag_datasize = fragment_size - (channel_size + 1);
         assert(firstfrag_datasize <= msg.len);
 
-        int packet_size = sizeof(hdr) + (channel_size + 1) + firstfrag_datasize;
+        OutPacket pkt;
+        pkt.dest = dest;
+        memcpy(pkt.hdr, &hdr, sizeof(hdr));
+        pkt.hdrlen = sizeof(hdr);
+        pkt.data[0].iov_base = (char*)msg.channel;
+        pkt.data[0].iov_len = channel_size+1;
+        pkt.data[1].iov_base = (char*)msg.buf;
+        pkt.data[1].iov_len = firstfrag_datasize;
+        pkt.ndata = 2;
+        txPackets.push_back(pkt);
         fragment_offset += firstfrag_datasize;
 
-        ssize_t status = sendfd.sendBuffers(destAddr,
-                                            (char*)&hdr, sizeof(hdr),
-                                            (char*)msg.channel, channel_size+1,
-                                            (char*)msg.buf, firstfrag_datasize);
-
-        // transmit the rest of the fragments
-        for (u16 frag_no = 1; packet_size == status && frag_no < nfragments; frag_no++) {
+        // the rest of the fragments
+        for (u16 frag_no = 1; frag_no < nfragments; frag_no++) {
             hdr.fragment_offset = htonl(fragment_offset);
             hdr.fragment_no = htons(frag_no);
 
             int fraglen = std::min(fragment_size, (int)msg.len - (int)fragment_offset);
-            status = sendfd.sendBuffers(destAddr,
-                                        (char*)&hdr, sizeof(hdr),
-                                        (char*)(msg.buf + fragment_offset), fraglen);
+            memcpy(pkt.hdr, &hdr, sizeof(hdr));
+            pkt.data[0].iov_base = (char*)(msg.buf + fragment_offset);
+            pkt.data[0].iov_len = fraglen;
+            pkt.ndata = 1;
+            txPackets.push_back(pkt);
 
             fragment_offset += fraglen;
-            packet_size = sizeof(hdr) + fraglen;
         }
 
         // sanity check
-        if (0 == status) {
-            assert(fragment_offset == msg.len);
-        }
+        assert(fragment_offset == msg.len);
+    }
 
-        msg_seqno++;
+    msg_seqnos[group]++;
+    txMsgEnds.push_back(txPackets.size());
+    return ZCM_EOK;
+}
+
+// Sends everything in txPackets, io_batch datagrams per syscall
+int UDP::sendPackets()
+{
+    int ret = ZCM_EOK;
+    size_t next = 0, m = 0;
+    while (next < txPackets.size()) {
+        size_t n = std::min(txPackets.size() - next, params.io_batch);
+        size_t sent = sendfd.sendPackets(&txPackets[next], n);
+        next += sent;
+        if (sent == n) continue;
+
+        // The rest of a message is useless to the receiver once one of its datagrams is lost
+        ZCM_DEBUG("udp send failed: %s", strerror(errno));
+        ret = ZCM_EUNKNOWN;
+        while (txMsgEnds[m] <= next) ++m;
+        next = txMsgEnds[m];
     }
 
-    return 0;
+    txPackets.clear();
+    txMsgEnds.clear();
+    return ret;
+}
+
+int UDP::sendmsg(zcm_msg_t msg)
+{
+    std::unique_lock<std::mutex> lk(sendLock);
+    int ret = queuePackets(msg);
+    if (ret != ZCM_EOK) return ret;
+    return sendPackets();
+}
+
+int UDP::sendmsgBatch(const zcm_msg_t *msgs, size_t nmsgs)
+{
+    std::unique_lock<std::mutex> lk(sendLock);
+    int ret = ZCM_EOK;
+    for (size_t i = 0; i < nmsgs; ++i) {
+        int rc = queuePackets(msgs[i]);
+        if (rc != ZCM_EOK) ret = rc;
+    }
+    int rc = sendPackets();
+    return rc != ZCM_EOK ? rc : ret;
+}
+
+void UDP::freeInFlight()
+{
+    for (Message *m : inFlight) pool.freeMessage(m);
+    inFlight.clear();
 }
 
 int UDP::recvmsg(zcm_msg_t *msg, int timeout)
 {
-    if (m) pool.freeMessage(m);
+    size_t n;
+    return recvmsgBatch(msg, 1, &n, timeout);
+}
+
+// Wait for the first message, then keep reading for as long as more
+// are already sitting in the socket buffer
+int UDP::recvmsgBatch(zcm_msg_t *msgs, size_t maxmsgs, size_t *nmsgs, int timeout)
+{
+    freeInFlight();
+    if (params.stats_period) publishStats();
+
+    *nmsgs = 0;
+    while (*nmsgs < maxmsgs) {
+        Message *m = readMessage(*nmsgs == 0 ? timeout : 0);
+        if (m == nullptr) break;
+        inFlight.push_back(m);
+
+        zcm_msg_t *msg = &msgs[(*nmsgs)++];
+        msg->utime = m->utime;
+        msg->channel = m->channel;
+        msg->len = m->datalen;
+        msg->buf = (uint8_t*) m->data;
+    }
+
+    return *nmsgs > 0 ? ZCM_EOK : ZCM_EAGAIN;
+}
+
+bool UDP::refGroups(u32 first, u32 last)
+{
+    for (u32 i = first; i < last; ++i) {
+        if (groupRefs[i]++ > 0) continue;
+        // Whatever was sent to the group before now was never going to arrive
+        seqs.joined(i);
+        struct in_addr addr;
+        addr.s_addr = htonl(ntohl(params.addr.s_addr) + i);
+        if (!recvfd.addMembership(addr)) {
+            groupRefs[i]--;
+            unrefGroups(first, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void UDP::unrefGroups(u32 first, u32 last)
+{
+    for (u32 i = first; i < last; ++i) {
+        if (--groupRefs[i] > 0) continue;
+        struct in_addr addr;
+        addr.s_addr = htonl(ntohl(params.addr.s_addr) + i);
+        recvfd.dropMembership(addr);
+    }
+}
+
+int UDP::recvmsgEnable(const char *channel, bool enable)
+{
+    // Without groups every channel arrives anyway
+    if (groupRefs.empty()) return ZCM_EOK;
+
+    std::unique_lock<std::mutex> lk(enableLock);
 
-    m = readMessage(timeout);
-    if (m == nullptr)
-        return ZCM_EAGAIN;
+    // The core enables a channel for every subscription to it, but only disables
+    // it once the last one is gone
+    if (enable ? !enabledChannels.insert(channel).second
+               : enabledChannels.erase(channel) == 0)
+        return ZCM_EOK;
 
-    msg->utime = m->utime;
-    msg->channel = m->channel;
-    msg->len = m->datalen;
-    msg->buf = (uint8_t*) m->data;
+    u32 first = 0, last = groupRefs.size();
+    if (!isRegexChannel(channel)) {
+        first = channelGroup(channel, groupRefs.size());
+        last = first + 1;
+    }
 
+    if (!enable) {
+        unrefGroups(first, last);
+        return ZCM_EOK;
+    }
+    if (!refGroups(first, last)) {
+        fprintf(stderr, "ZCM Error: failed to join the multicast groups of channel %s. "
+                "Check net.ipv4.igmp_max_memberships\n", channel);
+        enabledChannels.erase(channel);
+        return ZCM_EUNKNOWN;
+    }
     return ZCM_EOK;
 }
 
 UDP::~UDP()
 {
-    if (m) pool.freeMessage(m);
+    freeInFlight();
+    for (Packet *pkt : rxPackets) pool.freePacket(pkt);
     ZCM_DEBUG("closing zcm context");
 }
 
-UDP::UDP(const string& ip, u16 sub_port, u16 pub_port,
-         size_t recv_buf_size, u8 ttl, bool multicast)
-    : params(ip, sub_port, pub_port, recv_buf_size, ttl, multicast),
-      destAddr(ip, pub_port)
-{}
+UDP::UDP(const Params& params)
+    : params(params), destAddr(params.ip, params.pub_port)
+{
+    for (size_t i = 0; i < params.io_batch; ++i)
+        rxPackets.push_back(pool.allocPacket(ZCM_MAX_UNFRAGMENTED_PACKET_SIZE));
+
+    for (u32 i = 0; i < params.groups; ++i) {
+        struct in_addr addr;
+        addr.s_addr = htonl(ntohl(params.addr.s_addr) + i);
+        groupAddrs.emplace_back(inet_ntoa(addr), params.pub_port);
+    }
+    groupRefs.resize(params.groups, 0);
+    msg_seqnos.resize(std::max(params.groups, (u32)1), 0);
+    seqs.setGroups(params.groups);
+
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    statsSource = string("host=") + host + " pid=" + std::to_string(getpid());
+    nextStatsTime = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(params.stats_period);
+}
 
 bool UDP::init()
 {
@@ -412,10 +672,19 @@ bool UDP::init()
 
     sendfd = UDPSocket::createSendSocket(params.addr, params.ttl, params.multicast);
     if (!sendfd.isOpen()) return false;
+    if (params.sndbuf) sendfd.setSendBufSize(params.sndbuf);
     kernel_sbuf_sz = sendfd.getSendBufSize();
 
-    recvfd = UDPSocket::createRecvSocket(params.addr, params.sub_port, params.multicast);
+    recvfd = UDPSocket::createRecvSocket(params.addr, params.sub_port, params.multicast,
+                                         params.groups == 0);
     if (!recvfd.isOpen()) return false;
+    // Groups are joined as channels are enabled, and those should be the only ones
+    // that arrive. Other sockets on this port (e.g. another zcm without groups)
+    // would otherwise pull in their groups too
+    if (params.groups && !recvfd.disableMulticastAll()) return false;
+    if (params.rcvbuf) recvfd.setRecvBufSize(params.rcvbuf);
+    if (params.busy_poll || params.prefer_busy_poll)
+        recvfd.setBusyPoll(params.busy_poll, params.prefer_busy_poll);
     kernel_rbuf_sz = recvfd.getRecvBufSize();
 
     if (!this->selftest()) {
@@ -444,9 +713,8 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
 {
     UDP udp;
 
-    ZCM_TRANS_CLASSNAME(const string& ip, u16 sub_port, u16 pub_port, size_t recv_buf_size,
-                        u8 ttl, bool isMulticast)
-        : udp(ip, sub_port, pub_port, recv_buf_size, ttl, isMulticast)
+    ZCM_TRANS_CLASSNAME(const Params& params)
+        : udp(params)
     {
         trans_type = ZCM_BLOCKING;
         vtbl = &methods;
@@ -468,12 +736,22 @@ struct ZCM_TRANS_CLASSNAME : public zcm_trans_t
     static int _sendmsg(zcm_trans_t *zt, zcm_msg_t msg)
     { return cast(zt)->udp.sendmsg(msg); }
 
+    static int _sendmsgBatch(zcm_trans_t *zt, const zcm_msg_t *msgs, size_t nmsgs)
+    { return cast(zt)->udp.sendmsgBatch(msgs, nmsgs); }
+
     static int _recvmsgEnable(zcm_trans_t *zt, const char *channel, bool enable)
-    { return ZCM_EOK; }
+    { return cast(zt)->udp.recvmsgEnable(channel, enable); }
+
+    static int _getStats(zcm_trans_t *zt, zcm_transport_stats_t *stats)
+    { return cast(zt)->udp.getStats(stats); }
 
     static int _recvmsg(zcm_trans_t *zt, zcm_msg_t *msg, int timeout)
     { return cast(zt)->udp.recvmsg(msg, timeout); }
 
+    static int _recvmsgBatch(zcm_trans_t *zt, zcm_msg_t *msgs, size_t maxmsgs,
+                             size_t *nmsgs, int timeout)
+    { return cast(zt)->udp.recvmsgBatch(msgs, maxmsgs, nmsgs, timeout); }
+
     static void _destroy(zcm_trans_t *zt)
     { delete cast(zt); }
 
@@ -488,6 +766,9 @@ zcm_trans_methods_t ZCM_TRANS_CLASSNAME::methods = {
     &ZCM_TRANS_CLASSNAME::_recvmsg,
     NULL, // update
     &ZCM_TRANS_CLASSNAME::_destroy,
+    &ZCM_TRANS_CLASSNAME::_sendmsgBatch,
+    &ZCM_TRANS_CLASSNAME::_recvmsgBatch,
+    &ZCM_TRANS_CLASSNAME::_getStats,
 };
 
 static const char *optFind(zcm_url_opts_t *opts, const string& key)
@@ -498,6 +779,24 @@ static const char *optFind(zcm_url_opts_t *opts, const string& key)
     return NULL;
 }
 
+// Leaves val alone if the option is not there. Returns false if it is not a number
+// between min and max
+static bool optFindUint(zcm_url_opts_t *opts, const string& key, u64 min, u64 max, u64& val)
+{
+    const char *str = optFind(opts, key);
+    if (!str) return true;
+    char *end;
+    errno = 0;
+    u64 v = strtoull(str, &end, 10);
+    if (errno || end == str || *end != '\0' || *str == '-' || v < min || v > max) {
+        ZCM_DEBUG("ERROR: %s must be a number between %llu and %llu",
+                  key.c_str(), (unsigned long long)min, (unsigned long long)max);
+        return false;
+    }
+    val = v;
+    return true;
+}
+
 static zcm_trans_t *createUdp(zcm_url_t *url)
 {
     auto protocol = string(zcm_url_protocol(url));
@@ -531,10 +830,49 @@ static zcm_trans_t *createUdp(zcm_url_t *url)
         ttl = isMulticast ? "0" : "1";
         ZCM_DEBUG("No ttl specified. Using default ttl=%s", ttl);
     }
-    size_t recv_buf_size = 1024;
-    auto *trans = new ZCM_TRANS_CLASSNAME(address,
-                                          atoi(subPort.c_str()), atoi(pubPort.c_str()),
-                                          recv_buf_size, atoi(ttl), isMulticast);
+    Params params(address, atoi(subPort.c_str()), atoi(pubPort.c_str()),
+                  atoi(ttl), isMulticast);
+
+    u64 rcvbuf = 0, sndbuf = 0, busyPoll = 0, preferBusyPoll = 0;
+    u64 ioBatch = ZCM_DEFAULT_IO_BATCH, groups = 0, statsPeriod = 0;
+    if (!optFindUint(opts, "rcvbuf", 0, INT32_MAX, rcvbuf) ||
+        !optFindUint(opts, "sndbuf", 0, INT32_MAX, sndbuf) ||
+        !optFindUint(opts, "busy_poll", 0, INT32_MAX, busyPoll) ||
+        !optFindUint(opts, "prefer_busy_poll", 0, 1, preferBusyPoll) ||
+        !optFindUint(opts, "batch", 1, ZCM_MAX_IO_BATCH, ioBatch) ||
+        !optFindUint(opts, "groups", 0, ZCM_MAX_CHANNEL_GROUPS, groups) ||
+        !optFindUint(opts, "stats_period", 0, INT32_MAX, statsPeriod))
+        return nullptr;
+    if (groups) {
+        if (!isMulticast) {
+            ZCM_DEBUG("ERROR: groups only works with udpm");
+            return nullptr;
+        }
+        // Every group has to be a multicast address (224.0.0.0/4)
+        u32 first = ntohl(params.addr.s_addr);
+        u32 last = first + groups - 1;
+        if ((first >> 28) != 0xE || (last >> 28) != 0xE) {
+            ZCM_DEBUG("ERROR: %s plus %u groups is not all multicast addresses",
+                      address.c_str(), (u32)groups);
+            return nullptr;
+        }
+    }
+    params.rcvbuf = rcvbuf;
+    params.sndbuf = sndbuf;
+    params.busy_poll = busyPoll;
+    params.prefer_busy_poll = preferBusyPoll;
+    params.io_batch = ioBatch;
+    params.groups = groups;
+    params.stats_period = statsPeriod;
+    if (auto *statsChannel = optFind(opts, "stats_channel")) {
+        if (!*statsChannel || strlen(statsChannel) > ZCM_CHANNEL_MAXLEN) {
+            ZCM_DEBUG("ERROR: stats_channel must be a valid channel name");
+            return nullptr;
+        }
+        params.stats_channel = statsChannel;
+    }
+
+    auto *trans = new ZCM_TRANS_CLASSNAME(params);
     if (!trans->init()) {
         delete trans;
         return nullptr;
@@ -15,12 +15,15 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <memory>
 
 // Headers for C++ library
 #include <algorithm>
 #include <vector>
 #include <stack>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 using namespace std;
 
@@ -56,6 +59,11 @@ typedef int SOCKET;
 # define USE_REUSEPORT
 #endif
 
+// Several datagrams per syscall with recvmmsg() and sendmmsg()
+#ifdef __linux__
+# define USE_MMSG
+#endif
+
 // Headers needed on Windows
 #ifdef WIN32
 # include "windows/WinPorting.h"
@@ -100,7 +108,16 @@ typedef int64_t  i64;
 #define ZCM_DEFAULT_RECV_BUFS 2000
 #define ZCM_MAX_UNFRAGMENTED_PACKET_SIZE 65536
 
+#define ZCM_DEFAULT_IO_BATCH 32 // datagrams per recvmmsg() / sendmmsg()
+#define ZCM_MAX_IO_BATCH 1024   // the kernel's limit for both (UIO_MAXIOV)
+
+#define ZCM_MAX_CHANNEL_GROUPS 256 // multicast groups a udpm channel can hash onto
+
 #define MAX_FRAG_BUF_TOTAL_SIZE (1 << 24)// 16 megabytes
 #define MAX_NUM_FRAG_BUFS 1000
+#define FRAG_BUF_TIMEOUT_US 1000000 // partial messages not updated for this long are dropped
+
+#define MAX_TRACKED_SENDERS 1024       // senders whose sequence numbers are followed
+#define SENDER_TIMEOUT_US 10000000     // senders not heard from for this long are forgotten
 
 #define SELF_TEST_CHANNEL "LCM_SELF_TEST"
@@ -28,10 +28,31 @@ struct Platform
         return true;
     }
 
+    static bool setMembership(int fd, struct in_addr multiaddr, bool join)
+    {
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr = multiaddr;
+        mreq.imr_interface.s_addr = INADDR_ANY;
+        return setsockopt(fd, IPPROTO_IP, join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP,
+                          (char*)&mreq, sizeof(mreq)) == 0;
+    }
+
     static void checkRoutingTable(UDPAddress& addr)
     {
         // UNIMPL
     }
+
+    static bool setKernelBuffer(int fd, bool recv, int size)
+    {
+        return setsockopt(fd, SOL_SOCKET, recv ? SO_RCVBUF : SO_SNDBUF,
+                          (char*)&size, sizeof(size)) == 0;
+    }
+
+    static bool setBusyPoll(int fd, int micros, bool prefer)
+    {
+        fprintf(stderr, "ZCM Warning: busy polling is not supported on this platform\n");
+        return false;
+    }
 };
 #else
 struct Platform
@@ -51,10 +72,55 @@ struct Platform
         }
         return true;
     }
+
+    static bool setMembership(int fd, struct in_addr multiaddr, bool join)
+    {
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr = multiaddr;
+        mreq.imr_interface.s_addr = INADDR_ANY;
+        return setsockopt(fd, IPPROTO_IP, join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP,
+                          &mreq, sizeof(mreq)) == 0;
+    }
     static void checkRoutingTable(UDPAddress& addr)
     {
 #ifdef __linux__
         // TODO
+#endif
+    }
+
+    static bool setKernelBuffer(int fd, bool recv, int size)
+    {
+#ifdef __linux__
+        // Privileged processes may go past net.core.rmem_max / wmem_max
+        if (setsockopt(fd, SOL_SOCKET, recv ? SO_RCVBUFFORCE : SO_SNDBUFFORCE,
+                       &size, sizeof(size)) == 0)
+            return true;
+#endif
+        return setsockopt(fd, SOL_SOCKET, recv ? SO_RCVBUF : SO_SNDBUF,
+                          &size, sizeof(size)) == 0;
+    }
+
+    static bool setBusyPoll(int fd, int micros, bool prefer)
+    {
+#ifdef __linux__
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &micros, sizeof(micros)) < 0) {
+            perror("setsockopt (SOL_SOCKET, SO_BUSY_POLL)");
+            return false;
+        }
+        if (prefer) {
+# ifndef SO_PREFER_BUSY_POLL
+#  define SO_PREFER_BUSY_POLL 69 // Since linux 5.11, older headers don't have it
+# endif
+            int opt = 1;
+            if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &opt, sizeof(opt)) < 0) {
+                perror("setsockopt (SOL_SOCKET, SO_PREFER_BUSY_POLL)");
+                return false;
+            }
+        }
+        return true;
+#else
+        fprintf(stderr, "ZCM Warning: busy polling is not supported on this platform\n");
+        return false;
 #endif
     }
 };
@@ -105,6 +171,38 @@ bool UDPSocket::joinMulticastGroup(struct in_addr multiaddr)
     return true;
 }
 
+bool UDPSocket::addMembership(struct in_addr multiaddr)
+{
+    ZCM_DEBUG("ZCM: joining multicast group %s", inet_ntoa(multiaddr));
+    if (!Platform::setMembership(fd, multiaddr, true)) {
+        perror("setsockopt (IPPROTO_IP, IP_ADD_MEMBERSHIP)");
+        return false;
+    }
+    return true;
+}
+
+bool UDPSocket::dropMembership(struct in_addr multiaddr)
+{
+    ZCM_DEBUG("ZCM: leaving multicast group %s", inet_ntoa(multiaddr));
+    if (!Platform::setMembership(fd, multiaddr, false)) {
+        perror("setsockopt (IPPROTO_IP, IP_DROP_MEMBERSHIP)");
+        return false;
+    }
+    return true;
+}
+
+bool UDPSocket::disableMulticastAll()
+{
+#ifdef IP_MULTICAST_ALL
+    int opt = 0;
+    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt (IPPROTO_IP, IP_MULTICAST_ALL)");
+        return false;
+    }
+#endif
+    return true;
+}
+
 bool UDPSocket::setTTL(u8 ttl, bool multicast)
 {
     if (ttl == 0)
@@ -210,6 +308,60 @@ size_t UDPSocket::getSendBufSize()
     return size;
 }
 
+// Linux doubles the size it grants (it counts its bookkeeping too) and reports the doubled
+// value, so a buffer that was granted in full reads back as twice what was asked for
+static void warnIfClamped(const char *which, const char *opt, const char *sysctl,
+                          size_t requested, size_t granted)
+{
+#ifdef __linux__
+    if (granted >= 2 * requested) return;
+#else
+    if (granted >= requested) return;
+#endif
+    fprintf(stderr,
+            "==== ZCM Warning ===\n"
+            "ZCM asked for a %zu byte kernel UDP %s buffer (url option '%s'), but the\n"
+            "kernel only granted %zu bytes. Raise %s (see\n"
+            "scripts/set-multicast-buffers.sh) or run with CAP_NET_ADMIN.\n",
+            requested, which, opt, granted, sysctl);
+}
+
+bool UDPSocket::setRecvBufSize(size_t size)
+{
+    ZCM_DEBUG("ZCM: requesting a %zu byte receive buffer", size);
+    if (!Platform::setKernelBuffer(fd, true, (int)size)) {
+        perror("setsockopt (SOL_SOCKET, SO_RCVBUF)");
+        return false;
+    }
+    warnIfClamped("receive", "rcvbuf", "net.core.rmem_max", size, getRecvBufSize());
+    return true;
+}
+
+bool UDPSocket::setSendBufSize(size_t size)
+{
+    ZCM_DEBUG("ZCM: requesting a %zu byte send buffer", size);
+    if (!Platform::setKernelBuffer(fd, false, (int)size)) {
+        perror("setsockopt (SOL_SOCKET, SO_SNDBUF)");
+        return false;
+    }
+    warnIfClamped("send", "sndbuf", "net.core.wmem_max", size, getSendBufSize());
+    return true;
+}
+
+bool UDPSocket::setBusyPoll(u32 micros, bool prefer)
+{
+    ZCM_DEBUG("ZCM: busy polling for up to %u us%s", micros, prefer ? " (preferred)" : "");
+    if (!Platform::setBusyPoll(fd, (int)micros, prefer)) {
+        fprintf(stderr,
+                "==== ZCM Warning ===\n"
+                "ZCM could not enable busy polling (url options 'busy_poll' and\n"
+                "'prefer_busy_poll'). Going past net.core.busy_read or preferring busy\n"
+                "polling needs CAP_NET_ADMIN.\n");
+        return false;
+    }
+    return true;
+}
+
 bool UDPSocket::waitUntilData(int timeout)
 {
     assert(isOpen());
@@ -236,6 +388,29 @@ bool UDPSocket::waitUntilData(int timeout)
     }
 }
 
+// Room for the SO_TIMESTAMP control message of a single packet
+static const size_t CONTROL_BUF_SIZE = 64;
+
+static i64 packetUtime(struct msghdr *msg)
+{
+#ifdef SO_TIMESTAMP
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+    /* Get the receive timestamp out of the packet headers if possible */
+    while (cmsg) {
+        if (cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_TIMESTAMP) {
+            struct timeval *t = (struct timeval*) CMSG_DATA (cmsg);
+            return (i64) t->tv_sec * 1000000 + t->tv_usec;
+        }
+        cmsg = CMSG_NXTHDR(msg, cmsg);
+    }
+#endif
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (i64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 int UDPSocket::recvPacket(Packet *pkt)
 {
     struct iovec vec;
@@ -253,7 +428,7 @@ int UDPSocket::recvPacket(Packet *pkt)
     // operating systems that provide SO_TIMESTAMP allow us to obtain more
     // accurate timestamps by having the kernel produce timestamps as soon
     // as packets are received.
-    char controlbuf[64];
+    char controlbuf[CONTROL_BUF_SIZE];
     msg.msg_control = controlbuf;
     msg.msg_controllen = sizeof(controlbuf);
     msg.msg_flags = 0;
@@ -261,92 +436,96 @@ int UDPSocket::recvPacket(Packet *pkt)
 
     int ret = ::recvmsg(fd, &msg, 0);
     pkt->fromlen = msg.msg_namelen;
-
-    bool got_utime = false;
-#ifdef SO_TIMESTAMP
-    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-    /* Get the receive timestamp out of the packet headers if possible */
-    while (!pkt->utime && cmsg) {
-        if (cmsg->cmsg_level == SOL_SOCKET &&
-            cmsg->cmsg_type == SCM_TIMESTAMP) {
-            struct timeval *t = (struct timeval*) CMSG_DATA (cmsg);
-            pkt->utime = (int64_t) t->tv_sec * 1000000 + t->tv_usec;
-            got_utime = true;
-            break;
-        }
-        cmsg = CMSG_NXTHDR(&msg, cmsg);
-    }
-#endif
-
-    if (!got_utime) {
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        pkt->utime = (i64)tv.tv_sec * 1000000 + tv.tv_usec;
-    }
+    pkt->utime = packetUtime(&msg);
 
     return ret;
 }
 
-ssize_t UDPSocket::sendBuffers(const UDPAddress& dest, const char *a, size_t alen)
+int UDPSocket::recvPackets(Packet **pkts, size_t n)
 {
-    struct iovec iv;
-    iv.iov_base = (char*)a;
-    iv.iov_len = alen;;
+#ifdef USE_MMSG
+    n = std::min(n, (size_t) ZCM_MAX_IO_BATCH);
+    if (mmsgs.size() < n) {
+        mmsgs.resize(n);
+        iovs.resize(n);
+        controlBufs.resize(n * CONTROL_BUF_SIZE);
+    }
 
-    struct msghdr mhdr;
-    mhdr.msg_name = dest.getAddrPtr();
-    mhdr.msg_namelen = dest.getAddrSize();
-    mhdr.msg_iov = &iv;
-    mhdr.msg_iovlen = 1;
-    mhdr.msg_control = NULL;
-    mhdr.msg_controllen = 0;
-    mhdr.msg_flags = 0;
+    for (size_t i = 0; i < n; ++i) {
+        iovs[i].iov_base = pkts[i]->buf.data;
+        iovs[i].iov_len = pkts[i]->buf.size;
+
+        struct msghdr& msg = mmsgs[i].msg_hdr;
+        memset(&mmsgs[i], 0, sizeof(mmsgs[i]));
+        msg.msg_name = &pkts[i]->from;
+        msg.msg_namelen = sizeof(struct sockaddr);
+        msg.msg_iov = &iovs[i];
+        msg.msg_iovlen = 1;
+        msg.msg_control = &controlBufs[i * CONTROL_BUF_SIZE];
+        msg.msg_controllen = CONTROL_BUF_SIZE;
+    }
+
+    int ret = ::recvmmsg(fd, mmsgs.data(), n, MSG_DONTWAIT, NULL);
+    if (ret < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
 
-    return::sendmsg(fd, &mhdr, 0);
+    for (int i = 0; i < ret; ++i) {
+        pkts[i]->sz = mmsgs[i].msg_len;
+        pkts[i]->fromlen = mmsgs[i].msg_hdr.msg_namelen;
+        pkts[i]->utime = packetUtime(&mmsgs[i].msg_hdr);
+    }
+    return ret;
+#else
+    if (n == 0) return 0;
+    int ret = recvPacket(pkts[0]);
+    if (ret < 0) return -1;
+    pkts[0]->sz = ret;
+    return 1;
+#endif
 }
 
-ssize_t UDPSocket::sendBuffers(const UDPAddress& dest, const char *a, size_t alen,
-                                const char *b, size_t blen)
-{
-    struct iovec iv[2];
-    iv[0].iov_base = (char*)a;
-    iv[0].iov_len = alen;;
-    iv[1].iov_base = (char*)b;
-    iv[1].iov_len = blen;;
-
-    struct msghdr mhdr;
-    mhdr.msg_name = dest.getAddrPtr();
-    mhdr.msg_namelen = dest.getAddrSize();
-    mhdr.msg_iov = iv;
-    mhdr.msg_iovlen = 2;
-    mhdr.msg_control = NULL;
-    mhdr.msg_controllen = 0;
-    mhdr.msg_flags = 0;
-
-    return::sendmsg(fd, &mhdr, 0);
+static void fillMsghdr(struct msghdr *mhdr, struct iovec *iv, const OutPacket& pkt)
+{
+    iv[0].iov_base = (char*)pkt.hdr;
+    iv[0].iov_len = pkt.hdrlen;
+    for (size_t i = 0; i < pkt.ndata; ++i) iv[i + 1] = pkt.data[i];
+
+    mhdr->msg_name = pkt.dest->getAddrPtr();
+    mhdr->msg_namelen = pkt.dest->getAddrSize();
+    mhdr->msg_iov = iv;
+    mhdr->msg_iovlen = 1 + pkt.ndata;
+    mhdr->msg_control = NULL;
+    mhdr->msg_controllen = 0;
+    mhdr->msg_flags = 0;
 }
 
-ssize_t UDPSocket::sendBuffers(const UDPAddress& dest, const char *a, size_t alen,
-                                const char *b, size_t blen, const char *c, size_t clen)
-{
-    struct iovec iv[3];
-    iv[0].iov_base = (char*)a;
-    iv[0].iov_len = alen;;
-    iv[1].iov_base = (char*)b;
-    iv[1].iov_len = blen;;
-    iv[2].iov_base = (char*)c;
-    iv[2].iov_len = clen;;
-
-    struct msghdr mhdr;
-    mhdr.msg_name = dest.getAddrPtr();
-    mhdr.msg_namelen = dest.getAddrSize();
-    mhdr.msg_iov = iv;
-    mhdr.msg_iovlen = 3;
-    mhdr.msg_control = NULL;
-    mhdr.msg_controllen = 0;
-    mhdr.msg_flags = 0;
-
-    return::sendmsg(fd, &mhdr, 0);
+size_t UDPSocket::sendPackets(const OutPacket *pkts, size_t n)
+{
+    size_t sent = 0;
+#ifdef USE_MMSG
+    size_t batch = std::min(n, (size_t) ZCM_MAX_IO_BATCH);
+    if (mmsgs.size() < batch) mmsgs.resize(batch);
+    if (iovs.size() < 3 * batch) iovs.resize(3 * batch);
+
+    while (sent < n) {
+        batch = std::min(n - sent, (size_t) ZCM_MAX_IO_BATCH);
+        for (size_t i = 0; i < batch; ++i) {
+            memset(&mmsgs[i], 0, sizeof(mmsgs[i]));
+            fillMsghdr(&mmsgs[i].msg_hdr, &iovs[3 * i], pkts[sent + i]);
+        }
+        int ret = ::sendmmsg(fd, mmsgs.data(), batch, 0);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) break;
+        sent += ret;
+    }
+#else
+    for (; sent < n; ++sent) {
+        struct iovec iv[3];
+        struct msghdr mhdr;
+        fillMsghdr(&mhdr, iv, pkts[sent]);
+        if (::sendmsg(fd, &mhdr, 0) < 0) break;
+    }
+#endif
+    return sent;
 }
 
 bool UDPSocket::checkConnection(const string& ip, u16 port)
@@ -376,7 +555,8 @@ void UDPSocket::checkAndWarnAboutSmallBuffer(size_t datalen, size_t kbufsize)
                 "==== ZCM Warning ===\n"
                 "ZCM detected that large packets are being received, but the kernel UDP\n"
                 "receive buffer is very small.  The possibility of dropping packets due to\n"
-                "insufficient buffer space is very high.\n");
+                "insufficient buffer space is very high. Ask for a bigger one with the\n"
+                "'rcvbuf' url option.\n");
     }
 #endif
 }
@@ -395,7 +575,8 @@ UDPSocket UDPSocket::createSendSocket(struct in_addr addr, u8 ttl, bool multicas
     return sock;
 }
 
-UDPSocket UDPSocket::createRecvSocket(struct in_addr addr, u16 port, bool multicast)
+UDPSocket UDPSocket::createRecvSocket(struct in_addr addr, u16 port, bool multicast,
+                                       bool joinGroup)
 {
     UDPSocket sock;
     if (!sock.init())                        { sock.close(); return sock; }
@@ -405,7 +586,7 @@ UDPSocket UDPSocket::createRecvSocket(struct in_addr addr, u16 port, bool multic
     }
     if (!sock.enablePacketTimestamp())       { sock.close(); return sock; }
     if (!sock.bindPort(port))                { sock.close(); return sock; }
-    if (multicast) {
+    if (multicast && joinGroup) {
         if (!sock.joinMulticastGroup(addr))  { sock.close(); return sock; }
     }
     return sock;
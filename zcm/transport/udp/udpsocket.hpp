@@ -27,6 +27,16 @@ class UDPAddress
     struct sockaddr_in addr;
 };
 
+// One outgoing datagram to dest: a header followed by up to two more pieces of data
+struct OutPacket
+{
+    const UDPAddress *dest;
+    char hdr[sizeof(MsgHeaderLong)];
+    size_t hdrlen;
+    struct iovec data[2];
+    size_t ndata;
+};
+
 class UDPSocket
 {
   public:
@@ -44,30 +54,53 @@ class UDPSocket
     bool enablePacketTimestamp();
     bool enableMulticastLoopback();
     bool setDestination(const string& ip, u16 port);
+    // Join or leave a multicast group on an open socket, without closing it on failure
+    bool addMembership(struct in_addr multiaddr);
+    bool dropMembership(struct in_addr multiaddr);
+    // Only deliver multicast of the groups this socket joined itself (linux only, other
+    // platforms deliver the groups joined by any socket bound to the same port)
+    bool disableMulticastAll();
 
     size_t getRecvBufSize();
     size_t getSendBufSize();
+    // Ask for kernel buffers of the given size, past the system limits where the process
+    // is allowed to. Warn when the kernel grants less
+    bool setRecvBufSize(size_t size);
+    bool setSendBufSize(size_t size);
+    // Busy poll the device queue for up to micros when waiting for packets (linux only)
+    bool setBusyPoll(u32 micros, bool prefer);
 
     // Returns true when there is a packet available for receiving
     bool waitUntilData(int timeout);
     int recvPacket(Packet *pkt);
+    // Receives up to n of the packets that are already waiting, with a single recvmmsg()
+    // where available. Sets the size of every packet received. Returns how many were
+    // received (0 if none were waiting) or -1 on error
+    int recvPackets(Packet **pkts, size_t n);
 
-    ssize_t sendBuffers(const UDPAddress& dest, const char *a, size_t alen);
-    ssize_t sendBuffers(const UDPAddress& dest, const char *a, size_t alen,
-                            const char *b, size_t blen);
-    ssize_t sendBuffers(const UDPAddress& dest, const char *a, size_t alen,
-                        const char *b, size_t blen, const char *c, size_t clen);
+    // Sends the packets in order, up to ZCM_MAX_IO_BATCH of them per sendmmsg() where
+    // available. Stops at the first packet that fails and returns how many were sent
+    size_t sendPackets(const OutPacket *pkts, size_t n);
 
     static bool checkConnection(const string& ip, u16 port);
     void checkAndWarnAboutSmallBuffer(size_t datalen, size_t kbufsize);
 
     static UDPSocket createSendSocket(struct in_addr addr, u8 ttl, bool multicast);
-    static UDPSocket createRecvSocket(struct in_addr addr, u16 port, bool multicast);
+    // joinGroup=false leaves joining multicast groups to the caller
+    static UDPSocket createRecvSocket(struct in_addr addr, u16 port, bool multicast,
+                                      bool joinGroup = true);
 
   private:
     SOCKET fd = -1;
     bool warnedAboutSmallBuffer = false;
 
+#ifdef USE_MMSG
+    // Scratch space of recvPackets() and sendPackets(), only ever grows
+    vector<struct mmsghdr> mmsgs;
+    vector<struct iovec> iovs;
+    vector<char> controlBufs;
+#endif
+
   private:
     // Disallow copies
     UDPSocket(const UDPSocket&) = delete;
@@ -0,0 +1,175 @@
+#include "channel_intern.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace zcm {
+
+constexpr uint32_t ChannelIntern::NONE;
+constexpr uint32_t ChannelIntern::MAX_IDS;
+
+namespace {
+
+struct Entry
+{
+    uint32_t id;
+    uint32_t hash;
+    string name;
+};
+
+// Open addressing with linear probing. Slots go from empty to set exactly once, so a reader
+// never sees an entry move or disappear
+struct Table
+{
+    size_t mask;
+    unique_ptr<atomic<const Entry*>[]> slots;
+
+    Table(size_t capacity) : mask(capacity - 1), slots(new atomic<const Entry*>[capacity])
+    {
+        for (size_t i = 0; i <= mask; ++i) slots[i].store(nullptr, memory_order_relaxed);
+    }
+
+    const Entry* find(const char* name, uint32_t hash) const
+    {
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Entry* e = slots[i].load(memory_order_acquire);
+            if (!e) return nullptr;
+            if (e->hash == hash && e->name == name) return e;
+        }
+    }
+
+    // Interner only
+    void insert(const Entry* e)
+    {
+        size_t i = e->hash & mask;
+        while (slots[i].load(memory_order_relaxed)) i = (i + 1) & mask;
+        slots[i].store(e, memory_order_release);
+    }
+};
+
+static constexpr size_t INITIAL_CAPACITY = 256;
+// id -> entry lives in blocks that are allocated as needed and never move
+static constexpr size_t BLOCK_SIZE = 4096;
+static constexpr size_t NUM_BLOCKS = ChannelIntern::MAX_IDS / BLOCK_SIZE + 1;
+
+struct Interned
+{
+    atomic<const Table*> table {nullptr};
+    atomic<atomic<const Entry*>*> blocks[NUM_BLOCKS];
+    atomic<uint32_t> count {0};
+
+    // Serializes interning. Everything below is only touched while holding it
+    mutex mut;
+    // Readers may still be probing a table after it was outgrown, so they are all kept
+    vector<unique_ptr<Table>> tables;
+    vector<unique_ptr<Entry>> entries;
+
+    Interned()
+    {
+        for (auto& b : blocks) b.store(nullptr, memory_order_relaxed);
+        tables.emplace_back(new Table(INITIAL_CAPACITY));
+        table.store(tables.back().get(), memory_order_release);
+    }
+};
+
+// Never destroyed, so that channels can still be looked up from static destructors
+static Interned& interned()
+{
+    static Interned* in = new Interned();
+    return *in;
+}
+
+// FNV-1a
+static uint32_t hashName(const char* name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name; ++name) {
+        h ^= (uint8_t) *name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+}
+
+uint32_t ChannelIntern::id(const char* channel)
+{
+    Interned& in = interned();
+    uint32_t hash = hashName(channel);
+    const Entry* e = in.table.load(memory_order_acquire)->find(channel, hash);
+    if (e) return e->id;
+
+    unique_lock<mutex> lk(in.mut);
+    // Someone else may have interned it (or outgrown the table) in the meantime
+    Table* t = in.tables.back().get();
+    e = t->find(channel, hash);
+    if (e) return e->id;
+
+    uint32_t id = in.count.load(memory_order_relaxed) + 1;
+    if (id >= MAX_IDS) return NONE;
+
+    Entry* entry = new Entry();
+    entry->id = id;
+    entry->hash = hash;
+    entry->name = channel;
+    in.entries.emplace_back(entry);
+
+    // The name must be resolvable before the id can be found
+    atomic<const Entry*>* block = in.blocks[id / BLOCK_SIZE].load(memory_order_relaxed);
+    if (!block) {
+        block = new atomic<const Entry*>[BLOCK_SIZE];
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) block[i].store(nullptr, memory_order_relaxed);
+        in.blocks[id / BLOCK_SIZE].store(block, memory_order_release);
+    }
+    block[id % BLOCK_SIZE].store(entry, memory_order_release);
+    in.count.store(id, memory_order_release);
+
+    // Stay at most half full
+    if (2 * (size_t) id > t->mask + 1) {
+        Table* bigger = new Table(2 * (t->mask + 1));
+        for (auto& it : in.entries) bigger->insert(it.get());
+        in.tables.emplace_back(bigger);
+        in.table.store(bigger, memory_order_release);
+    } else {
+        t->insert(entry);
+    }
+    return id;
+}
+
+uint32_t ChannelIntern::find(const char* channel)
+{
+    Interned& in = interned();
+    uint32_t hash = hashName(channel);
+    const Table* t = in.table.load(memory_order_acquire);
+    while (true) {
+        const Entry* e = t->find(channel, hash);
+        if (e) return e->id;
+
+        // Channels interned after the table was outgrown only go into the new one, so a
+        // miss only counts if the table was not replaced while we were probing it
+        const Table* current = in.table.load(memory_order_acquire);
+        if (current == t) return NONE;
+        t = current;
+    }
+}
+
+const char* ChannelIntern::name(uint32_t id)
+{
+    Interned& in = interned();
+    if (id == NONE || id > in.count.load(memory_order_acquire)) return nullptr;
+    const atomic<const Entry*>* block = in.blocks[id / BLOCK_SIZE].load(memory_order_acquire);
+    return block[id % BLOCK_SIZE].load(memory_order_acquire)->name.c_str();
+}
+
+uint32_t ChannelIntern::size()
+{
+    return interned().count.load(memory_order_acquire);
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+// Process-wide table of channel names. Every channel gets a dense integer id the first time
+// it is interned (ids count up from 1, 0 is never handed out) and keeps it, together with a
+// single copy of its name, for the lifetime of the process. Ids therefore mean the same thing
+// to every zcm instance and transport in the process, but nothing outside of it.
+//
+// Looking up a channel that is already interned never takes a lock: it hashes the name once
+// and probes a table that is only ever added to. Interning a new channel takes a mutex.
+// Resolving an id back to its name is a couple of loads.
+namespace zcm {
+
+class ChannelIntern
+{
+  public:
+    static constexpr uint32_t NONE = 0;
+    // Ids are never reused, so the table stops handing out new ones past this many channels
+    static constexpr uint32_t MAX_IDS = 1u << 26;
+
+    // The id of channel, interning it if it was never seen before. Returns NONE only once
+    // MAX_IDS channels have been interned
+    static uint32_t id(const char* channel);
+
+    // The id of channel, or NONE if it was never interned
+    static uint32_t find(const char* channel);
+
+    // The interned name of id, or nullptr for ids that were never handed out. The name stays
+    // valid (and at the same address) for the lifetime of the process, so comparing the
+    // pointer against name(id) tells whether a channel pointer came from the table
+    static const char* name(uint32_t id);
+
+    // The number of channels interned so far, which is also the largest id handed out
+    static uint32_t size();
+};
+
+}
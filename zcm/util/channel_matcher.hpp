@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Matches channel names against a set of regex subscription patterns.
+//
+// Patterns of the form "<literal prefix>.*" (by far the most common kind) are compiled
+// into a prefix trie, so all of them are checked with a single walk over the channel.
+// Anything else falls back to std::regex. On top of that, the result for a channel is
+// memoized in a Cache: channels repeat, so in steady state matching a message costs one
+// hash lookup regardless of how many patterns are registered.
+//
+// add(), remove() and remap() must not run concurrently with lookups. Every thread that
+// looks up channels concurrently with other threads needs its own Cache. A Cache can
+// be used with several matchers: every matcher (and every modification of a matcher)
+// gets a process-wide unique version, so a Cache never returns stale results.
+template<class T>
+class ChannelMatcher
+{
+  public:
+    using Matches = std::vector<T*>;
+
+    class Cache
+    {
+        // Bound the memory used by caching channels we only ever see once
+        static constexpr size_t MAX_ENTRIES = 1024;
+
+        std::unordered_map<std::string, Matches> entries;
+        std::unordered_map<uint32_t, Matches> entriesById;
+        size_t version = 0;
+        std::string key; // Reused so that a lookup doesn't allocate
+
+        void checkVersion(const ChannelMatcher& matcher)
+        {
+            if (version != matcher.version) {
+                entries.clear();
+                entriesById.clear();
+                version = matcher.version;
+            }
+        }
+
+      public:
+        // Returns every value whose pattern fully matches channel
+        const Matches& lookup(const ChannelMatcher& matcher, const char* channel)
+        {
+            checkVersion(matcher);
+
+            key.assign(channel);
+            auto it = entries.find(key);
+            if (it != entries.end()) return it->second;
+
+            if (entries.size() >= MAX_ENTRIES) entries.clear();
+            Matches& ret = entries[key];
+            matcher.matchUncached(channel, ret);
+            return ret;
+        }
+
+        // Same as above for callers that know the interned id of channel (see
+        // channel_intern.hpp), which spares hashing the name
+        const Matches& lookup(const ChannelMatcher& matcher, uint32_t id, const char* channel)
+        {
+            checkVersion(matcher);
+
+            auto it = entriesById.find(id);
+            if (it != entriesById.end()) return it->second;
+
+            if (entriesById.size() >= MAX_ENTRIES) entriesById.clear();
+            Matches& ret = entriesById[id];
+            matcher.matchUncached(channel, ret);
+            return ret;
+        }
+    };
+
+    void add(const std::string& pattern, T* val)
+    {
+        Entry e;
+        e.pattern = pattern;
+        e.val = val;
+        std::string prefix;
+        if (!literalPrefix(pattern, prefix)) e.re = std::make_shared<const std::regex>(pattern);
+        entries.push_back(std::move(e));
+        rebuild();
+    }
+
+    // Returns false if there was no such pattern
+    bool remove(const std::string& pattern)
+    {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].pattern == pattern) {
+                entries[i] = std::move(entries.back());
+                entries.pop_back();
+                rebuild();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Replace the value of every pattern with f(pattern, value)
+    template<class F>
+    void remap(F f)
+    {
+        for (auto& e : entries) e.val = f(e.pattern, e.val);
+        rebuild();
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    ChannelMatcher()
+    {
+        rebuild();
+    }
+
+    // Compiled regexes are shared between copies
+    ChannelMatcher(const ChannelMatcher& other) : entries(other.entries)
+    {
+        rebuild();
+    }
+
+    ChannelMatcher& operator=(const ChannelMatcher& other) = delete;
+
+  private:
+    struct Entry
+    {
+        std::string pattern;
+        T* val;
+        // Only set if the pattern could not be compiled into the trie
+        std::shared_ptr<const std::regex> re;
+    };
+
+    struct TrieNode
+    {
+        Matches vals;
+        std::vector<std::pair<char, std::unique_ptr<TrieNode>>> children;
+
+        TrieNode* child(char c) const
+        {
+            for (auto& ch : children) if (ch.first == c) return ch.second.get();
+            return nullptr;
+        }
+    };
+
+    std::vector<Entry> entries;
+    std::unique_ptr<TrieNode> trie;
+    std::vector<Entry*> general;
+    size_t version;
+
+    static size_t nextVersion()
+    {
+        static std::atomic<size_t> v {1};
+        return v++;
+    }
+
+    // Returns true if pattern is of the form "<literal prefix>.*"
+    static bool literalPrefix(const std::string& pattern, std::string& prefix)
+    {
+        size_t n = pattern.size();
+        if (n < 2 || pattern[n - 2] != '.' || pattern[n - 1] != '*') return false;
+        for (size_t i = 0; i < n - 2; ++i)
+            if (strchr("^$\\.*+?()[]{}|", pattern[i])) return false;
+        prefix = pattern.substr(0, n - 2);
+        return true;
+    }
+
+    void rebuild()
+    {
+        trie.reset(new TrieNode());
+        general.clear();
+        for (auto& e : entries) {
+            if (e.re) {
+                general.push_back(&e);
+                continue;
+            }
+            std::string prefix;
+            literalPrefix(e.pattern, prefix);
+            TrieNode* node = trie.get();
+            for (char c : prefix) {
+                TrieNode* next = node->child(c);
+                if (!next) {
+                    next = new TrieNode();
+                    node->children.emplace_back(c, std::unique_ptr<TrieNode>(next));
+                }
+                node = next;
+            }
+            node->vals.push_back(e.val);
+        }
+        version = nextVersion();
+    }
+
+    void matchUncached(const char* channel, Matches& ret) const
+    {
+        // '.' doesn't match line terminators, so a trailing ".*" can only
+        // match if there are none after the end of the literal prefix
+        long lastTerm = -1;
+        for (long i = 0; channel[i]; ++i)
+            if (channel[i] == '\n' || channel[i] == '\r') lastTerm = i;
+
+        const TrieNode* node = trie.get();
+        for (long depth = 0; node; ++depth) {
+            if (depth > lastTerm)
+                ret.insert(ret.end(), node->vals.begin(), node->vals.end());
+            if (!channel[depth]) break;
+            node = node->child(channel[depth]);
+        }
+        for (auto* e : general)
+            if (std::regex_match(channel, *e->re)) ret.push_back(e->val);
+    }
+};
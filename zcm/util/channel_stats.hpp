@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Per-channel message counters and handler time histograms.
+//
+// Counting goes through Writers. Every Writer must only be used by one thread at a time
+// (or by threads serialized by an external mutex) and gets its own set of counters per
+// channel, each padded out to separate cache lines, so counting never contends with
+// other writers and costs a lookup in the writer's private map plus a few relaxed
+// increments. snapshot() sums up the counters of every writer that ever existed.
+//
+// Counters are owned by the ChannelStats and outlive the Writers that filled them.
+template<size_t HIST_BUCKETS>
+class ChannelStats
+{
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+  public:
+    struct Counters
+    {
+        uint8_t pad0[CACHE_LINE_SIZE];
+        std::atomic<uint64_t> published  {0};
+        std::atomic<uint64_t> received   {0};
+        std::atomic<uint64_t> dispatched {0};
+        std::atomic<uint64_t> dropped    {0};
+        std::atomic<uint64_t> blocked    {0};
+        std::atomic<uint64_t> handlerHist[HIST_BUCKETS];
+        uint8_t pad1[CACHE_LINE_SIZE];
+
+        Counters() { for (auto& h : handlerHist) h.store(0, std::memory_order_relaxed); }
+
+        // Only ever called by the one writer, so no read-modify-write is needed
+        static void inc(std::atomic<uint64_t>& c)
+        {
+            c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // Bucket 0 is for anything below 1us, bucket i for [2^(i-1), 2^i) us and the
+        // last bucket for everything longer
+        void addHandlerTime(uint64_t ns)
+        {
+            uint64_t us = ns / 1000;
+            size_t bucket = 0;
+            while (us && bucket < HIST_BUCKETS - 1) {
+                us >>= 1;
+                ++bucket;
+            }
+            inc(handlerHist[bucket]);
+        }
+    };
+
+    struct Totals
+    {
+        uint64_t published = 0;
+        uint64_t received = 0;
+        uint64_t dispatched = 0;
+        uint64_t dropped = 0;
+        uint64_t blocked = 0;
+        uint64_t handlerHist[HIST_BUCKETS] = {};
+    };
+
+    class Writer
+    {
+        ChannelStats& stats;
+        std::unordered_map<std::string, Counters*> channels;
+        std::string key; // Reused so that lookups don't allocate
+        // The same counters indexed by interned channel id (see channel_intern.hpp)
+        std::vector<Counters*> channelsById;
+
+      public:
+        Writer(ChannelStats& stats) : stats(stats) {}
+
+        Counters& get(const char* channel)
+        {
+            key.assign(channel);
+            auto it = channels.find(key);
+            if (it != channels.end()) return *it->second;
+            Counters* c = stats.add(key);
+            channels.emplace(key, c);
+            return *c;
+        }
+
+        // Same as above for callers that know the interned id of channel, which makes the
+        // lookup an index instead of a hash
+        Counters& get(uint32_t id, const char* channel)
+        {
+            if (id < channelsById.size() && channelsById[id]) return *channelsById[id];
+            if (id >= channelsById.size()) channelsById.resize(id + 1, nullptr);
+            channelsById[id] = &get(channel);
+            return *channelsById[id];
+        }
+
+      private:
+        Writer(const Writer& other) = delete;
+        Writer& operator=(const Writer& other) = delete;
+    };
+
+    std::map<std::string, Totals> snapshot()
+    {
+        std::map<std::string, Totals> ret;
+        std::unique_lock<std::mutex> lk(mut);
+        for (auto& e : all) {
+            Totals& t = ret[e.first];
+            const Counters& c = *e.second;
+            t.published  += c.published.load(std::memory_order_relaxed);
+            t.received   += c.received.load(std::memory_order_relaxed);
+            t.dispatched += c.dispatched.load(std::memory_order_relaxed);
+            t.dropped    += c.dropped.load(std::memory_order_relaxed);
+            t.blocked    += c.blocked.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < HIST_BUCKETS; ++i)
+                t.handlerHist[i] += c.handlerHist[i].load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+  private:
+    std::mutex mut;
+    std::vector<std::pair<std::string, std::unique_ptr<Counters>>> all;
+
+    Counters* add(const std::string& channel)
+    {
+        Counters* c = new Counters();
+        std::unique_lock<std::mutex> lk(mut);
+        all.emplace_back(channel, std::unique_ptr<Counters>(c));
+        return c;
+    }
+};
+
+// Largest value seen, raised by a single writer at a time
+inline void raiseHighWater(std::atomic<uint32_t>& hw, size_t val)
+{
+    if (val > hw.load(std::memory_order_relaxed))
+        hw.store((uint32_t) val, std::memory_order_relaxed);
+}
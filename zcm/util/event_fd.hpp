@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+// A file descriptor that is readable for as long as some condition holds, for handing to
+// poll(), select(), epoll or anything built on them (libuv, asio, ...). It is an eventfd on
+// linux and the read end of a pipe elsewhere.
+//
+// The thread that makes the condition true calls raise() afterwards, the thread that makes
+// it false calls lower() afterwards and passes the condition, so that a raise() racing with
+// lower() is never lost. raise() only writes to the fd when it is not already readable.
+//
+// Nothing is read from or written to the fd until open() succeeded, and isOpen() is cheap
+// enough to check on every message.
+class EventFd
+{
+    int rfd = -1;
+    int wfd = -1;
+    std::atomic<bool> opened {false};
+    std::atomic<bool> raised {false};
+
+    static bool setFlags(int fd)
+    {
+        return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0 &&
+               fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+    }
+
+  public:
+    EventFd() {}
+
+    ~EventFd()
+    {
+        if (rfd >= 0) ::close(rfd);
+        if (wfd >= 0 && wfd != rfd) ::close(wfd);
+    }
+
+    // Not thread safe with itself. Returns false if the fd could not be created
+    bool open()
+    {
+        if (isOpen()) return true;
+#ifdef __linux__
+        rfd = wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (rfd < 0) return false;
+#else
+        int fds[2];
+        if (pipe(fds) != 0) return false;
+        if (!setFlags(fds[0]) || !setFlags(fds[1])) {
+            ::close(fds[0]);
+            ::close(fds[1]);
+            return false;
+        }
+        rfd = fds[0];
+        wfd = fds[1];
+#endif
+        opened.store(true, std::memory_order_release);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return opened.load(std::memory_order_acquire);
+    }
+
+    int fd() const
+    {
+        return rfd;
+    }
+
+    // Make the fd readable. Must be called *after* the condition became true
+    void raise()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (raised.exchange(true)) return;
+        uint64_t one = 1;
+        ssize_t ret;
+        do {
+#ifdef __linux__
+            ret = write(wfd, &one, sizeof(one));
+#else
+            ret = write(wfd, &one, 1);
+#endif
+        } while (ret < 0 && errno == EINTR);
+    }
+
+    // Make the fd unreadable, unless stillTrue() says that the condition was made true
+    // again in the meantime. Must be called *after* the condition became false
+    template<class Pred>
+    void lower(Pred stillTrue)
+    {
+        uint64_t buf[8];
+        ssize_t ret;
+        do {
+            ret = read(rfd, buf, sizeof(buf));
+        } while (ret > 0 || (ret < 0 && errno == EINTR));
+        raised.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (stillTrue()) raise();
+    }
+
+  private:
+    EventFd(const EventFd& other) = delete;
+    EventFd& operator=(const EventFd& other) = delete;
+};
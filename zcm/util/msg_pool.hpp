@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+// A recycling allocator for message payload buffers.
+//
+// Buffers are grouped into power-of-two size classes and every size class keeps a
+// lock-free ring of free buffers, so once the pool has warmed up a steady stream of
+// messages never touches the heap. Each ring is sized from the capacity of the queue
+// that the pool feeds: a queue can never hold more buffers of one class than it has
+// slots, so anything beyond that goes back to the heap. Payloads above the largest size
+// class are not pooled at all, and a pool never holds on to more than MAX_RETAINED bytes
+// of free buffers, so that a queue of large messages doesn't pin down its peak forever.
+//
+// Like SpscQueue, this is built for exactly one allocating thread and one freeing
+// thread at any given time (each side may be serialized by an external mutex).
+//
+// Note: setCapacity() requires that *both* sides are quiesced by the caller
+class MsgPool
+{
+  public:
+    struct Stats
+    {
+        uint64_t heapAllocs; // Buffers that had to be malloc()'ed
+        uint64_t heapFrees;  // Buffers that were given back to the heap
+        uint64_t recycled;   // Allocations served from a free list
+    };
+
+  private:
+    // Size classes go from 2^MIN_SHIFT up to 2^(MIN_SHIFT + NUM_CLASSES - 1) bytes (4MB).
+    // Anything bigger is simply malloc()'ed and free()'d
+    static constexpr size_t MIN_SHIFT = 6;
+    static constexpr size_t NUM_CLASSES = 17;
+    // Most bytes of free buffers kept around, over all size classes
+    static constexpr size_t MAX_RETAINED = 32 << 20;
+
+    struct FreeList
+    {
+        uint8_t** slots = nullptr;
+        std::atomic<size_t> front {0}; // Owned by the allocating side
+        std::atomic<size_t> back {0};  // Owned by the freeing side
+    };
+
+    FreeList lists[NUM_CLASSES];
+    size_t capacity;
+    std::atomic<size_t> retained {0}; // Bytes of the buffers in the free lists
+
+    std::atomic<uint64_t> heapAllocs {0};
+    std::atomic<uint64_t> heapFrees {0};
+    std::atomic<uint64_t> recycled {0};
+
+    size_t incIdx(size_t i) const
+    {
+        size_t nextIdx = i + 1;
+        if (nextIdx == capacity) return 0;
+        return nextIdx;
+    }
+
+    // Returns NUM_CLASSES if len is too big to be pooled
+    static size_t sizeClass(size_t len)
+    {
+        size_t cls = 0;
+        while (cls < NUM_CLASSES && ((size_t)1 << (MIN_SHIFT + cls)) < len) ++cls;
+        return cls;
+    }
+
+    static size_t classSize(size_t cls)
+    {
+        return (size_t)1 << (MIN_SHIFT + cls);
+    }
+
+    uint8_t* heapAlloc(size_t sz)
+    {
+        heapAllocs.fetch_add(1, std::memory_order_relaxed);
+        return (uint8_t*) malloc(sz);
+    }
+
+    void heapFree(uint8_t* buf)
+    {
+        heapFrees.fetch_add(1, std::memory_order_relaxed);
+        ::free(buf);
+    }
+
+    void allocSlots(size_t capacity)
+    {
+        this->capacity = capacity;
+        for (auto& l : lists) {
+            l.slots = new uint8_t*[capacity];
+            l.front.store(0, std::memory_order_relaxed);
+            l.back.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void releaseSlots()
+    {
+        for (auto& l : lists) {
+            size_t f = l.front.load(std::memory_order_acquire);
+            size_t b = l.back.load(std::memory_order_acquire);
+            while (f != b) {
+                heapFree(l.slots[f]);
+                f = incIdx(f);
+            }
+            delete[] l.slots;
+            l.slots = nullptr;
+        }
+        retained.store(0, std::memory_order_relaxed);
+    }
+
+  public:
+    MsgPool(size_t capacity)
+    {
+        allocSlots(capacity);
+    }
+
+    ~MsgPool()
+    {
+        releaseSlots();
+    }
+
+    size_t getCapacity()
+    {
+        return capacity;
+    }
+
+    // Requires that both the allocating and the freeing side are quiesced
+    void setCapacity(size_t capacity)
+    {
+        releaseSlots();
+        allocSlots(capacity);
+    }
+
+    // Returns a buffer of at least len bytes
+    uint8_t* alloc(size_t len)
+    {
+        size_t cls = sizeClass(len);
+        if (cls == NUM_CLASSES) return heapAlloc(len);
+
+        FreeList& l = lists[cls];
+        size_t f = l.front.load(std::memory_order_relaxed);
+        if (f == l.back.load(std::memory_order_acquire)) return heapAlloc(classSize(cls));
+
+        uint8_t* buf = l.slots[f];
+        l.front.store(incIdx(f), std::memory_order_release);
+        retained.fetch_sub(classSize(cls), std::memory_order_relaxed);
+        recycled.fetch_add(1, std::memory_order_relaxed);
+        return buf;
+    }
+
+    // Must be called with the same len that the buffer was alloc()'ed with
+    void free(uint8_t* buf, size_t len)
+    {
+        if (!buf) return;
+
+        size_t cls = sizeClass(len);
+        if (cls == NUM_CLASSES) {
+            heapFree(buf);
+            return;
+        }
+
+        FreeList& l = lists[cls];
+        size_t b = l.back.load(std::memory_order_relaxed);
+        size_t nextB = incIdx(b);
+        if (nextB == l.front.load(std::memory_order_acquire) ||
+            retained.load(std::memory_order_relaxed) + classSize(cls) > MAX_RETAINED) {
+            heapFree(buf);
+            return;
+        }
+
+        retained.fetch_add(classSize(cls), std::memory_order_relaxed);
+        l.slots[b] = buf;
+        l.back.store(nextB, std::memory_order_release);
+    }
+
+    Stats getStats()
+    {
+        Stats s;
+        s.heapAllocs = heapAllocs.load(std::memory_order_relaxed);
+        s.heapFrees  = heapFrees.load(std::memory_order_relaxed);
+        s.recycled   = recycled.load(std::memory_order_relaxed);
+        return s;
+    }
+
+  private:
+    MsgPool(const MsgPool& other) = delete;
+    MsgPool(MsgPool&& other) = delete;
+    MsgPool& operator=(const MsgPool& other) = delete;
+    MsgPool& operator=(MsgPool&& other) = delete;
+};
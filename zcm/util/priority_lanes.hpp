@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "spin_wait.hpp"
+#include "spsc_queue.hpp"
+
+// A set of single-producer / single-consumer queues ("lanes") drained by one consumer in
+// priority order. Lane 0 has the highest priority. Every lane has a capacity of its own,
+// so a burst on one lane never takes room away from another, and the producer only ever
+// waits for room in the lane it pushes to.
+//
+// The consumer either serves the lanes strictly by priority or, when weighted, spreads
+// its pops over the non-empty lanes in proportion to their weights (smooth weighted
+// round robin), so that a busy high priority lane can not starve the lower ones.
+//
+// The threading rules are those of SpscQueue: one producer and one consumer at a time
+// across all lanes. The consumer waits for any lane the same way SpscQueue::top() does.
+//
+// Note: setCapacity() requires that *both* sides are quiesced by the caller
+template<class Element>
+class PriorityLanes
+{
+  public:
+    typedef SpscQueue<Element> Lane;
+    typedef typename Lane::WaitStrategy WaitStrategy;
+
+  private:
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::atomic<bool> disabled {false};
+
+    // Owned by the consumer
+    bool weighted = false;
+    std::vector<int64_t> weights;
+    std::vector<int64_t> credits;
+    size_t selected = 0; // Lane of the element last returned by top()
+    size_t consumerSpin = SpinWait::MIN_SPIN;
+    WaitStrategy consumerWait = Lane::WAIT_ADAPTIVE;
+    std::chrono::nanoseconds consumerSpinTime {0};
+
+    // The consumer parks here, the lanes' own waiters are only used by the producer
+    SpinWait waiter;
+
+    bool anyMessage()
+    {
+        for (auto& l : lanes)
+            if (l->hasMessage()) return true;
+        return false;
+    }
+
+    // Requires that some lane has a message
+    size_t select()
+    {
+        size_t best = lanes.size();
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            if (!lanes[i]->hasMessage()) continue;
+            if (!weighted) return i;
+            if (best == lanes.size() ||
+                credits[i] + weights[i] > credits[best] + weights[best]) best = i;
+        }
+        return best;
+    }
+
+  public:
+    PriorityLanes(size_t numLanes, size_t capacity) :
+        weights(numLanes, 1), credits(numLanes, 0)
+    {
+        for (size_t i = 0; i < numLanes; ++i) lanes.emplace_back(new Lane(capacity));
+    }
+
+    size_t numLanes() const
+    {
+        return lanes.size();
+    }
+
+    size_t getCapacity(size_t lane)
+    {
+        return lanes[lane]->getCapacity();
+    }
+
+    size_t totalCapacity()
+    {
+        size_t total = 0;
+        for (auto& l : lanes) total += l->getCapacity();
+        return total;
+    }
+
+    // Requires that both the producer and the consumer side are quiesced
+    void setCapacity(size_t lane, size_t capacity)
+    {
+        lanes[lane]->setCapacity(capacity);
+    }
+
+    // Consumer only (or while the consumer is quiesced). Weights must be at least 1
+    void setWeighted(bool weighted)
+    {
+        this->weighted = weighted;
+        for (auto& c : credits) c = 0;
+    }
+
+    bool isWeighted() const
+    {
+        return weighted;
+    }
+
+    void setWeight(size_t lane, size_t weight)
+    {
+        weights[lane] = (int64_t) weight;
+        for (auto& c : credits) c = 0;
+    }
+
+    size_t getWeight(size_t lane) const
+    {
+        return (size_t) weights[lane];
+    }
+
+    // Consumer only (or while the consumer is quiesced). spinTime only applies to WAIT_SPIN
+    void setConsumerWait(WaitStrategy strategy,
+                         std::chrono::nanoseconds spinTime = std::chrono::nanoseconds(0))
+    {
+        consumerWait = strategy;
+        consumerSpinTime = spinTime;
+    }
+
+    bool hasMessage()
+    {
+        return anyMessage();
+    }
+
+    size_t numMessages()
+    {
+        size_t n = 0;
+        for (auto& l : lanes) n += l->numMessages();
+        return n;
+    }
+
+    size_t numMessages(size_t lane)
+    {
+        return lanes[lane]->numMessages();
+    }
+
+    // Wait for room in lane and then push the new element. Returns true if the value was
+    // pushed, otherwise it was forcibly awoken by disable()
+    template<class... Args>
+    bool push(size_t lane, Args&&... args)
+    {
+        if (!lanes[lane]->push(std::forward<Args>(args)...)) return false;
+        waiter.wake();
+        return true;
+    }
+
+    // Wait for a message in any lane and then return the top element of the lane that is
+    // next in line. Returns nullptr when forcibly awoken by disable()
+    Element* top()
+    {
+        waiter.waitFor([&](){
+            return disabled.load(std::memory_order_acquire) || anyMessage();
+        }, consumerWait, consumerSpin, consumerSpinTime);
+        if (disabled.load(std::memory_order_acquire)) return nullptr;
+
+        selected = select();
+        return lanes[selected]->at(0);
+    }
+
+    // Lane of the element last returned by top()
+    size_t topLane() const
+    {
+        return selected;
+    }
+
+    // Pops the element last returned by top()
+    void pop()
+    {
+        if (weighted) {
+            int64_t total = 0;
+            for (size_t i = 0; i < lanes.size(); ++i) {
+                if (!lanes[i]->hasMessage()) continue;
+                credits[i] += weights[i];
+                total += weights[i];
+            }
+            credits[selected] -= total;
+        }
+        lanes[selected]->pop();
+    }
+
+    // Forcefully wakes up top() and push(), see SpscQueue::disable()
+    void disable()
+    {
+        disabled.store(true, std::memory_order_release);
+        for (auto& l : lanes) l->disable();
+        waiter.wake();
+    }
+
+    void enable()
+    {
+        for (auto& l : lanes) l->enable();
+        disabled.store(false, std::memory_order_release);
+    }
+
+    bool isEnabled()
+    {
+        return !disabled.load(std::memory_order_acquire);
+    }
+
+  private:
+    PriorityLanes(const PriorityLanes& other) = delete;
+    PriorityLanes& operator=(const PriorityLanes& other) = delete;
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A pointer to an immutable object that is read without locks and replaced
+// copy-on-write, with epoch-based reclamation of the objects it used to point to.
+//
+// Every context that reads through the pointer owns a Reader (a Reader may be shared
+// by several threads as long as they never use it at the same time). Between
+// Reader::lock() and Reader::unlock() the returned object stays alive no matter how
+// often the pointer is updated in the meantime. Reading is wait-free: one load of the
+// global epoch, one store to the reader's own slot and one load of the pointer.
+//
+// Updates must be serialized by the caller. An update swaps the pointer and retires the
+// previous object under the epoch it was current in. The object is destroyed once every
+// reader has either gone quiescent or started its read in a later epoch.
+template<class T>
+class RcuPtr
+{
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct Slot
+    {
+        // 0 while quiescent, otherwise the epoch the current read started in
+        std::atomic<uint64_t> epoch {0};
+        // Every reader writes to its slot on every read, keep them apart
+        uint8_t pad[CACHE_LINE_SIZE];
+    };
+
+    struct Retired
+    {
+        uint64_t epoch;
+        T* obj;
+        std::function<void()> onReclaim;
+    };
+
+    std::atomic<T*> ptr;
+    std::atomic<uint64_t> epoch {1};
+
+    // Protects the list of slots, not their contents
+    std::mutex slotsMutex;
+    std::vector<Slot*> slots;
+
+    // Only touched by updaters
+    std::vector<Retired> retired;
+
+    Slot* addSlot()
+    {
+        std::unique_lock<std::mutex> lk(slotsMutex);
+        Slot* s = new Slot();
+        slots.push_back(s);
+        return s;
+    }
+
+    void removeSlot(Slot* s)
+    {
+        std::unique_lock<std::mutex> lk(slotsMutex);
+        slots.erase(std::find(slots.begin(), slots.end(), s));
+        delete s;
+    }
+
+    static void destroy(Retired& r)
+    {
+        delete r.obj;
+        if (r.onReclaim) r.onReclaim();
+    }
+
+  public:
+    class Reader
+    {
+        RcuPtr& rcu;
+        Slot* slot;
+        size_t depth = 0;
+
+      public:
+        Reader(RcuPtr& rcu) : rcu(rcu), slot(rcu.addSlot()) {}
+        ~Reader() { rcu.removeSlot(slot); }
+
+        // May be nested, the outermost lock() determines how long objects are kept alive
+        const T* lock()
+        {
+            if (depth++ == 0) slot->epoch.store(rcu.epoch.load());
+            return rcu.ptr.load();
+        }
+
+        void unlock()
+        {
+            if (--depth == 0) slot->epoch.store(0, std::memory_order_release);
+        }
+
+      private:
+        Reader(const Reader& other) = delete;
+        Reader& operator=(const Reader& other) = delete;
+    };
+
+    // RAII wrapper around Reader::lock() / Reader::unlock()
+    class ReadLock
+    {
+        Reader& reader;
+        const T* obj;
+
+      public:
+        ReadLock(Reader& reader) : reader(reader), obj(reader.lock()) {}
+        ~ReadLock() { reader.unlock(); }
+
+        const T* get() const { return obj; }
+        const T* operator->() const { return obj; }
+        const T& operator*() const { return *obj; }
+
+      private:
+        ReadLock(const ReadLock& other) = delete;
+        ReadLock& operator=(const ReadLock& other) = delete;
+    };
+
+    RcuPtr(T* init) : ptr(init) {}
+
+    // Requires that all Readers are gone
+    ~RcuPtr()
+    {
+        for (auto& r : retired) destroy(r);
+        delete ptr.load();
+    }
+
+    // For updaters only: the current object
+    const T* get() const
+    {
+        return ptr.load(std::memory_order_acquire);
+    }
+
+    // Replace the current object with next and retire the old one. onReclaim (if any)
+    // is called right after the old object has been destroyed, which makes it the place
+    // to release anything else that readers of the old object might still be using
+    void update(T* next, std::function<void()> onReclaim = nullptr)
+    {
+        T* old = ptr.exchange(next);
+        uint64_t e = epoch.fetch_add(1);
+        retired.push_back(Retired{e, old, std::move(onReclaim)});
+        reclaim();
+    }
+
+    // Destroy every retired object that no reader can still be looking at
+    void reclaim()
+    {
+        if (retired.empty()) return;
+
+        uint64_t minActive = UINT64_MAX;
+        {
+            std::unique_lock<std::mutex> lk(slotsMutex);
+            for (Slot* s : slots) {
+                uint64_t e = s->epoch.load();
+                if (e != 0 && e < minActive) minActive = e;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch < minActive) destroy(retired[i]);
+            else retired[kept++] = std::move(retired[i]);
+        }
+        retired.resize(kept);
+    }
+
+    // Wait until every read that was in progress when this was called has ended. Unlike
+    // reclaim() this blocks, so it must never be called from within a read of this RcuPtr
+    void synchronize()
+    {
+        uint64_t e = epoch.load();
+        for (;;) {
+            bool waiting = false;
+            {
+                std::unique_lock<std::mutex> lk(slotsMutex);
+                for (Slot* s : slots) {
+                    uint64_t se = s->epoch.load();
+                    if (se != 0 && se < e) {
+                        waiting = true;
+                        break;
+                    }
+                }
+            }
+            if (!waiting) return;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    size_t numRetired() const
+    {
+        return retired.size();
+    }
+
+  private:
+    RcuPtr(const RcuPtr& other) = delete;
+    RcuPtr& operator=(const RcuPtr& other) = delete;
+};
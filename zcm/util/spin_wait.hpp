@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// How the lock-free queues (SpscQueue, PriorityLanes) wait for the other side. A waiting
+// thread first spins and only then parks on a condition variable. A wakeup only costs a
+// lock + notify when there is actually a parked thread.
+//
+// Every waiting thread brings its own spin budget, so one SpinWait can serve both the
+// producer and the consumer of a queue.
+class SpinWait
+{
+  public:
+    enum Strategy {
+        WAIT_ADAPTIVE = 0, // Spin for an adaptive number of iterations, then park (default)
+        WAIT_SPIN,         // Spin for up to a fixed amount of time, then park
+        WAIT_POLL,         // Spin until the condition holds, never park
+    };
+
+    static constexpr size_t MIN_SPIN = 16;
+    static constexpr size_t MAX_SPIN = 1 << 14;
+
+    static inline void cpuRelax()
+    {
+    #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+    #elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield" ::: "memory");
+    #endif
+    }
+
+    // Spin for up to 'spin' iterations waiting for pred() and then park. The spin budget
+    // grows when spinning pays off and shrinks when it doesn't so that an idle thread
+    // quickly settles into parking instead of burning a core.
+    template<class Pred>
+    void waitFor(Pred pred, size_t& spin)
+    {
+        if (pred()) return;
+        for (size_t i = 0; i < spin; ++i) {
+            cpuRelax();
+            if (pred()) {
+                if (spin < MAX_SPIN) spin <<= 1;
+                return;
+            }
+        }
+        if (spin > MIN_SPIN) spin >>= 1;
+
+        park(pred);
+    }
+
+    // Wait for pred() using strategy. spinTime only applies to WAIT_SPIN
+    template<class Pred>
+    void waitFor(Pred pred, Strategy strategy, size_t& spin,
+                 std::chrono::nanoseconds spinTime)
+    {
+        switch (strategy) {
+            case WAIT_ADAPTIVE:
+                waitFor(pred, spin);
+                return;
+            case WAIT_SPIN: {
+                // Only look at the clock every so often, it is much slower than pred()
+                auto deadline = std::chrono::steady_clock::now() + spinTime;
+                while (!pred()) {
+                    for (size_t i = 0; i < MIN_SPIN; ++i) {
+                        cpuRelax();
+                        if (pred()) return;
+                    }
+                    if (std::chrono::steady_clock::now() >= deadline) {
+                        park(pred);
+                        return;
+                    }
+                }
+                return;
+            }
+            case WAIT_POLL:
+                while (!pred()) cpuRelax();
+                return;
+        }
+    }
+
+    template<class Pred>
+    void park(Pred pred)
+    {
+        std::unique_lock<std::mutex> lk(parkMut);
+        sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        parkCond.wait(lk, pred);
+        sleepers.fetch_sub(1);
+    }
+
+    // Park until pred() or for up to timeout. Returns pred()
+    template<class Pred>
+    bool parkFor(Pred pred, std::chrono::nanoseconds timeout)
+    {
+        std::unique_lock<std::mutex> lk(parkMut);
+        sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ret = parkCond.wait_for(lk, timeout, pred);
+        sleepers.fetch_sub(1);
+        return ret;
+    }
+
+    // Wake every parked thread. Must be called *after* the state change that they are
+    // waiting on has been published
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) == 0) return;
+        std::unique_lock<std::mutex> lk(parkMut);
+        parkCond.notify_all();
+    }
+
+  private:
+    std::atomic<size_t> sleepers {0};
+    std::mutex parkMut;
+    std::condition_variable parkCond;
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cassert>
+
+#include "spin_wait.hpp"
+
+// A lock-free single-producer / single-consumer C++ queue designed for efficiency.
+// No unneeded copies or initializations.
+//
+// This is a drop-in replacement for ThreadsafeQueue on paths where the caller can
+// guarantee that at most one thread pushes and at most one thread pops at any given
+// time (the producer and consumer sides may each be serialized by an external mutex).
+// The hot path never takes a lock: producers and consumers only touch the 'front' and
+// 'back' indices. A blocked thread waits as described in SpinWait.
+//
+// Note: setCapacity() requires that *both* sides are quiesced by the caller
+template<class Element>
+class SpscQueue
+{
+  public:
+    // How the consumer waits for a message in top()
+    typedef SpinWait::Strategy WaitStrategy;
+    static constexpr WaitStrategy WAIT_ADAPTIVE = SpinWait::WAIT_ADAPTIVE;
+    static constexpr WaitStrategy WAIT_SPIN = SpinWait::WAIT_SPIN;
+    static constexpr WaitStrategy WAIT_POLL = SpinWait::WAIT_POLL;
+
+  private:
+    // Keep the producer- and consumer-owned fields on separate cache lines
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    Element* queue;
+    size_t   capacity;
+    std::atomic<bool> disabled {false};
+
+    uint8_t pad0[CACHE_LINE_SIZE];
+
+    // Owned by the consumer
+    std::atomic<size_t> front {0};
+    size_t consumerSpin = SpinWait::MIN_SPIN;
+    WaitStrategy consumerWait = WAIT_ADAPTIVE;
+    std::chrono::nanoseconds consumerSpinTime {0};
+
+    uint8_t pad1[CACHE_LINE_SIZE];
+
+    // Owned by the producer
+    std::atomic<size_t> back {0};
+    size_t producerSpin = SpinWait::MIN_SPIN;
+
+    uint8_t pad2[CACHE_LINE_SIZE];
+
+    SpinWait waiter;
+
+    size_t incIdx(size_t i) const
+    {
+        // Note: one might be tempted to write '(i + 1) % capacity' here
+        // But, the modulus operation is slower than possibly missing
+        // a branch every once in a while. The branch is almost always
+        // Not Taken
+        size_t nextIdx = i + 1;
+        if (nextIdx == capacity) return 0;
+        return nextIdx;
+    }
+
+    bool _hasFreeSpace() const
+    {
+        return front.load(std::memory_order_acquire) !=
+               incIdx(back.load(std::memory_order_relaxed));
+    }
+
+    bool _hasMessage() const
+    {
+        return front.load(std::memory_order_relaxed) !=
+               back.load(std::memory_order_acquire);
+    }
+
+  public:
+    SpscQueue(size_t capacity) : capacity(capacity)
+    {
+        // We are avoiding initializing the structs here
+        queue = (Element*) new uint8_t[capacity * sizeof(Element)];
+        ZCM_ASSERT(queue);
+    }
+
+    ~SpscQueue()
+    {
+        // We need to deconstruct any elements still in the queue
+        while (_hasMessage()) pop();
+        delete[] ((uint8_t*) queue);
+    }
+
+    size_t getCapacity()
+    {
+        return capacity;
+    }
+
+    // Requires that both the producer and the consumer side are quiesced
+    void setCapacity(size_t capacity)
+    {
+        uint8_t* newQueue = new uint8_t[capacity * sizeof(Element)];
+        ZCM_ASSERT(newQueue);
+
+        size_t f = front.load(std::memory_order_acquire);
+        size_t b = back.load(std::memory_order_acquire);
+
+        size_t newBack = 0;
+        while (f != b && newBack + 1 < capacity) {
+            uint8_t* msg = (uint8_t*) &queue[f];
+            std::uninitialized_copy_n(msg, sizeof(Element), newQueue + newBack * sizeof(Element));
+            f = incIdx(f);
+            ++newBack;
+        }
+        // Destruct anything that no longer fits
+        while (f != b) {
+            queue[f].~Element();
+            f = incIdx(f);
+        }
+
+        delete[] ((uint8_t*) queue);
+        queue = (Element*) newQueue;
+        this->capacity = capacity;
+        front.store(0, std::memory_order_release);
+        back.store(newBack, std::memory_order_release);
+        waiter.wake();
+    }
+
+    // Consumer only (or while the consumer is quiesced). spinTime only applies to WAIT_SPIN
+    void setConsumerWait(WaitStrategy strategy,
+                         std::chrono::nanoseconds spinTime = std::chrono::nanoseconds(0))
+    {
+        consumerWait = strategy;
+        consumerSpinTime = spinTime;
+    }
+
+    bool hasFreeSpace()
+    {
+        return _hasFreeSpace();
+    }
+
+    bool hasMessage()
+    {
+        return _hasMessage();
+    }
+
+    size_t numMessages()
+    {
+        size_t f = front.load(std::memory_order_acquire);
+        size_t b = back.load(std::memory_order_acquire);
+        if (b >= f) {
+            return b - f;
+        } else {
+            return capacity - (f - b);
+        }
+    }
+
+    // Wait for hasFreeSpace() and then push the new element
+    // Returns true if the value was pushed, otherwise it
+    // was forcibly awoken by disable()
+    template<class... Args>
+    bool push(Args&&... args)
+    {
+        waiter.waitFor([&](){
+            return disabled.load(std::memory_order_acquire) || _hasFreeSpace();
+        }, producerSpin);
+        return pushIfRoom(std::forward<Args>(args)...);
+    }
+
+    // Wait for hasFreeSpace() without pushing anything, for up to timeout. Unlike the
+    // other producer methods, any thread may wait here while another one is producing.
+    // Returns whether there was room
+    bool waitForRoom(std::chrono::nanoseconds timeout)
+    {
+        if (_hasFreeSpace()) return true;
+        return waiter.parkFor([&](){ return _hasFreeSpace(); }, timeout);
+    }
+
+    // Check for hasFreeSpace() and if so, push the new element
+    // Returns true if the value was pushed, returns false if no room
+    template<class... Args>
+    bool pushIfRoom(Args&&... args)
+    {
+        if (!_hasFreeSpace()) return false;
+
+        size_t b = back.load(std::memory_order_relaxed);
+
+        // Initialize the Element by forwarding the parameter pack
+        // directly to the constructor called via Placement New
+        new (&queue[b]) Element(std::forward<Args>(args)...);
+
+        back.store(incIdx(b), std::memory_order_release);
+        waiter.wake();
+        return true;
+    }
+
+    // Wait for hasMessage() and then return the top element
+    // Always returns a valid Element* except when is was
+    // forcibly awoken by disable(). In such a case
+    // nullptr is returned to the user
+    Element* top()
+    {
+        waiter.waitFor([&](){
+            return disabled.load(std::memory_order_acquire) || _hasMessage();
+        }, consumerWait, consumerSpin, consumerSpinTime);
+        if (disabled.load(std::memory_order_acquire)) return nullptr;
+
+        return &queue[front.load(std::memory_order_relaxed)];
+    }
+
+    // Consumer only. Requires that numMessages() > i. Returns the i-th element from
+    // the top without waiting, so that several elements can be consumed at once
+    Element* at(size_t i)
+    {
+        size_t idx = front.load(std::memory_order_relaxed) + i;
+        if (idx >= capacity) idx -= capacity;
+        return &queue[idx];
+    }
+
+    // Requires that hasMessage() == true
+    void pop()
+    {
+        assert(_hasMessage());
+        size_t f = front.load(std::memory_order_relaxed);
+        // Manually call the destructor
+        queue[f].~Element();
+        front.store(incIdx(f), std::memory_order_release);
+        waiter.wake();
+    }
+
+    // Forcefully wakes up top() and push(). top() *will not* return a message from
+    // the queue, even if one exists. push() *will* push the message if there is room.
+    void disable()
+    {
+        disabled.store(true, std::memory_order_release);
+        waiter.wake();
+    }
+
+    void enable()
+    {
+        disabled.store(false, std::memory_order_release);
+    }
+
+    bool isEnabled()
+    {
+        return !disabled.load(std::memory_order_acquire);
+    }
+
+  private:
+    SpscQueue(const SpscQueue& other) = delete;
+    SpscQueue(SpscQueue&& other) = delete;
+    SpscQueue& operator=(const SpscQueue& other) = delete;
+    SpscQueue& operator=(SpscQueue&& other) = delete;
+};
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A pool of worker threads that runs jobs concurrently across strands, but one at a time
+// and in submission order within a strand.
+//
+// Every worker owns a list of ready strands. A strand that gets its first pending job is
+// queued on its home worker (picked by hashing its name) and an idle worker steals ready
+// strands from the other workers' lists. After running one job, a strand goes to the back
+// of the list of the worker that ran it, so a busy strand tends to stay on one thread and
+// cannot starve the others.
+//
+// At most maxPending jobs can be queued or running at once, push() fails beyond that.
+// Job slots are recycled, so once every strand has been seen, pushing and running jobs
+// does not allocate.
+//
+// While held (see setHeld()) workers don't start new jobs, but runOne() and drain() can
+// still be used to run them from the calling thread.
+//
+// Moving a channel to another strand (see setGroup()) only takes effect once the jobs
+// already queued for it have run, so its jobs stay in submission order.
+template<class Job>
+class StrandPool
+{
+  public:
+    // Called with the job and the index of the worker running it. Jobs run from
+    // runOne() or drain() get numThreads() as their index.
+    using Handler = std::function<void(Job& job, size_t worker)>;
+    // Called from every worker thread before it starts running jobs
+    using ThreadInit = std::function<void(size_t worker)>;
+
+  private:
+    static constexpr size_t NONE = (size_t) -1;
+
+    struct Strand
+    {
+        size_t home;
+        size_t head = NONE; // Pending jobs, linked through Slot::next
+        size_t tail = NONE;
+        bool scheduled = false; // Either in a ready list or currently running
+        Strand* nextReady = nullptr;
+    };
+
+    struct Slot
+    {
+        Job job;
+        size_t next;
+    };
+
+    struct ReadyList
+    {
+        Strand* head = nullptr;
+        Strand* tail = nullptr;
+    };
+
+    Handler handler;
+
+    std::mutex mut;
+    std::condition_variable workCond; // Signaled when there is a ready strand
+    std::condition_variable doneCond; // Signaled when a job finished or the pool was released
+
+    std::vector<Slot> slots;
+    size_t freeSlot = NONE;
+    size_t maxPending;
+    size_t inFlight = 0; // Jobs queued or running
+    size_t running = 0;
+
+    std::vector<std::unique_ptr<Strand>> strandStore;
+    std::unordered_map<std::string, Strand*> strands;
+    // Channels moved by setGroup() while their old strand was still busy
+    std::unordered_map<std::string, Strand*> regrouped;
+    std::string key; // Reused so that a lookup doesn't allocate
+
+    std::vector<ReadyList> ready;
+    size_t numReady = 0;
+
+    bool held = false;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+
+    Strand* getStrand(const char* name)
+    {
+        key.assign(name);
+        auto it = strands.find(key);
+        if (it != strands.end()) return it->second;
+
+        Strand* s = new Strand();
+        s->home = std::hash<std::string>()(key) % ready.size();
+        strandStore.emplace_back(s);
+        strands.emplace(key, s);
+        return s;
+    }
+
+    // The strand jobs for name go to, which applies a pending setGroup() once the old
+    // strand has run everything that was queued before it
+    Strand* strandFor(const char* name)
+    {
+        Strand* s = getStrand(name);
+        if (regrouped.empty() || s->scheduled) return s;
+
+        auto it = regrouped.find(key);
+        if (it == regrouped.end()) return s;
+        s = it->second;
+        strands[key] = s;
+        regrouped.erase(it);
+        return s;
+    }
+
+    void pushReady(Strand* s, size_t worker)
+    {
+        ReadyList& l = ready[worker];
+        s->nextReady = nullptr;
+        if (l.tail) l.tail->nextReady = s;
+        else        l.head = s;
+        l.tail = s;
+        ++numReady;
+    }
+
+    // Prefers the list of 'worker', steals from the others otherwise
+    Strand* popReady(size_t worker)
+    {
+        for (size_t i = 0; i < ready.size(); ++i) {
+            ReadyList& l = ready[(worker + i) % ready.size()];
+            if (!l.head) continue;
+            Strand* s = l.head;
+            l.head = s->nextReady;
+            if (!l.head) l.tail = nullptr;
+            --numReady;
+            return s;
+        }
+        return nullptr;
+    }
+
+    // Takes s out of the ready lists. Returns false if it was not in any
+    bool unlinkReady(Strand* s)
+    {
+        for (ReadyList& l : ready) {
+            Strand* prev = nullptr;
+            for (Strand* it = l.head; it; prev = it, it = it->nextReady) {
+                if (it != s) continue;
+                if (prev) prev->nextReady = s->nextReady;
+                else      l.head = s->nextReady;
+                if (l.tail == s) l.tail = prev;
+                --numReady;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Requires numReady > 0. Runs the next job of a ready strand with mut unlocked
+    void runLocked(std::unique_lock<std::mutex>& lk, size_t worker)
+    {
+        runStrand(lk, popReady(worker % ready.size()), worker);
+    }
+
+    // Runs the next job of s, which was just taken out of the ready lists
+    void runStrand(std::unique_lock<std::mutex>& lk, Strand* s, size_t worker)
+    {
+        size_t idx = s->head;
+        Job job = std::move(slots[idx].job);
+        s->head = slots[idx].next;
+        if (s->head == NONE) s->tail = NONE;
+        slots[idx].next = freeSlot;
+        freeSlot = idx;
+
+        ++running;
+        lk.unlock();
+        handler(job, worker);
+        lk.lock();
+        --running;
+        --inFlight;
+
+        if (s->head != NONE) {
+            pushReady(s, worker < workers.size() ? worker : s->home);
+            if (!held) workCond.notify_one();
+        } else {
+            s->scheduled = false;
+        }
+        doneCond.notify_all();
+    }
+
+    void workerFunc(size_t worker, ThreadInit init)
+    {
+        if (init) init(worker);
+
+        std::unique_lock<std::mutex> lk(mut);
+        while (true) {
+            workCond.wait(lk, [&](){ return stopping || (!held && numReady > 0); });
+            if (stopping) break;
+            runLocked(lk, worker);
+        }
+    }
+
+    bool isWorkerThread() const
+    {
+        for (auto& t : workers)
+            if (t.get_id() == std::this_thread::get_id()) return true;
+        return false;
+    }
+
+  public:
+    StrandPool(size_t numThreads, size_t maxPending, Handler handler,
+               ThreadInit init = nullptr) :
+        handler(std::move(handler)), maxPending(maxPending),
+        ready(numThreads > 0 ? numThreads : 1)
+    {
+        for (size_t i = 0; i < numThreads; ++i)
+            workers.emplace_back(&StrandPool::workerFunc, this, i, init);
+    }
+
+    // Pending jobs are dropped, use discard() to clean them up first
+    ~StrandPool()
+    {
+        {
+            std::unique_lock<std::mutex> lk(mut);
+            stopping = true;
+        }
+        workCond.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    size_t numThreads() const
+    {
+        return workers.size();
+    }
+
+    // Jobs for channel will be run in order with those of group from now on, after the
+    // ones already queued for channel
+    void setGroup(const std::string& channel, const std::string& group)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        Strand* s = getStrand(group.c_str());
+        auto it = strands.find(channel);
+        if (it != strands.end() && it->second != s && it->second->scheduled) {
+            regrouped[channel] = s;
+        } else {
+            regrouped.erase(channel);
+            strands[channel] = s;
+        }
+    }
+
+    void setMaxPending(size_t maxPending)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        this->maxPending = maxPending;
+        doneCond.notify_all();
+    }
+
+    // Returns false if the pool is full
+    bool push(const char* strand, const Job& job)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        if (inFlight >= maxPending) return false;
+
+        size_t idx = freeSlot;
+        if (idx == NONE) {
+            idx = slots.size();
+            slots.push_back(Slot{job, NONE});
+        } else {
+            freeSlot = slots[idx].next;
+            slots[idx].job = job;
+            slots[idx].next = NONE;
+        }
+
+        Strand* s = strandFor(strand);
+        if (s->tail != NONE) slots[s->tail].next = idx;
+        else                 s->head = idx;
+        s->tail = idx;
+        ++inFlight;
+
+        if (!s->scheduled) {
+            s->scheduled = true;
+            pushReady(s, s->home);
+            if (!held) workCond.notify_one();
+        }
+        return true;
+    }
+
+    // Run the next job of the strand that push(strand, ...) would use in the calling
+    // thread. Returns false if that strand has no job waiting for a worker (or if the
+    // pool is held and ignoreHeld is false). Jobs of other strands are left to the
+    // workers, so a slow one can't hold up the caller
+    bool runOne(const char* strand, bool ignoreHeld)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        if (numReady == 0 || (held && !ignoreHeld)) return false;
+        Strand* s = strandFor(strand);
+        if (!s->scheduled || !unlinkReady(s)) return false;
+        runStrand(lk, s, workers.size());
+        return true;
+    }
+
+    // Wait until push() can succeed. Returns false early if the pool is (or becomes)
+    // held, unless ignoreHeld is true. Workers don't start jobs while the pool is held,
+    // so with ignoreHeld the caller then makes room by running ready jobs itself
+    bool waitForRoom(bool ignoreHeld)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        while (inFlight >= maxPending) {
+            if (held) {
+                if (!ignoreHeld) return false;
+                if (numReady > 0) {
+                    runLocked(lk, workers.size());
+                    continue;
+                }
+            }
+            doneCond.wait(lk);
+        }
+        return true;
+    }
+
+    // Run jobs in the calling thread (with the help of the workers unless the pool is
+    // held) until every pushed job has completed
+    void drain()
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        while (inFlight > 0) {
+            if (numReady > 0) runLocked(lk, workers.size());
+            else doneCond.wait(lk);
+        }
+    }
+
+    // Stop workers from starting new jobs, or let them continue again
+    void setHeld(bool held)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        this->held = held;
+        if (!held) workCond.notify_all();
+        doneCond.notify_all();
+    }
+
+    // Wait for all jobs that are currently running to complete (not counting the calling
+    // thread's own job if it is a worker)
+    void waitRunning()
+    {
+        size_t self = isWorkerThread() ? 1 : 0;
+        std::unique_lock<std::mutex> lk(mut);
+        doneCond.wait(lk, [&](){ return running <= self; });
+    }
+
+    // Calls f on every job that has not started running yet and removes it from the pool
+    template<class F>
+    void discard(F f)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        for (auto& l : ready) {
+            for (Strand* s = l.head; s; s = s->nextReady) s->scheduled = false;
+            l.head = l.tail = nullptr;
+        }
+        numReady = 0;
+        for (auto& s : strandStore) {
+            while (s->head != NONE) {
+                size_t idx = s->head;
+                f(slots[idx].job);
+                s->head = slots[idx].next;
+                slots[idx].next = freeSlot;
+                freeSlot = idx;
+                --inFlight;
+            }
+            s->tail = NONE;
+        }
+        doneCond.notify_all();
+    }
+
+  private:
+    StrandPool(const StrandPool& other) = delete;
+    StrandPool(StrandPool&& other) = delete;
+    StrandPool& operator=(const StrandPool& other) = delete;
+    StrandPool& operator=(StrandPool&& other) = delete;
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "channel_intern.hpp"
+
+using zcm::ChannelIntern;
+
+class ChannelInternTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testIdsAreStable()
+    {
+        uint32_t before = ChannelIntern::size();
+        TS_ASSERT_EQUALS(ChannelIntern::find("CHANNEL_INTERN_A"), ChannelIntern::NONE);
+
+        uint32_t a = ChannelIntern::id("CHANNEL_INTERN_A");
+        uint32_t b = ChannelIntern::id("CHANNEL_INTERN_B");
+        TS_ASSERT_DIFFERS(a, ChannelIntern::NONE);
+        TS_ASSERT_DIFFERS(a, b);
+        // Dense
+        TS_ASSERT_EQUALS(a, before + 1);
+        TS_ASSERT_EQUALS(b, before + 2);
+        TS_ASSERT_EQUALS(ChannelIntern::size(), before + 2);
+
+        std::string copy = "CHANNEL_INTERN_A";
+        TS_ASSERT_EQUALS(ChannelIntern::id(copy.c_str()), a);
+        TS_ASSERT_EQUALS(ChannelIntern::find(copy.c_str()), a);
+
+        const char* name = ChannelIntern::name(a);
+        TS_ASSERT(name);
+        TS_ASSERT_EQUALS(strcmp(name, "CHANNEL_INTERN_A"), 0);
+        TS_ASSERT_EQUALS(ChannelIntern::name(a), name);
+        TS_ASSERT(!ChannelIntern::name(ChannelIntern::NONE));
+        TS_ASSERT(!ChannelIntern::name(ChannelIntern::size() + 1));
+    }
+
+    void testGrowth()
+    {
+        // Well past the initial capacity of the table
+        const int N = 5000;
+        std::vector<uint32_t> ids;
+        std::vector<const char*> names;
+        for (int i = 0; i < N; ++i) {
+            std::string ch = "CHANNEL_INTERN_GROW_" + std::to_string(i);
+            ids.push_back(ChannelIntern::id(ch.c_str()));
+            names.push_back(ChannelIntern::name(ids.back()));
+        }
+        for (int i = 0; i < N; ++i) {
+            std::string ch = "CHANNEL_INTERN_GROW_" + std::to_string(i);
+            TS_ASSERT_EQUALS(ChannelIntern::find(ch.c_str()), ids[i]);
+            // Names never move
+            TS_ASSERT_EQUALS(ChannelIntern::name(ids[i]), names[i]);
+            TS_ASSERT_EQUALS(ch, names[i]);
+        }
+    }
+
+    void testConcurrent()
+    {
+        // Every thread interns the same channels in a different order and must agree
+        const int NUM_THREADS = 4;
+        const int N = 2003; // Prime, so that every order below is a permutation
+        std::vector<std::vector<uint32_t>> ids(NUM_THREADS, std::vector<uint32_t>(N));
+        std::vector<std::thread> threads;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            threads.emplace_back([&, t](){
+                for (int n = 0; n < N; ++n) {
+                    int i = (n * (2 * t + 1)) % N;
+                    std::string ch = "CHANNEL_INTERN_CONC_" + std::to_string(i);
+                    ids[t][i] = ChannelIntern::id(ch.c_str());
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+
+        for (int i = 0; i < N; ++i) {
+            std::string ch = "CHANNEL_INTERN_CONC_" + std::to_string(i);
+            TS_ASSERT_DIFFERS(ids[0][i], ChannelIntern::NONE);
+            for (int t = 1; t < NUM_THREADS; ++t) TS_ASSERT_EQUALS(ids[t][i], ids[0][i]);
+            TS_ASSERT_EQUALS(ch, ChannelIntern::name(ids[0][i]));
+        }
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "channel_matcher.hpp"
+
+class ChannelMatcherTest : public CxxTest::TestSuite
+{
+    struct Val { std::string pattern; };
+
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testMatchesLikeStdRegex()
+    {
+        std::vector<Val> vals = {
+            {".*"}, {"FOO.*"}, {"FOO_BAR.*"}, {"F.*"}, {"BAR.*"},
+            {"FOO|BAR"}, {"(FOO)+"}, {"[A-Z]+_[0-9]+"}, {"FOO\\..*"}, {"F.O.*"},
+        };
+        std::vector<std::string> channels = {
+            "", "F", "FOO", "FOOFOO", "FOO_BAR", "FOO_BAR_BAZ", "BAR", "BARF",
+            "FOO.BAR", "FXO", "ABC_123", "foo", "FOO\nBAR", "\nFOO",
+        };
+
+        ChannelMatcher<Val> m;
+        for (auto& v : vals) m.add(v.pattern, &v);
+        TS_ASSERT_EQUALS(m.size(), vals.size());
+
+        ChannelMatcher<Val>::Cache cache;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (auto& c : channels) {
+                auto matches = cache.lookup(m, c.c_str());
+                for (auto& v : vals) {
+                    bool expected = std::regex_match(c, std::regex(v.pattern));
+                    bool got = std::find(matches.begin(), matches.end(), &v) != matches.end();
+                    TSM_ASSERT(("channel '" + c + "' pattern '" + v.pattern + "'").c_str(),
+                               expected == got);
+                }
+            }
+        }
+    }
+
+    void testRemoveInvalidatesCache()
+    {
+        Val a {"FOO.*"}, b {"FO+"};
+        ChannelMatcher<Val> m;
+        ChannelMatcher<Val>::Cache cache;
+        m.add(a.pattern, &a);
+        m.add(b.pattern, &b);
+
+        TS_ASSERT_EQUALS(cache.lookup(m, "FOO").size(), 2);
+
+        TS_ASSERT(m.remove(a.pattern));
+        TS_ASSERT(!m.remove(a.pattern));
+        TS_ASSERT_EQUALS(cache.lookup(m, "FOO").size(), 1);
+        TS_ASSERT_EQUALS(cache.lookup(m, "FOO")[0], &b);
+
+        TS_ASSERT(m.remove(b.pattern));
+        TS_ASSERT(cache.lookup(m, "FOO").empty());
+    }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <thread>
+
+#include "cxxtest/TestSuite.h"
+
+#include "channel_stats.hpp"
+
+class ChannelStatsTest : public CxxTest::TestSuite
+{
+    typedef ChannelStats<4> Stats;
+
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testWritersAreSummed()
+    {
+        Stats stats;
+        {
+            Stats::Writer w1(stats);
+            Stats::Writer w2(stats);
+            Stats::Counters::inc(w1.get("A").published);
+            Stats::Counters::inc(w1.get("A").published);
+            Stats::Counters::inc(w1.get("B").dropped);
+            Stats::Counters::inc(w1.get("B").blocked);
+            std::thread t([&](){ Stats::Counters::inc(w2.get("A").published); });
+            t.join();
+        }
+        // The counts outlive the writers
+        auto totals = stats.snapshot();
+        TS_ASSERT_EQUALS(totals.size(), 2);
+        TS_ASSERT_EQUALS(totals["A"].published, 3);
+        TS_ASSERT_EQUALS(totals["A"].dropped, 0);
+        TS_ASSERT_EQUALS(totals["B"].dropped, 1);
+        TS_ASSERT_EQUALS(totals["B"].blocked, 1);
+    }
+
+    void testHandlerHistogram()
+    {
+        Stats stats;
+        Stats::Writer w(stats);
+        Stats::Counters& c = w.get("A");
+        c.addHandlerTime(500);        // < 1us
+        c.addHandlerTime(1000);       // [1, 2) us
+        c.addHandlerTime(3000);       // [2, 4) us
+        c.addHandlerTime(1000000000); // Too long, goes into the last bucket
+        auto totals = stats.snapshot();
+        for (size_t i = 0; i < 4; ++i)
+            TS_ASSERT_EQUALS(totals["A"].handlerHist[i], 1);
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <poll.h>
+#include <thread>
+
+#include "cxxtest/TestSuite.h"
+
+#include "event_fd.hpp"
+
+class EventFdTest : public CxxTest::TestSuite
+{
+    static bool isReadable(const EventFd& e)
+    {
+        struct pollfd pfd;
+        pfd.fd = e.fd();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+    }
+
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testRaiseLower()
+    {
+        EventFd e;
+        TS_ASSERT(!e.isOpen());
+        TS_ASSERT(e.open());
+        TS_ASSERT(e.isOpen());
+        TS_ASSERT(e.fd() >= 0);
+        TS_ASSERT(!isReadable(e));
+
+        e.raise();
+        e.raise();
+        TS_ASSERT(isReadable(e));
+        e.lower([](){ return false; });
+        TS_ASSERT(!isReadable(e));
+
+        // A condition that is still true keeps the fd readable
+        e.raise();
+        e.lower([](){ return true; });
+        TS_ASSERT(isReadable(e));
+        e.lower([](){ return false; });
+        TS_ASSERT(!isReadable(e));
+    }
+
+    void testNoLostWakeup()
+    {
+        const int N = 100000;
+        EventFd e;
+        TS_ASSERT(e.open());
+
+        // The producer makes the count non-zero, the consumer brings it back to zero
+        std::atomic<int> count {0};
+        std::thread producer([&](){
+            for (int i = 0; i < N; ++i) {
+                count++;
+                e.raise();
+            }
+        });
+        int consumed = 0;
+        while (consumed < N) {
+            struct pollfd pfd;
+            pfd.fd = e.fd();
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 1000) != 1) break;
+            consumed += count.exchange(0);
+            e.lower([&](){ return count > 0; });
+        }
+        producer.join();
+        TS_ASSERT_EQUALS(consumed, N);
+    }
+};
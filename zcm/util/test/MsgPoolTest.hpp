@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstring>
+#include <thread>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+#include "msg_pool.hpp"
+#include "spsc_queue.hpp"
+
+class MsgPoolTest : public CxxTest::TestSuite
+{
+    // Mirrors the Msg in blocking.cpp
+    struct Buf
+    {
+        MsgPool& pool;
+        uint8_t* data;
+        size_t len;
+        Buf(MsgPool& pool, size_t len) : pool(pool), data(pool.alloc(len)), len(len)
+        {
+            memset(data, 0xab, len);
+        }
+        ~Buf() { pool.free(data, len); }
+    };
+
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testRecycle()
+    {
+        MsgPool pool(4);
+
+        uint8_t* a = pool.alloc(100);
+        TS_ASSERT_EQUALS(pool.getStats().heapAllocs, 1);
+        pool.free(a, 100);
+
+        // Anything in the same size class reuses the buffer
+        uint8_t* b = pool.alloc(128);
+        TS_ASSERT(a == b);
+        TS_ASSERT_EQUALS(pool.getStats().heapAllocs, 1);
+        TS_ASSERT_EQUALS(pool.getStats().recycled, 1);
+        pool.free(b, 128);
+
+        // A different size class does not
+        uint8_t* c = pool.alloc(129);
+        TS_ASSERT_EQUALS(pool.getStats().heapAllocs, 2);
+        pool.free(c, 129);
+    }
+
+    void testBoundedByCapacity()
+    {
+        MsgPool pool(4);
+        uint8_t* bufs[5];
+        for (auto& b : bufs) b = pool.alloc(10);
+        TS_ASSERT_EQUALS(pool.getStats().heapAllocs, 5);
+
+        // Only capacity - 1 buffers are kept around
+        for (auto& b : bufs) pool.free(b, 10);
+        TS_ASSERT_EQUALS(pool.getStats().heapFrees, 2);
+
+        pool.setCapacity(8);
+        TS_ASSERT_EQUALS(pool.getStats().heapFrees, 5);
+    }
+
+    void testLargeBuffersAreBounded()
+    {
+        MsgPool pool(32);
+
+        // Past the largest size class nothing is pooled
+        uint8_t* big = pool.alloc(5 << 20);
+        pool.free(big, 5 << 20);
+        TS_ASSERT_EQUALS(pool.getStats().heapFrees, 1);
+
+        // And the free lists only ever hold 32MB, here 8 buffers of 4MB
+        uint8_t* bufs[10];
+        for (auto& b : bufs) b = pool.alloc(4 << 20);
+        for (auto& b : bufs) pool.free(b, 4 << 20);
+        TS_ASSERT_EQUALS(pool.getStats().heapFrees, 3);
+
+        for (auto& b : bufs) b = pool.alloc(4 << 20);
+        TS_ASSERT_EQUALS(pool.getStats().recycled, 8);
+        for (auto& b : bufs) pool.free(b, 4 << 20);
+    }
+
+    void testSteadyStateIsAllocationFree()
+    {
+        const int N = 100000;
+        const size_t CAPACITY = 16;
+        const size_t sizes[] = { 0, 1, 17, 64, 65, 1000, 4096, 70000 };
+        const size_t NSIZES = sizeof(sizes) / sizeof(sizes[0]);
+
+        MsgPool pool(CAPACITY);
+        SpscQueue<Buf> q(CAPACITY);
+
+        std::thread consumer([&](){
+            for (int i = 0; i < N; ++i) {
+                Buf* b = q.top();
+                if (!b) return;
+                q.pop();
+            }
+        });
+        for (int i = 0; i < N; ++i) q.push(pool, sizes[i % NSIZES]);
+        consumer.join();
+
+        // Every size class can at most have as many buffers as fit in the queue
+        MsgPool::Stats s = pool.getStats();
+        TS_ASSERT(s.heapAllocs <= NSIZES * (CAPACITY - 1));
+        TS_ASSERT_EQUALS(s.heapAllocs + s.recycled, (uint64_t) N);
+        TS_ASSERT_EQUALS(s.heapFrees, 0);
+    }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+#include "priority_lanes.hpp"
+
+class PriorityLanesTest : public CxxTest::TestSuite
+{
+    typedef PriorityLanes<int> Lanes;
+
+    static std::vector<int> drain(Lanes& lanes, size_t n)
+    {
+        std::vector<int> got;
+        for (size_t i = 0; i < n && lanes.hasMessage(); ++i) {
+            got.push_back(*lanes.top());
+            lanes.pop();
+        }
+        return got;
+    }
+
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testStrict()
+    {
+        Lanes lanes(3, 8);
+        TS_ASSERT(!lanes.hasMessage());
+        for (int i = 0; i < 3; ++i) TS_ASSERT(lanes.push(2, 20 + i));
+        for (int i = 0; i < 3; ++i) TS_ASSERT(lanes.push(1, 10 + i));
+        TS_ASSERT(lanes.push(0, 0));
+        TS_ASSERT_EQUALS(lanes.numMessages(), 7);
+        TS_ASSERT_EQUALS(lanes.numMessages(2), 3);
+
+        // Highest lane first, each lane in order
+        std::vector<int> expected = {0, 10, 11, 12, 20, 21, 22};
+        TS_ASSERT_EQUALS(drain(lanes, 7), expected);
+        TS_ASSERT(!lanes.hasMessage());
+    }
+
+    void testTopLane()
+    {
+        Lanes lanes(2, 4);
+        TS_ASSERT(lanes.push(1, 1));
+        TS_ASSERT_EQUALS(*lanes.top(), 1);
+        TS_ASSERT_EQUALS(lanes.topLane(), 1);
+
+        // Until it is popped, top() may switch to a message of a higher lane
+        TS_ASSERT(lanes.push(0, 0));
+        TS_ASSERT_EQUALS(*lanes.top(), 0);
+        TS_ASSERT_EQUALS(lanes.topLane(), 0);
+        lanes.pop();
+        TS_ASSERT_EQUALS(*lanes.top(), 1);
+        lanes.pop();
+    }
+
+    void testWeighted()
+    {
+        Lanes lanes(2, 64);
+        lanes.setWeighted(true);
+        lanes.setWeight(0, 3);
+        lanes.setWeight(1, 1);
+        for (int i = 0; i < 40; ++i) {
+            TS_ASSERT(lanes.push(0, 0));
+            TS_ASSERT(lanes.push(1, 1));
+        }
+
+        // While both lanes are busy, lane 0 gets 3 of every 4 pops
+        std::vector<int> got = drain(lanes, 40);
+        int fromHigh = 0;
+        for (int v : got) fromHigh += v == 0;
+        TS_ASSERT_EQUALS(fromHigh, 30);
+
+        // And once lane 0 is empty, lane 1 gets everything
+        got = drain(lanes, 40);
+        TS_ASSERT_EQUALS(got.size(), 40);
+        TS_ASSERT_EQUALS(got.back(), 1);
+    }
+
+    void testLanesHaveTheirOwnCapacity()
+    {
+        Lanes lanes(2, 4);
+        lanes.setCapacity(0, 8);
+        TS_ASSERT_EQUALS(lanes.getCapacity(0), 8);
+        TS_ASSERT_EQUALS(lanes.getCapacity(1), 4);
+        TS_ASSERT_EQUALS(lanes.totalCapacity(), 12);
+
+        // A full lane 1 leaves lane 0 alone
+        for (int i = 0; i < 3; ++i) TS_ASSERT(lanes.push(1, i));
+        for (int i = 0; i < 7; ++i) TS_ASSERT(lanes.push(0, i));
+        TS_ASSERT_EQUALS(lanes.numMessages(), 10);
+        drain(lanes, 10);
+    }
+
+    void testDisableWakesConsumer()
+    {
+        Lanes lanes(2, 4);
+        int* ret = (int*) 0x1;
+        std::thread consumer([&](){ ret = lanes.top(); });
+        usleep(10000);
+        lanes.disable();
+        consumer.join();
+        TS_ASSERT(ret == nullptr);
+        TS_ASSERT(!lanes.isEnabled());
+        lanes.enable();
+        TS_ASSERT(lanes.isEnabled());
+    }
+
+    void testThreadedTransfer()
+    {
+        const int N = 100000;
+        Lanes lanes(3, 16);
+        std::vector<int> last(3, -1);
+        bool inOrder = true;
+
+        std::thread consumer([&](){
+            for (int i = 0; i < N; ++i) {
+                int* v = lanes.top();
+                if (!v) return;
+                size_t lane = lanes.topLane();
+                inOrder &= *v > last[lane];
+                last[lane] = *v;
+                lanes.pop();
+            }
+        });
+        for (int i = 0; i < N; ++i) TS_ASSERT(lanes.push(i % 3, i));
+        consumer.join();
+
+        // Every lane stays in order
+        TS_ASSERT(inOrder);
+        TS_ASSERT_EQUALS(last[0] + last[1] + last[2], 3 * N - 6);
+    }
+};
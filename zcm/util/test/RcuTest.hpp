@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "cxxtest/TestSuite.h"
+
+#include "rcu.hpp"
+
+class RcuTest : public CxxTest::TestSuite
+{
+    struct Obj
+    {
+        static int alive;
+        int val;
+        Obj(int v) : val(v) { ++alive; }
+        ~Obj() { --alive; }
+    };
+
+  public:
+    void setUp() override { Obj::alive = 0; }
+    void tearDown() override {}
+
+    void testReaderKeepsObjectAlive()
+    {
+        int reclaimed = 0;
+        {
+            RcuPtr<Obj> p(new Obj(1));
+            RcuPtr<Obj>::Reader r(p);
+
+            const Obj* o = r.lock();
+            TS_ASSERT_EQUALS(o->val, 1);
+
+            p.update(new Obj(2), [&](){ ++reclaimed; });
+            TS_ASSERT_EQUALS(p.numRetired(), 1);
+            TS_ASSERT_EQUALS(Obj::alive, 2);
+            TS_ASSERT_EQUALS(reclaimed, 0);
+
+            // Nested reads see the new object but keep the old one alive
+            TS_ASSERT_EQUALS(r.lock()->val, 2);
+            r.unlock();
+            p.reclaim();
+            TS_ASSERT_EQUALS(o->val, 1);
+            TS_ASSERT_EQUALS(p.numRetired(), 1);
+
+            r.unlock();
+            p.reclaim();
+            TS_ASSERT_EQUALS(p.numRetired(), 0);
+            TS_ASSERT_EQUALS(Obj::alive, 1);
+            TS_ASSERT_EQUALS(reclaimed, 1);
+
+            // Reads that start after an update do not hold up reclamation
+            {
+                RcuPtr<Obj>::ReadLock lk(r);
+                p.update(new Obj(3));
+                TS_ASSERT_EQUALS(p.numRetired(), 1);
+            }
+            {
+                RcuPtr<Obj>::ReadLock lk(r);
+                p.reclaim();
+                TS_ASSERT_EQUALS(p.numRetired(), 0);
+                TS_ASSERT_EQUALS(lk->val, 3);
+            }
+        }
+        TS_ASSERT_EQUALS(Obj::alive, 0);
+    }
+
+    void testSynchronize()
+    {
+        RcuPtr<Obj> p(new Obj(0));
+        RcuPtr<Obj>::Reader r(p), idle(p);
+
+        // Nothing to wait for without readers
+        p.synchronize();
+
+        std::atomic<bool> done {false};
+        r.lock();
+        p.update(new Obj(1));
+        std::thread t([&](){
+            p.synchronize();
+            done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        TS_ASSERT(!done);
+
+        // Reads that started after the update are not waited for
+        {
+            RcuPtr<Obj>::ReadLock lk(idle);
+            r.unlock();
+            t.join();
+            TS_ASSERT(done);
+        }
+    }
+
+    void testConcurrentReaders()
+    {
+        const int N = 20000;
+        RcuPtr<Obj> p(new Obj(0));
+        std::atomic<bool> done {false};
+        std::atomic<bool> sawGarbage {false};
+
+        auto reader = [&](){
+            RcuPtr<Obj>::Reader r(p);
+            int last = 0;
+            while (!done) {
+                RcuPtr<Obj>::ReadLock lk(r);
+                // Values only ever go up
+                if (lk->val < last) sawGarbage = true;
+                last = lk->val;
+            }
+        };
+        std::thread t1(reader), t2(reader);
+
+        for (int i = 1; i <= N; ++i) {
+            p.update(new Obj(i), nullptr);
+        }
+        done = true;
+        t1.join();
+        t2.join();
+
+        p.reclaim();
+        TS_ASSERT(!sawGarbage);
+        TS_ASSERT_EQUALS(p.numRetired(), 0);
+        TS_ASSERT_EQUALS(Obj::alive, 1);
+    }
+};
+
+int RcuTest::Obj::alive = 0;
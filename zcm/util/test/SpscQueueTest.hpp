@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "zcm/zcm.h"
+#include "spsc_queue.hpp"
+
+class SpscQueueTest : public CxxTest::TestSuite
+{
+    struct Elt
+    {
+        static std::atomic<int> alive;
+        int val;
+        Elt(int v) : val(v) { ++alive; }
+        ~Elt() { --alive; }
+    };
+
+  public:
+    void setUp() override { Elt::alive = 0; }
+    void tearDown() override {}
+
+    void testPushPop()
+    {
+        SpscQueue<Elt> q(4);
+        TS_ASSERT(!q.hasMessage());
+        TS_ASSERT(q.pushIfRoom(1));
+        TS_ASSERT(q.pushIfRoom(2));
+        TS_ASSERT(q.pushIfRoom(3));
+        // One slot is always kept empty, just like Queue
+        TS_ASSERT(!q.pushIfRoom(4));
+        TS_ASSERT_EQUALS(q.numMessages(), 3);
+        TS_ASSERT_EQUALS(Elt::alive.load(), 3);
+
+        for (int i = 1; i <= 3; ++i) {
+            Elt* e = q.top();
+            TS_ASSERT(e);
+            TS_ASSERT_EQUALS(e->val, i);
+            q.pop();
+        }
+        TS_ASSERT(!q.hasMessage());
+        TS_ASSERT_EQUALS(Elt::alive.load(), 0);
+    }
+
+    void testAtWrapsAround()
+    {
+        SpscQueue<Elt> q(4);
+        TS_ASSERT(q.pushIfRoom(0));
+        TS_ASSERT(q.pushIfRoom(1));
+        q.pop();
+        q.pop();
+        for (int i = 2; i <= 4; ++i) TS_ASSERT(q.pushIfRoom(i));
+
+        for (size_t i = 0; i < q.numMessages(); ++i)
+            TS_ASSERT_EQUALS(q.at(i)->val, (int) i + 2);
+        TS_ASSERT_EQUALS(q.top(), q.at(0));
+        while (q.hasMessage()) q.pop();
+    }
+
+    void testDisableWakesConsumer()
+    {
+        SpscQueue<Elt> q(4);
+        Elt* ret = (Elt*) 0x1;
+        std::thread consumer([&](){ ret = q.top(); });
+        q.disable();
+        consumer.join();
+        TS_ASSERT(ret == nullptr);
+        TS_ASSERT(!q.isEnabled());
+        q.enable();
+        TS_ASSERT(q.isEnabled());
+    }
+
+    void testConsumerWaitStrategies()
+    {
+        SpscQueue<Elt> q(4);
+        q.setConsumerWait(SpscQueue<Elt>::WAIT_SPIN, std::chrono::microseconds(100));
+        std::thread producer([&](){ usleep(10000); q.push(1); });
+        TS_ASSERT_EQUALS(q.top()->val, 1);
+        q.pop();
+        producer.join();
+
+        // A polling consumer still has to be woken by disable()
+        q.setConsumerWait(SpscQueue<Elt>::WAIT_POLL);
+        Elt* ret = (Elt*) 0x1;
+        std::thread consumer([&](){ ret = q.top(); });
+        usleep(10000);
+        q.disable();
+        consumer.join();
+        TS_ASSERT(ret == nullptr);
+    }
+
+    void testWaitForRoom()
+    {
+        SpscQueue<Elt> q(2);
+        TS_ASSERT(q.waitForRoom(std::chrono::milliseconds(0)));
+        TS_ASSERT(q.pushIfRoom(1));
+        TS_ASSERT(!q.waitForRoom(std::chrono::milliseconds(10)));
+
+        std::thread consumer([&](){ usleep(10000); q.pop(); });
+        TS_ASSERT(q.waitForRoom(std::chrono::seconds(10)));
+        consumer.join();
+    }
+
+    void testSetCapacity()
+    {
+        SpscQueue<Elt> q(8);
+        for (int i = 0; i < 5; ++i) TS_ASSERT(q.pushIfRoom(i));
+
+        q.setCapacity(16);
+        TS_ASSERT_EQUALS(q.getCapacity(), 16);
+        TS_ASSERT_EQUALS(q.numMessages(), 5);
+        TS_ASSERT_EQUALS(q.top()->val, 0);
+
+        // Shrinking drops whatever no longer fits
+        q.setCapacity(3);
+        TS_ASSERT_EQUALS(q.numMessages(), 2);
+        TS_ASSERT_EQUALS(Elt::alive.load(), 2);
+        TS_ASSERT_EQUALS(q.top()->val, 0);
+        q.pop();
+        TS_ASSERT_EQUALS(q.top()->val, 1);
+        q.pop();
+    }
+
+    void testThreadedTransfer()
+    {
+        const int N = 100000;
+        SpscQueue<Elt> q(16);
+        std::vector<int> got;
+        got.reserve(N);
+
+        std::thread consumer([&](){
+            for (int i = 0; i < N; ++i) {
+                Elt* e = q.top();
+                if (!e) return;
+                got.push_back(e->val);
+                q.pop();
+            }
+        });
+        for (int i = 0; i < N; ++i) TS_ASSERT(q.push(i));
+        consumer.join();
+
+        TS_ASSERT_EQUALS(got.size(), (size_t) N);
+        bool inOrder = true;
+        for (int i = 0; i < (int) got.size(); ++i) inOrder &= got[i] == i;
+        TS_ASSERT(inOrder);
+    }
+};
+
+std::atomic<int> SpscQueueTest::Elt::alive {0};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "strand_pool.hpp"
+
+class StrandPoolTest : public CxxTest::TestSuite
+{
+    struct Job
+    {
+        size_t strand;
+        int seq;
+    };
+
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testOrderWithinStrand()
+    {
+        const size_t NSTRANDS = 8;
+        const int N = 2000;
+
+        std::vector<int> next(NSTRANDS, 0);
+        std::atomic<bool> outOfOrder {false};
+        std::atomic<size_t> inStrand[NSTRANDS];
+        for (auto& i : inStrand) i = 0;
+
+        StrandPool<Job> pool(4, 64, [&](Job& job, size_t worker) {
+            if (inStrand[job.strand]++ != 0) outOfOrder = true;
+            if (next[job.strand] != job.seq) outOfOrder = true;
+            next[job.strand] = job.seq + 1;
+            inStrand[job.strand]--;
+        });
+
+        for (int seq = 0; seq < N; ++seq) {
+            for (size_t s = 0; s < NSTRANDS; ++s) {
+                std::string name = "STRAND" + std::to_string(s);
+                while (!pool.push(name.c_str(), Job{s, seq}))
+                    pool.waitForRoom(false);
+            }
+        }
+        pool.drain();
+
+        TS_ASSERT(!outOfOrder);
+        for (size_t s = 0; s < NSTRANDS; ++s) TS_ASSERT_EQUALS(next[s], N);
+    }
+
+    void testHeldAndDiscard()
+    {
+        std::atomic<int> ran {0};
+        StrandPool<Job> pool(2, 4, [&](Job& job, size_t worker) {
+            TS_ASSERT_EQUALS(worker, 2);
+            ran++;
+        });
+        pool.setHeld(true);
+
+        for (int i = 0; i < 4; ++i) TS_ASSERT(pool.push("A", Job{0, i}));
+        TS_ASSERT(!pool.push("A", Job{0, 4}));
+        TS_ASSERT(!pool.waitForRoom(false));
+
+        // Held pools only run jobs from the calling thread, and only of the given strand
+        TS_ASSERT(!pool.runOne("B", true));
+        TS_ASSERT(pool.runOne("A", true));
+        TS_ASSERT(!pool.runOne("A", false));
+        TS_ASSERT_EQUALS(ran, 1);
+
+        int discarded = 0;
+        pool.discard([&](Job& job) { discarded++; });
+        TS_ASSERT_EQUALS(discarded, 3);
+        TS_ASSERT(pool.push("A", Job{0, 5}));
+        pool.drain();
+        TS_ASSERT_EQUALS(ran, 2);
+    }
+
+    void testSetGroupKeepsOrder()
+    {
+        std::vector<int> order;
+        StrandPool<Job> pool(2, 16, [&](Job& job, size_t worker) {
+            order.push_back(job.seq);
+        });
+        pool.setHeld(true);
+
+        // A's queued jobs come first, so the job pushed after it joined group G waits
+        // behind them instead of running with G's
+        TS_ASSERT(pool.push("G", Job{0, 0}));
+        for (int i = 1; i <= 2; ++i) TS_ASSERT(pool.push("A", Job{0, i}));
+        pool.setGroup("A", "G");
+        TS_ASSERT(pool.push("A", Job{0, 3}));
+        while (pool.runOne("G", true)) {}
+        TS_ASSERT_EQUALS(order, std::vector<int>({ 0 }));
+        while (pool.runOne("A", true)) {}
+        TS_ASSERT_EQUALS(order, std::vector<int>({ 0, 1, 2, 3 }));
+
+        // Once A's old strand is done, it moves over to G
+        order.clear();
+        TS_ASSERT(pool.push("G", Job{0, 4}));
+        TS_ASSERT(pool.push("A", Job{0, 5}));
+        while (pool.runOne("G", true)) {}
+        TS_ASSERT_EQUALS(order, std::vector<int>({ 4, 5 }));
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cxxtest/TestSuite.h"
+
+#include "thread_sched.hpp"
+
+class ThreadSchedTest : public CxxTest::TestSuite
+{
+  public:
+    void setUp() override {}
+    void tearDown() override {}
+
+    void testParseCpus()
+    {
+        std::vector<int> cpus;
+        TS_ASSERT(ThreadSched::parseCpus("3", cpus));
+        TS_ASSERT_EQUALS(cpus, std::vector<int>({ 3 }));
+        TS_ASSERT(ThreadSched::parseCpus("0,2-4,7", cpus));
+        TS_ASSERT_EQUALS(cpus, std::vector<int>({ 0, 2, 3, 4, 7 }));
+
+        TS_ASSERT(!ThreadSched::parseCpus("", cpus));
+        TS_ASSERT(!ThreadSched::parseCpus("x", cpus));
+        TS_ASSERT(!ThreadSched::parseCpus("4-2", cpus));
+        TS_ASSERT(!ThreadSched::parseCpus("1;2", cpus));
+        TS_ASSERT(!ThreadSched::parseCpus("-1", cpus));
+        TS_ASSERT(!ThreadSched::parseCpus("100000", cpus));
+    }
+
+    void testParsePolicy()
+    {
+        int policy, priority;
+        TS_ASSERT(ThreadSched::parsePolicy("other", policy, priority));
+        TS_ASSERT_EQUALS(policy, SCHED_OTHER);
+        TS_ASSERT(ThreadSched::parsePolicy("fifo:50", policy, priority));
+        TS_ASSERT_EQUALS(policy, SCHED_FIFO);
+        TS_ASSERT_EQUALS(priority, 50);
+        TS_ASSERT(ThreadSched::parsePolicy("rr:1", policy, priority));
+        TS_ASSERT_EQUALS(policy, SCHED_RR);
+
+        TS_ASSERT(!ThreadSched::parsePolicy("fifo", policy, priority));
+        TS_ASSERT(!ThreadSched::parsePolicy("fifo:", policy, priority));
+        TS_ASSERT(!ThreadSched::parsePolicy("rr:5x", policy, priority));
+        TS_ASSERT(!ThreadSched::parsePolicy("fifo:1000", policy, priority));
+        TS_ASSERT(!ThreadSched::parsePolicy("batch", policy, priority));
+    }
+
+    void testApplyAffinity()
+    {
+        ThreadSched sched;
+        TS_ASSERT(ThreadSched::parseCpus("0", sched.cpus));
+        std::string report;
+        std::thread t([&](){ report = sched.apply(); });
+        t.join();
+    #ifdef __linux__
+        TS_ASSERT_EQUALS(report.find("failed"), std::string::npos);
+        TS_ASSERT_EQUALS(report.find("cpus=0 "), 0);
+    #endif
+    }
+};
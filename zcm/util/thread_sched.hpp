@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// Where and how one thread is scheduled: the cpus it may run on and its scheduling policy
+// and priority. Either part may be left unset, in which case the thread keeps whatever it
+// inherited from the thread that spawned it.
+//
+// The string forms are a list of cpus and cpu ranges for the affinity ("2", "0,2-3") and
+// "other", "fifo:<priority>" or "rr:<priority>" for the policy.
+struct ThreadSched
+{
+    static constexpr int MAX_CPUS = 1024;
+
+    std::vector<int> cpus; // Empty leaves the affinity alone
+    bool hasPolicy = false;
+    int policy = SCHED_OTHER;
+    int priority = 0;
+
+    bool isSet() const { return !cpus.empty() || hasPolicy; }
+
+    static bool parseCpus(const char* str, std::vector<int>& cpus)
+    {
+        cpus.clear();
+        const char* p = str;
+        while (*p) {
+            char* end;
+            long first = strtol(p, &end, 10);
+            if (end == p || first < 0) return false;
+            long last = first;
+            p = end;
+            if (*p == '-') {
+                ++p;
+                last = strtol(p, &end, 10);
+                if (end == p || last < first) return false;
+                p = end;
+            }
+            if (last >= MAX_CPUS) return false;
+            for (long c = first; c <= last; ++c) cpus.push_back((int) c);
+            if (*p == ',') ++p;
+            else if (*p) return false;
+        }
+        return !cpus.empty();
+    }
+
+    static bool validPriority(int policy, int priority)
+    {
+        if (policy == SCHED_OTHER) return priority == 0;
+        return priority >= sched_get_priority_min(policy) &&
+               priority <= sched_get_priority_max(policy);
+    }
+
+    static bool parsePolicy(const char* str, int& policy, int& priority)
+    {
+        priority = 0;
+        if (strcmp(str, "other") == 0) {
+            policy = SCHED_OTHER;
+            return true;
+        }
+        const char* prio;
+        if (strncmp(str, "fifo:", 5) == 0) {
+            policy = SCHED_FIFO;
+            prio = str + 5;
+        } else if (strncmp(str, "rr:", 3) == 0) {
+            policy = SCHED_RR;
+            prio = str + 3;
+        } else {
+            return false;
+        }
+        char* end;
+        priority = (int) strtol(prio, &end, 10);
+        if (end == prio || *end) return false;
+        return validPriority(policy, priority);
+    }
+
+    // Applies the settings to the calling thread. Returns a description of the settings
+    // the thread actually ended up with, prefixed by anything that could not be applied
+    std::string apply() const
+    {
+        std::string report;
+        if (!cpus.empty()) {
+        #ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int c : cpus) if (c < CPU_SETSIZE) CPU_SET(c, &set);
+            int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (err) report += std::string("failed to set cpus: ") + strerror(err) + "; ";
+        #else
+            report += "cpu affinity is not supported on this platform; ";
+        #endif
+        }
+        if (hasPolicy) {
+            sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = priority;
+            int err = pthread_setschedparam(pthread_self(), policy, &param);
+            if (err) report += std::string("failed to set policy: ") + strerror(err) + "; ";
+        }
+        return report + describeCurrent();
+    }
+
+    // The affinity and policy of the calling thread
+    static std::string describeCurrent()
+    {
+        std::string desc = "cpus=";
+    #ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            // Print runs of cpus as ranges
+            bool first = true;
+            for (int c = 0; c < CPU_SETSIZE; ++c) {
+                if (!CPU_ISSET(c, &set)) continue;
+                int last = c;
+                while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)) ++last;
+                char buf[32];
+                if (last == c) snprintf(buf, sizeof(buf), "%s%d", first ? "" : ",", c);
+                else snprintf(buf, sizeof(buf), "%s%d-%d", first ? "" : ",", c, last);
+                desc += buf;
+                first = false;
+                c = last;
+            }
+        } else {
+            desc += "?";
+        }
+    #else
+        desc += "any";
+    #endif
+
+        int policy;
+        sched_param param;
+        if (pthread_getschedparam(pthread_self(), &policy, &param) != 0) return desc;
+        char buf[32];
+        switch (policy) {
+            case SCHED_FIFO: snprintf(buf, sizeof(buf), " policy=fifo:%d", param.sched_priority);
+                             break;
+            case SCHED_RR:   snprintf(buf, sizeof(buf), " policy=rr:%d", param.sched_priority);
+                             break;
+            case SCHED_OTHER: snprintf(buf, sizeof(buf), " policy=other"); break;
+            default: snprintf(buf, sizeof(buf), " policy=%d", policy); break;
+        }
+        return desc + buf;
+    }
+};
@@ -0,0 +1,353 @@
+#pragma once
+
+// Coroutine layer on top of zcm::ZCM. It is opt-in: nothing else includes this header, so
+// the rest of the C++ api keeps building with older standards.
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "zcm/zcm-cpp-coro.hpp requires C++20 coroutines (-std=c++20)"
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "zcm/zcm-cpp.hpp"
+
+namespace zcm {
+
+// Decides where a coroutine continues once the operation it awaited has completed
+class Executor
+{
+  public:
+    virtual ~Executor() {}
+    virtual void post(std::coroutine_handle<> h) = 0;
+};
+
+// Continues right away on the thread that completed the operation. For next() that is the
+// thread dispatching the message (the handler thread of start(), or whichever thread calls
+// handle() / handleNonblock()), for publishAsync() the thread that awaited it.
+class InlineExecutor : public Executor
+{
+  public:
+    void post(std::coroutine_handle<> h) override { h.resume(); }
+};
+
+// Continues on a pool: the numThreads threads it owns plus any thread that calls run() or
+// runOne(). Coroutines that are still queued when it is stopped are never resumed.
+class PoolExecutor : public Executor
+{
+    std::mutex mut;
+    std::condition_variable cond;
+    std::deque<std::coroutine_handle<>> ready;
+    bool stopped = false;
+    std::vector<std::thread> threads;
+
+  public:
+    explicit PoolExecutor(size_t numThreads = 0)
+    {
+        for (size_t i = 0; i < numThreads; ++i) threads.emplace_back([this]{ run(); });
+    }
+
+    ~PoolExecutor()
+    {
+        stop();
+        for (auto& t : threads) t.join();
+    }
+
+    void post(std::coroutine_handle<> h) override
+    {
+        {
+            std::unique_lock<std::mutex> lk(mut);
+            ready.push_back(h);
+        }
+        cond.notify_one();
+    }
+
+    // Resumes one coroutine, waiting up to timeout for one to be posted.
+    // Returns false if none was, or once stopped
+    bool runOne(std::chrono::nanoseconds timeout = std::chrono::nanoseconds(0))
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        cond.wait_for(lk, timeout, [&]{ return stopped || !ready.empty(); });
+        if (stopped || ready.empty()) return false;
+        std::coroutine_handle<> h = ready.front();
+        ready.pop_front();
+        lk.unlock();
+        h.resume();
+        return true;
+    }
+
+    // Resumes coroutines until stop()
+    void run()
+    {
+        while (true) {
+            std::unique_lock<std::mutex> lk(mut);
+            cond.wait(lk, [&]{ return stopped || !ready.empty(); });
+            if (stopped) return;
+            std::coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            lk.unlock();
+            h.resume();
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::unique_lock<std::mutex> lk(mut);
+            stopped = true;
+        }
+        cond.notify_all();
+    }
+};
+
+// Return type for coroutines that start right away and run on their own. The coroutine
+// frame is freed when it finishes, an exception escaping it terminates the program.
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// A ZCM whose messages can be awaited from coroutines:
+//
+//     zcm::Task requestPose(zcm::CoroZCM& zcm)
+//     {
+//         auto reply = zcm.next<pose_t>("POSE");   // Listening from here on
+//         co_await zcm.publishAsync("POSE_REQUEST", request);
+//         pose_t pose = co_await reply;
+//         ...
+//     }
+//
+// Coroutines continue on the executor set with setExecutor() (InlineExecutor by default).
+// Every channel that was ever awaited keeps a subscription of its own until destruction,
+// so awaiting the same channel again costs nothing but the wait. Destroying a CoroZCM stops
+// it; coroutines that are still waiting on it are never resumed.
+class CoroZCM : public ZCM
+{
+    struct Channel;
+
+    struct Waiter
+    {
+        Channel* ch = nullptr;
+        std::coroutine_handle<> handle;
+        Executor* executor = nullptr;
+        bool done = false;
+
+        virtual ~Waiter() {}
+        // Takes the message if it is what the waiter is waiting for
+        virtual bool take(const ReceiveBuffer* rbuf, const char* channel) = 0;
+    };
+
+    struct Channel
+    {
+        CoroZCM* owner;
+        void* sub = nullptr; // Use subMut
+        std::vector<Waiter*> waiters;
+
+        Channel(CoroZCM* owner) : owner(owner) {}
+    };
+
+    // Protects channels and every Waiter's handle, done flag and message
+    std::mutex mut;
+    // Serializes subscribing, which must not happen under mut
+    std::mutex subMut;
+    std::unordered_map<std::string, std::unique_ptr<Channel>> channels;
+
+    InlineExecutor inlineExecutor;
+    Executor* executor = &inlineExecutor;
+
+    static void onMessage(const ReceiveBuffer* rbuf, const char* channel, void* usr)
+    {
+        Channel* ch = (Channel*) usr;
+        std::vector<std::pair<std::coroutine_handle<>, Executor*>> resume;
+        {
+            std::unique_lock<std::mutex> lk(ch->owner->mut);
+            auto& ws = ch->waiters;
+            for (size_t i = 0; i < ws.size();) {
+                Waiter* w = ws[i];
+                if (!w->take(rbuf, channel)) {
+                    ++i;
+                    continue;
+                }
+                w->done = true;
+                if (w->handle) resume.emplace_back(w->handle, w->executor);
+                ws[i] = ws.back();
+                ws.pop_back();
+            }
+        }
+        // A resumed coroutine may well destroy its waiter or wait again, so only after
+        // every waiter has been handled and mut was released
+        for (auto& r : resume) r.second->post(r.first);
+    }
+
+    // Returns false if the channel could not be subscribed to
+    bool addWaiter(const std::string& channel, Waiter* w)
+    {
+        Channel* ch;
+        {
+            std::unique_lock<std::mutex> lk(mut);
+            auto& c = channels[channel];
+            if (!c) c.reset(new Channel(this));
+            ch = c.get();
+            ch->waiters.push_back(w);
+            w->ch = ch;
+        }
+
+        std::unique_lock<std::mutex> lk(subMut);
+        if (!ch->sub) subscribeRaw(ch->sub, channel, onMessage, ch);
+        if (ch->sub) return true;
+        fprintf(stderr, "Failed to subscribe to channel \"%s\"\n", channel.c_str());
+        removeWaiter(w);
+        return false;
+    }
+
+    void removeWaiter(Waiter* w)
+    {
+        std::unique_lock<std::mutex> lk(mut);
+        if (w->done) return;
+        w->done = true;
+        auto& ws = w->ch->waiters;
+        for (size_t i = 0; i < ws.size(); ++i) {
+            if (ws[i] != w) continue;
+            ws[i] = ws.back();
+            ws.pop_back();
+            return;
+        }
+    }
+
+  public:
+    using ZCM::ZCM;
+
+    ~CoroZCM()
+    {
+        if (!good()) return;
+        // No callback may run once the channels are gone
+        stop();
+        std::unique_lock<std::mutex> lk(subMut);
+        for (auto& it : channels)
+            if (it.second->sub) unsubscribeRaw(it.second->sub);
+    }
+
+    // Where coroutines continue after awaiting next() or publishAsync(). Only affects
+    // awaitables created afterwards. exec must outlive them
+    void setExecutor(Executor& exec)
+    {
+        executor = &exec;
+    }
+
+    // Awaitable for the next message of type Msg on channel (which may be a regex). It starts
+    // listening as soon as it is created, not once it is awaited, so it can be created before
+    // publishing a request and awaited afterwards without missing the reply. Messages that
+    // do not decode as Msg are skipped. The message is decoded exactly once, straight from
+    // the receive buffer, and moved out by co_await. If the channel can not be subscribed to,
+    // co_await completes right away with a default constructed Msg.
+    template <class Msg>
+    class Next : private Waiter
+    {
+        CoroZCM& owner;
+        Msg msg {};
+        std::string channel;
+
+        bool take(const ReceiveBuffer* rbuf, const char* chan) override
+        {
+            if (msg.decode(rbuf->data, 0, rbuf->data_size) < 0) return false;
+            channel = chan;
+            return true;
+        }
+
+      public:
+        Next(CoroZCM& owner, const std::string& channel) : owner(owner)
+        {
+            executor = owner.executor;
+            owner.addWaiter(channel, this);
+        }
+
+        ~Next()
+        {
+            owner.removeWaiter(this);
+        }
+
+        Next(const Next&) = delete;
+        Next& operator=(const Next&) = delete;
+
+        bool await_ready()
+        {
+            std::unique_lock<std::mutex> lk(owner.mut);
+            return done;
+        }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            std::unique_lock<std::mutex> lk(owner.mut);
+            if (done) return false;
+            handle = h;
+            return true;
+        }
+
+        Msg await_resume()
+        {
+            return std::move(msg);
+        }
+
+        // The channel the message was received on, once awaited
+        const std::string& receivedOn() const
+        {
+            return channel;
+        }
+    };
+
+    // Publishes msg from the executor: the awaiting coroutine moves to the executor first,
+    // so a publish that waits (see setPublishMode() and setBackpressure()) holds up the
+    // executor instead of whatever thread awaited it. msg is encoded straight into the send
+    // queue (see publishLoaned()), so it must stay alive until co_await returns.
+    // co_await returns the result of the publish
+    template <class Msg>
+    class PublishAsync
+    {
+        CoroZCM& owner;
+        std::string channel;
+        const Msg& msg;
+        Executor* executor;
+
+      public:
+        PublishAsync(CoroZCM& owner, const std::string& channel, const Msg& msg) :
+            owner(owner), channel(channel), msg(msg), executor(owner.executor) {}
+
+        bool await_ready() { return false; }
+
+        // Note: The coroutine may already be done with this awaitable once post() returns
+        void await_suspend(std::coroutine_handle<> h) { executor->post(h); }
+
+        int await_resume() { return owner.publishLoaned(channel, &msg); }
+    };
+
+    template <class Msg>
+    Next<Msg> next(const std::string& channel)
+    {
+        return Next<Msg>(*this, channel);
+    }
+
+    template <class Msg>
+    PublishAsync<Msg> publishAsync(const std::string& channel, const Msg& msg)
+    {
+        return PublishAsync<Msg>(*this, channel, msg);
+    }
+};
+
+}
@@ -19,13 +19,20 @@
 class Subscription
 {
     friend class ZCM;
+    friend class DecodeGroup;
     void* rawSub;
+    // Set once a typed subscription leaves its group. Dispatches that are still going
+    // through an older snapshot of the group's members skip it from then on
+    std::atomic<bool> removed;
 
   protected:
     void* usr;
     void (*callback)(const ReceiveBuffer* rbuf, const std::string& channel, void* usr);
+    DecodeGroup* group; // Decodes the messages of typed subscriptions
 
   public:
+    Subscription() : rawSub(nullptr), removed(false), usr(nullptr), callback(nullptr),
+                     group(nullptr) {}
     virtual ~Subscription() {}
 
     void* getRawSub() const
@@ -33,8 +40,113 @@ class Subscription
 
     inline void dispatch(const ReceiveBuffer* rbuf, const std::string& channel)
     { (*callback)(rbuf, channel, usr); }
+
+    // Typed subscriptions get their message through here, already decoded by their group
+    virtual void dispatchDecoded(const ReceiveBuffer* rbuf, const std::string& channel,
+                                 const void* msg) {}
 };
 
+// All typed subscriptions to the same channel with the same message type (and the same
+// subscribe flags) share one raw subscription, so every message is decoded once and the
+// same const message is handed to each of them in turn.
+class DecodeGroup
+{
+    friend class ZCM;
+
+  protected:
+    // The group owns its members. A dispatch in progress keeps the members of its snapshot
+    // alive, even if they are unsubscribed (or the group is deleted) in the meantime
+    typedef std::vector<std::shared_ptr<Subscription> > Members;
+
+    void* rawSub;
+    std::string channel;
+    int64_t hash;
+    uint32_t flags;
+    MsgHandler dispatcher; // Tells apart the message types that share a hash
+    // Replaced rather than modified, so that a dispatch in progress keeps going through its
+    // own snapshot while subscribe() and unsubscribe() (callbacks included) change it
+    std::shared_ptr<const Members> members;
+
+  public:
+    DecodeGroup() : rawSub(nullptr), hash(0), flags(0), dispatcher(nullptr),
+                    members(new Members()) {}
+    virtual ~DecodeGroup() {}
+
+    inline std::shared_ptr<const Members> snapshot() const
+    { return std::atomic_load(&members); }
+
+    inline void add(Subscription* sub)
+    {
+        std::shared_ptr<Members> next(new Members(*snapshot()));
+        next->push_back(std::shared_ptr<Subscription>(sub));
+        std::atomic_store(&members, std::shared_ptr<const Members>(next));
+    }
+
+    // Returns the number of members left. sub is deleted once no dispatch uses it anymore
+    inline size_t remove(Subscription* sub)
+    {
+        sub->removed = true;
+        std::shared_ptr<Members> next(new Members());
+        std::shared_ptr<const Members> prev = snapshot();
+        for (size_t i = 0; i < prev->size(); ++i)
+            if ((*prev)[i].get() != sub) next->push_back((*prev)[i]);
+        std::atomic_store(&members, std::shared_ptr<const Members>(next));
+        return next->size();
+    }
+
+    static inline void dispatchMembers(const Members& subs, const ReceiveBuffer* rbuf,
+                                       const std::string& channel, const void* msg)
+    {
+        for (size_t i = 0; i < subs.size(); ++i)
+            if (!subs[i]->removed) subs[i]->dispatchDecoded(rbuf, channel, msg);
+    }
+};
+
+template <class Msg>
+class TypedDecodeGroup : public DecodeGroup
+{
+    // A decoded message kept around for the next dispatch to reuse. Every dispatch takes
+    // it out while decoding into it, so concurrent dispatches (dispatch threads, nested
+    // handle calls) never share a message and just allocate their own
+    struct Spare
+    {
+        std::shared_ptr<Msg> msg;
+    };
+    // Held by every dispatch in progress, in case the last member unsubscribes mid-dispatch
+    std::shared_ptr<Spare> spare;
+
+  public:
+    TypedDecodeGroup() : spare(new Spare()) { spare->msg.reset(new Msg()); }
+    virtual ~TypedDecodeGroup() {}
+
+    inline void dispatch(const ReceiveBuffer* rbuf, const char* chan)
+    {
+        std::shared_ptr<const Members> subs = snapshot();
+        std::shared_ptr<Spare> sp = spare;
+        std::shared_ptr<Msg> msg = std::atomic_exchange(&sp->msg, std::shared_ptr<Msg>());
+        if (!msg) msg.reset(new Msg());
+        int status = msg->decode(rbuf->data, 0, rbuf->data_size);
+        if (status < 0) {
+            #ifndef ZCM_EMBEDDED
+            fprintf (stderr, "Error %d decoding %s on channel \"%s\"\n",
+                             status, Msg::getTypeName(), chan);
+            #endif
+            std::atomic_store(&sp->msg, msg);
+            return;
+        }
+        dispatchMembers(*subs, rbuf, std::string(chan), msg.get());
+        // The group itself may be gone by now
+        std::atomic_store(&sp->msg, msg);
+    }
+};
+
+template <class Msg>
+static inline void TypedDecodeGroupDispatch(const ReceiveBuffer* rbuf,
+                                            const char* channel, void* usr)
+{
+    ((TypedDecodeGroup<Msg>*)usr)->dispatch(rbuf, channel);
+}
+
 static inline void SubscriptionDispatch(const ReceiveBuffer* rbuf, const char* channel, void* usr)
 { ((Subscription*)usr)->dispatch(rbuf, channel); }
 
@@ -70,7 +182,9 @@ inline ZCM::~ZCM()
 
     std::vector<Subscription*>::iterator end = subscriptions.end(),
                                           it = subscriptions.begin();
-    for (;it != end; ++it) delete *it;
+    // Typed subscriptions go with their group
+    for (;it != end; ++it) if (!(*it)->group) delete *it;
+    for (size_t i = 0; i < decodeGroups.size(); ++i) delete decodeGroups[i];
 
     zcm = nullptr;
 }
@@ -137,6 +251,20 @@ inline int ZCM::handle()
 }
 #endif
 
+#ifndef ZCM_EMBEDDED
+inline int ZCM::getFd()
+{
+    return zcm_get_fd(zcm);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setNonblockBatch(uint32_t maxMsgs)
+{
+    return zcm_set_nonblock_batch(zcm, maxMsgs);
+}
+#endif
+
 #ifndef ZCM_EMBEDDED
 inline void ZCM::setQueueSize(uint32_t sz)
 {
@@ -144,6 +272,97 @@ inline void ZCM::setQueueSize(uint32_t sz)
 }
 #endif
 
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setPriorityClass(zcm_priority prio, uint32_t capacity, uint32_t weight)
+{
+    return zcm_set_priority_class(zcm, prio, capacity, weight);
+}
+
+inline int ZCM::setPriorityMode(zcm_priority_mode mode)
+{
+    return zcm_set_priority_mode(zcm, mode);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setDispatchThreads(uint32_t numThreads)
+{
+    return zcm_set_dispatch_threads(zcm, numThreads);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setDispatchGroup(const std::string& channel, const std::string& group)
+{
+    return zcm_set_dispatch_group(zcm, channel.c_str(), group.c_str());
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setPublishMode(zcm_publish_mode mode)
+{
+    return zcm_set_publish_mode(zcm, NULL, mode);
+}
+
+inline int ZCM::setPublishMode(const std::string& channel, zcm_publish_mode mode)
+{
+    return zcm_set_publish_mode(zcm, channel.c_str(), mode);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setBackpressure(zcm_backpressure policy, uint32_t param)
+{
+    return zcm_set_backpressure(zcm, NULL, policy, param);
+}
+
+inline int ZCM::setBackpressure(const std::string& channel, zcm_backpressure policy,
+                                uint32_t param)
+{
+    return zcm_set_backpressure(zcm, channel.c_str(), policy, param);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setRecvStrategy(zcm_recv_strategy strategy, uint32_t spinMicros)
+{
+    return zcm_set_recv_strategy(zcm, strategy, spinMicros);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+inline int ZCM::setThreadSched(zcm_thread_kind thread, const std::string& cpus,
+                               zcm_sched_policy policy, int priority)
+{
+    return zcm_set_thread_sched(zcm, thread, cpus.c_str(), policy, priority);
+}
+
+inline int ZCM::lockMemory()
+{
+    return zcm_lock_memory(zcm);
+}
+
+inline int ZCM::getStats(Stats& stats)
+{
+    // Channels can show up between the calls, so retry until everything fit
+    stats.channels.clear();
+    while (true) {
+        int ret = zcm_get_stats(zcm, &stats.summary,
+                                stats.channels.data(), (uint32_t) stats.channels.size());
+        if (ret != ZCM_EOK) return ret;
+        if (stats.summary.num_channels <= stats.channels.size()) break;
+        stats.channels.resize(stats.summary.num_channels);
+    }
+    stats.channels.resize(stats.summary.num_channels);
+    return ZCM_EOK;
+}
+
+inline int ZCM::getTransportStats(zcm_transport_stats_t& stats)
+{
+    return zcm_get_transport_stats(zcm, &stats);
+}
+#endif
+
 #ifndef ZCM_EMBEDDED
 inline int ZCM::writeTopology(const std::string& name)
 {
@@ -156,6 +375,11 @@ inline int ZCM::handleNonblock()
     return zcm_handle_nonblock(zcm);
 }
 
+inline int ZCM::handleNonblockBudget(uint32_t maxMsgs, uint32_t maxMicros)
+{
+    return zcm_handle_nonblock_budget(zcm, maxMsgs, maxMicros);
+}
+
 inline void ZCM::flush()
 {
     zcm_flush(zcm);
@@ -182,10 +406,43 @@ inline int ZCM::publish(const std::string& channel, const Msg* msg)
     return status;
 }
 
+#ifndef ZCM_EMBEDDED
+inline int ZCM::publishLoan(const std::string& channel, uint32_t len, zcm_loan_t* loan)
+{
+    return zcm_publish_loan(zcm, channel.c_str(), len, loan);
+}
+
+inline int ZCM::publishCommit(zcm_loan_t* loan, uint32_t len)
+{
+    return zcm_publish_commit(zcm, loan, len);
+}
+
+inline void ZCM::publishCancel(zcm_loan_t* loan)
+{
+    zcm_publish_cancel(zcm, loan);
+}
+
+template <class Msg>
+inline int ZCM::publishLoaned(const std::string& channel, const Msg* msg)
+{
+    zcm_loan_t loan;
+    int ret = publishLoan(channel, msg->getEncodedSize(), &loan);
+    if (ret != ZCM_EOK) return ret;
+    int encodeRet = msg->encodeInto(&loan);
+    if (encodeRet < 0 || (uint32_t) encodeRet != loan.len) {
+        publishCancel(&loan);
+        return ZCM_EINVALID;
+    }
+    ret = publishCommit(&loan, loan.len);
+    if (ret != ZCM_EOK) publishCancel(&loan);
+    return ret;
+}
+#endif
+
 inline Subscription* ZCM::subscribe(const std::string& channel,
                                     void (*cb)(const ReceiveBuffer* rbuf,
                                                const std::string& channel, void* usr),
-                                    void* usr)
+                                    void* usr, uint32_t flags)
 {
     if (!zcm) {
         #ifndef ZCM_EMBEDDED
@@ -202,7 +459,7 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
     }
     sub->usr = usr;
     sub->callback = cb;
-    subscribeRaw(sub->rawSub, channel, &SubscriptionDispatch, sub);
+    subscribeRaw(sub->rawSub, channel, &SubscriptionDispatch, sub, flags);
 
     subscriptions.push_back(sub);
     return sub;
@@ -217,38 +474,17 @@ class TypedSubscription : public virtual Subscription
   protected:
     void (*typedCallback)(const ReceiveBuffer* rbuf, const std::string& channel, const Msg* msg,
                           void* usr);
-    Msg msgMem; // Memory to decode this message into
 
   public:
     virtual ~TypedSubscription() {}
 
-    inline int readMsg(const ReceiveBuffer* rbuf, const std::string& channel)
+    virtual void dispatchDecoded(const ReceiveBuffer* rbuf, const std::string& channel,
+                                 const void* msg)
     {
-        int status = msgMem.decode(rbuf->data, 0, rbuf->data_size);
-        if (status < 0) {
-            #ifndef ZCM_EMBEDDED
-            fprintf (stderr, "Error %d decoding %s on channel \"%s\"\n",
-                             status, Msg::getTypeName(), channel.c_str());
-            #endif
-            return -1;
-        }
-        return 0;
-    }
-
-    inline void typedDispatch(const ReceiveBuffer* rbuf, const std::string& channel)
-    {
-        if (readMsg(rbuf, channel) != 0) return;
-        (*typedCallback)(rbuf, channel, &msgMem, usr);
+        (*typedCallback)(rbuf, channel, (const Msg*) msg, usr);
     }
 };
 
-template <class Msg>
-static inline void TypedSubscriptionDispatch(const ReceiveBuffer* rbuf,
-                                             const char* channel, void* usr)
-{
-    ((TypedSubscription<Msg>*)usr)->typedDispatch(rbuf, channel);
-}
-
 #if __cplusplus > 199711L
 // Virtual inheritance to avoid ambiguous base class problem http://stackoverflow.com/a/139329
 template<class Msg>
@@ -260,38 +496,17 @@ class TypedFunctionalSubscription : public virtual Subscription
     std::function<void (const ReceiveBuffer* rbuf,
                         const std::string& channel,
                         const Msg* msg)> cb;
-    Msg msgMem; // Memory to decode this message into
 
   public:
     virtual ~TypedFunctionalSubscription() {}
 
-    inline int readMsg(const ReceiveBuffer* rbuf, const std::string& channel)
+    virtual void dispatchDecoded(const ReceiveBuffer* rbuf, const std::string& channel,
+                                 const void* msg)
     {
-        int status = msgMem.decode(rbuf->data, 0, rbuf->data_size);
-        if (status < 0) {
-            #ifndef ZCM_EMBEDDED
-            fprintf (stderr, "Error %d decoding %s on channel \"%s\"\n",
-                             status, Msg::getTypeName(), channel.c_str());
-            #endif
-            return -1;
-        }
-        return 0;
-    }
-
-    inline void typedDispatch(const ReceiveBuffer* rbuf, const std::string& channel)
-    {
-        if (readMsg(rbuf, channel) != 0) return;
-        cb(rbuf, channel, &msgMem);
+        cb(rbuf, channel, (const Msg*) msg);
     }
 };
 
-template <class Msg>
-static inline void TypedFunctionalSubscriptionDispatch(const ReceiveBuffer* rbuf,
-                                                       const char* channel, void* usr)
-{
-    ((TypedFunctionalSubscription<Msg>*)usr)->typedDispatch(rbuf, channel);
-}
-
 // Virtual inheritance to avoid ambiguous base class problem http://stackoverflow.com/a/139329
 class FunctionalSubscription : public virtual Subscription
 {
@@ -355,20 +570,56 @@ class TypedHandlerSubscription : public TypedSubscription<Msg>, HandlerSubscript
   public:
     virtual ~TypedHandlerSubscription() {}
 
-    inline void typedHandlerDispatch(const ReceiveBuffer* rbuf, const std::string& channel)
+    virtual void dispatchDecoded(const ReceiveBuffer* rbuf, const std::string& channel,
+                                 const void* msg)
     {
         // Unfortunately, we need to add "this" here to handle template inheritance:
         // https://isocpp.org/wiki/faq/templates#nondependent-name-lookup-members
-        if (this->readMsg(rbuf, channel) != 0) return;
-        (this->handler->*typedHandlerCallback)(rbuf, channel, &this->msgMem);
+        (this->handler->*typedHandlerCallback)(rbuf, channel, (const Msg*) msg);
     }
 };
 
-template <class Msg, class Handler>
-static inline void TypedHandlerSubscriptionDispatch(const ReceiveBuffer* rbuf,
-                                                    const char* channel, void* usr)
-{
-    ((TypedHandlerSubscription<Msg, Handler>*)usr)->typedHandlerDispatch(rbuf, channel);
+template <class Msg>
+inline Subscription* ZCM::subscribeDecoded(const std::string& channel, Subscription* sub,
+                                           uint32_t flags)
+{
+    MsgHandler dispatcher = &TypedDecodeGroupDispatch<Msg>;
+    DecodeGroup* group = nullptr;
+    for (size_t i = 0; i < decodeGroups.size(); ++i) {
+        DecodeGroup* g = decodeGroups[i];
+        if (g->dispatcher == dispatcher && g->hash == Msg::getHash() &&
+            g->flags == flags && g->channel == channel) {
+            group = g;
+            break;
+        }
+    }
+
+    if (!group) {
+        group = new TypedDecodeGroup<Msg>();
+        if (!group) {
+            delete sub;
+            _err = ZCM_EMEMORY;
+            return nullptr;
+        }
+        group->channel = channel;
+        group->hash = Msg::getHash();
+        group->flags = flags;
+        group->dispatcher = dispatcher;
+        subscribeRaw(group->rawSub, channel, dispatcher, group, flags);
+        if (!group->rawSub) {
+            delete group;
+            delete sub;
+            _err = ZCM_EINVALID;
+            return nullptr;
+        }
+        decodeGroups.push_back(group);
+    }
+
+    sub->group = group;
+    sub->rawSub = group->rawSub;
+    group->add(sub);
+    subscriptions.push_back(sub);
+    return sub;
 }
 
 // TODO: lots of room to condense the implementations of the various subscribe functions
@@ -377,7 +628,7 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
                                     void (Handler::*cb)(const ReceiveBuffer* rbuf,
                                                         const std::string& channel,
                                                         const Msg* msg),
-                                    Handler* handler)
+                                    Handler* handler, uint32_t flags)
 {
     if (!zcm) {
         #ifndef ZCM_EMBEDDED
@@ -394,17 +645,14 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
     }
     sub->handler = handler;
     sub->typedHandlerCallback = cb;
-    subscribeRaw(sub->rawSub, channel, &TypedHandlerSubscriptionDispatch<Msg, Handler>, sub);
-
-    subscriptions.push_back(sub);
-    return sub;
+    return subscribeDecoded<Msg>(channel, sub, flags);
 }
 
 template <class Handler>
 inline Subscription* ZCM::subscribe(const std::string& channel,
                                     void (Handler::*cb)(const ReceiveBuffer* rbuf,
                                                         const std::string& channel),
-                                    Handler* handler)
+                                    Handler* handler, uint32_t flags)
 {
     if (!zcm) {
         #ifndef ZCM_EMBEDDED
@@ -421,7 +669,7 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
     }
     sub->handler = handler;
     sub->handlerCallback = cb;
-    subscribeRaw(sub->rawSub, channel, &HandlerSubscriptionDispatch<Handler>, sub);
+    subscribeRaw(sub->rawSub, channel, &HandlerSubscriptionDispatch<Handler>, sub, flags);
 
     subscriptions.push_back(sub);
     return sub;
@@ -432,7 +680,7 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
                                     void (*cb)(const ReceiveBuffer* rbuf,
                                                const std::string& channel,
                                                const Msg* msg, void* usr),
-                                    void* usr)
+                                    void* usr, uint32_t flags)
 {
     if (!zcm) {
         #ifndef ZCM_EMBEDDED
@@ -449,10 +697,7 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
     }
     sub->usr = usr;
     sub->typedCallback = cb;
-    subscribeRaw(sub->rawSub, channel, &TypedSubscriptionDispatch<Msg>, sub);
-
-    subscriptions.push_back(sub);
-    return sub;
+    return subscribeDecoded<Msg>(channel, sub, flags);
 }
 
 #if __cplusplus > 199711L
@@ -460,7 +705,8 @@ template <class Msg>
 inline Subscription* ZCM::subscribe(const std::string& channel,
                                     std::function<void (const ReceiveBuffer* rbuf,
                                                         const std::string& channel,
-                                                        const Msg* msg)> cb)
+                                                        const Msg* msg)> cb,
+                                    uint32_t flags)
 {
     if (!zcm) {
         #ifndef ZCM_EMBEDDED
@@ -477,15 +723,13 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
     }
     sub->usr = nullptr;
     sub->cb = cb;
-    subscribeRaw(sub->rawSub, channel, &TypedFunctionalSubscriptionDispatch<Msg>, sub);
-
-    subscriptions.push_back(sub);
-    return sub;
+    return subscribeDecoded<Msg>(channel, sub, flags);
 }
 
 inline Subscription* ZCM::subscribe(const std::string& channel,
                                     std::function<void (const ReceiveBuffer* rbuf,
-                                                        const std::string& channel)> cb)
+                                                        const std::string& channel)> cb,
+                                    uint32_t flags)
 {
     if (!zcm) {
         #ifndef ZCM_EMBEDDED
@@ -502,7 +746,7 @@ inline Subscription* ZCM::subscribe(const std::string& channel,
     }
     sub->usr = nullptr;
     sub->cb = cb;
-    subscribeRaw(sub->rawSub, channel, &FunctionalSubscriptionDispatch, sub);
+    subscribeRaw(sub->rawSub, channel, &FunctionalSubscriptionDispatch, sub, flags);
 
     subscriptions.push_back(sub);
     return sub;
@@ -516,9 +760,27 @@ inline int ZCM::unsubscribe(Subscription* sub)
                                           it = subscriptions.begin();
     for (; it != end; ++it) {
         if (*it == sub) {
-            ret = unsubscribeRaw(sub->rawSub);
+            DecodeGroup* group = sub->group;
+            if (!group) {
+                ret = unsubscribeRaw(sub->rawSub);
+            } else if (group->remove(sub) > 0) {
+                ret = ZCM_EOK;
+            } else {
+                // The last member takes the group's raw subscription with it. Should that
+                // fail, the group stays around (empty) for the next subscriber
+                ret = unsubscribeRaw(group->rawSub);
+                if (ret == ZCM_EOK) {
+                    for (size_t i = 0; i < decodeGroups.size(); ++i) {
+                        if (decodeGroups[i] != group) continue;
+                        decodeGroups.erase(decodeGroups.begin() + i);
+                        break;
+                    }
+                    delete group;
+                }
+            }
             subscriptions.erase(it);
-            delete sub;
+            // Members of a group were handed over to it
+            if (!group) delete sub;
             break;
         }
     }
@@ -535,6 +797,20 @@ inline void ZCM::subscribeRaw(void*& rawSub, const std::string& channel,
                               MsgHandler cb, void* usr)
 { rawSub = zcm_subscribe(zcm, channel.c_str(), cb, usr); }
 
+inline void ZCM::subscribeRaw(void*& rawSub, const std::string& channel,
+                              MsgHandler cb, void* usr, uint32_t flags)
+{
+    if (!flags) {
+        subscribeRaw(rawSub, channel, cb, usr);
+        return;
+    }
+    #ifndef ZCM_EMBEDDED
+    rawSub = zcm_subscribe_flags(zcm, channel.c_str(), cb, usr, flags);
+    #else
+    rawSub = nullptr;
+    #endif
+}
+
 inline int ZCM::unsubscribeRaw(void*& rawSub)
 {
     auto ret = zcm_unsubscribe(zcm, (zcm_sub_t*) rawSub);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -19,6 +21,15 @@ namespace zcm {
 typedef zcm_recv_buf_t ReceiveBuffer;
 typedef zcm_msg_handler_t MsgHandler;
 class Subscription;
+class DecodeGroup;
+
+#ifndef ZCM_EMBEDDED
+struct Stats
+{
+    zcm_stats_t summary;
+    std::vector<zcm_channel_stats_t> channels;
+};
+#endif
 
 class ZCM
 {
@@ -42,10 +53,29 @@ class ZCM
     virtual inline void pause();
     virtual inline void resume();
     virtual inline int  handle();
+    virtual inline int  getFd();
+    virtual inline int  setNonblockBatch(uint32_t maxMsgs);
     virtual inline void setQueueSize(uint32_t sz);
+    virtual inline int  setPriorityClass(zcm_priority prio, uint32_t capacity, uint32_t weight);
+    virtual inline int  setPriorityMode(zcm_priority_mode mode);
+    virtual inline int  setDispatchThreads(uint32_t numThreads);
+    virtual inline int  setDispatchGroup(const std::string& channel, const std::string& group);
+    virtual inline int  setPublishMode(zcm_publish_mode mode);
+    virtual inline int  setPublishMode(const std::string& channel, zcm_publish_mode mode);
+    virtual inline int  setBackpressure(zcm_backpressure policy, uint32_t param = 0);
+    virtual inline int  setBackpressure(const std::string& channel, zcm_backpressure policy,
+                                        uint32_t param = 0);
+    virtual inline int  setRecvStrategy(zcm_recv_strategy strategy, uint32_t spinMicros = 0);
+    virtual inline int  setThreadSched(zcm_thread_kind thread, const std::string& cpus,
+                                       zcm_sched_policy policy = ZCM_SCHED_INHERIT,
+                                       int priority = 0);
+    virtual inline int  lockMemory();
+    virtual inline int  getStats(Stats& stats);
+    virtual inline int  getTransportStats(zcm_transport_stats_t& stats);
     virtual inline int  writeTopology(const std::string& name);
     #endif
     virtual inline int  handleNonblock();
+    virtual inline int  handleNonblockBudget(uint32_t maxMsgs, uint32_t maxMicros = 0);
     virtual inline void flush();
 
   public:
@@ -59,42 +89,59 @@ class ZCM
     template <class Msg>
     inline int publish(const std::string& channel, const Msg* msg);
 
+    #ifndef ZCM_EMBEDDED
+    // Zero-copy publishing, see zcm_publish_loan()
+    virtual inline int  publishLoan(const std::string& channel, uint32_t len, zcm_loan_t* loan);
+    virtual inline int  publishCommit(zcm_loan_t* loan, uint32_t len);
+    virtual inline void publishCancel(zcm_loan_t* loan);
+
+    // Encodes msg straight into a loaned buffer instead of a temporary one
+    template <class Msg>
+    inline int publishLoaned(const std::string& channel, const Msg* msg);
+    #endif
+
+    // flags are ZCM_SUB_* flags, see zcm_subscribe_flags()
     inline Subscription* subscribe(const std::string& channel,
                                    void (*cb)(const ReceiveBuffer* rbuf,
                                               const std::string& channel,
                                               void* usr),
-                                   void* usr);
+                                   void* usr, uint32_t flags = 0);
 
+    // Typed subscriptions to the same channel and type (made with the same flags)
+    // share one decode: every message is decoded once and the same const Msg is handed to
+    // each of their callbacks. It is only valid for the duration of the callback
     template <class Msg, class Handler>
     inline Subscription* subscribe(const std::string& channel,
                                    void (Handler::*cb)(const ReceiveBuffer* rbuf,
                                                        const std::string& channel,
                                                        const Msg* msg),
-                                   Handler* handler);
+                                   Handler* handler, uint32_t flags = 0);
 
     template <class Handler>
     inline Subscription* subscribe(const std::string& channel,
                                    void (Handler::*cb)(const ReceiveBuffer* rbuf,
                                                        const std::string& channel),
-                                   Handler* handler);
+                                   Handler* handler, uint32_t flags = 0);
 
     template <class Msg>
     inline Subscription* subscribe(const std::string& channel,
                                    void (*cb)(const ReceiveBuffer* rbuf,
                                               const std::string& channel,
                                               const Msg* msg, void* usr),
-                                   void* usr);
+                                   void* usr, uint32_t flags = 0);
 
     #if __cplusplus > 199711L
     inline Subscription* subscribe(const std::string& channel,
                                    std::function<void (const ReceiveBuffer* rbuf,
-                                                       const std::string& channel)> cb);
+                                                       const std::string& channel)> cb,
+                                   uint32_t flags = 0);
 
     template <class Msg>
     inline Subscription* subscribe(const std::string& channel,
                                    std::function<void (const ReceiveBuffer* rbuf,
                                                        const std::string& channel,
-                                                       const Msg* msg)> cb);
+                                                       const Msg* msg)> cb,
+                                   uint32_t flags = 0);
     #endif
 
     inline int unsubscribe(Subscription* sub);
@@ -114,9 +161,19 @@ class ZCM
     virtual inline int unsubscribeRaw(void*& rawSub);
 
   private:
+    // Uses subscribeRaw() for subscriptions without flags
+    inline void subscribeRaw(void*& rawSub, const std::string& channel,
+                             MsgHandler cb, void* usr, uint32_t flags);
+
+    // Adds a typed subscription to the DecodeGroup of its channel, type and flags
+    template <class Msg>
+    inline Subscription* subscribeDecoded(const std::string& channel, Subscription* sub,
+                                          uint32_t flags);
+
     zcm_t* zcm;
     int _err;
     std::vector<Subscription*> subscriptions;
+    std::vector<DecodeGroup*> decodeGroups;
 };
 
 // TODO: why not use or inherit from the existing zcm data structures for the below
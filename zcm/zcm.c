@@ -85,6 +85,44 @@ void zcm_destroy(zcm_t* zcm)
 }
 
 #ifndef ZCM_EMBEDDED
+#define RECV_SPIN_US_DEFAULT 100
+
+/* Applies the url options that configure zcm itself rather than its transport.
+   Transports ignore options they don't know, so these are valid on any url */
+static int zcm_apply_url_opts(zcm_t* zcm, zcm_url_t* u)
+{
+    zcm_url_opts_t* opts = zcm_url_opts(u);
+    zcm_recv_strategy strategy = ZCM_RECV_BLOCK;
+    uint32_t spinMicros = RECV_SPIN_US_DEFAULT;
+    int hasStrategy = 0;
+    size_t i;
+
+    for (i = 0; i < opts->numopts; ++i) {
+        if (strcmp(opts->name[i], "recv_strategy") == 0) {
+            hasStrategy = 1;
+            if (strcmp(opts->value[i], "block") == 0) {
+                strategy = ZCM_RECV_BLOCK;
+            } else if (strcmp(opts->value[i], "spin") == 0) {
+                strategy = ZCM_RECV_SPIN_BLOCK;
+            } else if (strcmp(opts->value[i], "busy_poll") == 0) {
+                strategy = ZCM_RECV_BUSY_POLL;
+            } else {
+                ZCM_DEBUG("unknown recv_strategy '%s'", opts->value[i]);
+                return ZCM_EINVALID;
+            }
+        } else if (strcmp(opts->name[i], "recv_spin_us") == 0) {
+            spinMicros = (uint32_t) strtoul(opts->value[i], NULL, 10);
+        }
+    }
+
+    if (!hasStrategy) return ZCM_EOK;
+    if (zcm->type != ZCM_BLOCKING) {
+        ZCM_DEBUG("recv_strategy is only supported by blocking transports");
+        return ZCM_EINVALID;
+    }
+    return zcm_set_recv_strategy(zcm, strategy, spinMicros);
+}
+
 int zcm_init(zcm_t* zcm, const char* url)
 {
     /* If we have no url, try to use the env var */
@@ -108,6 +146,10 @@ int zcm_init(zcm_t* zcm, const char* url)
         zcm_trans_t* trans = creator(u);
         if (trans) {
             ret = zcm_init_from_trans(zcm, trans);
+            if (ret == ZCM_EOK) {
+                ret = zcm_apply_url_opts(zcm, u);
+                if (ret != ZCM_EOK) zcm_cleanup(zcm);
+            }
         } else {
             ZCM_DEBUG("failed to create transport for '%s'", url);
         }
@@ -199,6 +241,26 @@ int zcm_publish(zcm_t* zcm, const char* channel, const uint8_t* data, uint32_t l
     return ret;
 }
 
+#ifndef ZCM_EMBEDDED
+int zcm_publish_loan(zcm_t* zcm, const char* channel, uint32_t len, zcm_loan_t* loan)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_publish_loan(zcm->impl, channel, len, loan);
+}
+
+int zcm_publish_commit(zcm_t* zcm, zcm_loan_t* loan, uint32_t len)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_publish_commit(zcm->impl, loan, len);
+}
+
+void zcm_publish_cancel(zcm_t* zcm, zcm_loan_t* loan)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    zcm_blocking_publish_cancel(zcm->impl, loan);
+}
+#endif
+
 void zcm_flush(zcm_t* zcm)
 {
 #ifndef ZCM_EMBEDDED
@@ -231,6 +293,15 @@ zcm_sub_t* zcm_subscribe(zcm_t* zcm, const char* channel, zcm_msg_handler_t cb,
     return ret;
 }
 
+#ifndef ZCM_EMBEDDED
+zcm_sub_t* zcm_subscribe_flags(zcm_t* zcm, const char* channel, zcm_msg_handler_t cb,
+                               void* usr, uint32_t flags)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_subscribe_flags(zcm->impl, channel, cb, usr, flags);
+}
+#endif
+
 int zcm_unsubscribe(zcm_t* zcm, zcm_sub_t* sub)
 {
     int ret = ZCM_EUNKNOWN;
@@ -298,6 +369,22 @@ int zcm_handle(zcm_t* zcm)
 }
 #endif
 
+#ifndef ZCM_EMBEDDED
+int zcm_get_fd(zcm_t* zcm)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_get_fd(zcm->impl);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_nonblock_batch(zcm_t* zcm, uint32_t maxMsgs)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_nonblock_batch(zcm->impl, maxMsgs);
+}
+#endif
+
 #ifndef ZCM_EMBEDDED
 void zcm_set_queue_size(zcm_t* zcm, uint32_t numMsgs)
 {
@@ -306,6 +393,97 @@ void zcm_set_queue_size(zcm_t* zcm, uint32_t numMsgs)
 }
 #endif
 
+#ifndef ZCM_EMBEDDED
+int zcm_set_priority_class(zcm_t* zcm, zcm_priority prio, uint32_t capacity, uint32_t weight)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_priority_class(zcm->impl, prio, capacity, weight);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_priority_mode(zcm_t* zcm, zcm_priority_mode mode)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_priority_mode(zcm->impl, mode);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_dispatch_threads(zcm_t* zcm, uint32_t numThreads)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_dispatch_threads(zcm->impl, numThreads);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_dispatch_group(zcm_t* zcm, const char* channel, const char* group)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_dispatch_group(zcm->impl, channel, group);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_publish_mode(zcm_t* zcm, const char* channel, zcm_publish_mode mode)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_publish_mode(zcm->impl, channel, mode);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_backpressure(zcm_t* zcm, const char* channel, zcm_backpressure policy,
+                         uint32_t param)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_backpressure(zcm->impl, channel, policy, param);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_recv_strategy(zcm_t* zcm, zcm_recv_strategy strategy, uint32_t spinMicros)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_recv_strategy(zcm->impl, strategy, spinMicros);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_set_thread_sched(zcm_t* zcm, zcm_thread_kind thread, const char* cpus,
+                         zcm_sched_policy policy, int priority)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_set_thread_sched(zcm->impl, thread, cpus, policy, priority);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_lock_memory(zcm_t* zcm)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_lock_memory(zcm->impl);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_get_stats(zcm_t* zcm, zcm_stats_t* stats,
+                  zcm_channel_stats_t* channels, uint32_t maxChannels)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_get_stats(zcm->impl, stats, channels, maxChannels);
+}
+#endif
+
+#ifndef ZCM_EMBEDDED
+int zcm_get_transport_stats(zcm_t* zcm, zcm_transport_stats_t* stats)
+{
+    ZCM_ASSERT(zcm->type == ZCM_BLOCKING);
+    return zcm_blocking_get_transport_stats(zcm->impl, stats);
+}
+#endif
+
 #ifndef ZCM_EMBEDDED
 int zcm_write_topology(zcm_t* zcm, const char* name)
 {
@@ -337,6 +515,25 @@ int zcm_handle_nonblock(zcm_t* zcm)
     return ret;
 }
 
+int zcm_handle_nonblock_budget(zcm_t* zcm, uint32_t maxMsgs, uint32_t maxMicros)
+{
+    int ret = ZCM_EUNKNOWN;
+#ifndef ZCM_EMBEDDED
+    switch (zcm->type) {
+        case ZCM_BLOCKING:
+            ret = zcm_blocking_handle_nonblock_budget(zcm->impl, maxMsgs, maxMicros);
+            break;
+        case ZCM_NONBLOCKING:
+            ret = zcm_nonblocking_handle_nonblock_budget(zcm->impl, maxMsgs, maxMicros);
+            break;
+    }
+#else
+    ZCM_ASSERT(zcm->type == ZCM_NONBLOCKING);
+    ret = zcm_nonblocking_handle_nonblock_budget(zcm->impl, maxMsgs, maxMicros);
+#endif
+    return ret;
+}
+
 
 
 
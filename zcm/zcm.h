@@ -31,6 +31,57 @@ enum zcm_type {
     ZCM_NONBLOCKING
 };
 
+/* How a blocking zcm hands published messages to the transport */
+typedef enum zcm_publish_mode {
+    ZCM_PUBLISH_QUEUED, /* queued and sent by zcm's send thread (the default) */
+    ZCM_PUBLISH_INLINE  /* sent from the publishing thread before zcm_publish() returns */
+} zcm_publish_mode;
+
+/* What zcm_publish() does with a message that does not fit into the send queue */
+typedef enum zcm_backpressure {
+    ZCM_BACKPRESSURE_DROP_NEWEST, /* drop it and return ZCM_EAGAIN (the default) */
+    ZCM_BACKPRESSURE_BLOCK,       /* wait up to a timeout for room, then drop it */
+    ZCM_BACKPRESSURE_DROP_OLDEST, /* drop the oldest unsent message of the same channel */
+    ZCM_BACKPRESSURE_COALESCE     /* replace the unsent message of the same channel */
+} zcm_backpressure;
+
+typedef enum zcm_recv_strategy {
+    ZCM_RECV_BLOCK,      /* sleep in the transport and the queue until a message arrives
+                            (the default) */
+    ZCM_RECV_SPIN_BLOCK, /* poll for up to a spin budget after each message, then sleep */
+    ZCM_RECV_BUSY_POLL   /* never sleep: the receive and dispatch threads each keep a core
+                            busy polling */
+} zcm_recv_strategy;
+
+/* Priority classes of received messages, see zcm_set_priority_class() */
+typedef enum zcm_priority {
+    ZCM_PRIORITY_HIGH,
+    ZCM_PRIORITY_NORMAL, /* the default */
+    ZCM_PRIORITY_LOW
+} zcm_priority;
+#define ZCM_NUM_PRIORITIES 3
+
+typedef enum zcm_priority_mode {
+    ZCM_PRIORITY_STRICT,  /* always dispatch from the highest class with messages (the
+                             default) */
+    ZCM_PRIORITY_WEIGHTED /* share dispatching between the classes with messages in
+                             proportion to their weights */
+} zcm_priority_mode;
+
+typedef enum zcm_thread_kind {
+    ZCM_THREAD_SEND,     /* ZeroCM_sender */
+    ZCM_THREAD_RECV,     /* ZeroCM_receiver */
+    ZCM_THREAD_HANDLE,   /* ZeroCM_handler, or the thread calling zcm_run() */
+    ZCM_THREAD_DISPATCH  /* every thread of the dispatch pool (ZeroCM_disp<N>) */
+} zcm_thread_kind;
+
+typedef enum zcm_sched_policy {
+    ZCM_SCHED_INHERIT,   /* keep the policy of the thread that started zcm (the default) */
+    ZCM_SCHED_OTHER,
+    ZCM_SCHED_FIFO,
+    ZCM_SCHED_RR
+} zcm_sched_policy;
+
 #define ZCM_RETURN_CODES \
     X(ZCM_EOK,               0, "Okay, no errors"                       ) \
     X(ZCM_EINVALID,         -1, "Invalid arguments"                     ) \
@@ -53,6 +104,11 @@ typedef struct zcm_trans_t    zcm_trans_t;
 typedef struct zcm_t          zcm_t;
 typedef struct zcm_recv_buf_t zcm_recv_buf_t;
 typedef struct zcm_sub_t      zcm_sub_t;
+typedef struct zcm_loan_t     zcm_loan_t;
+typedef struct zcm_stats_t    zcm_stats_t;
+typedef struct zcm_priority_stats_t zcm_priority_stats_t;
+typedef struct zcm_channel_stats_t zcm_channel_stats_t;
+typedef struct zcm_transport_stats_t zcm_transport_stats_t;
 
 /* Generic message handler function type */
 typedef void (*zcm_msg_handler_t)(const zcm_recv_buf_t* rbuf,
@@ -79,6 +135,68 @@ struct zcm_recv_buf_t
     uint32_t data_size;
 };
 
+/* A message buffer loaned out by zcm_publish_loan() */
+struct zcm_loan_t
+{
+    uint8_t* data; /* NOTE: do not free, write the message here */
+    uint32_t len;  /* size of data in bytes */
+
+    /* Private to zcm */
+    char _channel[ZCM_CHANNEL_MAXLEN + 1];
+};
+
+/* Handler time histogram: bucket 0 counts messages whose handlers took less than 1us,
+   bucket i those that took [2^(i-1), 2^i) us and the last bucket everything longer */
+#define ZCM_STATS_HIST_BUCKETS 20
+
+/* Counters of one channel since zcm was created, see zcm_get_stats() */
+struct zcm_channel_stats_t
+{
+    char     channel[ZCM_CHANNEL_MAXLEN + 1];
+    uint64_t published;  /* messages accepted by zcm_publish() or zcm_publish_commit() */
+    uint64_t received;   /* messages received for a subscription and queued for dispatch */
+    uint64_t dispatched; /* messages handed to at least one handler */
+    uint64_t dropped;    /* messages that zcm_publish() could not queue or send inline,
+                            or that a newer message replaced (see ZCM_SUB_CONFLATE and
+                            zcm_set_backpressure()) */
+    uint64_t blocked;    /* zcm_publish() calls that waited for room in the send queue */
+    uint64_t handler_hist[ZCM_STATS_HIST_BUCKETS]; /* time spent in handlers per message */
+};
+
+/* The queue of one priority class of received messages */
+struct zcm_priority_stats_t
+{
+    uint32_t capacity;
+    uint32_t weight;     /* only used with ZCM_PRIORITY_WEIGHTED */
+    uint32_t queued;     /* messages waiting to be dispatched right now */
+    uint32_t high_water; /* most messages ever waiting to be dispatched */
+};
+
+struct zcm_stats_t
+{
+    uint32_t send_queue_capacity;
+    uint32_t send_queue_high_water; /* most messages ever waiting in the send queue */
+    uint32_t recv_queue_capacity;   /* same as priorities[ZCM_PRIORITY_NORMAL] */
+    uint32_t recv_queue_high_water;
+    uint32_t priority_mode;         /* zcm_priority_mode */
+    zcm_priority_stats_t priorities[ZCM_NUM_PRIORITIES];
+    uint32_t num_channels;          /* channels with counters, see zcm_get_stats() */
+};
+
+/* Counters of the transport since zcm was created, see zcm_get_transport_stats().
+   Messages are counted per sender by their sequence numbers (e.g. by udp and udpm) */
+struct zcm_transport_stats_t
+{
+    uint64_t received;       /* messages received */
+    uint64_t lost;           /* messages skipped by the sequence numbers of their sender that
+                                have not arrived (yet) */
+    uint64_t reordered;      /* messages that arrived after a later one of their sender */
+    uint64_t duplicates;     /* messages that arrived more than once */
+    uint64_t lost_fragments; /* fragments missing from partial messages that were dropped */
+    uint64_t discarded;      /* packets that were not valid zcm packets */
+    uint32_t num_senders;    /* senders heard from recently */
+};
+
 #ifndef ZCM_EMBEDDED
 int zcm_retcode_name_to_enum(const char* zcm_retcode_name);
 #endif
@@ -113,15 +231,59 @@ const char* zcm_strerrno(int err);
 zcm_sub_t* zcm_subscribe(zcm_t* zcm, const char* channel, zcm_msg_handler_t cb, void* usr);
 
 /* Unsubscribe to zcm messages, freeing the subscription object
+   Blocking Mode: Waits for callbacks of sub that are running on other threads, unless called
+   from within a callback. A callback that unsubscribes sub keeps the rest of the current
+   message from being dispatched to it.
    Returns ZCM_EOK on success, error code on failure */
 int zcm_unsubscribe(zcm_t* zcm, zcm_sub_t* sub);
 
+#ifndef ZCM_EMBEDDED
+/* Flags for zcm_subscribe_flags() */
+#define ZCM_SUB_CONFLATE      0x1 /* only dispatch the latest received message */
+#define ZCM_SUB_PRIORITY_HIGH 0x2 /* queue messages as ZCM_PRIORITY_HIGH */
+#define ZCM_SUB_PRIORITY_LOW  0x4 /* queue messages as ZCM_PRIORITY_LOW */
+
+/* Blocking Mode Only: Subscribe like zcm_subscribe() with a set of ZCM_SUB_* flags.
+   With ZCM_SUB_CONFLATE, a newer message replaces a message on the same channel that is
+   still waiting to be dispatched instead of being queued behind it, so a slow handler
+   never works through a backlog of stale messages and the channel never holds more than
+   one message in zcm. Replaced messages are counted as dropped (see zcm_get_stats()).
+   A message only conflates if every subscription it is dispatched to is conflating.
+   With ZCM_SUB_PRIORITY_*, messages are queued for dispatch in that priority class (see
+   zcm_set_priority_class()). A message is queued in the highest class of all the
+   subscriptions it is dispatched to, ZCM_PRIORITY_NORMAL if they do not have one.
+   Returns a subscription object on success, and NULL on failure */
+zcm_sub_t* zcm_subscribe_flags(zcm_t* zcm, const char* channel, zcm_msg_handler_t cb,
+                               void* usr, uint32_t flags);
+#endif
+
 /* Publish a zcm message buffer. Note: the message may not be completely
    sent after this call has returned. To block until the messages are transmitted,
    call the zcm_flush() method.
+   Blocking Mode: Every channel name that is published, subscribed to or received for a
+   regex subscription is remembered for the rest of the process, shared by all zcm
+   instances. Once 2^26 distinct names have been seen, publishing on a channel that was
+   never seen before fails with ZCM_EMEMORY, so don't put unbounded data (ids, counters)
+   into channel names.
    Returns ZCM_EOK on success, error code on failure */
 int zcm_publish(zcm_t* zcm, const char* channel, const uint8_t* data, uint32_t len);
 
+#ifndef ZCM_EMBEDDED
+/* Blocking Mode Only: Zero-copy publishing. zcm_publish_loan() borrows a buffer of len
+   bytes from zcm for a message on channel and stores it in loan->data. Write the message
+   straight into it and then hand it to zcm with zcm_publish_commit(), where len is the
+   number of bytes actually written (at most loan->len). This saves copying the message
+   into zcm. If zcm_publish_commit() fails the buffer is still on loan, so either retry
+   or give it back with zcm_publish_cancel(). Every loan must be committed or cancelled
+   before zcm is destroyed.
+   zcm_publish_loan() and zcm_publish_commit() return ZCM_EOK on success, error code on
+   failure (ZCM_EAGAIN if the message can't be queued right now, ZCM_EMEMORY if there is
+   no buffer to loan) */
+int  zcm_publish_loan(zcm_t* zcm, const char* channel, uint32_t len, zcm_loan_t* loan);
+int  zcm_publish_commit(zcm_t* zcm, zcm_loan_t* loan, uint32_t len);
+void zcm_publish_cancel(zcm_t* zcm, zcm_loan_t* loan);
+#endif
+
 /* Block until all published messages have been sent even if the underlying
    transport is nonblocking. Additionally, dispatches all messages that have
    already been received sequentially in this thread. */
@@ -135,6 +297,20 @@ void zcm_stop(zcm_t* zcm);
 void zcm_pause(zcm_t* zcm); /* pauses message dispatch and publishing, not transport */
 void zcm_resume(zcm_t* zcm);
 int  zcm_handle(zcm_t* zcm); /* returns ZCM_EOK normally, error code on failure. */
+/* Get a file descriptor that is readable while received messages are waiting to be
+   dispatched, for integrating zcm into poll(), epoll or an event loop such as libuv or asio.
+   Wait for the fd to become readable, then dispatch with zcm_handle_nonblock() until it
+   returns ZCM_EAGAIN; the fd stays readable until everything was dispatched. Never read
+   from or close the fd, it belongs to zcm. Starts receiving like zcm_handle_nonblock(), so
+   it can not be combined with zcm_run() or zcm_start(). While paused, the fd stays readable
+   but nothing is dispatched.
+   Returns the fd, ZCM_EINVALID if zcm is running, ZCM_EUNKNOWN if it could not be created */
+int  zcm_get_fd(zcm_t* zcm);
+/* Let every call to zcm_handle_nonblock() dispatch up to maxMsgs of the messages that were
+   already received (default 1), so an event loop drains the queue in fewer calls.
+   zcm_handle_nonblock() never waits for more messages either way.
+   Returns ZCM_EOK normally, ZCM_EINVALID if maxMsgs is 0 */
+int  zcm_set_nonblock_batch(zcm_t* zcm, uint32_t maxMsgs);
 /* Determines how many messages can be stored from the transport without being dispatched
    As well as the number of messages that may be stored from the user without being
    transmitted by the transport. Normal operation does not require the user to modify
@@ -145,6 +321,100 @@ int  zcm_handle(zcm_t* zcm); /* returns ZCM_EOK normally, error code on failure.
    issues depending on the transport. */
 void zcm_set_queue_size(zcm_t* zcm, uint32_t numMsgs);
 
+/* Set the capacity and weight of the queue of one priority class of received messages.
+   Every class has a queue of its own, so a burst on a channel of one class never fills
+   up the queue of another. The ZCM_PRIORITY_NORMAL queue is the one sized by
+   zcm_set_queue_size(); the capacity of every queue defaults to that of the normal queue
+   and the weights default to 4, 2 and 1 from high to low. When the receive thread finds
+   the queue of a message full, it waits for room before receiving anything else.
+   Returns ZCM_EOK normally, ZCM_EINVALID on bad arguments */
+int zcm_set_priority_class(zcm_t* zcm, zcm_priority prio, uint32_t capacity, uint32_t weight);
+/* Set the order in which the priority classes are dispatched. With a dispatch pool
+   (zcm_set_dispatch_threads()) this is the order messages are handed to the pool in.
+   Returns ZCM_EOK normally, ZCM_EINVALID on bad arguments */
+int zcm_set_priority_mode(zcm_t* zcm, zcm_priority_mode mode);
+
+/* Dispatch callbacks from a pool of numThreads threads instead of a single thread.
+   Messages on the same channel (or in the same group, see zcm_set_dispatch_group()) are
+   still dispatched one at a time and in the order they were received, but different
+   channels are dispatched concurrently. The callback of a regex subscription still never
+   runs on more than one thread at a time. zcm_pause(), zcm_stop() and zcm_flush() apply to
+   the whole pool. 0 (the default) dispatches everything from a single thread.
+   Must be called while zcm is not running.
+   Returns ZCM_EOK normally, ZCM_EINVALID if zcm is running */
+int zcm_set_dispatch_threads(zcm_t* zcm, uint32_t numThreads);
+/* Dispatch channel in order with every other channel of group when using a dispatch pool.
+   Only affects messages received after this call, which are dispatched after any that
+   were already waiting on channel. Returns ZCM_EOK or ZCM_EINVALID */
+int zcm_set_dispatch_group(zcm_t* zcm, const char* channel, const char* group);
+
+/* Set the publish mode of channel, or the default mode of every channel that does not
+   have one of its own if channel is NULL. Inline publishing saves the hand-off to the
+   send thread, but zcm_publish() then blocks for as long as the transport takes to send
+   the message and returns the transport's error if sending failed. Messages are still
+   sent in the order they were published: while earlier messages are queued (or while
+   zcm is paused), inline messages are queued behind them.
+   Returns ZCM_EOK normally, ZCM_EINVALID on bad arguments */
+int zcm_set_publish_mode(zcm_t* zcm, const char* channel, zcm_publish_mode mode);
+
+/* Set the backpressure policy of channel, or the default policy of every channel that does
+   not have one of its own if channel is NULL. With ZCM_BACKPRESSURE_BLOCK, zcm_publish()
+   waits up to param microseconds for room in the send queue. With
+   ZCM_BACKPRESSURE_DROP_OLDEST, the unsent messages of the channel are kept apart from the
+   send queue, up to param of them (0 for the send queue size), and the oldest one is
+   dropped to make room for a new one. ZCM_BACKPRESSURE_COALESCE does the same with room
+   for a single message, so only the latest message of the channel is ever waiting to be
+   sent. These two never fail to take a message, but the messages of such a channel are
+   sent together, possibly ahead of messages of other channels published in between.
+   Every dropped message is counted in the dropped counter of its channel, every publish
+   that had to wait in the blocked counter (see zcm_get_stats()). Loaned messages (see
+   zcm_publish_loan()) are not affected.
+   Returns ZCM_EOK normally, ZCM_EINVALID on bad arguments */
+int zcm_set_backpressure(zcm_t* zcm, const char* channel, zcm_backpressure policy,
+                         uint32_t param);
+
+/* Set how the receive thread waits on the transport and how the dispatching thread waits
+   for received messages. With ZCM_RECV_SPIN_BLOCK both poll for spinMicros after the last
+   message before going back to sleep. Polling trades cpu time for wakeup latency, so it
+   is best paired with a core of its own. The dispatch pool (zcm_set_dispatch_threads())
+   always sleeps while idle. Can also be set with the url options
+   "recv_strategy=block|spin|busy_poll" and "recv_spin_us=<micros>" (default 100).
+   Only valid while zcm is not running.
+   Returns ZCM_EOK normally, ZCM_EINVALID on bad arguments or while running */
+int zcm_set_recv_strategy(zcm_t* zcm, zcm_recv_strategy strategy, uint32_t spinMicros);
+
+/* Set the cpus that zcm's threads of the given kind may run on and their scheduling policy.
+   cpus is a list of cpus and cpu ranges such as "2" or "0,2-3", NULL or "" to leave the
+   affinity alone. priority must be 0 for ZCM_SCHED_INHERIT and ZCM_SCHED_OTHER and within
+   the policy's range otherwise (the real-time policies usually need CAP_SYS_NICE).
+   Settings apply whenever a thread starts, so changes take effect the next time zcm is
+   started. Every thread with settings reports its effective settings on stderr when it
+   starts, along with anything the kernel refused.
+   The same can be set with the environment variables ZCM_<THREAD>_CPUS and
+   ZCM_<THREAD>_SCHED ("other", "fifo:<priority>" or "rr:<priority>") where <THREAD> is
+   one of SENDER, RECEIVER, HANDLER and DISPATCH.
+   Returns ZCM_EOK normally, ZCM_EINVALID on bad arguments */
+int zcm_set_thread_sched(zcm_t* zcm, zcm_thread_kind thread, const char* cpus,
+                         zcm_sched_policy policy, int priority);
+
+/* Lock every current and future page of the process into memory (mlockall()) so that
+   zcm's threads never stall on a page fault. Also done when creating zcm if the
+   environment variable ZCM_MLOCKALL is set.
+   Returns ZCM_EOK normally, ZCM_EUNKNOWN if the kernel refused */
+int zcm_lock_memory(zcm_t* zcm);
+
+/* Fill stats and the counters of up to maxChannels channels (channels may be NULL when
+   maxChannels is 0). stats->num_channels is set to the number of channels that have
+   counters, which can be more than were filled in. Counting happens in per-thread
+   counters as messages go through zcm, so this is cheap enough to call periodically.
+   Returns ZCM_EOK */
+int zcm_get_stats(zcm_t* zcm, zcm_stats_t* stats,
+                  zcm_channel_stats_t* channels, uint32_t maxChannels);
+
+/* Fill stats with the transport's own counters. Safe to call from any thread.
+   Returns ZCM_EOK normally, ZCM_EINVALID if the transport keeps no counters */
+int zcm_get_transport_stats(zcm_t* zcm, zcm_transport_stats_t* stats);
+
 /* Write topology file to filename. Returns ZCM_EOK normally, error code on failure */
 int zcm_write_topology(zcm_t* zcm, const char* name);
 #endif
@@ -154,6 +424,13 @@ int zcm_write_topology(zcm_t* zcm, const char* name);
    error code otherwise */
 int zcm_handle_nonblock(zcm_t* zcm);
 
+/* Dispatch up to maxMsgs of the messages that are already waiting, in one call. Stops early
+   once maxMicros have passed (0 means no time limit; embedded builds need
+   ZCM_NONBLOCK_UTIME() for one) or when no more messages are waiting, and never waits for
+   more. Transport updates happen once per call rather than once per message.
+   Returns the number of messages dispatched (0 if none were waiting), error code otherwise */
+int zcm_handle_nonblock_budget(zcm_t* zcm, uint32_t maxMsgs, uint32_t maxMicros);
+
 
 
 /****************************************************************************/
@@ -166,7 +443,8 @@ int zcm_handle_nonblock(zcm_t* zcm);
 zcm_sub_t* zcm_try_subscribe(zcm_t* zcm, const char* channel, zcm_msg_handler_t cb, void* usr);
 /* Unsubscribe to zcm messages, freeing the subscription object
    Returns ZCM_EOK on success, error code on failure
-   Can fail to subscribe if zcm is already running */
+   Can fail to subscribe if zcm is already running
+   Unlike zcm_unsubscribe(), never waits for running callbacks of sub */
 int zcm_try_unsubscribe(zcm_t* zcm, zcm_sub_t* sub);
 /* Nonblocking version of flush (ZCM_EAGAIN if fail, ZCM_EOK if success) as defined
    above. If you want to guarantee that this function returns ZCM_EOK at some point,
@@ -16,6 +16,8 @@ struct zcm_sub_t
     void *regexobj;
     zcm_msg_handler_t callback;
     void *usr;
+    uint32_t flags; /* ZCM_SUB_* flags, blocking mode only */
+    uint32_t channel_id; /* interned id of a non regex channel, blocking mode only */
 };
 
 #ifdef __cplusplus